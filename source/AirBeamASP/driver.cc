@@ -11,7 +11,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -20,30 +22,54 @@
 #include "aspl/Device.hpp"
 #include "aspl/IORequestHandler.hpp"
 #include "aspl/Plugin.hpp"
+#include "discovery/service_cache.h"
 #include "helper/logger.h"
+#include "helper/trace.h"
 #include "macos/bonjour_browse.h"
 #include "macos/volume_observer.h"
 #include "raop/codec.h"
+#include "raop/constants.h"
 #include "raop/fifo.h"
 #include "raop/raop.h"
+#include "raop/session_pool.h"
 
 namespace {
 
 using namespace AirBeamCore::raop;
 using namespace AirBeamCore::helper;
 using namespace AirBeamCore::macos;
+using AirBeamCore::discovery::ServiceCache;
 
-constexpr UInt32 SampleRate = 44100;
+// What the device takes from CoreAudio: the pipeline's s16 stereo. The
+// sample rate is the receiver's; Raop's packetizer does the rest.
 constexpr UInt32 ChannelCount = 2;
 
 const size_t kFiFOCapacity = 30 * 1024 * 1024;  // 30MB buffer
 
+// Keep RTSP connections to recently used receivers warm, so switching the
+// output device back to them skips the connect and OPTIONS round trips.
+constexpr bool kEnableWarmPool = true;
+
+// Record per-packet spans from the IO callback to the wire, and write them
+// as a Chrome trace when IO stops.
+constexpr bool kEnableTracing = false;
+constexpr char kTracePath[] = "/tmp/airbeam-trace.json";
+
+// How often a session the receiver refused or dropped is tried again while
+// IO runs.
+constexpr auto kSessionRetryInterval = std::chrono::seconds(2);
+
 class RaopHandler : public aspl::ControlRequestHandler,
                     public aspl::IORequestHandler {
  public:
-  explicit RaopHandler(aspl::Device& device, const std::string& ip,
-                       uint32_t port)
-      : raop_(std::make_shared<Raop>(ip, port)),
+  explicit RaopHandler(aspl::Device& device, RaopSessionPool& pool,
+                       const std::string& ip, uint32_t port,
+                       const AirBeamCore::discovery::RaopCapabilities&
+                           capabilities)
+      : pool_(pool),
+        ip_(ip),
+        port_(port),
+        capabilities_(capabilities),
         fifo_(kFiFOCapacity),
         device_(device) {
     auto volume_control =
@@ -51,82 +77,220 @@ class RaopHandler : public aspl::ControlRequestHandler,
     volume_control->SetScalarValue(0.5);
   }
 
+  ~RaopHandler() override {
+    closing_ = true;
+    if (volume_thread_.joinable()) volume_thread_.join();
+    volume_observer_.reset();
+    Stop();
+  }
+
   OSStatus OnStartIO() override {
-    Prepare();
+    Start();
 
     return kAudioHardwareNoError;
   }
 
-  void OnStopIO() override {}
+  void OnStopIO() override {
+    Stop();
+    if (kEnableTracing) Tracer::WriteChromeTrace(kTracePath);
+  }
 
   void OnWriteMixedOutput(const std::shared_ptr<aspl::Stream>& stream,
                           Float64 zeroTimestamp, Float64 timestamp,
                           const void* buff, UInt32 buffBytesSize) override {
+    ABTraceScope("io_write");
     fifo_.Write(reinterpret_cast<const uint8_t*>(buff), buffBytesSize);
   }
 
- public:
-  std::unique_ptr<VolumeObserver> volume_observer_ = nullptr;
-
  private:
-  std::shared_ptr<Raop> raop_;
+  RaopSessionPool& pool_;
+  const std::string ip_;
+  const uint32_t port_;
+  const AirBeamCore::discovery::RaopCapabilities capabilities_;
   ConcurrentByteFIFO fifo_;
   aspl::Device& device_;
 
-  std::unique_ptr<std::thread> consumer_thread_;
+  // Guards raop_ against the volume observer; the consumer thread only runs
+  // while raop_ is set.
+  std::mutex raop_mtx_;
+  std::shared_ptr<Raop> raop_;
+  uint8_t volume_percent_ = 50;
+  std::atomic<bool> consuming_ = false;
+  std::thread consumer_thread_;
+
+  std::atomic<bool> closing_ = false;
+  std::thread volume_thread_;
+  std::unique_ptr<VolumeObserver> volume_observer_;
+
+  // Runs while IO does, bringing back a session that failed to start or
+  // stopped sending. Only it touches raop_ and the consumer thread between
+  // Start and Stop.
+  std::mutex supervisor_mtx_;
+  std::condition_variable supervisor_cv_;
+  bool io_running_ = false;
+  std::thread supervisor_thread_;
+
+  void Start() {
+    if (supervisor_thread_.joinable()) return;
+    StartSession(kEnableWarmPool);
+    {
+      std::lock_guard<std::mutex> guard(supervisor_mtx_);
+      io_running_ = true;
+    }
+    supervisor_thread_ = std::thread(&RaopHandler::Supervise, this);
+    if (!volume_thread_.joinable()) {
+      volume_thread_ = std::thread(&RaopHandler::ObserveVolume, this);
+    }
+  }
 
-  void Prepare() {
-    if (consumer_thread_) {
-      return;
+  // Ends the session and warms a fresh one, so starting IO again, such as
+  // switching the output back, skips the connect.
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> guard(supervisor_mtx_);
+      io_running_ = false;
+    }
+    supervisor_cv_.notify_all();
+    if (supervisor_thread_.joinable()) supervisor_thread_.join();
+    if (EndSession() && kEnableWarmPool && !closing_) {
+      pool_.WarmAsync(ip_, port_);
     }
+  }
 
-    raop_->Start();
-    consumer_thread_ = std::make_unique<std::thread>([&]() {
-      while (true) {
-        RtpAudioPacketChunk chunk, encoded;
-        size_t read_cnt = fifo_.Read(chunk.data_, sizeof(chunk.data_));
-        chunk.len_ = read_cnt;
-        if (read_cnt == 0) {
-          continue;
-        }
+  // Every IO start is a session of its own, taken from the pool when a warm
+  // one is there. One the receiver refuses, or a pooled one gone stale,
+  // leaves raop_ unset and the consumer not running.
+  bool StartSession(bool pooled) {
+    std::lock_guard<std::mutex> guard(raop_mtx_);
+    auto raop = pooled ? pool_.Acquire(ip_, port_)
+                       : std::make_shared<Raop>(ip_, port_);
+    raop->SetReceiverCapabilities(capabilities_);
+    // IO start/stop is the usual cause of an empty FIFO here, so rather than
+    // streaming silence to an idle device, pause and resync on resume.
+    raop->SetUnderrunPolicy(UnderrunPolicy::kResync);
+    ErrCode ret = raop->Start();
+    if (ret == kOk) ret = raop->SetVolume(volume_percent_);
+    if (ret != kOk) {
+      ABWarningLog("RaopHandler failed to start a session with %s:%u, ret=%d",
+                   ip_.c_str(), port_, static_cast<int>(ret));
+      raop->Stop();
+      return false;
+    }
+    // What the device wrote while there was no session is too late to play.
+    DrainFifo();
+    raop_ = raop;
+    Tracer::Enable(kEnableTracing);
+    consuming_ = true;
+    consumer_thread_ = std::thread(&RaopHandler::Consume, this);
+    return true;
+  }
 
-        PCMCodec::Encode(chunk, encoded);
-        encoded.len_ = chunk.len_;
+  // Stops the consumer and the session, if there was one.
+  bool EndSession() {
+    consuming_ = false;
+    if (consumer_thread_.joinable()) consumer_thread_.join();
+    std::shared_ptr<Raop> raop;
+    {
+      std::lock_guard<std::mutex> guard(raop_mtx_);
+      raop.swap(raop_);
+    }
+    // What was left is from before the stop.
+    DrainFifo();
+    if (!raop) return false;
+    raop->Stop();
+    return true;
+  }
+
+  void DrainFifo() {
+    uint8_t stale[4096];
+    while (fifo_.Read(stale, sizeof(stale), std::chrono::milliseconds(1))) {
+    }
+  }
 
-        raop_->AcceptFrame();
-        raop_->SendChunk(encoded);
+  // A fresh session each retry: the pool would only hand back the receiver's
+  // warm one, which is what may have gone stale.
+  void Supervise() {
+    std::unique_lock<std::mutex> lock(supervisor_mtx_);
+    while (!supervisor_cv_.wait_for(lock, kSessionRetryInterval,
+                                    [this] { return !io_running_; })) {
+      if (raop_ && consuming_) continue;
+      lock.unlock();
+      if (EndSession()) {
+        ABWarningLog("RaopHandler lost the session with %s:%u", ip_.c_str(),
+                     port_);
       }
-    });
-    consumer_thread_->detach();
+      StartSession(false);
+      lock.lock();
+    }
+  }
 
-    (new std::thread([=]() {
-      auto device_uid = device_.GetDeviceUID();
+  void Consume() {
+    Tracer::SetThreadName("consumer");
+    while (consuming_) {
+      RtpAudioPacketChunk chunk, encoded;
+      raop_->SetFifoDepth(fifo_.Size());
+      uint32_t seq = raop_->GetTimeline().next_seq;
+      size_t read_cnt;
+      {
+        // A packet not all there by the time it is due is an underrun,
+        // never a partial packet padded with silence.
+        ABTraceScope("fifo_wait", seq);
+        read_cnt = fifo_.ReadFull(chunk.data_, raop_->GetPacketInputBytes(),
+                                  raop_->GetStreamFormat().PacketDuration());
+      }
 
-      AudioObjectID output_device_id = 0;
-      while (true) {
-        OSStatus status =
-            VolumeObserver::FindAudioDeviceByUID(device_uid, output_device_id);
+      {
+        ABTraceScope("encode", seq);
+        raop_->Packetize(chunk.data_, read_cnt, encoded);
+      }
 
-        if (status == noErr) {
-          break;
-        }
-        if (status == kAudioHardwareUnknownPropertyError) {
-          std::this_thread::sleep_for(std::chrono::milliseconds(100));
-          continue;
-        }
-        return;
+      raop_->AcceptFrame();
+      ErrCode ret = raop_->SendChunk(encoded);
+      if (ret != kOk) {
+        // The supervisor ends the session and starts another.
+        ABWarningLog("RaopHandler stopped sending to %s:%u, ret=%d",
+                     ip_.c_str(), port_, static_cast<int>(ret));
+        consuming_ = false;
       }
+    }
+  }
 
-      raop_->SetVolume(50);
-      volume_observer_ = std::make_unique<VolumeObserver>(
-          output_device_id, [=](Float32 volume) {
-            uint8_t volume_percent = volume * 100;
-            raop_->SetVolume(volume_percent);
-          });
-    }))->detach();
+  void ObserveVolume() {
+    auto device_uid = device_.GetDeviceUID();
+
+    AudioObjectID output_device_id = 0;
+    while (!closing_) {
+      OSStatus status =
+          VolumeObserver::FindAudioDeviceByUID(device_uid, output_device_id);
+
+      if (status == noErr) {
+        break;
+      }
+      if (status == kAudioHardwareUnknownPropertyError) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        continue;
+      }
+      return;
+    }
+    if (closing_) return;
+
+    volume_observer_ = std::make_unique<VolumeObserver>(
+        output_device_id, [this](Float32 volume) {
+          std::lock_guard<std::mutex> guard(raop_mtx_);
+          volume_percent_ = volume * 100;
+          if (raop_) raop_->SetVolume(volume_percent_);
+        });
   }
 };
 
+RaopSessionPool::Options WarmPoolOptions() {
+  RaopSessionPool::Options options;
+  // Survives coreaudiod restarts, so the first device switch after one
+  // finds a warm session too.
+  options.recent_path = ServiceCache::DefaultPath("recent");
+  return options;
+}
+
 class DriverHelper {
  protected:
   struct DeviceInfo {
@@ -139,13 +303,17 @@ class DriverHelper {
       : context_(std::make_shared<aspl::Context>()),
         plugin_(std::make_shared<aspl::Plugin>(context_)),
         driver_(std::make_shared<aspl::Driver>(context_, plugin_)),
-        devices_mapping_() {
+        devices_mapping_(),
+        pool_(WarmPoolOptions()),
+        cache_(ServiceCache::Options{ServiceCache::DefaultPath()}) {
     static const std::string kServiceType = "_raop._tcp";
     using namespace std::placeholders;
-    ABDebugLog("DriverHelper startBrowse %s", kServiceType.c_str());
-    browse_.startBrowse(
-        kServiceType,
+    // Receivers from the last run show up before the browse finds them.
+    auto callback = cache_.Attach(
         std::bind(&DriverHelper::HandleBrowseCallback, this, _1, _2));
+    cache_.Load();
+    ABDebugLog("DriverHelper startBrowse %s", kServiceType.c_str());
+    browse_.startBrowse(kServiceType, callback);
   }
 
   std::shared_ptr<aspl::Driver> GetDriver() { return driver_; }
@@ -173,38 +341,54 @@ class DriverHelper {
       }
 
       AddDevice(service_info);
-      ABDebugLog("device %s added", service_info.fullname.c_str());
       return;
     }
 
     if (event_type == BonjourBrowse::EventType::kServiceOffline) {
       ABDebugLog("kServiceOffline %s", service_info.fullname.c_str());
       RemoveDevice(service_info);
-      ABDebugLog("device %s removed", service_info.fullname.c_str());
+      ABInfoLog("device %s removed", service_info.fullname.c_str());
       return;
     }
   }
 
   void AddDevice(const BonjourBrowse::ServiceInfo& service_info) {
+    // Receivers that only take encrypted or compressed streams never show
+    // up as a device, rather than failing when picked.
+    StreamFormat format;
+    if (NegotiateStreamFormat(service_info.capabilities, format) != kOk) {
+      ABInfoLog("device %s skipped, no common format",
+                service_info.fullname.c_str());
+      return;
+    }
     aspl::DeviceParameters deviceParams;
     deviceParams.Name = service_info.name;
-    deviceParams.SampleRate = SampleRate;
+    deviceParams.SampleRate = format.sample_rate;
     deviceParams.ChannelCount = ChannelCount;
     deviceParams.EnableMixing = true;
 
     auto device = std::make_shared<aspl::Device>(context_, deviceParams);
     device->AddStreamWithControlsAsync(aspl::Direction::Output);
-    auto raop_handler = std::make_shared<RaopHandler>(*device, service_info.ip,
-                                                      service_info.port);
+    auto raop_handler = std::make_shared<RaopHandler>(
+        *device, pool_, service_info.ip, service_info.port,
+        service_info.capabilities);
 
     device->SetControlHandler(raop_handler);
     device->SetIOHandler(raop_handler);
     plugin_->AddDevice(device);
     devices_mapping_[service_info.fullname] = {device, service_info};
+    ABInfoLog("device %s added, %s", service_info.fullname.c_str(),
+              format.Rtpmap().c_str());
+
+    if (kEnableWarmPool &&
+        pool_.IsRecentlyUsed(service_info.ip, service_info.port)) {
+      pool_.WarmAsync(service_info.ip, service_info.port);
+    }
   }
 
   void RemoveDevice(const BonjourBrowse::ServiceInfo& service_info) {
     auto it = devices_mapping_.find(service_info.fullname);
+    if (it == devices_mapping_.end()) return;
     plugin_->RemoveDevice(it->second.device_);
     devices_mapping_.erase(it);
   }
@@ -215,6 +399,8 @@ class DriverHelper {
   std::shared_ptr<aspl::Driver> driver_;
   std::map<std::string, DeviceInfo> devices_mapping_;
   std::mutex device_mapping_mutex_;
+  RaopSessionPool pool_;
+  ServiceCache cache_;
   BonjourBrowse browse_;
 };
 
@@ -0,0 +1,99 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "audio_source.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "audio/datagram_source.h"
+#include "audio/flac_decoder.h"
+#include "audio/mapped_pcm_file.h"
+#include "audio/pipe_source.h"
+#include "audio/wav_decoder.h"
+
+namespace AirBeamCore {
+namespace audio {
+namespace {
+template <typename Decoder>
+helper::ErrCode OpenWith(const std::string& path,
+                         std::unique_ptr<AudioSource>& source) {
+  auto decoder = std::make_unique<Decoder>();
+  helper::ErrCode ret = decoder->Open(path);
+  if (ret == helper::kOk) source = std::move(decoder);
+  return ret;
+}
+}  // namespace
+
+size_t NextFull(AudioSource& source, size_t max_bytes, uint8_t* buffer,
+                const uint8_t*& data, bool loop, uint64_t* loops) {
+  max_bytes -= max_bytes % kOutputFrameBytes;
+  size_t filled = 0;
+  // Stops on an empty source instead of rewinding forever.
+  bool rewound = false;
+  while (filled < max_bytes) {
+    const uint8_t* piece;
+    size_t len = source.Next(max_bytes - filled, piece);
+    if (len == 0) {
+      if (!source.AtEnd()) break;
+      if (!loop || rewound || source.Rewind() != helper::kOk) break;
+      rewound = true;
+      if (loops != nullptr) ++*loops;
+      continue;
+    }
+    rewound = false;
+    if (len == max_bytes) {
+      data = piece;
+      return len;
+    }
+    memcpy(buffer + filled, piece, len);
+    filled += len;
+  }
+  data = buffer;
+  return filled;
+}
+
+helper::ErrCode OpenAudioSource(const std::string& path,
+                                std::unique_ptr<AudioSource>& source) {
+  if (path.rfind("udp://", 0) == 0 || path.rfind("unix://", 0) == 0) {
+    DatagramSource::Options options;
+    options.address = path;
+    auto datagrams = std::make_unique<DatagramSource>(options);
+    helper::ErrCode ret = datagrams->Open();
+    if (ret == helper::kOk) source = std::move(datagrams);
+    return ret;
+  }
+  // Sniffing the header would eat from a pipe.
+  struct stat st;
+  if (path == "-" || (stat(path.c_str(), &st) == 0 && S_ISFIFO(st.st_mode))) {
+    auto pipe = std::make_unique<PipeSource>(PipeSource::Options());
+    helper::ErrCode ret =
+        path == "-" ? pipe->Open(STDIN_FILENO) : pipe->Open(path);
+    if (ret == helper::kOk) source = std::move(pipe);
+    return ret;
+  }
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return helper::kErrInvalidParam;
+  uint8_t magic[12] = {0};
+  size_t len = fread(magic, 1, sizeof(magic), file);
+  fclose(file);
+
+  if (len == sizeof(magic) && memcmp(magic, "RIFF", 4) == 0 &&
+      memcmp(magic + 8, "WAVE", 4) == 0) {
+    return OpenWith<WavDecoder>(path, source);
+  }
+  if (len == sizeof(magic) && memcmp(magic, "FORM", 4) == 0 &&
+      (memcmp(magic + 8, "AIFF", 4) == 0 ||
+       memcmp(magic + 8, "AIFC", 4) == 0)) {
+    return OpenWith<AiffDecoder>(path, source);
+  }
+  if (len >= 4 &&
+      (memcmp(magic, "fLaC", 4) == 0 || memcmp(magic, "ID3", 3) == 0)) {
+    return OpenWith<FlacDecoder>(path, source);
+  }
+  return OpenWith<MappedPCMFile>(path, source);
+}
+}  // namespace audio
+}  // namespace AirBeamCore
@@ -0,0 +1,50 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "audio/pcm_format.h"
+#include "helper/errcode.h"
+
+namespace AirBeamCore {
+namespace audio {
+// A pull source of 16-bit stereo PCM in host byte order, at the sample
+// rate of its input. Decoders convert a bounded block at a time, so memory
+// does not grow with the file.
+class AudioSource {
+ public:
+  virtual ~AudioSource() = default;
+
+  // Points data at up to max_bytes of whole output frames and moves past
+  // them; data stays valid until the next call. Returns 0 at the end, or
+  // for a live source, when nothing arrived in time.
+  virtual size_t Next(size_t max_bytes, const uint8_t*& data) = 0;
+  // After Next returned 0, whether that was the end.
+  virtual bool AtEnd() const { return true; }
+  // Goes back to the first frame.
+  virtual helper::ErrCode Rewind() = 0;
+  // The layout of the input, before conversion.
+  virtual PCMFormat GetInputFormat() const = 0;
+};
+
+// Fills max_bytes from source where Next returns less, such as at a
+// decoder's block boundaries, copying the pieces into buffer; a single
+// piece that fills the request is passed through without a copy. With
+// loop, the source is rewound at its end and loops counted. Returns less
+// than max_bytes only at the end of a source that does not loop, or when
+// a live source runs dry.
+size_t NextFull(AudioSource& source, size_t max_bytes, uint8_t* buffer,
+                const uint8_t*& data, bool loop, uint64_t* loops = nullptr);
+
+// Opens path with the decoder its header calls for: WAV, AIFF/AIFC or
+// FLAC. Anything else is taken as raw 16-bit stereo PCM. "-" and FIFOs
+// are read live, as raw PCM, and udp://host:port or unix:///path listen
+// for raw PCM or RTP L16 datagrams.
+helper::ErrCode OpenAudioSource(const std::string& path,
+                                std::unique_ptr<AudioSource>& source);
+}  // namespace audio
+}  // namespace AirBeamCore
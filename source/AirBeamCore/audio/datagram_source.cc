@@ -0,0 +1,416 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "datagram_source.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "helper/capture.h"
+#include "helper/logger.h"
+
+namespace AirBeamCore {
+namespace audio {
+namespace {
+using helper::PacketCapture;
+
+constexpr size_t kRtpHeaderBytes = 12;
+// L16 payload types from RFC 3551; anything from 96 up is dynamic.
+constexpr uint8_t kRtpL16Stereo = 10;
+constexpr uint8_t kRtpL16Mono = 11;
+constexpr uint8_t kRtpDynamicFirst = 96;
+
+uint64_t ToFrames(std::chrono::milliseconds duration) {
+  return static_cast<uint64_t>(duration.count()) * PCMFormat().sample_rate /
+         1000;
+}
+
+bool IsL16PayloadType(uint8_t type) {
+  return type == kRtpL16Stereo || type == kRtpL16Mono ||
+         type >= kRtpDynamicFirst;
+}
+
+// A guess from one packet: version 2 with no padding, extension or CSRCs,
+// which raw PCM matches about once in a few thousand packets.
+bool LooksLikeRtp(const uint8_t* data, size_t len) {
+  return len >= kRtpHeaderBytes && data[0] == 0x80 &&
+         IsL16PayloadType(data[1] & 0x7f);
+}
+
+int BindUdp(const std::string& host_port) {
+  size_t colon = host_port.rfind(':');
+  if (colon == std::string::npos) return -1;
+  std::string host = host_port.substr(0, colon);
+  std::string port = host_port.substr(colon + 1);
+  if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+    host = host.substr(1, host.size() - 2);
+  }
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_PASSIVE;
+  addrinfo* result = nullptr;
+  if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(),
+                  &hints, &result) != 0) {
+    return -1;
+  }
+  int fd = -1;
+  for (addrinfo* ai = result; ai != nullptr && fd < 0; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd >= 0 && bind(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(result);
+  return fd;
+}
+
+int BindUnix(const std::string& path) {
+  sockaddr_un addr{};
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) return -1;
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.c_str(), path.size());
+  int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (fd < 0) return -1;
+  // A socket file left behind by an earlier run would make bind fail.
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+}  // namespace
+
+DatagramSource::DatagramSource(const Options& options)
+    : options_(options),
+      depth_frames_(std::max<uint64_t>(ToFrames(options.depth), 1)),
+      capacity_(std::max<uint64_t>(ToFrames(options.max_depth),
+                                   depth_frames_ + kHistoryFrames)),
+      ring_(capacity_ * 2),
+      present_(capacity_),
+      history_(kHistoryFrames * 2) {}
+
+DatagramSource::~DatagramSource() { Stop(); }
+
+helper::ErrCode DatagramSource::Open() {
+  Stop();
+  const std::string& address = options_.address;
+  if (address.rfind("unix://", 0) == 0) {
+    unix_path_ = address.substr(strlen("unix://"));
+    fd_ = BindUnix(unix_path_);
+    if (fd_ < 0) unix_path_.clear();
+  } else if (address.rfind("udp://", 0) == 0) {
+    fd_ = BindUdp(address.substr(strlen("udp://")));
+  }
+  if (fd_ < 0) {
+    ABWarningLog("DatagramSource cannot listen on %s, errno=%d",
+                 address.c_str(), errno);
+    return helper::kErrInvalidParam;
+  }
+  if (pipe(wake_) != 0) {
+    Stop();
+    return helper::kErrInvalidParam;
+  }
+  // Room for bursts while the receiver thread is descheduled.
+  int rcvbuf = 1024 * 1024;
+  setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  socklen_t addr_len = sizeof(local_addr_);
+  getsockname(fd_, reinterpret_cast<sockaddr*>(&local_addr_), &addr_len);
+  if (local_addr_.ss_family == AF_INET) {
+    local_port_ =
+        ntohs(reinterpret_cast<const sockaddr_in*>(&local_addr_)->sin_port);
+  } else if (local_addr_.ss_family == AF_INET6) {
+    local_port_ =
+        ntohs(reinterpret_cast<const sockaddr_in6*>(&local_addr_)->sin6_port);
+  }
+
+  std::fill(present_.begin(), present_.end(), 0);
+  play_pos_ = head_pos_ = 0;
+  playing_ = closed_ = false;
+  stats_ = Stats();
+  rtp_ = options_.payload == Payload::kRtp;
+  payload_known_ = options_.payload != Payload::kAuto;
+  have_timestamp_ = false;
+  raw_pos_ = 0;
+  history_pos_ = history_frames_ = 0;
+  concealed_run_ = 0;
+  receiver_ = std::thread(&DatagramSource::ReceiverLoop, this);
+  return helper::kOk;
+}
+
+void DatagramSource::Stop() {
+  if (receiver_.joinable()) {
+    char wake = 0;
+    (void)!write(wake_[1], &wake, 1);
+    receiver_.join();
+  }
+  for (int& fd : wake_) {
+    if (fd >= 0) close(fd);
+    fd = -1;
+  }
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+  if (!unix_path_.empty()) unlink(unix_path_.c_str());
+  unix_path_.clear();
+  local_port_ = 0;
+}
+
+void DatagramSource::ReceiverLoop() {
+  // The largest UDP payload.
+  std::vector<uint8_t> buffer(65536);
+  const bool udp = unix_path_.empty();
+  while (true) {
+    pollfd fds[2] = {{fd_, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      ABErrorLog("DatagramSource poll failed, errno=%d", errno);
+      break;
+    }
+    if (fds[1].revents != 0) break;
+    sockaddr_storage remote{};
+    socklen_t remote_len = sizeof(remote);
+    ssize_t got = recvfrom(fd_, buffer.data(), buffer.size(), 0,
+                           reinterpret_cast<sockaddr*>(&remote), &remote_len);
+    if (got < 0) {
+      if (errno == EINTR || errno == EAGAIN) continue;
+      ABErrorLog("DatagramSource recv failed, errno=%d", errno);
+      break;
+    }
+    if (udp) {
+      PacketCapture::Tap({PacketCapture::Protocol::kUdp,
+                          PacketCapture::Direction::kInbound,
+                          reinterpret_cast<const sockaddr*>(&local_addr_),
+                          reinterpret_cast<const sockaddr*>(&remote),
+                          buffer.data(), static_cast<size_t>(got)});
+    }
+    Receive(buffer.data(), got);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+  }
+  not_empty_.notify_one();
+}
+
+void DatagramSource::Receive(const uint8_t* data, size_t len) {
+  if (!payload_known_) {
+    rtp_ = LooksLikeRtp(data, len);
+    payload_known_ = true;
+    ABInfoLog("DatagramSource %s carries %s", options_.address.c_str(),
+              rtp_ ? "RTP L16" : "raw PCM");
+  }
+
+  uint64_t pos = 0;
+  size_t frames = 0;
+  if (rtp_) {
+    // RFC 3550 header, then big-endian samples.
+    bool valid = len >= kRtpHeaderBytes && (data[0] >> 6) == 2 &&
+                 IsL16PayloadType(data[1] & 0x7f);
+    size_t header = kRtpHeaderBytes + 4 * (data[0] & 0x0f);
+    if (valid && (data[0] & 0x10) != 0) {
+      valid = header + 4 <= len;
+      if (valid) {
+        header += 4 + 4 * ((data[header + 2] << 8) | data[header + 3]);
+      }
+    }
+    valid = valid && header <= len;
+    if (valid && (data[0] & 0x20) != 0) {
+      valid = data[len - 1] <= len - header;
+      if (valid) len -= data[len - 1];
+    }
+    const size_t channels = (data[1] & 0x7f) == kRtpL16Mono ? 1 : 2;
+    if (valid && header < len && (len - header) % (2 * channels) == 0) {
+      uint32_t timestamp;
+      memcpy(&timestamp, data + 4, sizeof(timestamp));
+      timestamp = ntohl(timestamp);
+      if (!have_timestamp_) {
+        // Far enough from zero that reordering never goes below it.
+        last_rtp_pos_ = (uint64_t{1} << 32) + timestamp;
+        last_timestamp_ = timestamp;
+        have_timestamp_ = true;
+      }
+      int32_t delta = static_cast<int32_t>(timestamp - last_timestamp_);
+      pos = last_rtp_pos_ + delta;
+      if (delta > 0) {
+        last_rtp_pos_ = pos;
+        last_timestamp_ = timestamp;
+      }
+      const uint8_t* payload = data + header;
+      frames = (len - header) / (2 * channels);
+      scratch_.resize(frames * 2);
+      for (size_t i = 0; i < frames; ++i) {
+        for (size_t c = 0; c < 2; ++c) {
+          const uint8_t* sample = payload + 2 * (i * channels + c % channels);
+          scratch_[2 * i + c] =
+              static_cast<int16_t>((sample[0] << 8) | sample[1]);
+        }
+      }
+    }
+  } else if (len != 0 && len % kOutputFrameBytes == 0) {
+    frames = len / kOutputFrameBytes;
+    scratch_.resize(frames * 2);
+    memcpy(scratch_.data(), data, len);
+    pos = raw_pos_;
+    raw_pos_ += frames;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.packets++;
+    stats_.bytes += len;
+    if (frames == 0) {
+      stats_.rejected++;
+      return;
+    }
+    Insert(pos, scratch_.data(), frames);
+  }
+  not_empty_.notify_one();
+}
+
+void DatagramSource::Insert(uint64_t pos, const int16_t* samples,
+                            size_t frames) {
+  if (frames > capacity_) {
+    // Only the end of it fits.
+    samples += 2 * (frames - capacity_);
+    pos += frames - capacity_;
+    frames = capacity_;
+  }
+  if (!playing_ && head_pos_ <= play_pos_) {
+    // Nothing buffered: playout starts wherever the audio is.
+    play_pos_ = head_pos_ = pos;
+  } else if (pos + frames <= play_pos_ && play_pos_ - pos > capacity_) {
+    // Too far back to be late: the sender restarted its timeline.
+    std::fill(present_.begin(), present_.end(), 0);
+    play_pos_ = head_pos_ = pos;
+    playing_ = false;
+  } else if (!playing_ && pos < play_pos_ && head_pos_ - pos <= capacity_) {
+    // Arrived after a later packet, before playout started.
+    play_pos_ = pos;
+  }
+  if (pos < play_pos_) {
+    stats_.late++;
+    uint64_t skip = play_pos_ - pos;
+    if (skip >= frames) return;
+    samples += 2 * skip;
+    pos += skip;
+    frames -= skip;
+  }
+  uint64_t end = pos + frames;
+  if (end - play_pos_ > capacity_) {
+    stats_.overflow_frames += Advance(end - play_pos_ - capacity_);
+  }
+
+  size_t slot = pos % capacity_;
+  size_t first = std::min(frames, capacity_ - slot);
+  memcpy(&ring_[2 * slot], samples, first * kOutputFrameBytes);
+  memcpy(&ring_[0], samples + 2 * first,
+         (frames - first) * kOutputFrameBytes);
+  uint8_t duplicate = 0;
+  for (size_t i = 0; i < frames; ++i) {
+    uint8_t& present = present_[slot];
+    duplicate |= present;
+    present = 1;
+    if (++slot == capacity_) slot = 0;
+  }
+  if (duplicate != 0) stats_.duplicates++;
+  head_pos_ = std::max(head_pos_, end);
+}
+
+uint64_t DatagramSource::Advance(uint64_t frames) {
+  uint64_t forgotten = 0;
+  if (frames >= capacity_) {
+    forgotten = std::count(present_.begin(), present_.end(), 1);
+    std::fill(present_.begin(), present_.end(), 0);
+  } else {
+    size_t slot = play_pos_ % capacity_;
+    for (uint64_t i = 0; i < frames; ++i) {
+      forgotten += present_[slot];
+      present_[slot] = 0;
+      if (++slot == capacity_) slot = 0;
+    }
+  }
+  play_pos_ += frames;
+  head_pos_ = std::max(head_pos_, play_pos_);
+  return forgotten;
+}
+
+size_t DatagramSource::Next(size_t max_bytes, const uint8_t*& data) {
+  const uint64_t max_frames = max_bytes / kOutputFrameBytes;
+  std::unique_lock<std::mutex> lock(mutex_);
+  not_empty_.wait_for(lock, options_.read_timeout, [&]() {
+    uint64_t buffered = head_pos_ - play_pos_;
+    return closed_ || buffered >= (playing_ ? 1 : depth_frames_);
+  });
+  const uint64_t buffered = head_pos_ - play_pos_;
+  if (!playing_) {
+    // Once closed, what is left plays without waiting for depth.
+    if (buffered < depth_frames_ && !(closed_ && buffered != 0)) return 0;
+    playing_ = true;
+  }
+  if (buffered == 0) {
+    playing_ = false;
+    if (!closed_) stats_.underruns++;
+    return 0;
+  }
+
+  const size_t frames = std::min(max_frames, buffered);
+  output_.resize(frames * 2);
+  size_t slot = play_pos_ % capacity_;
+  for (size_t i = 0; i < frames; ++i) {
+    int16_t* out = &output_[2 * i];
+    if (present_[slot]) {
+      memcpy(out, &ring_[2 * slot], kOutputFrameBytes);
+      memcpy(&history_[2 * history_pos_], out, kOutputFrameBytes);
+      history_pos_ = (history_pos_ + 1) % kHistoryFrames;
+      history_frames_ = std::min(history_frames_ + 1, kHistoryFrames);
+      concealed_run_ = 0;
+    } else if (history_frames_ == 0) {
+      out[0] = out[1] = 0;
+      stats_.concealed_frames++;
+    } else {
+      // Loops over the last history_frames_ played, oldest first.
+      size_t oldest = history_frames_ == kHistoryFrames ? history_pos_ : 0;
+      size_t index = (oldest + concealed_run_ % history_frames_) %
+                     kHistoryFrames;
+      for (size_t c = 0; c < 2; ++c) {
+        int32_t sample = history_[2 * index + c];
+        if (options_.concealment == Concealment::kFade) {
+          uint64_t left = kFadeFrames - std::min(concealed_run_, kFadeFrames);
+          sample = static_cast<int32_t>(sample * static_cast<int64_t>(left) /
+                                        static_cast<int64_t>(kFadeFrames));
+        }
+        out[c] = static_cast<int16_t>(sample);
+      }
+      concealed_run_++;
+      stats_.concealed_frames++;
+    }
+    if (++slot == capacity_) slot = 0;
+  }
+  Advance(frames);
+  data = reinterpret_cast<const uint8_t*>(output_.data());
+  return frames * kOutputFrameBytes;
+}
+
+bool DatagramSource::AtEnd() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return closed_ && head_pos_ <= play_pos_;
+}
+
+DatagramSource::Stats DatagramSource::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats = stats_;
+  stats.buffered_frames = head_pos_ - play_pos_;
+  return stats;
+}
+}  // namespace audio
+}  // namespace AirBeamCore
@@ -0,0 +1,140 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <sys/socket.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio/audio_source.h"
+#include "helper/errcode.h"
+
+namespace AirBeamCore {
+namespace audio {
+// Live PCM sent by another process as datagrams, over UDP or a Unix
+// datagram socket. Payloads are either raw 16-bit stereo PCM in host order,
+// played in arrival order, or RTP with L16 audio (big endian, payload type
+// 10 for stereo, 11 for mono, or dynamic), placed by RTP timestamp.
+//
+// Packets go into a jitter buffer indexed by frame. Playout starts once
+// depth worth of audio is buffered, and restarts that way after running
+// dry. A gap with later audio already buffered is a lost packet and is
+// concealed by repeating the last audio, or fading it out. Packets behind
+// the playout position are dropped as late; past max_depth ahead, the
+// oldest audio is dropped to keep latency bounded.
+class DatagramSource : public AudioSource {
+ public:
+  enum class Payload { kAuto, kRaw, kRtp };
+  enum class Concealment { kRepeat, kFade };
+
+  struct Options {
+    // udp://host:port (port 0 picks one) or unix:///path/to/socket.
+    std::string address;
+    // kAuto guesses from the first packet; say which when it is known.
+    Payload payload = Payload::kAuto;
+    std::chrono::milliseconds depth{40};
+    std::chrono::milliseconds max_depth{500};
+    Concealment concealment = Concealment::kFade;
+    // How long Next waits for audio before reporting an underrun.
+    std::chrono::milliseconds read_timeout{8};
+  };
+
+  struct Stats {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    // Packets that came after their place was played, wholly or in part.
+    uint64_t late = 0;
+    uint64_t duplicates = 0;
+    // Not whole frames, or not L16 RTP when RTP is expected.
+    uint64_t rejected = 0;
+    uint64_t concealed_frames = 0;
+    // Buffered frames dropped to stay within max_depth.
+    uint64_t overflow_frames = 0;
+    // Times playout ran dry and went back to buffering depth.
+    uint64_t underruns = 0;
+    // From the playout position to the newest audio, gaps included.
+    size_t buffered_frames = 0;
+  };
+
+  explicit DatagramSource(const Options& options);
+  ~DatagramSource() override;
+  DatagramSource(const DatagramSource&) = delete;
+  DatagramSource& operator=(const DatagramSource&) = delete;
+
+  // Binds the socket and starts receiving.
+  helper::ErrCode Open();
+  // The bound UDP port, for udp://...:0.
+  uint16_t GetLocalPort() const { return local_port_; }
+
+  size_t Next(size_t max_bytes, const uint8_t*& data) override;
+  helper::ErrCode Rewind() override { return helper::kErrInvalidParam; }
+  PCMFormat GetInputFormat() const override { return PCMFormat(); }
+  // Live until the socket fails and what it brought is played out.
+  bool AtEnd() const override;
+
+  Stats GetStats() const;
+
+ private:
+  // What repeat concealment loops over: about one packet of the last audio.
+  static constexpr size_t kHistoryFrames = 352;
+  // kFade goes from full to silence over this many frames, about 10 ms.
+  static constexpr uint64_t kFadeFrames = 441;
+
+  void ReceiverLoop();
+  // Decodes a datagram and passes its frames to Insert.
+  void Receive(const uint8_t* data, size_t len);
+  void Insert(uint64_t pos, const int16_t* samples, size_t frames);
+  // Moves the playout position on, forgetting the frames passed over;
+  // returns how many of them had arrived.
+  uint64_t Advance(uint64_t frames);
+  void Stop();
+
+  Options options_;
+  uint64_t depth_frames_;
+  size_t capacity_;
+  // Stereo frames by position modulo capacity_, and whether each arrived.
+  // Only positions in [play_pos_, head_pos_) can be present.
+  std::vector<int16_t> ring_;
+  std::vector<uint8_t> present_;
+  uint64_t play_pos_ = 0;
+  uint64_t head_pos_ = 0;
+  bool playing_ = false;
+  bool closed_ = false;
+  Stats stats_;
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_;
+
+  // Receiver thread only. RTP timestamps are unwrapped to 64 bits; raw
+  // packets are placed one after another.
+  bool rtp_ = false;
+  bool payload_known_ = false;
+  bool have_timestamp_ = false;
+  uint32_t last_timestamp_ = 0;
+  uint64_t last_rtp_pos_ = 0;
+  uint64_t raw_pos_ = 0;
+  std::vector<int16_t> scratch_;
+
+  // Next only: recently played frames and how far into a gap we are.
+  std::vector<int16_t> history_;
+  size_t history_pos_ = 0;
+  size_t history_frames_ = 0;
+  uint64_t concealed_run_ = 0;
+  std::vector<int16_t> output_;
+
+  int fd_ = -1;
+  sockaddr_storage local_addr_{};
+  uint16_t local_port_ = 0;
+  std::string unix_path_;
+  // Written to by Stop to wake the receiver out of poll().
+  int wake_[2] = {-1, -1};
+  std::thread receiver_;
+};
+}  // namespace audio
+}  // namespace AirBeamCore
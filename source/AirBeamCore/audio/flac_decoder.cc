@@ -0,0 +1,448 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "flac_decoder.h"
+
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "helper/logger.h"
+
+namespace AirBeamCore {
+namespace audio {
+namespace {
+constexpr uint32_t kMaxBlockSize = 65535;
+constexpr int kMaxLpcOrder = 32;
+
+// Channel assignments past the independent ones.
+constexpr uint32_t kLeftSide = 8;
+constexpr uint32_t kSideRight = 9;
+constexpr uint32_t kMidSide = 10;
+
+uint8_t Crc8(const uint8_t* data, size_t len) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < len; ++i) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07)
+                         : static_cast<uint8_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+int16_t ToS16(int32_t sample, int bits) {
+  return static_cast<int16_t>(bits >= 16 ? sample >> (bits - 16)
+                                         : sample * (1 << (16 - bits)));
+}
+}  // namespace
+
+FlacDecoder::FlacDecoder() : read_buffer_(kReadBufferBytes) {}
+
+FlacDecoder::~FlacDecoder() {
+  if (file_ != nullptr) fclose(file_);
+}
+
+helper::ErrCode FlacDecoder::Open(const std::string& path) {
+  if (file_ != nullptr) fclose(file_);
+  file_ = fopen(path.c_str(), "rb");
+  if (file_ == nullptr) return helper::kErrInvalidParam;
+  if (!ReadMetadata()) {
+    fclose(file_);
+    file_ = nullptr;
+    return helper::kErrInvalidParam;
+  }
+  for (auto& channel : channels_) channel.assign(max_block_size_, 0);
+  scratch_.assign(max_block_size_, 0);
+  output_.assign(max_block_size_ * 2, 0);
+  return Rewind();
+}
+
+bool FlacDecoder::ReadMetadata() {
+  uint8_t header[10];
+  if (fread(header, 1, 4, file_) != 4) return false;
+  // Some taggers put ID3v2 in front of the stream.
+  if (memcmp(header, "ID3", 3) == 0) {
+    if (fread(header + 4, 1, 6, file_) != 6) return false;
+    uint32_t size = (header[6] & 0x7F) << 21 | (header[7] & 0x7F) << 14 |
+                    (header[8] & 0x7F) << 7 | (header[9] & 0x7F);
+    if (header[5] & 0x10) size += 10;
+    if (fseeko(file_, 10 + size, SEEK_SET) != 0) return false;
+    if (fread(header, 1, 4, file_) != 4) return false;
+  }
+  if (memcmp(header, "fLaC", 4) != 0) return false;
+
+  bool have_info = false;
+  bool last = false;
+  while (!last) {
+    uint8_t block[4];
+    if (fread(block, 1, 4, file_) != 4) return false;
+    last = block[0] & 0x80;
+    uint32_t type = block[0] & 0x7F;
+    uint32_t len = block[1] << 16 | block[2] << 8 | block[3];
+    if (type == 0 && len >= 34) {
+      uint8_t info[34];
+      if (fread(info, 1, sizeof(info), file_) != sizeof(info)) return false;
+      max_block_size_ = info[2] << 8 | info[3];
+      format_.sample_rate = info[10] << 12 | info[11] << 4 | info[12] >> 4;
+      format_.channels = ((info[12] >> 1) & 7) + 1;
+      format_.bits = ((info[12] & 1) << 4 | info[13] >> 4) + 1;
+      format_.encoding = PCMFormat::Encoding::kSigned;
+      format_.big_endian = false;
+      total_frames_ = static_cast<uint64_t>(info[13] & 0x0F) << 32 |
+                      static_cast<uint64_t>(info[14]) << 24 |
+                      info[15] << 16 | info[16] << 8 | info[17];
+      have_info = true;
+      len -= sizeof(info);
+    }
+    if (fseeko(file_, len, SEEK_CUR) != 0) return false;
+  }
+  if (!have_info || max_block_size_ < 16 || format_.sample_rate == 0 ||
+      format_.bits < 4) {
+    return false;
+  }
+  first_frame_offset_ = ftello(file_);
+  return true;
+}
+
+helper::ErrCode FlacDecoder::Rewind() {
+  if (file_ == nullptr ||
+      fseeko(file_, static_cast<off_t>(first_frame_offset_), SEEK_SET) != 0) {
+    return helper::kErrInvalidParam;
+  }
+  read_pos_ = read_len_ = 0;
+  cache_ = 0;
+  cache_bits_ = 0;
+  output_frames_ = output_pos_ = 0;
+  return helper::kOk;
+}
+
+size_t FlacDecoder::Next(size_t max_bytes, const uint8_t*& data) {
+  if (file_ == nullptr) return 0;
+  if (output_pos_ == output_frames_ && !DecodeFrame()) return 0;
+  size_t frames =
+      std::min(max_bytes / kOutputFrameBytes, output_frames_ - output_pos_);
+  data = reinterpret_cast<const uint8_t*>(output_.data() + output_pos_ * 2);
+  output_pos_ += frames;
+  return frames * kOutputFrameBytes;
+}
+
+bool FlacDecoder::Fill() {
+  while (cache_bits_ <= 56) {
+    if (read_pos_ == read_len_) {
+      read_len_ = fread(read_buffer_.data(), 1, read_buffer_.size(), file_);
+      read_pos_ = 0;
+      if (read_len_ == 0) break;
+    }
+    cache_ |= static_cast<uint64_t>(read_buffer_[read_pos_++])
+              << (56 - cache_bits_);
+    cache_bits_ += 8;
+  }
+  return cache_bits_ > 0;
+}
+
+bool FlacDecoder::ReadBits(int count, uint32_t& value) {
+  if (count == 0) {
+    value = 0;
+    return true;
+  }
+  if (cache_bits_ < count) {
+    Fill();
+    if (cache_bits_ < count) return false;
+  }
+  value = static_cast<uint32_t>(cache_ >> (64 - count));
+  cache_ <<= count;
+  cache_bits_ -= count;
+  return true;
+}
+
+bool FlacDecoder::ReadSignedBits(int count, int32_t& value) {
+  uint32_t raw;
+  if (count > 32 || !ReadBits(count, raw)) return false;
+  if (count == 0 || count == 32) {
+    value = static_cast<int32_t>(raw);
+  } else {
+    value = static_cast<int32_t>(raw << (32 - count)) >> (32 - count);
+  }
+  return true;
+}
+
+bool FlacDecoder::ReadUnary(uint32_t& value) {
+  value = 0;
+  while (true) {
+    if (cache_bits_ == 0 && !Fill()) return false;
+    // Bits past cache_bits_ are always zero.
+    int zeros = cache_ == 0 ? 64 : __builtin_clzll(cache_);
+    if (zeros < cache_bits_) {
+      value += zeros;
+      cache_ <<= zeros;
+      cache_ <<= 1;
+      cache_bits_ -= zeros + 1;
+      return true;
+    }
+    value += cache_bits_;
+    cache_ = 0;
+    cache_bits_ = 0;
+  }
+}
+
+void FlacDecoder::AlignToByte() {
+  int drop = cache_bits_ % 8;
+  cache_ <<= drop;
+  cache_bits_ -= drop;
+}
+
+bool FlacDecoder::DecodeFrame() {
+  while (true) {
+    AlignToByte();
+    uint32_t byte;
+    uint32_t previous = 0;
+    bool synced = false;
+    while (ReadBits(8, byte)) {
+      // 14 sync bits, a reserved zero and the blocking strategy.
+      if (previous == 0xFF && (byte & 0xFE) == 0xF8) {
+        synced = true;
+        break;
+      }
+      previous = byte;
+    }
+    if (!synced) return false;
+    if (DecodeFrameAfterSync(static_cast<uint8_t>(byte))) return true;
+    corrupt_frames_++;
+  }
+}
+
+bool FlacDecoder::DecodeFrameAfterSync(uint8_t sync) {
+  uint8_t header[16] = {0xFF, sync};
+  size_t len = 2;
+  uint32_t value;
+  auto read_byte = [&]() {
+    if (!ReadBits(8, value)) return false;
+    header[len++] = static_cast<uint8_t>(value);
+    return true;
+  };
+
+  if (!read_byte() || !read_byte()) return false;
+  uint32_t block_code = header[2] >> 4;
+  uint32_t rate_code = header[2] & 0x0F;
+  uint32_t assignment = header[3] >> 4;
+  uint32_t size_code = (header[3] >> 1) & 0x07;
+  if (block_code == 0 || rate_code == 15 || size_code == 3 ||
+      assignment > kMidSide || (header[3] & 1)) {
+    return false;
+  }
+
+  // The frame or sample number, UTF-8 style in one to seven bytes.
+  if (!read_byte()) return false;
+  int extra = 0;
+  for (uint8_t mask = 0x80; header[4] & mask && mask > 1; mask >>= 1) extra++;
+  if (extra == 1 || extra > 7) return false;
+  for (int i = 1; i < extra; ++i) {
+    if (!read_byte() || (header[len - 1] & 0xC0) != 0x80) return false;
+  }
+
+  uint32_t block_size;
+  if (block_code == 1) {
+    block_size = 192;
+  } else if (block_code <= 5) {
+    block_size = 576u << (block_code - 2);
+  } else if (block_code == 6) {
+    if (!read_byte()) return false;
+    block_size = header[len - 1] + 1;
+  } else if (block_code == 7) {
+    if (!read_byte() || !read_byte()) return false;
+    block_size = (header[len - 2] << 8 | header[len - 1]) + 1;
+  } else {
+    block_size = 256u << (block_code - 8);
+  }
+  // Only STREAMINFO's rate is used; these just have to be skipped.
+  if (rate_code == 12 && !read_byte()) return false;
+  if ((rate_code == 13 || rate_code == 14) && (!read_byte() || !read_byte())) {
+    return false;
+  }
+  uint32_t crc;
+  if (!ReadBits(8, crc) || crc != Crc8(header, len)) return false;
+
+  static constexpr int kSampleBits[] = {0, 8, 12, 0, 16, 20, 24, 32};
+  int bits = size_code == 0 ? format_.bits : kSampleBits[size_code];
+  uint32_t channels = assignment < kLeftSide ? assignment + 1 : 2;
+  if (channels != format_.channels || block_size > kMaxBlockSize) {
+    return false;
+  }
+  if (block_size > channels_[0].size()) {
+    // STREAMINFO understated the block size.
+    for (auto& channel : channels_) channel.resize(block_size);
+    scratch_.resize(block_size);
+    output_.resize(block_size * 2);
+  }
+
+  for (uint32_t channel = 0; channel < channels; ++channel) {
+    // The side channel carries one more bit.
+    bool side = (assignment == kLeftSide && channel == 1) ||
+                (assignment == kSideRight && channel == 0) ||
+                (assignment == kMidSide && channel == 1);
+    int32_t* samples =
+        channel < 2 ? channels_[channel].data() : scratch_.data();
+    if (!DecodeSubframe(bits + (side ? 1 : 0), block_size, samples)) {
+      return false;
+    }
+  }
+  AlignToByte();
+  uint32_t crc16;
+  if (!ReadBits(16, crc16)) return false;
+
+  int32_t* left = channels_[0].data();
+  int32_t* right = channels_[channels > 1 ? 1 : 0].data();
+  for (uint32_t i = 0; i < block_size; ++i) {
+    int32_t l = left[i];
+    int32_t r = right[i];
+    if (assignment == kLeftSide) {
+      r = l - r;
+    } else if (assignment == kSideRight) {
+      l = l + r;
+    } else if (assignment == kMidSide) {
+      int32_t mid = static_cast<int32_t>(static_cast<uint32_t>(l) << 1) |
+                    (r & 1);
+      l = (mid + r) >> 1;
+      r = (mid - r) >> 1;
+    }
+    output_[i * 2] = ToS16(l, bits);
+    output_[i * 2 + 1] = ToS16(r, bits);
+  }
+  output_frames_ = block_size;
+  output_pos_ = 0;
+  return true;
+}
+
+bool FlacDecoder::DecodeSubframe(int bits, uint32_t block_size,
+                                 int32_t* samples) {
+  uint32_t padding, type, has_wasted;
+  if (!ReadBits(1, padding) || !ReadBits(6, type) ||
+      !ReadBits(1, has_wasted) || padding != 0) {
+    return false;
+  }
+  int wasted = 0;
+  if (has_wasted) {
+    uint32_t count;
+    if (!ReadUnary(count)) return false;
+    wasted = static_cast<int>(count) + 1;
+    bits -= wasted;
+  }
+  if (bits <= 0 || bits > 32) return false;
+
+  if (type == 0) {
+    int32_t value;
+    if (!ReadSignedBits(bits, value)) return false;
+    std::fill(samples, samples + block_size, value);
+  } else if (type == 1) {
+    for (uint32_t i = 0; i < block_size; ++i) {
+      if (!ReadSignedBits(bits, samples[i])) return false;
+    }
+  } else if (type >= 8 && type <= 12) {
+    int order = static_cast<int>(type - 8);
+    if (static_cast<uint32_t>(order) > block_size) return false;
+    for (int i = 0; i < order; ++i) {
+      if (!ReadSignedBits(bits, samples[i])) return false;
+    }
+    if (!DecodeResidual(block_size, order, samples)) return false;
+    // Fixed polynomial predictors, in 64 bits for 32-bit input.
+    for (uint32_t i = order; i < block_size; ++i) {
+      int64_t prediction = 0;
+      switch (order) {
+        case 1:
+          prediction = samples[i - 1];
+          break;
+        case 2:
+          prediction = 2 * int64_t{samples[i - 1]} - samples[i - 2];
+          break;
+        case 3:
+          prediction = 3 * (int64_t{samples[i - 1]} - samples[i - 2]) +
+                       samples[i - 3];
+          break;
+        case 4:
+          prediction = 4 * (int64_t{samples[i - 1]} + samples[i - 3]) -
+                       6 * int64_t{samples[i - 2]} - samples[i - 4];
+          break;
+      }
+      samples[i] = static_cast<int32_t>(samples[i] + prediction);
+    }
+  } else if (type >= 32) {
+    int order = static_cast<int>(type - 31);
+    if (static_cast<uint32_t>(order) > block_size) return false;
+    for (int i = 0; i < order; ++i) {
+      if (!ReadSignedBits(bits, samples[i])) return false;
+    }
+    uint32_t precision;
+    int32_t shift;
+    if (!ReadBits(4, precision) || precision == 15 ||
+        !ReadSignedBits(5, shift) || shift < 0) {
+      return false;
+    }
+    int32_t coefs[kMaxLpcOrder];
+    for (int i = 0; i < order; ++i) {
+      if (!ReadSignedBits(precision + 1, coefs[i])) return false;
+    }
+    if (!DecodeResidual(block_size, order, samples)) return false;
+    for (uint32_t i = order; i < block_size; ++i) {
+      int64_t sum = 0;
+      for (int j = 0; j < order; ++j) {
+        sum += int64_t{coefs[j]} * samples[i - 1 - j];
+      }
+      samples[i] = static_cast<int32_t>(samples[i] + (sum >> shift));
+    }
+  } else {
+    return false;
+  }
+
+  if (wasted != 0) {
+    for (uint32_t i = 0; i < block_size; ++i) {
+      samples[i] = static_cast<int32_t>(static_cast<uint32_t>(samples[i])
+                                        << wasted);
+    }
+  }
+  return true;
+}
+
+bool FlacDecoder::DecodeResidual(uint32_t block_size, int order,
+                                 int32_t* samples) {
+  uint32_t method, partition_order;
+  if (!ReadBits(2, method) || method > 1 || !ReadBits(4, partition_order)) {
+    return false;
+  }
+  int parameter_bits = method == 0 ? 4 : 5;
+  uint32_t escape = (1u << parameter_bits) - 1;
+  uint32_t partition_size = block_size >> partition_order;
+  if ((partition_size << partition_order) != block_size ||
+      partition_size < static_cast<uint32_t>(order)) {
+    return false;
+  }
+
+  uint32_t index = order;
+  for (uint32_t partition = 0; partition < (1u << partition_order);
+       ++partition) {
+    uint32_t count = partition_size - (partition == 0 ? order : 0);
+    uint32_t parameter;
+    if (!ReadBits(parameter_bits, parameter)) return false;
+    if (parameter == escape) {
+      uint32_t raw_bits;
+      if (!ReadBits(5, raw_bits)) return false;
+      for (uint32_t i = 0; i < count; ++i) {
+        if (!ReadSignedBits(raw_bits, samples[index++])) return false;
+      }
+      continue;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      uint32_t quotient, remainder;
+      if (!ReadUnary(quotient) || !ReadBits(parameter, remainder)) {
+        return false;
+      }
+      uint32_t folded = quotient << parameter | remainder;
+      samples[index++] =
+          static_cast<int32_t>(folded >> 1) ^ -static_cast<int32_t>(folded & 1);
+    }
+  }
+  return true;
+}
+}  // namespace audio
+}  // namespace AirBeamCore
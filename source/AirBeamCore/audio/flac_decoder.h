@@ -0,0 +1,74 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "audio/audio_source.h"
+
+namespace AirBeamCore {
+namespace audio {
+// A native FLAC decoder. Frames are decoded one at a time into buffers
+// sized from STREAMINFO's maximum block size and reused, and the file is
+// read through a fixed-size buffer, so memory stays flat for any length.
+//
+// Frame headers are checked against their CRC-8; a frame that fails to
+// parse is skipped by searching for the next sync code. The per-frame
+// CRC-16 and the stream MD5 are not checked.
+class FlacDecoder : public AudioSource {
+ public:
+  FlacDecoder();
+  ~FlacDecoder() override;
+
+  helper::ErrCode Open(const std::string& path);
+
+  size_t Next(size_t max_bytes, const uint8_t*& data) override;
+  helper::ErrCode Rewind() override;
+  PCMFormat GetInputFormat() const override { return format_; }
+
+  uint64_t GetTotalFrames() const { return total_frames_; }
+  // Frames dropped because they did not decode.
+  uint64_t GetCorruptFrames() const { return corrupt_frames_; }
+
+ private:
+  static constexpr size_t kReadBufferBytes = 64 * 1024;
+
+  // Bit reader over the file.
+  bool Fill();
+  bool ReadBits(int count, uint32_t& value);
+  bool ReadSignedBits(int count, int32_t& value);
+  bool ReadUnary(uint32_t& value);
+  void AlignToByte();
+
+  bool ReadMetadata();
+  // Decodes the next frame into output_; false at the end of the stream.
+  bool DecodeFrame();
+  bool DecodeFrameAfterSync(uint8_t sync);
+  bool DecodeSubframe(int bits, uint32_t block_size, int32_t* samples);
+  // Reads the residual of samples order and up into samples.
+  bool DecodeResidual(uint32_t block_size, int order, int32_t* samples);
+
+  FILE* file_ = nullptr;
+  uint64_t first_frame_offset_ = 0;
+  std::vector<uint8_t> read_buffer_;
+  size_t read_pos_ = 0;
+  size_t read_len_ = 0;
+  uint64_t cache_ = 0;
+  int cache_bits_ = 0;
+
+  PCMFormat format_;
+  uint32_t max_block_size_ = 0;
+  uint64_t total_frames_ = 0;
+  uint64_t corrupt_frames_ = 0;
+  // The first two channels; any further ones are decoded into scratch_
+  // and dropped.
+  std::vector<int32_t> channels_[2];
+  std::vector<int32_t> scratch_;
+  std::vector<int16_t> output_;
+  size_t output_frames_ = 0;
+  size_t output_pos_ = 0;
+};
+}  // namespace audio
+}  // namespace AirBeamCore
@@ -0,0 +1,101 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "mapped_pcm_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "helper/logger.h"
+
+namespace AirBeamCore {
+namespace audio {
+MappedPCMFile::~MappedPCMFile() { Close(); }
+
+helper::ErrCode MappedPCMFile::Open(const std::string& path) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    ABWarningLog("MappedPCMFile open %s failed, errno=%d", path.c_str(),
+                 errno);
+    return helper::kErrInvalidParam;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(kFrameBytes)) {
+    close(fd);
+    return helper::kErrInvalidParam;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file alive.
+  close(fd);
+  if (data == MAP_FAILED) {
+    ABWarningLog("MappedPCMFile mmap %s failed, errno=%d", path.c_str(),
+                 errno);
+    return helper::kErrInvalidParam;
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  data_ = static_cast<uint8_t*>(data);
+  mapped_ = st.st_size;
+  size_ = mapped_ / kFrameBytes * kFrameBytes;
+  offset_ = 0;
+  loops_ = 0;
+  return helper::kOk;
+}
+
+void MappedPCMFile::Close() {
+  if (data_ == nullptr) return;
+  munmap(data_, mapped_);
+  data_ = nullptr;
+  mapped_ = 0;
+  size_ = 0;
+  offset_ = 0;
+}
+
+size_t MappedPCMFile::Next(size_t max_bytes, const uint8_t*& data) {
+  max_bytes = max_bytes / kFrameBytes * kFrameBytes;
+  if (data_ == nullptr || max_bytes == 0) return 0;
+  uint64_t left = size_ - offset_;
+  if (left >= max_bytes || !loop_) {
+    size_t len = std::min<uint64_t>(left, max_bytes);
+    data = data_ + offset_;
+    offset_ += len;
+    return len;
+  }
+
+  // Crossing the loop point: the tail, then as much of the head as fits,
+  // going around again for files shorter than a chunk.
+  size_t len = std::min(max_bytes, kStitchBytes);
+  size_t filled = 0;
+  while (filled < len) {
+    size_t part = std::min<uint64_t>(len - filled, size_ - offset_);
+    memcpy(stitch_ + filled, data_ + offset_, part);
+    filled += part;
+    offset_ += part;
+    if (offset_ == size_) {
+      offset_ = 0;
+      loops_++;
+    }
+  }
+  data = stitch_;
+  return len;
+}
+
+helper::ErrCode MappedPCMFile::Rewind() {
+  if (data_ == nullptr) return helper::kErrInvalidParam;
+  offset_ = 0;
+  return helper::kOk;
+}
+
+void MappedPCMFile::Seek(uint64_t frame) {
+  if (data_ == nullptr) return;
+  uint64_t offset = frame * kFrameBytes;
+  offset_ = loop_ ? offset % size_ : std::min(offset, size_);
+}
+}  // namespace audio
+}  // namespace AirBeamCore
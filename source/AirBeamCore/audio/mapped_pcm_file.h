@@ -0,0 +1,67 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "audio/audio_source.h"
+#include "helper/errcode.h"
+
+namespace AirBeamCore {
+namespace audio {
+// Raw 16-bit stereo PCM read straight out of a memory-mapped file. Next
+// hands out pointers into the mapping, so a sender can encode from the
+// page cache without a producer thread, a FIFO or a copy. The mapping is
+// advised MADV_SEQUENTIAL, for the kernel to read ahead and drop pages
+// behind.
+//
+// Looping, the file plays over and over; the chunk that crosses the end
+// is stitched together from the tail and the head in a small buffer, so
+// the loop point adds no gap. Not thread safe.
+class MappedPCMFile : public AudioSource {
+ public:
+  static constexpr size_t kFrameBytes = kOutputFrameBytes;
+
+  MappedPCMFile() = default;
+  ~MappedPCMFile() override;
+  MappedPCMFile(const MappedPCMFile&) = delete;
+  MappedPCMFile& operator=(const MappedPCMFile&) = delete;
+
+  // A trailing partial frame is ignored; a file without a whole frame is
+  // an error.
+  helper::ErrCode Open(const std::string& path);
+  void Close();
+  bool IsOpen() const { return data_ != nullptr; }
+
+  void SetLoop(bool loop) { loop_ = loop; }
+  // Points data at up to max_bytes, rounded down to whole frames, and
+  // moves past them. Returns 0 at the end of the file when not looping.
+  // data stays valid until the next call.
+  size_t Next(size_t max_bytes, const uint8_t*& data) override;
+  helper::ErrCode Rewind() override;
+  // Raw files carry no header; they are taken as 16-bit stereo 44.1 kHz.
+  PCMFormat GetInputFormat() const override { return PCMFormat(); }
+  // Moves to a frame, wrapped to the file length when looping and clamped
+  // to the end otherwise.
+  void Seek(uint64_t frame);
+
+  uint64_t GetFrames() const { return size_ / kFrameBytes; }
+  uint64_t GetFrame() const { return offset_ / kFrameBytes; }
+  // Times the end was passed while looping.
+  uint64_t GetLoops() const { return loops_; }
+
+ private:
+  static constexpr size_t kStitchBytes = 16 * 1024;
+
+  uint8_t* data_ = nullptr;
+  size_t mapped_ = 0;
+  uint64_t size_ = 0;
+  uint64_t offset_ = 0;
+  uint64_t loops_ = 0;
+  bool loop_ = false;
+  uint8_t stitch_[kStitchBytes];
+};
+}  // namespace audio
+}  // namespace AirBeamCore
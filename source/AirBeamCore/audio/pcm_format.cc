@@ -0,0 +1,112 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "pcm_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace AirBeamCore {
+namespace audio {
+namespace {
+bool HostIsBigEndian() {
+  const uint16_t probe = 1;
+  uint8_t first;
+  memcpy(&first, &probe, 1);
+  return first == 0;
+}
+
+// Reads bytes bytes as an unsigned integer of the given byte order.
+uint64_t ReadUint(const uint8_t* in, size_t bytes, bool big_endian) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    size_t index = big_endian ? i : bytes - 1 - i;
+    value = (value << 8) | in[index];
+  }
+  return value;
+}
+
+int16_t FloatToS16(double value) {
+  double scaled = std::nearbyint(value * 32768.0);
+  return static_cast<int16_t>(std::clamp(scaled, -32768.0, 32767.0));
+}
+
+// One sample as 16 bits, keeping its most significant bits.
+int16_t ReadSample(const PCMFormat& format, const uint8_t* in) {
+  size_t bytes = format.bits / 8;
+  uint64_t bits = ReadUint(in, bytes, format.big_endian);
+  if (format.encoding == PCMFormat::Encoding::kFloat) {
+    if (bytes == 4) {
+      uint32_t raw = static_cast<uint32_t>(bits);
+      float value;
+      memcpy(&value, &raw, sizeof(value));
+      return FloatToS16(value);
+    }
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return FloatToS16(value);
+  }
+  uint32_t raw = static_cast<uint32_t>(bits);
+  // Left justify to 32 bits, then keep the top 16.
+  raw <<= 32 - format.bits;
+  if (format.encoding == PCMFormat::Encoding::kUnsigned) raw ^= 0x80000000u;
+  return static_cast<int16_t>(static_cast<int32_t>(raw) >> 16);
+}
+}  // namespace
+
+bool PCMFormat::IsSupported() const {
+  if (channels == 0 || sample_rate == 0) return false;
+  if (encoding == Encoding::kFloat) return bits == 32 || bits == 64;
+  return bits == 8 || bits == 16 || bits == 24 || bits == 32;
+}
+
+bool PCMFormat::IsNative() const {
+  return channels == 2 && bits == 16 && encoding == Encoding::kSigned &&
+         big_endian == HostIsBigEndian();
+}
+
+void ConvertToS16Stereo(const PCMFormat& format, const uint8_t* input,
+                        size_t frames, int16_t* output) {
+  if (format.IsNative()) {
+    memcpy(output, input, frames * kOutputFrameBytes);
+    return;
+  }
+  size_t sample_bytes = format.bits / 8;
+  size_t frame_bytes = format.FrameBytes();
+  // The common 16-bit little endian case without the generic reader.
+  if (format.bits == 16 && format.encoding == PCMFormat::Encoding::kSigned &&
+      format.big_endian == HostIsBigEndian()) {
+    for (size_t i = 0; i < frames; ++i) {
+      const uint8_t* frame = input + i * frame_bytes;
+      memcpy(&output[i * 2], frame, 2);
+      memcpy(&output[i * 2 + 1], frame + (format.channels > 1 ? 2 : 0), 2);
+    }
+    return;
+  }
+  // Other signed integers: truncating is keeping the top two bytes.
+  if (format.bits >= 16 && format.encoding == PCMFormat::Encoding::kSigned) {
+    size_t high = format.big_endian ? 0 : sample_bytes - 2;
+    size_t second = format.channels > 1 ? sample_bytes : 0;
+    for (size_t i = 0; i < frames; ++i) {
+      const uint8_t* left = input + i * frame_bytes + high;
+      const uint8_t* right = left + second;
+      if (format.big_endian) {
+        output[i * 2] = static_cast<int16_t>(left[0] << 8 | left[1]);
+        output[i * 2 + 1] = static_cast<int16_t>(right[0] << 8 | right[1]);
+      } else {
+        output[i * 2] = static_cast<int16_t>(left[1] << 8 | left[0]);
+        output[i * 2 + 1] = static_cast<int16_t>(right[1] << 8 | right[0]);
+      }
+    }
+    return;
+  }
+  for (size_t i = 0; i < frames; ++i) {
+    const uint8_t* frame = input + i * frame_bytes;
+    output[i * 2] = ReadSample(format, frame);
+    output[i * 2 + 1] = format.channels > 1
+                            ? ReadSample(format, frame + sample_bytes)
+                            : output[i * 2];
+  }
+}
+}  // namespace audio
+}  // namespace AirBeamCore
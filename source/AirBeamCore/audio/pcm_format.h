@@ -0,0 +1,37 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace AirBeamCore {
+namespace audio {
+// The sample layout of an input file: interleaved frames of channels
+// samples, each bits wide.
+struct PCMFormat {
+  enum class Encoding : uint8_t { kSigned, kUnsigned, kFloat };
+
+  uint32_t sample_rate = 44'100;
+  uint16_t channels = 2;
+  uint16_t bits = 16;
+  Encoding encoding = Encoding::kSigned;
+  bool big_endian = false;
+
+  size_t FrameBytes() const { return channels * (bits / 8); }
+  // 8 to 32-bit integers and 32 or 64-bit floats, any channel count.
+  bool IsSupported() const;
+  // Already what the sender takes: 16-bit stereo in host byte order.
+  bool IsNative() const;
+};
+
+// What every AudioSource produces, at the input's sample rate.
+constexpr size_t kOutputFrameBytes = 4;
+
+// Converts frames to interleaved 16-bit stereo in host order. Mono is
+// copied to both sides; past two channels, only the first two are kept.
+// Wider samples are truncated and floats clipped to [-1, 1).
+void ConvertToS16Stereo(const PCMFormat& format, const uint8_t* input,
+                        size_t frames, int16_t* output);
+}  // namespace audio
+}  // namespace AirBeamCore
@@ -0,0 +1,59 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "pcm_region_source.h"
+
+#include <algorithm>
+
+namespace AirBeamCore {
+namespace audio {
+PCMRegionSource::~PCMRegionSource() {
+  if (file_ != nullptr) fclose(file_);
+}
+
+helper::ErrCode PCMRegionSource::Init(FILE* file, uint64_t data_offset,
+                                      uint64_t data_bytes,
+                                      const PCMFormat& format) {
+  if (file_ != nullptr) fclose(file_);
+  file_ = file;
+  if (!format.IsSupported()) return helper::kErrInvalidParam;
+  data_offset_ = data_offset;
+  data_bytes_ = data_bytes;
+  format_ = format;
+  input_.resize(kBlockFrames * format_.FrameBytes());
+  output_.resize(kBlockFrames * 2);
+  return Rewind();
+}
+
+helper::ErrCode PCMRegionSource::Rewind() {
+  if (file_ == nullptr ||
+      fseeko(file_, static_cast<off_t>(data_offset_), SEEK_SET) != 0) {
+    return helper::kErrInvalidParam;
+  }
+  read_bytes_ = 0;
+  output_frames_ = 0;
+  output_pos_ = 0;
+  return helper::kOk;
+}
+
+size_t PCMRegionSource::Next(size_t max_bytes, const uint8_t*& data) {
+  if (file_ == nullptr) return 0;
+  if (output_pos_ == output_frames_) {
+    size_t frame_bytes = format_.FrameBytes();
+    uint64_t want =
+        std::min<uint64_t>(input_.size(), data_bytes_ - read_bytes_);
+    want = want / frame_bytes * frame_bytes;
+    size_t got = want == 0 ? 0 : fread(input_.data(), 1, want, file_);
+    read_bytes_ += got;
+    output_frames_ = got / frame_bytes;
+    output_pos_ = 0;
+    if (output_frames_ == 0) return 0;
+    ConvertToS16Stereo(format_, input_.data(), output_frames_, output_.data());
+  }
+  size_t frames =
+      std::min(max_bytes / kOutputFrameBytes, output_frames_ - output_pos_);
+  data = reinterpret_cast<const uint8_t*>(output_.data() + output_pos_ * 2);
+  output_pos_ += frames;
+  return frames * kOutputFrameBytes;
+}
+}  // namespace audio
+}  // namespace AirBeamCore
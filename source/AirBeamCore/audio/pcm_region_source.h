@@ -0,0 +1,44 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+#include "audio/audio_source.h"
+
+namespace AirBeamCore {
+namespace audio {
+// Streams the sample data of an uncompressed container, such as the data
+// chunk of a WAV file, converting kBlockFrames at a time. Subclasses parse
+// the header and hand over where the samples are.
+class PCMRegionSource : public AudioSource {
+ public:
+  static constexpr size_t kBlockFrames = 4096;
+  // For data_bytes, when the header leaves the length open.
+  static constexpr uint64_t kToEnd = UINT64_MAX;
+
+  ~PCMRegionSource() override;
+
+  size_t Next(size_t max_bytes, const uint8_t*& data) override;
+  helper::ErrCode Rewind() override;
+  PCMFormat GetInputFormat() const override { return format_; }
+
+ protected:
+  // Takes file over, also on failure.
+  helper::ErrCode Init(FILE* file, uint64_t data_offset, uint64_t data_bytes,
+                       const PCMFormat& format);
+
+ private:
+  FILE* file_ = nullptr;
+  uint64_t data_offset_ = 0;
+  uint64_t data_bytes_ = 0;
+  uint64_t read_bytes_ = 0;
+  PCMFormat format_;
+  std::vector<uint8_t> input_;
+  std::vector<int16_t> output_;
+  size_t output_frames_ = 0;
+  size_t output_pos_ = 0;
+};
+}  // namespace audio
+}  // namespace AirBeamCore
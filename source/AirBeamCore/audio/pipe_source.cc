@@ -0,0 +1,188 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "pipe_source.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+#include "helper/logger.h"
+
+namespace AirBeamCore {
+namespace audio {
+namespace {
+constexpr size_t kPageBytes = 4096;
+
+size_t RoundUp(size_t value, size_t unit) {
+  return (value + unit - 1) / unit * unit;
+}
+}  // namespace
+
+PipeSource::PipeSource(const Options& options)
+    : options_(options),
+      ring_size_(RoundUp(std::max<size_t>(options.ring_bytes, kPageBytes),
+                         options.format.FrameBytes())),
+      ring_(static_cast<uint8_t*>(
+                aligned_alloc(kPageBytes, RoundUp(ring_size_, kPageBytes))),
+            free) {}
+
+PipeSource::~PipeSource() { Stop(); }
+
+helper::ErrCode PipeSource::Open(int fd) {
+  Stop();
+  if (fd < 0 || !options_.format.IsSupported() || pipe(wake_) != 0) {
+    return helper::kErrInvalidParam;
+  }
+#ifdef F_SETPIPE_SZ
+  // A deeper pipe lets the writer run further ahead between our reads.
+  // Only works on pipes; anything else keeps its size.
+  fcntl(fd, F_SETPIPE_SZ, static_cast<int>(std::min<size_t>(
+                              ring_size_, 1024 * 1024)));
+#endif
+  fd_ = fd;
+  head_ = tail_ = 0;
+  lent_ = 0;
+  eof_ = started_ = stopping_ = false;
+  stats_ = Stats();
+  reader_ = std::thread(&PipeSource::ReaderLoop, this);
+  return helper::kOk;
+}
+
+helper::ErrCode PipeSource::Open(const std::string& path) {
+  // A FIFO's open blocks until a writer shows up.
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    ABWarningLog("PipeSource open %s failed, errno=%d", path.c_str(), errno);
+    return helper::kErrInvalidParam;
+  }
+  helper::ErrCode ret = Open(fd);
+  if (ret != helper::kOk) {
+    close(fd);
+    return ret;
+  }
+  own_fd_ = true;
+  return helper::kOk;
+}
+
+void PipeSource::Stop() {
+  if (reader_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    not_full_.notify_all();
+    char wake = 0;
+    (void)!write(wake_[1], &wake, 1);
+    reader_.join();
+  }
+  for (int& fd : wake_) {
+    if (fd >= 0) close(fd);
+    fd = -1;
+  }
+  if (own_fd_ && fd_ >= 0) close(fd_);
+  fd_ = -1;
+  own_fd_ = false;
+}
+
+void PipeSource::ReaderLoop() {
+  while (true) {
+    size_t pos, len;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (head_ - tail_ == ring_size_) stats_.stalls++;
+      not_full_.wait(lock, [this]() {
+        return stopping_ || head_ - tail_ < ring_size_;
+      });
+      if (stopping_) break;
+      // The free space up to the end of the ring; the reads after it wrap.
+      pos = head_ % ring_size_;
+      len = std::min<size_t>(ring_size_ - pos,
+                             ring_size_ - (head_ - tail_));
+    }
+
+    pollfd fds[2] = {{fd_, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      ABErrorLog("PipeSource poll failed, errno=%d", errno);
+      break;
+    }
+    if (fds[1].revents != 0) break;
+    ssize_t got = read(fd_, ring_.get() + pos, len);
+    if (got < 0) {
+      if (errno == EINTR || errno == EAGAIN) continue;
+      ABErrorLog("PipeSource read failed, errno=%d", errno);
+      break;
+    }
+    if (got == 0) break;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      head_ += got;
+      started_ = true;
+      stats_.bytes += got;
+      stats_.reads++;
+    }
+    not_empty_.notify_one();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    eof_ = true;
+  }
+  not_empty_.notify_one();
+}
+
+size_t PipeSource::Next(size_t max_bytes, const uint8_t*& data) {
+  const size_t frame_bytes = options_.format.FrameBytes();
+  size_t pos, frames;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (lent_ != 0) {
+      tail_ += lent_;
+      lent_ = 0;
+      not_full_.notify_one();
+    }
+    not_empty_.wait_for(lock, options_.read_timeout, [&]() {
+      return eof_ || head_ - tail_ >= frame_bytes;
+    });
+    uint64_t available = head_ - tail_;
+    if (available < frame_bytes) {
+      // A trailing partial frame at the end is dropped.
+      if (!eof_ && started_) stats_.underruns++;
+      return 0;
+    }
+    // The ring holds whole frames, so none straddles its end.
+    pos = tail_ % ring_size_;
+    frames = std::min<uint64_t>(available, ring_size_ - pos) / frame_bytes;
+    frames = std::min(frames, max_bytes / kOutputFrameBytes);
+    lent_ = frames * frame_bytes;
+  }
+
+  const uint8_t* input = ring_.get() + pos;
+  if (options_.format.IsNative()) {
+    data = input;
+  } else {
+    output_.resize(frames * 2);
+    ConvertToS16Stereo(options_.format, input, frames, output_.data());
+    data = reinterpret_cast<const uint8_t*>(output_.data());
+  }
+  return frames * kOutputFrameBytes;
+}
+
+bool PipeSource::AtEnd() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return eof_ && head_ - tail_ - lent_ < options_.format.FrameBytes();
+}
+
+PipeSource::Stats PipeSource::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats = stats_;
+  stats.buffered = head_ - tail_;
+  return stats;
+}
+}  // namespace audio
+}  // namespace AirBeamCore
@@ -0,0 +1,100 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio/audio_source.h"
+#include "helper/errcode.h"
+
+namespace AirBeamCore {
+namespace audio {
+// Live PCM from a pipe or FIFO, e.g. `ffmpeg ... -f s16le - | ...` or
+// `parec`. A reader thread read()s straight into a page-aligned ring in
+// large pieces, and Next hands out pointers into the ring, so a byte is
+// copied once, by the kernel. When the ring is full the reader stops
+// reading and the pipe fills up, blocking the writer: back-pressure
+// reaches the producer instead of growing memory.
+//
+// Next waits up to read_timeout for audio. Coming back empty-handed before
+// the end of the input is an underrun, which the sender handles as it does
+// any late audio. Cannot be rewound. Next is for one consumer thread.
+class PipeSource : public AudioSource {
+ public:
+  struct Options {
+    // Rounded up to whole input frames.
+    size_t ring_bytes = 1024 * 1024;
+    // About one 352-frame packet.
+    std::chrono::milliseconds read_timeout{8};
+    // Raw input carries no header; anything but 16-bit stereo is converted.
+    PCMFormat format;
+  };
+
+  struct Stats {
+    uint64_t bytes = 0;
+    // read() calls that returned data.
+    uint64_t reads = 0;
+    // Next calls that timed out with nothing buffered.
+    uint64_t underruns = 0;
+    // Times the ring was full and the reader waited.
+    uint64_t stalls = 0;
+    size_t buffered = 0;
+  };
+
+  explicit PipeSource(const Options& options);
+  ~PipeSource() override;
+  PipeSource(const PipeSource&) = delete;
+  PipeSource& operator=(const PipeSource&) = delete;
+
+  // Reads fd until its end; fd stays owned by the caller and must outlive
+  // the source.
+  helper::ErrCode Open(int fd);
+  // Opens a FIFO or other file by path, owned by the source.
+  helper::ErrCode Open(const std::string& path);
+
+  size_t Next(size_t max_bytes, const uint8_t*& data) override;
+  helper::ErrCode Rewind() override { return helper::kErrInvalidParam; }
+  PCMFormat GetInputFormat() const override { return options_.format; }
+  bool AtEnd() const override;
+
+  Stats GetStats() const;
+
+ private:
+  void ReaderLoop();
+  void Stop();
+
+  Options options_;
+  size_t ring_size_;
+  std::unique_ptr<uint8_t, void (*)(void*)> ring_;
+  // Absolute byte counts: written by the reader, consumed by Next. Bytes
+  // handed out by the last Next stay reserved until the next call.
+  uint64_t head_ = 0;
+  uint64_t tail_ = 0;
+  size_t lent_ = 0;
+  bool eof_ = false;
+  bool started_ = false;
+  bool stopping_ = false;
+  Stats stats_;
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+
+  int fd_ = -1;
+  bool own_fd_ = false;
+  // Written to by Stop to wake the reader out of poll().
+  int wake_[2] = {-1, -1};
+  std::thread reader_;
+
+  // Conversion for non-native input.
+  std::vector<int16_t> output_;
+};
+}  // namespace audio
+}  // namespace AirBeamCore
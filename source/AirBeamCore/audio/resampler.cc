@@ -0,0 +1,361 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#if defined(__ARM_NEON) || defined(SIMD_ARM)
+#include <arm_neon.h>
+#define AIRBEAM_RESAMPLER_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AIRBEAM_RESAMPLER_SSE2
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define AIRBEAM_RESAMPLER_AVX2
+#endif
+#endif
+
+namespace AirBeamCore {
+namespace audio {
+namespace {
+// Every kernel returns the dot product of n floats; the vector ones finish
+// a remainder below their width in scalar.
+float DotScalar(const float* a, const float* b, size_t n) {
+  float sum[4] = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    sum[0] += a[i] * b[i];
+    sum[1] += a[i + 1] * b[i + 1];
+    sum[2] += a[i + 2] * b[i + 2];
+    sum[3] += a[i + 3] * b[i + 3];
+  }
+  for (; i < n; ++i) sum[0] += a[i] * b[i];
+  return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+#ifdef AIRBEAM_RESAMPLER_NEON
+float DotNeon(const float* a, const float* b, size_t n) {
+  float32x4_t sum0 = vdupq_n_f32(0), sum1 = vdupq_n_f32(0);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+#ifdef __aarch64__
+    sum0 = vfmaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+    sum1 = vfmaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+#else
+    sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+    sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+#endif
+  }
+  float32x4_t sum = vaddq_f32(sum0, sum1);
+  float32x2_t half = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+  float total = vget_lane_f32(vpadd_f32(half, half), 0);
+  return total + DotScalar(a + i, b + i, n - i);
+}
+#endif
+
+#ifdef AIRBEAM_RESAMPLER_SSE2
+float HorizontalSum(__m128 v) {
+  __m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+  __m128 sums = _mm_add_ps(v, shuffled);
+  shuffled = _mm_movehl_ps(shuffled, sums);
+  return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+}
+
+float DotSse2(const float* a, const float* b, size_t n) {
+  __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    sum0 = _mm_add_ps(sum0,
+                      _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    sum1 = _mm_add_ps(
+        sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  return HorizontalSum(_mm_add_ps(sum0, sum1)) +
+         DotScalar(a + i, b + i, n - i);
+}
+#endif
+
+#ifdef AIRBEAM_RESAMPLER_AVX2
+float DotAvx2(const float* a, const float* b, size_t n) {
+  __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i),
+                           sum0);
+    sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8),
+                           _mm256_loadu_ps(b + i + 8), sum1);
+  }
+  __m256 sum = _mm256_add_ps(sum0, sum1);
+  __m128 half =
+      _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+  return HorizontalSum(half) + DotScalar(a + i, b + i, n - i);
+}
+#endif
+
+// The zeroth-order modified Bessel function, for the Kaiser window.
+double BesselI0(double x) {
+  double sum = 1, term = 1;
+  for (int k = 1; k < 64 && term > sum * 1e-12; ++k) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+int16_t ToS16(float sample) {
+  float scaled = std::clamp(sample * 32768.0f, -32768.0f, 32767.0f);
+  return static_cast<int16_t>(std::lrint(scaled));
+}
+
+// Pulls input a block at a time and hands out the resampled frames.
+class ResampledSource : public AudioSource {
+ public:
+  ResampledSource(std::unique_ptr<AudioSource> inner,
+                  const Resampler::Options& options)
+      : inner_(std::move(inner)), resampler_(options) {}
+
+  helper::ErrCode Init() { return resampler_.Init(); }
+  std::unique_ptr<AudioSource> Release() { return std::move(inner_); }
+
+  size_t Next(size_t max_bytes, const uint8_t*& data) override {
+    output_.erase(output_.begin(), output_.begin() + handed_out_);
+    handed_out_ = 0;
+    const size_t max_frames = max_bytes / kOutputFrameBytes;
+    while (output_.size() / 2 < max_frames && !flushed_) {
+      const uint8_t* input;
+      size_t len = inner_->Next(kBlockFrames * kOutputFrameBytes, input);
+      if (len == 0) {
+        // An underrun passes through; the end drains the filter.
+        if (inner_->AtEnd()) {
+          resampler_.Flush(output_);
+          flushed_ = true;
+        }
+        break;
+      }
+      resampler_.Process(reinterpret_cast<const int16_t*>(input),
+                         len / kOutputFrameBytes, output_);
+    }
+    size_t frames = std::min(max_frames, output_.size() / 2);
+    handed_out_ = frames * 2;
+    data = reinterpret_cast<const uint8_t*>(output_.data());
+    return frames * kOutputFrameBytes;
+  }
+
+  bool AtEnd() const override {
+    return flushed_ && output_.size() <= handed_out_;
+  }
+
+  helper::ErrCode Rewind() override {
+    helper::ErrCode ret = inner_->Rewind();
+    if (ret != helper::kOk) return ret;
+    resampler_.Reset();
+    output_.clear();
+    handed_out_ = 0;
+    flushed_ = false;
+    return helper::kOk;
+  }
+
+  PCMFormat GetInputFormat() const override {
+    return inner_->GetInputFormat();
+  }
+
+ private:
+  static constexpr size_t kBlockFrames = 1024;
+
+  std::unique_ptr<AudioSource> inner_;
+  Resampler resampler_;
+  // Interleaved output; the first handed_out_ samples went out with the
+  // last Next.
+  std::vector<int16_t> output_;
+  size_t handed_out_ = 0;
+  bool flushed_ = false;
+};
+}  // namespace
+
+Resampler::Resampler(const Options& options) : options_(options) {}
+
+helper::ErrCode Resampler::Init() {
+  const size_t taps = options_.taps;
+  if (options_.input_rate == 0 || options_.output_rate == 0 || taps == 0 ||
+      taps % 2 != 0) {
+    return helper::kErrInvalidParam;
+  }
+  uint32_t gcd = std::gcd(options_.input_rate, options_.output_rate);
+  up_ = options_.output_rate / gcd;
+  down_ = options_.input_rate / gcd;
+  if (up_ > kMaxPhases) return helper::kErrInvalidParam;
+
+  // The prototype runs at up_ times the input rate, centered on tap
+  // length / 2 so that the output lines up with the input.
+  const size_t length = up_ * taps;
+  const double center = length / 2.0;
+  const double nyquist =
+      std::min(options_.input_rate, options_.output_rate) / 2.0;
+  const double cutoff = options_.cutoff * nyquist /
+                        (static_cast<double>(up_) * options_.input_rate);
+  const double window_scale = 1 / BesselI0(options_.kaiser_beta);
+  std::vector<double> prototype(length);
+  for (size_t j = 0; j < length; ++j) {
+    double x = j - center;
+    double sinc = x == 0 ? 2 * cutoff
+                         : std::sin(2 * M_PI * cutoff * x) / (M_PI * x);
+    double r = x / center;
+    double window =
+        BesselI0(options_.kaiser_beta * std::sqrt(std::max(0.0, 1 - r * r))) *
+        window_scale;
+    prototype[j] = sinc * window;
+  }
+
+  // Each phase sums to one, so DC comes through every phase at unity.
+  coefficients_.assign(length, 0);
+  for (uint32_t phase = 0; phase < up_; ++phase) {
+    double sum = 0;
+    for (size_t k = 0; k < taps; ++k) sum += prototype[phase + k * up_];
+    for (size_t k = 0; k < taps; ++k) {
+      coefficients_[phase * taps + taps - 1 - k] =
+          static_cast<float>(prototype[phase + k * up_] / sum);
+    }
+  }
+  Reset();
+  return helper::kOk;
+}
+
+void Resampler::Reset() {
+  // With taps / 2 - 1 frames of silence ahead of the input and the newest
+  // frame at taps - 1, the center tap of the first output lands on the
+  // first input frame.
+  left_.assign(options_.taps / 2 - 1, 0);
+  right_.assign(options_.taps / 2 - 1, 0);
+  base_ = options_.taps - 1;
+  phase_ = 0;
+}
+
+void Resampler::Process(const int16_t* input, size_t frames,
+                        std::vector<int16_t>& output) {
+  if (coefficients_.empty()) return;
+  size_t offset = left_.size();
+  left_.resize(offset + frames);
+  right_.resize(offset + frames);
+  for (size_t i = 0; i < frames; ++i) {
+    left_[offset + i] = input[2 * i] * (1.0f / 32768);
+    right_[offset + i] = input[2 * i + 1] * (1.0f / 32768);
+  }
+  switch (options_.level) {
+#ifdef AIRBEAM_RESAMPLER_NEON
+    case ResamplerLevel::kNeon:
+      Produce<DotNeon>(output);
+      break;
+#endif
+#ifdef AIRBEAM_RESAMPLER_SSE2
+    case ResamplerLevel::kSse2:
+      Produce<DotSse2>(output);
+      break;
+#endif
+#ifdef AIRBEAM_RESAMPLER_AVX2
+    case ResamplerLevel::kAvx2:
+      Produce<DotAvx2>(output);
+      break;
+#endif
+    default:
+      Produce<DotScalar>(output);
+      break;
+  }
+}
+
+template <float (*kDot)(const float*, const float*, size_t)>
+void Resampler::Produce(std::vector<int16_t>& output) {
+  const size_t taps = options_.taps;
+  while (base_ < left_.size()) {
+    const float* coefficients = &coefficients_[phase_ * taps];
+    size_t first = base_ + 1 - taps;
+    output.push_back(ToS16(kDot(coefficients, &left_[first], taps)));
+    output.push_back(ToS16(kDot(coefficients, &right_[first], taps)));
+    phase_ += down_;
+    base_ += phase_ / up_;
+    phase_ %= up_;
+  }
+  // Keep what the next output reaches back to. When downsampling, base_
+  // can be past the input received; those frames are dropped as they come.
+  size_t drop = std::min(base_ + 1 - taps, left_.size());
+  left_.erase(left_.begin(), left_.begin() + drop);
+  right_.erase(right_.begin(), right_.begin() + drop);
+  base_ -= drop;
+}
+
+void Resampler::Flush(std::vector<int16_t>& output) {
+  std::vector<int16_t> silence(options_.taps, 0);
+  Process(silence.data(), options_.taps / 2, output);
+  Reset();
+}
+
+bool Resampler::IsSupported(ResamplerLevel level) {
+  switch (level) {
+    case ResamplerLevel::kScalar:
+      return true;
+    case ResamplerLevel::kSse2:
+#ifdef AIRBEAM_RESAMPLER_SSE2
+      return true;
+#else
+      return false;
+#endif
+    case ResamplerLevel::kAvx2:
+#ifdef AIRBEAM_RESAMPLER_AVX2
+      return true;
+#else
+      return false;
+#endif
+    case ResamplerLevel::kNeon:
+#ifdef AIRBEAM_RESAMPLER_NEON
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+ResamplerLevel Resampler::BestLevel() {
+#if defined(AIRBEAM_RESAMPLER_NEON)
+  return ResamplerLevel::kNeon;
+#elif defined(AIRBEAM_RESAMPLER_AVX2)
+  return ResamplerLevel::kAvx2;
+#elif defined(AIRBEAM_RESAMPLER_SSE2)
+  return ResamplerLevel::kSse2;
+#else
+  return ResamplerLevel::kScalar;
+#endif
+}
+
+const char* Resampler::LevelName(ResamplerLevel level) {
+  switch (level) {
+    case ResamplerLevel::kScalar:
+      return "scalar";
+    case ResamplerLevel::kSse2:
+      return "sse2";
+    case ResamplerLevel::kAvx2:
+      return "avx2";
+    case ResamplerLevel::kNeon:
+      return "neon";
+  }
+  return "unknown";
+}
+
+helper::ErrCode ResampleAudioSource(uint32_t output_rate,
+                                    std::unique_ptr<AudioSource>& source) {
+  uint32_t input_rate = source->GetInputFormat().sample_rate;
+  if (input_rate == output_rate) return helper::kOk;
+  Resampler::Options options;
+  options.input_rate = input_rate;
+  options.output_rate = output_rate;
+  auto resampled =
+      std::make_unique<ResampledSource>(std::move(source), options);
+  helper::ErrCode ret = resampled->Init();
+  // On failure the caller keeps its source, not resampled.
+  source = ret == helper::kOk ? std::move(resampled) : resampled->Release();
+  return ret;
+}
+}  // namespace audio
+}  // namespace AirBeamCore
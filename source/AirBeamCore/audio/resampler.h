@@ -0,0 +1,87 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "audio/audio_source.h"
+#include "helper/errcode.h"
+
+namespace AirBeamCore {
+namespace audio {
+// Kernels the resampler can run with. As with PCMCodec, which ones exist
+// depends on the target the library was compiled for; AVX2 needs the
+// AIRBEAM_AVX2 build option.
+enum class ResamplerLevel { kScalar, kSse2, kAvx2, kNeon };
+
+// Converts pipeline frames, s16 stereo, between two sample rates with a
+// polyphase windowed-sinc filter: for input_rate:output_rate reduced to
+// M:L, the Kaiser-windowed prototype is split into L phases of taps
+// coefficients each, and every output frame is one dot product per
+// channel against the latest taps input frames.
+//
+// Process takes input in any size of piece; the last taps input frames
+// carry over to the next call, so chunk boundaries leave no trace. The
+// output is aligned with the input: output frame n is input time
+// n * input_rate / output_rate, with no added delay.
+class Resampler {
+ public:
+  struct Options {
+    uint32_t input_rate = 48'000;
+    uint32_t output_rate = 44'100;
+    // Per phase. Longer is a steeper transition and a deeper stopband.
+    size_t taps = 128;
+    // The cutoff, as a fraction of the lower of the two Nyquist rates.
+    double cutoff = 0.948;
+    // Kaiser window beta; 10 is about 100 dB of stopband.
+    double kaiser_beta = 10.0;
+    ResamplerLevel level = BestLevel();
+  };
+
+  explicit Resampler(const Options& options);
+
+  // Builds the filter. Fails for a zero rate, an odd or zero tap count, or
+  // rates whose reduced ratio needs more than kMaxPhases phases.
+  helper::ErrCode Init();
+  // Appends to output the frames that input completes.
+  void Process(const int16_t* input, size_t frames,
+               std::vector<int16_t>& output);
+  // Runs silence through to get out the output the filter still holds for
+  // the input so far.
+  void Flush(std::vector<int16_t>& output);
+  // Forgets all input, as after Init.
+  void Reset();
+
+  static constexpr uint32_t kMaxPhases = 4096;
+  static bool IsSupported(ResamplerLevel level);
+  static ResamplerLevel BestLevel();
+  static const char* LevelName(ResamplerLevel level);
+
+ private:
+  template <float (*kDot)(const float*, const float*, size_t)>
+  void Produce(std::vector<int16_t>& output);
+
+  Options options_;
+  // The reduced ratio: L output frames for every M input frames.
+  uint32_t up_ = 1;
+  uint32_t down_ = 1;
+  // up_ phases of taps coefficients, each reversed to run forwards over
+  // the input.
+  std::vector<float> coefficients_;
+  // Deinterleaved input still needed, as floats.
+  std::vector<float> left_;
+  std::vector<float> right_;
+  // The newest input index and the phase of the next output frame.
+  size_t base_ = 0;
+  uint32_t phase_ = 0;
+};
+
+// Wraps source in a Resampler to output_rate, unless it already is at that
+// rate. The wrapper's GetInputFormat is still the inner source's.
+helper::ErrCode ResampleAudioSource(uint32_t output_rate,
+                                    std::unique_ptr<AudioSource>& source);
+}  // namespace audio
+}  // namespace AirBeamCore
@@ -0,0 +1,194 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "wav_decoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "helper/logger.h"
+
+namespace AirBeamCore {
+namespace audio {
+namespace {
+constexpr uint16_t kWaveFormatPCM = 1;
+constexpr uint16_t kWaveFormatFloat = 3;
+constexpr uint16_t kWaveFormatExtensible = 0xFFFE;
+
+uint32_t Little(const uint8_t* p, size_t bytes) {
+  uint32_t value = 0;
+  for (size_t i = bytes; i-- > 0;) value = (value << 8) | p[i];
+  return value;
+}
+
+uint32_t Big(const uint8_t* p, size_t bytes) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) value = (value << 8) | p[i];
+  return value;
+}
+
+// The 80-bit IEEE extended float AIFF stores its sample rate in.
+double Extended(const uint8_t* p) {
+  int exponent = static_cast<int>(Big(p, 2) & 0x7FFF);
+  uint64_t mantissa = (static_cast<uint64_t>(Big(p + 2, 4)) << 32) |
+                      Big(p + 6, 4);
+  if (exponent == 0 && mantissa == 0) return 0;
+  double value = std::ldexp(static_cast<double>(mantissa),
+                            exponent - 16383 - 63);
+  return (p[0] & 0x80) ? -value : value;
+}
+
+bool ReadExact(FILE* file, uint8_t* out, size_t len) {
+  return fread(out, 1, len, file) == len;
+}
+
+// Walks the chunks after a RIFF or FORM header, calling on_chunk with each
+// id, size and file offset of its body until it returns false.
+template <typename OnChunk>
+bool WalkChunks(FILE* file, bool big_endian, OnChunk on_chunk) {
+  uint8_t header[8];
+  while (ReadExact(file, header, sizeof(header))) {
+    uint32_t size = big_endian ? Big(header + 4, 4) : Little(header + 4, 4);
+    off_t body = ftello(file);
+    if (!on_chunk(header, size, body)) return true;
+    // Chunks are padded to an even length.
+    if (fseeko(file, body + size + (size & 1), SEEK_SET) != 0) return false;
+  }
+  return false;
+}
+}  // namespace
+
+helper::ErrCode WavDecoder::Open(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return helper::kErrInvalidParam;
+  uint8_t riff[12];
+  if (!ReadExact(file, riff, sizeof(riff)) || memcmp(riff, "RIFF", 4) != 0 ||
+      memcmp(riff + 8, "WAVE", 4) != 0) {
+    fclose(file);
+    return helper::kErrInvalidParam;
+  }
+
+  PCMFormat format;
+  bool have_format = false;
+  uint64_t data_offset = 0;
+  uint64_t data_bytes = 0;
+  bool have_data = false;
+  WalkChunks(file, false, [&](const uint8_t* header, uint32_t size,
+                               off_t body) {
+    if (memcmp(header, "fmt ", 4) == 0 && size >= 16) {
+      uint8_t fmt[40] = {0};
+      if (!ReadExact(file, fmt, std::min<uint32_t>(size, sizeof(fmt)))) {
+        return false;
+      }
+      uint16_t tag = Little(fmt, 2);
+      // The sub-format GUID starts with the plain format tag.
+      if (tag == kWaveFormatExtensible && size >= 40) tag = Little(fmt + 24, 2);
+      format.channels = Little(fmt + 2, 2);
+      format.sample_rate = Little(fmt + 4, 4);
+      format.bits = Little(fmt + 14, 2);
+      // Containers round odd widths up to whole bytes.
+      uint16_t block_align = Little(fmt + 12, 2);
+      if (format.channels != 0) format.bits = block_align / format.channels * 8;
+      format.big_endian = false;
+      if (tag == kWaveFormatPCM) {
+        format.encoding = format.bits == 8 ? PCMFormat::Encoding::kUnsigned
+                                           : PCMFormat::Encoding::kSigned;
+        have_format = true;
+      } else if (tag == kWaveFormatFloat) {
+        format.encoding = PCMFormat::Encoding::kFloat;
+        have_format = true;
+      } else {
+        ABWarningLog("WavDecoder unsupported format tag %u", tag);
+      }
+      return true;
+    }
+    if (memcmp(header, "data", 4) == 0) {
+      data_offset = body;
+      // Streams written without knowing their length leave it open.
+      data_bytes = size == 0 || size == UINT32_MAX ? kToEnd : size;
+      have_data = true;
+      return false;
+    }
+    return true;
+  });
+
+  if (!have_format || !have_data) {
+    fclose(file);
+    return helper::kErrInvalidParam;
+  }
+  return Init(file, data_offset, data_bytes, format);
+}
+
+helper::ErrCode AiffDecoder::Open(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return helper::kErrInvalidParam;
+  uint8_t form[12];
+  if (!ReadExact(file, form, sizeof(form)) || memcmp(form, "FORM", 4) != 0 ||
+      (memcmp(form + 8, "AIFF", 4) != 0 && memcmp(form + 8, "AIFC", 4) != 0)) {
+    fclose(file);
+    return helper::kErrInvalidParam;
+  }
+  bool aifc = memcmp(form + 8, "AIFC", 4) == 0;
+
+  PCMFormat format;
+  format.big_endian = true;
+  bool have_format = false;
+  uint64_t frames = 0;
+  uint64_t data_offset = 0;
+  bool have_data = false;
+  WalkChunks(file, true, [&](const uint8_t* header, uint32_t size,
+                              off_t body) {
+    if (memcmp(header, "COMM", 4) == 0 && size >= 18) {
+      uint8_t comm[22] = {0};
+      if (!ReadExact(file, comm, std::min<uint32_t>(size, sizeof(comm)))) {
+        return false;
+      }
+      format.channels = Big(comm, 2);
+      frames = Big(comm + 2, 4);
+      // Samples are left justified in whole bytes.
+      format.bits = (Big(comm + 6, 2) + 7) / 8 * 8;
+      format.sample_rate =
+          static_cast<uint32_t>(std::lround(Extended(comm + 8)));
+      format.encoding = PCMFormat::Encoding::kSigned;
+      have_format = true;
+      if (aifc && size >= 22) {
+        if (memcmp(comm + 18, "sowt", 4) == 0) {
+          format.big_endian = false;
+        } else if (memcmp(comm + 18, "fl32", 4) == 0 ||
+                   memcmp(comm + 18, "FL32", 4) == 0) {
+          format.encoding = PCMFormat::Encoding::kFloat;
+          format.bits = 32;
+        } else if (memcmp(comm + 18, "fl64", 4) == 0 ||
+                   memcmp(comm + 18, "FL64", 4) == 0) {
+          format.encoding = PCMFormat::Encoding::kFloat;
+          format.bits = 64;
+        } else if (memcmp(comm + 18, "NONE", 4) != 0 &&
+                   memcmp(comm + 18, "twos", 4) != 0) {
+          ABWarningLog("AiffDecoder unsupported compression %s",
+                       std::string(reinterpret_cast<const char*>(comm + 18),
+                                   4));
+          have_format = false;
+        }
+      }
+      return true;
+    }
+    if (memcmp(header, "SSND", 4) == 0 && size >= 8) {
+      uint8_t ssnd[8];
+      if (!ReadExact(file, ssnd, sizeof(ssnd))) return false;
+      data_offset = body + 8 + Big(ssnd, 4);
+      have_data = true;
+      // COMM may come after SSND.
+      return !have_format;
+    }
+    return true;
+  });
+
+  if (!have_format || !have_data) {
+    fclose(file);
+    return helper::kErrInvalidParam;
+  }
+  // COMM gives the length in frames; SSND's size can include padding.
+  return Init(file, data_offset, frames * format.FrameBytes(), format);
+}
+}  // namespace audio
+}  // namespace AirBeamCore
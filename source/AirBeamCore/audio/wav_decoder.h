@@ -0,0 +1,25 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <string>
+
+#include "audio/pcm_region_source.h"
+
+namespace AirBeamCore {
+namespace audio {
+// RIFF WAVE files with integer or float PCM, including
+// WAVE_FORMAT_EXTENSIBLE.
+class WavDecoder : public PCMRegionSource {
+ public:
+  helper::ErrCode Open(const std::string& path);
+};
+
+// AIFF and AIFF-C files, uncompressed: big endian ("NONE", "twos"),
+// little endian ("sowt") or float ("fl32", "fl64").
+class AiffDecoder : public PCMRegionSource {
+ public:
+  helper::ErrCode Open(const std::string& path);
+};
+}  // namespace audio
+}  // namespace AirBeamCore
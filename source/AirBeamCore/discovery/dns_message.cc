@@ -0,0 +1,349 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "dns_message.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+
+namespace AirBeamCore {
+namespace discovery {
+namespace {
+constexpr size_t kHeaderBytes = 12;
+constexpr size_t kMaxLabelBytes = 63;
+constexpr size_t kMaxNameBytes = 255;
+constexpr uint16_t kCacheFlushBit = 0x8000;
+constexpr uint8_t kPointerBits = 0xc0;
+constexpr uint16_t kMaxPointerOffset = 0x3fff;
+
+bool IsKnownType(uint16_t type) {
+  switch (static_cast<RecordType>(type)) {
+    case RecordType::kA:
+    case RecordType::kPtr:
+    case RecordType::kTxt:
+    case RecordType::kAaaa:
+    case RecordType::kSrv:
+    case RecordType::kAny:
+      return true;
+  }
+  return false;
+}
+
+class Writer {
+ public:
+  void U8(uint8_t value) { out_.push_back(static_cast<char>(value)); }
+  void U16(uint16_t value) {
+    U8(value >> 8);
+    U8(value & 0xff);
+  }
+  void U32(uint32_t value) {
+    U16(value >> 16);
+    U16(value & 0xffff);
+  }
+  void Patch16(size_t pos, uint16_t value) {
+    out_[pos] = static_cast<char>(value >> 8);
+    out_[pos + 1] = static_cast<char>(value & 0xff);
+  }
+
+  // Points at an earlier copy of the longest suffix already written.
+  void Name(const std::string& name) {
+    auto labels = SplitDnsName(name);
+    for (size_t i = 0; i < labels.size(); ++i) {
+      std::string key = DnsNameKey(JoinDnsName(
+          std::vector<std::string>(labels.begin() + i, labels.end())));
+      auto it = suffixes_.find(key);
+      if (it != suffixes_.end()) {
+        U16((kPointerBits << 8) | it->second);
+        return;
+      }
+      if (out_.size() <= kMaxPointerOffset) suffixes_[key] = out_.size();
+      std::string label = labels[i].substr(0, kMaxLabelBytes);
+      U8(label.size());
+      out_ += label;
+    }
+    U8(0);
+  }
+
+  // Returns false, writing nothing, for records it cannot encode.
+  bool Record(const DnsRecord& record) {
+    size_t start = out_.size();
+    if (!IsKnownType(static_cast<uint16_t>(record.type)) ||
+        record.type == RecordType::kAny) {
+      return false;
+    }
+    Name(record.name);
+    U16(static_cast<uint16_t>(record.type));
+    U16(kClassIn | (record.cache_flush ? kCacheFlushBit : 0));
+    U32(record.ttl);
+    size_t length_pos = out_.size();
+    U16(0);
+    size_t rdata_start = out_.size();
+    switch (record.type) {
+      case RecordType::kPtr:
+        Name(record.target);
+        break;
+      case RecordType::kSrv:
+        U16(record.priority);
+        U16(record.weight);
+        U16(record.port);
+        Name(record.target);
+        break;
+      case RecordType::kTxt:
+        for (const auto& text : record.txt) {
+          std::string piece = text.substr(0, 255);
+          U8(piece.size());
+          out_ += piece;
+        }
+        // An empty TXT record still holds one empty string.
+        if (record.txt.empty()) U8(0);
+        break;
+      case RecordType::kA:
+      case RecordType::kAaaa: {
+        uint8_t address[16];
+        int family = record.type == RecordType::kA ? AF_INET : AF_INET6;
+        if (inet_pton(family, record.address.c_str(), address) != 1) {
+          Truncate(start);
+          return false;
+        }
+        out_.append(reinterpret_cast<const char*>(address),
+                    family == AF_INET ? 4 : 16);
+        break;
+      }
+      default:
+        break;
+    }
+    Patch16(length_pos, out_.size() - rdata_start);
+    return true;
+  }
+
+  std::string& Out() { return out_; }
+
+ private:
+  // Forgets a partly written record, and the names it introduced.
+  void Truncate(size_t size) {
+    out_.resize(size);
+    for (auto it = suffixes_.begin(); it != suffixes_.end();) {
+      it = it->second >= size ? suffixes_.erase(it) : std::next(it);
+    }
+  }
+
+  std::string out_;
+  std::map<std::string, size_t> suffixes_;
+};
+
+class Reader {
+ public:
+  Reader(const uint8_t* data, size_t len) : data_(data), len_(len) {}
+
+  bool U8(size_t& pos, uint8_t& value) const {
+    if (pos + 1 > len_) return false;
+    value = data_[pos++];
+    return true;
+  }
+  bool U16(size_t& pos, uint16_t& value) const {
+    if (pos + 2 > len_) return false;
+    value = static_cast<uint16_t>((data_[pos] << 8) | data_[pos + 1]);
+    pos += 2;
+    return true;
+  }
+  bool U32(size_t& pos, uint32_t& value) const {
+    uint16_t high, low;
+    if (!U16(pos, high) || !U16(pos, low)) return false;
+    value = (static_cast<uint32_t>(high) << 16) | low;
+    return true;
+  }
+
+  // Leaves pos after the name where it starts, not where pointers lead.
+  bool Name(size_t& pos, std::string& name) const {
+    std::vector<std::string> labels;
+    size_t cursor = pos;
+    size_t total = 0;
+    bool jumped = false;
+    while (true) {
+      uint8_t len;
+      size_t label_start = cursor;
+      if (!U8(cursor, len)) return false;
+      if ((len & kPointerBits) == kPointerBits) {
+        uint8_t low;
+        if (!U8(cursor, low)) return false;
+        size_t target = ((len & ~kPointerBits) << 8) | low;
+        // Only backwards, which also rules out loops.
+        if (target >= label_start) return false;
+        if (!jumped) pos = cursor;
+        jumped = true;
+        cursor = target;
+        continue;
+      }
+      if ((len & kPointerBits) != 0) return false;
+      if (len == 0) break;
+      if (cursor + len > len_) return false;
+      total += len + 1;
+      if (total > kMaxNameBytes) return false;
+      labels.emplace_back(reinterpret_cast<const char*>(data_ + cursor), len);
+      cursor += len;
+    }
+    if (!jumped) pos = cursor;
+    name = JoinDnsName(labels);
+    return true;
+  }
+
+  // Returns false on malformed input; known is false for skipped types.
+  bool Record(size_t& pos, DnsRecord& record, bool& known) const {
+    uint16_t type, cls, rdlength;
+    if (!Name(pos, record.name) || !U16(pos, type) || !U16(pos, cls) ||
+        !U32(pos, record.ttl) || !U16(pos, rdlength) ||
+        pos + rdlength > len_) {
+      return false;
+    }
+    const size_t end = pos + rdlength;
+    record.type = static_cast<RecordType>(type);
+    record.cache_flush = (cls & kCacheFlushBit) != 0;
+    known = true;
+    size_t cursor = pos;
+    pos = end;
+    switch (record.type) {
+      case RecordType::kPtr:
+        return Name(cursor, record.target) && cursor <= end;
+      case RecordType::kSrv:
+        return U16(cursor, record.priority) && U16(cursor, record.weight) &&
+               U16(cursor, record.port) && Name(cursor, record.target) &&
+               cursor <= end;
+      case RecordType::kTxt:
+        while (cursor < end) {
+          uint8_t len;
+          U8(cursor, len);
+          if (cursor + len > end) return false;
+          if (len != 0) {
+            record.txt.emplace_back(
+                reinterpret_cast<const char*>(data_ + cursor), len);
+          }
+          cursor += len;
+        }
+        return true;
+      case RecordType::kA:
+      case RecordType::kAaaa: {
+        const bool v4 = record.type == RecordType::kA;
+        if (rdlength != (v4 ? 4 : 16)) return false;
+        char text[INET6_ADDRSTRLEN];
+        if (inet_ntop(v4 ? AF_INET : AF_INET6, data_ + cursor, text,
+                      sizeof(text)) == nullptr) {
+          return false;
+        }
+        record.address = text;
+        return true;
+      }
+      default:
+        known = false;
+        return true;
+    }
+  }
+
+ private:
+  const uint8_t* data_;
+  size_t len_;
+};
+}  // namespace
+
+std::vector<std::string> SplitDnsName(const std::string& name) {
+  std::vector<std::string> labels;
+  std::string label;
+  for (size_t i = 0; i < name.size(); ++i) {
+    if (name[i] == '\\' && i + 1 < name.size()) {
+      label += name[++i];
+    } else if (name[i] == '.') {
+      labels.push_back(std::move(label));
+      label.clear();
+    } else {
+      label += name[i];
+    }
+  }
+  if (!label.empty()) labels.push_back(std::move(label));
+  return labels;
+}
+
+std::string JoinDnsName(const std::vector<std::string>& labels) {
+  std::string name;
+  for (const auto& label : labels) {
+    if (!name.empty()) name += '.';
+    for (char c : label) {
+      if (c == '.' || c == '\\') name += '\\';
+      name += c;
+    }
+  }
+  return name;
+}
+
+bool DnsNameEquals(const std::string& a, const std::string& b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           return std::tolower(static_cast<unsigned char>(x)) ==
+                  std::tolower(static_cast<unsigned char>(y));
+         });
+}
+
+std::string DnsNameKey(const std::string& name) {
+  std::string key = name;
+  for (char& c : key) c = std::tolower(static_cast<unsigned char>(c));
+  return key;
+}
+
+std::string EncodeDnsMessage(const DnsMessage& message) {
+  Writer writer;
+  writer.U16(message.id);
+  writer.U16(message.flags);
+  for (int i = 0; i < 4; ++i) writer.U16(0);
+  for (const auto& question : message.questions) {
+    writer.Name(question.name);
+    writer.U16(static_cast<uint16_t>(question.type));
+    writer.U16(kClassIn | (question.unicast_response ? kCacheFlushBit : 0));
+  }
+  writer.Patch16(4, message.questions.size());
+  size_t count_pos = 6;
+  for (const auto* section :
+       {&message.answers, &message.authorities, &message.additionals}) {
+    uint16_t count = 0;
+    for (const auto& record : *section) count += writer.Record(record);
+    writer.Patch16(count_pos, count);
+    count_pos += 2;
+  }
+  return std::move(writer.Out());
+}
+
+bool DecodeDnsMessage(const uint8_t* data, size_t len, DnsMessage& message) {
+  message = DnsMessage();
+  Reader reader(data, len);
+  size_t pos = 0;
+  uint16_t counts[4];
+  if (len < kHeaderBytes || !reader.U16(pos, message.id) ||
+      !reader.U16(pos, message.flags)) {
+    return false;
+  }
+  for (uint16_t& count : counts) reader.U16(pos, count);
+  for (uint16_t i = 0; i < counts[0]; ++i) {
+    DnsQuestion question;
+    uint16_t type, cls;
+    if (!reader.Name(pos, question.name) || !reader.U16(pos, type) ||
+        !reader.U16(pos, cls)) {
+      return false;
+    }
+    if (!IsKnownType(type)) continue;
+    question.type = static_cast<RecordType>(type);
+    question.unicast_response = (cls & kCacheFlushBit) != 0;
+    message.questions.push_back(std::move(question));
+  }
+  std::vector<DnsRecord>* sections[3] = {
+      &message.answers, &message.authorities, &message.additionals};
+  for (int s = 0; s < 3; ++s) {
+    for (uint16_t i = 0; i < counts[s + 1]; ++i) {
+      DnsRecord record;
+      bool known;
+      if (!reader.Record(pos, record, known)) return false;
+      if (known) sections[s]->push_back(std::move(record));
+    }
+  }
+  return true;
+}
+}  // namespace discovery
+}  // namespace AirBeamCore
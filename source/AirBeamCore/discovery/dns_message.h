@@ -0,0 +1,82 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace AirBeamCore {
+namespace discovery {
+// The parts of the DNS wire format (RFC 1035) that mDNS and DNS-SD use
+// (RFC 6762, 6763).
+//
+// Names are dotted, without the trailing dot, e.g. "_raop._tcp.local". A
+// dot or backslash inside a label, as instance names may have, is escaped
+// with a backslash. Names compare case-insensitively.
+enum class RecordType : uint16_t {
+  kA = 1,
+  kPtr = 12,
+  kTxt = 16,
+  kAaaa = 28,
+  kSrv = 33,
+  kAny = 255,
+};
+
+constexpr uint16_t kClassIn = 1;
+
+struct DnsQuestion {
+  std::string name;
+  RecordType type;
+  // The QU bit: ask for a unicast reply.
+  bool unicast_response = false;
+};
+
+struct DnsRecord {
+  std::string name;
+  RecordType type;
+  // The cache-flush bit: this record replaces the others of its name and
+  // type.
+  bool cache_flush = false;
+  uint32_t ttl = 0;
+  // PTR and SRV.
+  std::string target;
+  // SRV.
+  uint16_t priority = 0;
+  uint16_t weight = 0;
+  uint16_t port = 0;
+  // TXT strings, usually key=value.
+  std::vector<std::string> txt;
+  // A and AAAA, as text.
+  std::string address;
+};
+
+struct DnsMessage {
+  uint16_t id = 0;
+  // QR, opcode, AA and the rest, as on the wire.
+  uint16_t flags = 0;
+  std::vector<DnsQuestion> questions;
+  std::vector<DnsRecord> answers;
+  std::vector<DnsRecord> authorities;
+  std::vector<DnsRecord> additionals;
+
+  static constexpr uint16_t kResponseFlags = 0x8400;
+  bool IsResponse() const { return (flags & 0x8000) != 0; }
+};
+
+// Compresses repeated name suffixes. Records of other types, or addresses
+// that do not parse, are left out.
+std::string EncodeDnsMessage(const DnsMessage& message);
+// Records of types not listed above are skipped. Returns false on anything
+// malformed, including compression pointers that do not point backwards.
+bool DecodeDnsMessage(const uint8_t* data, size_t len, DnsMessage& message);
+
+// Splits a name into unescaped labels, and joins them back.
+std::vector<std::string> SplitDnsName(const std::string& name);
+std::string JoinDnsName(const std::vector<std::string>& labels);
+bool DnsNameEquals(const std::string& a, const std::string& b);
+// The name in lowercase, for map keys.
+std::string DnsNameKey(const std::string& name);
+}  // namespace discovery
+}  // namespace AirBeamCore
@@ -0,0 +1,488 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "mdns_browser.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <set>
+
+#include "helper/capture.h"
+#include "helper/logger.h"
+
+namespace AirBeamCore {
+namespace discovery {
+namespace {
+using helper::PacketCapture;
+
+constexpr auto kGoodbyeGrace = std::chrono::seconds(1);
+// Cached answers are asked for again at 80, 85, 90 and 95% of their TTL.
+constexpr int kRefreshPercent = 80;
+constexpr int kRefreshStepPercent = 5;
+constexpr int kRefreshes = 4;
+// Keeps queries within one Ethernet frame, mostly.
+constexpr size_t kMaxQuestions = 32;
+constexpr size_t kMaxKnownAnswers = 16;
+
+// "name=value" to name, lowercased, and value; a bare name has no value.
+void ParseTxt(const std::vector<std::string>& strings,
+              std::map<std::string, std::string>& txt) {
+  txt.clear();
+  for (const auto& text : strings) {
+    size_t equals = text.find('=');
+    std::string key = DnsNameKey(text.substr(0, equals));
+    // The first occurrence of a key wins (RFC 6763 6.4).
+    if (key.empty() || txt.count(key) != 0) continue;
+    txt[key] = equals == std::string::npos ? "" : text.substr(equals + 1);
+  }
+}
+
+std::string InstanceName(const std::string& fullname) {
+  auto labels = SplitDnsName(fullname);
+  return labels.empty() ? fullname : labels.front();
+}
+}  // namespace
+
+void MdnsBrowser::Lifetime::Set(Clock::time_point now, uint32_t ttl) {
+  valid = true;
+  received = now;
+  this->ttl = ttl;
+  refreshes = ttl == 0 ? kRefreshes : 0;
+  expiry = ttl == 0 ? now + kGoodbyeGrace : now + std::chrono::seconds(ttl);
+}
+
+bool MdnsBrowser::Lifetime::Expired(Clock::time_point now) const {
+  return valid && now >= expiry;
+}
+
+bool MdnsBrowser::Lifetime::NeedsRefresh(Clock::time_point now) const {
+  return valid && refreshes < kRefreshes && now >= NextEvent();
+}
+
+MdnsBrowser::Clock::time_point MdnsBrowser::Lifetime::NextEvent() const {
+  if (!valid) return Clock::time_point::max();
+  if (refreshes >= kRefreshes) return expiry;
+  return received +
+         std::chrono::milliseconds(uint64_t{ttl} * 10 *
+                                   (kRefreshPercent +
+                                    kRefreshStepPercent * refreshes));
+}
+
+MdnsBrowser::MdnsBrowser() : MdnsBrowser(Options()) {}
+
+MdnsBrowser::MdnsBrowser(const Options& options) : options_(options) {}
+
+MdnsBrowser::~MdnsBrowser() { Stop(); }
+
+helper::ErrCode MdnsBrowser::Start(const std::string& service_type,
+                                   ServiceCallback callback) {
+  Stop();
+  sockaddr_in peer{};
+  peer.sin_family = AF_INET;
+  peer.sin_port = htons(options_.peer_port);
+  if (inet_pton(AF_INET, options_.peer_ip.c_str(), &peer.sin_addr) != 1) {
+    return helper::kErrUdpAddrParse;
+  }
+  memcpy(&peer_addr_, &peer, sizeof(peer));
+
+  fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd_ < 0) return helper::kErrUdpSocketCreate;
+  // Share 5353 with the system's responder, if there is one.
+  int on = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#ifdef SO_REUSEPORT
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+#endif
+  sockaddr_in local{};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(options_.local_port);
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(fd_, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) !=
+      0) {
+    ABWarningLog("MdnsBrowser bind %u failed, errno=%d", options_.local_port,
+                 errno);
+    Stop();
+    return helper::kErrUdpBind;
+  }
+  if (IN_MULTICAST(ntohl(peer.sin_addr.s_addr))) {
+    ip_mreq group{};
+    group.imr_multiaddr = peer.sin_addr;
+    group.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(fd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group,
+                   sizeof(group)) != 0) {
+      // Unicast replies to our questions still arrive.
+      ABWarningLog("MdnsBrowser cannot join %s, errno=%d",
+                   options_.peer_ip.c_str(), errno);
+    }
+    unsigned char ttl = 255;
+    setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  }
+  socklen_t addr_len = sizeof(local_addr_);
+  if (getsockname(fd_, reinterpret_cast<sockaddr*>(&local_addr_),
+                  &addr_len) != 0 ||
+      pipe(wake_) != 0) {
+    Stop();
+    return helper::kErrGetsockName;
+  }
+  local_port_ =
+      ntohs(reinterpret_cast<const sockaddr_in*>(&local_addr_)->sin_port);
+
+  service_type_ = service_type;
+  if (SplitDnsName(service_type_).size() <= 2) service_type_ += ".local";
+  callback_ = std::move(callback);
+  next_browse_ = Clock::now();
+  browse_interval_ = options_.query_interval;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = Stats();
+  }
+  ABDebugLog("MdnsBrowser browsing %s on port %u", service_type_.c_str(),
+             local_port_);
+  thread_ = std::thread(&MdnsBrowser::BrowseLoop, this);
+  return helper::kOk;
+}
+
+void MdnsBrowser::Stop() {
+  if (thread_.joinable()) {
+    char wake = 0;
+    (void)!write(wake_[1], &wake, 1);
+    thread_.join();
+  }
+  for (int& fd : wake_) {
+    if (fd >= 0) close(fd);
+    fd = -1;
+  }
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+  local_port_ = 0;
+  instances_.clear();
+  hosts_.clear();
+  std::lock_guard<std::mutex> lock(mutex_);
+  online_.clear();
+}
+
+std::vector<ServiceInfo> MdnsBrowser::GetServices() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<ServiceInfo> services;
+  for (const auto& [key, info] : online_) services.push_back(info);
+  return services;
+}
+
+MdnsBrowser::Stats MdnsBrowser::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void MdnsBrowser::BrowseLoop() {
+  // Larger than any mDNS packet on Ethernet.
+  std::vector<uint8_t> buffer(9000);
+  while (true) {
+    Clock::time_point now = Clock::now();
+    Maintain(now);
+    Clock::time_point wake = SendQueries(now);
+    auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+        wake - Clock::now());
+    pollfd fds[2] = {{fd_, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+    // Rounded up, so a wake is never early.
+    int wait_ms = static_cast<int>(std::clamp<int64_t>(
+        timeout.count() + 1, 0, options_.max_query_interval.count()));
+    if (poll(fds, 2, wait_ms) < 0) {
+      if (errno == EINTR) continue;
+      ABErrorLog("MdnsBrowser poll failed, errno=%d", errno);
+      break;
+    }
+    if (fds[1].revents != 0) break;
+    if (fds[0].revents == 0) continue;
+
+    while (true) {
+      sockaddr_storage remote{};
+      socklen_t remote_len = sizeof(remote);
+      ssize_t got =
+          recvfrom(fd_, buffer.data(), buffer.size(), MSG_DONTWAIT,
+                   reinterpret_cast<sockaddr*>(&remote), &remote_len);
+      if (got < 0) break;
+      PacketCapture::Tap({PacketCapture::Protocol::kUdp,
+                          PacketCapture::Direction::kInbound,
+                          reinterpret_cast<const sockaddr*>(&local_addr_),
+                          reinterpret_cast<const sockaddr*>(&remote),
+                          buffer.data(), static_cast<size_t>(got)});
+      DnsMessage message;
+      if (!DecodeDnsMessage(buffer.data(), got, message)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.malformed++;
+        continue;
+      }
+      // Other queriers' questions, and our own looped back.
+      if (!message.IsResponse()) continue;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.responses++;
+      }
+      HandleResponse(message, Clock::now());
+    }
+  }
+}
+
+void MdnsBrowser::HandleResponse(const DnsMessage& message,
+                                 Clock::time_point now) {
+  // Addresses last, so the SRV records naming their hosts are in.
+  for (bool addresses : {false, true}) {
+    for (const auto* section : {&message.answers, &message.additionals}) {
+      for (const auto& record : *section) {
+        if ((record.type == RecordType::kA) == addresses) {
+          ApplyRecord(record, now);
+        }
+      }
+    }
+  }
+}
+
+void MdnsBrowser::ApplyRecord(const DnsRecord& record, Clock::time_point now) {
+  switch (record.type) {
+    case RecordType::kPtr: {
+      if (!DnsNameEquals(record.name, service_type_)) return;
+      std::string key = DnsNameKey(record.target);
+      auto it = instances_.find(key);
+      if (it == instances_.end()) {
+        if (record.ttl == 0) return;
+        Instance& instance = instances_[key];
+        instance.fullname = record.target;
+        instance.name = InstanceName(record.target);
+        instance.resolve_start = instance.next_query = now;
+        instance.query_interval = options_.query_interval;
+        instance.ptr.Set(now, record.ttl);
+        ABDebugLog("MdnsBrowser found %s", record.target.c_str());
+        return;
+      }
+      it->second.ptr.Set(now, record.ttl);
+      return;
+    }
+    case RecordType::kSrv: {
+      auto it = instances_.find(DnsNameKey(record.name));
+      if (it == instances_.end()) return;
+      it->second.host = record.target;
+      it->second.port = record.port;
+      it->second.srv.Set(now, record.ttl);
+      return;
+    }
+    case RecordType::kTxt: {
+      auto it = instances_.find(DnsNameKey(record.name));
+      if (it == instances_.end()) return;
+      ParseTxt(record.txt, it->second.txt);
+      it->second.txt_lifetime.Set(now, record.ttl);
+      return;
+    }
+    case RecordType::kA: {
+      std::string key = DnsNameKey(record.name);
+      bool wanted = hosts_.count(key) != 0 ||
+                    std::any_of(instances_.begin(), instances_.end(),
+                                [&](const auto& entry) {
+                                  return entry.second.srv.valid &&
+                                         DnsNameEquals(entry.second.host,
+                                                       record.name);
+                                });
+      if (!wanted) return;
+      hosts_[key].ip = record.address;
+      hosts_[key].lifetime.Set(now, record.ttl);
+      return;
+    }
+    default:
+      return;
+  }
+}
+
+bool MdnsBrowser::Resolved(const Instance& instance, ServiceInfo& info) const {
+  if (!instance.srv.valid || !instance.txt_lifetime.valid) return false;
+  auto host = hosts_.find(DnsNameKey(instance.host));
+  if (host == hosts_.end()) return false;
+  info.name = instance.name;
+  info.fullname = instance.fullname;
+  info.ip = host->second.ip;
+  info.port = instance.port;
+  info.txt = instance.txt;
+  info.capabilities = RaopCapabilities::FromTxt(info.txt);
+  return true;
+}
+
+void MdnsBrowser::Maintain(Clock::time_point now) {
+  for (auto it = hosts_.begin(); it != hosts_.end();) {
+    it = it->second.lifetime.Expired(now) ? hosts_.erase(it) : std::next(it);
+  }
+  for (auto it = instances_.begin(); it != instances_.end();) {
+    Instance& instance = it->second;
+    if (instance.ptr.Expired(now)) {
+      if (instance.online) {
+        Report(EventType::kServiceOffline, instance.reported);
+      }
+      it = instances_.erase(it);
+      continue;
+    }
+    if (instance.srv.Expired(now)) instance.srv = Lifetime();
+    if (instance.txt_lifetime.Expired(now)) {
+      instance.txt_lifetime = Lifetime();
+      instance.txt.clear();
+    }
+
+    ServiceInfo info;
+    if (Resolved(instance, info)) {
+      if (!instance.online || info != instance.reported) {
+        instance.online = true;
+        instance.reported = info;
+        Report(EventType::kServiceOnline, info);
+      }
+    } else if (instance.online) {
+      // Lost an answer it needs; resolve it again.
+      Report(EventType::kServiceOffline, instance.reported);
+      instance.online = false;
+      instance.resolve_start = instance.next_query = now;
+      instance.query_interval = options_.query_interval;
+    } else if (now - instance.resolve_start >= options_.resolve_timeout) {
+      ABDebugLog("MdnsBrowser gave up resolving %s",
+                 instance.fullname.c_str());
+      it = instances_.erase(it);
+      continue;
+    }
+    ++it;
+  }
+}
+
+MdnsBrowser::Clock::time_point MdnsBrowser::SendQueries(
+    Clock::time_point now) {
+  Clock::time_point wake = now + options_.max_query_interval;
+  auto consider = [&](Clock::time_point when) { wake = std::min(wake, when); };
+  std::vector<DnsQuestion> questions;
+  std::vector<DnsRecord> known_answers;
+
+  bool browse = now >= next_browse_;
+  if (browse) {
+    next_browse_ = now + browse_interval_;
+    browse_interval_ =
+        std::min(browse_interval_ * 2, options_.max_query_interval);
+  }
+  consider(next_browse_);
+  std::set<std::string> asked_hosts;
+  for (auto& [key, instance] : instances_) {
+    if (instance.ptr.NeedsRefresh(now)) {
+      instance.ptr.refreshes++;
+      browse = true;
+    }
+    consider(instance.ptr.NextEvent());
+
+    ServiceInfo info;
+    if (!Resolved(instance, info)) {
+      consider(instance.resolve_start + options_.resolve_timeout);
+      if (now >= instance.next_query) {
+        if (!instance.srv.valid) {
+          questions.push_back({instance.fullname, RecordType::kSrv});
+        }
+        if (!instance.txt_lifetime.valid) {
+          questions.push_back({instance.fullname, RecordType::kTxt});
+        }
+        if (instance.srv.valid &&
+            asked_hosts.insert(DnsNameKey(instance.host)).second) {
+          questions.push_back({instance.host, RecordType::kA});
+        }
+        instance.next_query = now + instance.query_interval;
+        instance.query_interval *= 2;
+      }
+      consider(instance.next_query);
+    }
+    if (instance.srv.NeedsRefresh(now)) {
+      instance.srv.refreshes++;
+      questions.push_back({instance.fullname, RecordType::kSrv});
+    }
+    if (instance.txt_lifetime.NeedsRefresh(now)) {
+      instance.txt_lifetime.refreshes++;
+      questions.push_back({instance.fullname, RecordType::kTxt});
+    }
+    consider(instance.srv.NextEvent());
+    consider(instance.txt_lifetime.NextEvent());
+  }
+  for (auto& [key, host] : hosts_) {
+    if (host.lifetime.NeedsRefresh(now)) {
+      host.lifetime.refreshes++;
+      if (asked_hosts.insert(key).second) {
+        questions.push_back({key, RecordType::kA});
+      }
+    }
+    consider(host.lifetime.NextEvent());
+  }
+
+  if (browse) {
+    DnsQuestion question{service_type_, RecordType::kPtr};
+    // The first query asks for unicast replies, to hear back at once.
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      question.unicast_response = stats_.queries == 0;
+    }
+    questions.insert(questions.begin(), question);
+    // Known answers with over half their TTL left are not repeated back
+    // to us (RFC 6762 7.1).
+    for (const auto& [key, instance] : instances_) {
+      if (known_answers.size() == kMaxKnownAnswers) break;
+      auto left = std::chrono::duration_cast<std::chrono::seconds>(
+          instance.ptr.expiry - now);
+      if (instance.ptr.ttl == 0 || left.count() * 2 < instance.ptr.ttl) {
+        continue;
+      }
+      DnsRecord answer;
+      answer.name = service_type_;
+      answer.type = RecordType::kPtr;
+      answer.ttl = static_cast<uint32_t>(left.count());
+      answer.target = instance.fullname;
+      known_answers.push_back(std::move(answer));
+    }
+  }
+
+  for (size_t i = 0; i < questions.size(); i += kMaxQuestions) {
+    DnsMessage query;
+    query.questions.assign(
+        questions.begin() + i,
+        questions.begin() + std::min(questions.size(), i + kMaxQuestions));
+    if (i == 0) query.answers = std::move(known_answers);
+    Send(query);
+  }
+  return wake;
+}
+
+void MdnsBrowser::Send(const DnsMessage& message) {
+  std::string packet = EncodeDnsMessage(message);
+  if (sendto(fd_, packet.data(), packet.size(), 0,
+             reinterpret_cast<const sockaddr*>(&peer_addr_),
+             sizeof(sockaddr_in)) < 0) {
+    ABDebugLog("MdnsBrowser send failed, errno=%d", errno);
+    return;
+  }
+  PacketCapture::Tap({PacketCapture::Protocol::kUdp,
+                      PacketCapture::Direction::kOutbound,
+                      reinterpret_cast<const sockaddr*>(&local_addr_),
+                      reinterpret_cast<const sockaddr*>(&peer_addr_),
+                      reinterpret_cast<const uint8_t*>(packet.data()),
+                      packet.size()});
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.queries++;
+}
+
+void MdnsBrowser::Report(EventType type, const ServiceInfo& info) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (type == EventType::kServiceOnline) {
+      online_[DnsNameKey(info.fullname)] = info;
+      stats_.online_events++;
+    } else {
+      online_.erase(DnsNameKey(info.fullname));
+      stats_.offline_events++;
+    }
+  }
+  ABDebugLog("MdnsBrowser %s %s %s:%u",
+             type == EventType::kServiceOnline ? "online" : "offline",
+             info.fullname.c_str(), info.ip.c_str(), info.port);
+  if (callback_) callback_(type, info);
+}
+}  // namespace discovery
+}  // namespace AirBeamCore
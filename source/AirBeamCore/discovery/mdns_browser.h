@@ -0,0 +1,154 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <sys/socket.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "discovery/dns_message.h"
+#include "discovery/service_info.h"
+#include "helper/errcode.h"
+
+namespace AirBeamCore {
+namespace discovery {
+// A DNS-SD browser speaking mDNS over its own UDP socket, so it needs no
+// system daemon. One thread sends the browse (PTR) query and, in the same
+// packets, SRV, TXT and A queries for every instance still missing
+// answers, so N receivers resolve in one or two round trips rather than
+// one after another. Answers are cached until their TTL runs out and
+// re-asked for at 80% of it, as RFC 6762 has it.
+//
+// A service is reported online as soon as its SRV, TXT and address are
+// all in, again when any of them changes, and offline when its PTR record
+// expires or is withdrawn with a goodbye. Callbacks run on the browser
+// thread.
+class MdnsBrowser {
+ public:
+  using ServiceCallback = std::function<void(EventType, const ServiceInfo&)>;
+
+  struct Options {
+    // Where queries go: the mDNS group, or a responder on loopback.
+    std::string peer_ip = "224.0.0.251";
+    uint16_t peer_port = 5353;
+    // Announcements arrive on 5353, shared with any system responder.
+    // 0 picks a port, for tests.
+    uint16_t local_port = 5353;
+    // The browse query is repeated at this interval, doubling up to max.
+    std::chrono::milliseconds query_interval{1000};
+    std::chrono::milliseconds max_query_interval{60'000};
+    // Instances whose answers stay missing this long are dropped until
+    // they are seen again.
+    std::chrono::milliseconds resolve_timeout{5000};
+  };
+
+  struct Stats {
+    uint64_t queries = 0;
+    uint64_t responses = 0;
+    uint64_t malformed = 0;
+    uint64_t online_events = 0;
+    uint64_t offline_events = 0;
+  };
+
+  MdnsBrowser();
+  explicit MdnsBrowser(const Options& options);
+  ~MdnsBrowser();
+  MdnsBrowser(const MdnsBrowser&) = delete;
+  MdnsBrowser& operator=(const MdnsBrowser&) = delete;
+
+  // Browses service_type, e.g. "_raop._tcp"; ".local" is added when it has
+  // no domain.
+  helper::ErrCode Start(const std::string& service_type,
+                        ServiceCallback callback);
+  void Stop();
+  uint16_t GetLocalPort() const { return local_port_; }
+
+  // The services online now.
+  std::vector<ServiceInfo> GetServices() const;
+  Stats GetStats() const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  // A cached answer's lifetime, and when to ask for it again.
+  struct Lifetime {
+    bool valid = false;
+    Clock::time_point received;
+    Clock::time_point expiry;
+    uint32_t ttl = 0;
+    // Refresh queries sent since it was received.
+    int refreshes = 0;
+
+    // A TTL of 0 is a goodbye: the answer goes a second later.
+    void Set(Clock::time_point now, uint32_t ttl);
+    bool Expired(Clock::time_point now) const;
+    bool NeedsRefresh(Clock::time_point now) const;
+    // The next refresh or the expiry, whichever is due first.
+    Clock::time_point NextEvent() const;
+  };
+
+  struct Instance {
+    std::string fullname;
+    std::string name;
+    Lifetime ptr;
+    std::string host;
+    uint16_t port = 0;
+    Lifetime srv;
+    std::map<std::string, std::string> txt;
+    Lifetime txt_lifetime;
+    // While resolving: when it started, and the next retry.
+    Clock::time_point resolve_start;
+    Clock::time_point next_query;
+    std::chrono::milliseconds query_interval{0};
+    bool online = false;
+    ServiceInfo reported;
+  };
+
+  struct Host {
+    std::string ip;
+    Lifetime lifetime;
+  };
+
+  void BrowseLoop();
+  void HandleResponse(const DnsMessage& message, Clock::time_point now);
+  void ApplyRecord(const DnsRecord& record, Clock::time_point now);
+  // Drops what has expired and reports what changed.
+  void Maintain(Clock::time_point now);
+  // Sends the questions that are due; returns when the next one is, or
+  // something expires.
+  Clock::time_point SendQueries(Clock::time_point now);
+  void Send(const DnsMessage& message);
+  void Report(EventType type, const ServiceInfo& info);
+  bool Resolved(const Instance& instance, ServiceInfo& info) const;
+
+  Options options_;
+  std::string service_type_;
+  ServiceCallback callback_;
+
+  // Browser thread only, keyed by DnsNameKey.
+  std::map<std::string, Instance> instances_;
+  std::map<std::string, Host> hosts_;
+  Clock::time_point next_browse_;
+  std::chrono::milliseconds browse_interval_{0};
+
+  mutable std::mutex mutex_;
+  std::map<std::string, ServiceInfo> online_;
+  Stats stats_;
+
+  int fd_ = -1;
+  sockaddr_storage local_addr_{};
+  sockaddr_storage peer_addr_{};
+  uint16_t local_port_ = 0;
+  // Written to by Stop to wake the browser out of poll().
+  int wake_[2] = {-1, -1};
+  std::thread thread_;
+};
+}  // namespace discovery
+}  // namespace AirBeamCore
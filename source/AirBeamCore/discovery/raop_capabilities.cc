@@ -0,0 +1,59 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "raop_capabilities.h"
+
+#include <vector>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+
+namespace AirBeamCore {
+namespace discovery {
+namespace {
+// "0,1,2" to bits 0, 1 and 2. Leaves bits alone if nothing in the list
+// parses, so a garbled key does not make a receiver unusable.
+void ParseList(const std::string& value, uint32_t& bits) {
+  uint32_t parsed = 0;
+  for (absl::string_view item : absl::StrSplit(value, ',')) {
+    uint32_t n;
+    if (absl::SimpleAtoi(item, &n) && n < 32) parsed |= 1u << n;
+  }
+  if (parsed != 0) bits = parsed;
+}
+
+void ParseNumber(const std::string& value, uint32_t& number) {
+  uint32_t parsed;
+  if (absl::SimpleAtoi(value, &parsed) && parsed != 0) number = parsed;
+}
+}  // namespace
+
+RaopCapabilities RaopCapabilities::FromTxt(
+    const std::map<std::string, std::string>& txt) {
+  RaopCapabilities capabilities;
+  for (const auto& [key, value] : txt) {
+    if (key == "cn") {
+      ParseList(value, capabilities.codecs);
+    } else if (key == "et") {
+      ParseList(value, capabilities.encryptions);
+    } else if (key == "sr") {
+      ParseNumber(value, capabilities.sample_rate);
+    } else if (key == "ss") {
+      ParseNumber(value, capabilities.sample_size);
+    } else if (key == "ch") {
+      ParseNumber(value, capabilities.channels);
+    } else if (key == "tp") {
+      std::vector<std::string> transports =
+          absl::StrSplit(absl::AsciiStrToUpper(value), ',');
+      capabilities.udp = false;
+      for (const auto& transport : transports) {
+        capabilities.udp |= transport == "UDP";
+      }
+    } else if (key == "am") {
+      capabilities.model = value;
+    }
+  }
+  return capabilities;
+}
+}  // namespace discovery
+}  // namespace AirBeamCore
@@ -0,0 +1,66 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace AirBeamCore {
+namespace discovery {
+// Values of the "cn" TXT key.
+enum class RaopCodec : uint8_t {
+  kPcm = 0,
+  kAlac = 1,
+  kAac = 2,
+  kAacEld = 3,
+};
+
+// Values of the "et" TXT key.
+enum class RaopEncryption : uint8_t {
+  kNone = 0,
+  kRsa = 1,
+  kFairPlay = 3,
+  kMfiSap = 4,
+  kFairPlaySap25 = 5,
+};
+
+// What a RAOP receiver says it can play, from its TXT record. A key the
+// receiver leaves out takes the value the original AirPort Express
+// advertised.
+struct RaopCapabilities {
+  // Bit n is set for codec or encryption type n.
+  uint32_t codecs = 1u << static_cast<int>(RaopCodec::kPcm) |
+                    1u << static_cast<int>(RaopCodec::kAlac);
+  uint32_t encryptions = 1u << static_cast<int>(RaopEncryption::kNone) |
+                         1u << static_cast<int>(RaopEncryption::kRsa);
+  // "sr", "ss" and "ch": the one format the receiver plays.
+  uint32_t sample_rate = 44'100;
+  uint32_t sample_size = 16;
+  uint32_t channels = 2;
+  // "tp" lists UDP.
+  bool udp = true;
+  // "am", e.g. "AirPort10,115"; empty if not given.
+  std::string model;
+
+  bool Supports(RaopCodec codec) const {
+    return (codecs >> static_cast<int>(codec) & 1) != 0;
+  }
+  bool Supports(RaopEncryption encryption) const {
+    return (encryptions >> static_cast<int>(encryption) & 1) != 0;
+  }
+
+  // From TXT keys, lowercased, as ServiceInfo holds them. Values that do
+  // not parse keep the default.
+  static RaopCapabilities FromTxt(
+      const std::map<std::string, std::string>& txt);
+
+  bool operator==(const RaopCapabilities& other) const {
+    return codecs == other.codecs && encryptions == other.encryptions &&
+           sample_rate == other.sample_rate &&
+           sample_size == other.sample_size && channels == other.channels &&
+           udp == other.udp && model == other.model;
+  }
+};
+}  // namespace discovery
+}  // namespace AirBeamCore
@@ -0,0 +1,220 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "service_cache.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include "absl/strings/escaping.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "helper/logger.h"
+
+namespace AirBeamCore {
+namespace discovery {
+namespace {
+// One entry per line after this, tab-separated: last seen, port, address,
+// name, fullname, then one key=value per TXT key. Text fields are
+// C-escaped, so they hold no tabs or newlines.
+constexpr char kHeader[] = "# AirBeam receivers v1";
+
+int64_t NowSeconds() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+std::string FormatEntry(const ServiceCache::Entry& entry) {
+  std::string line = std::to_string(entry.last_seen) + "\t" +
+                     std::to_string(entry.info.port) + "\t" + entry.info.ip +
+                     "\t" + absl::CEscape(entry.info.name) + "\t" +
+                     absl::CEscape(entry.info.fullname);
+  for (const auto& [key, value] : entry.info.txt) {
+    line += "\t" + absl::CEscape(key) + "=" + absl::CEscape(value);
+  }
+  return line;
+}
+
+bool ParseEntry(const std::string& line, ServiceCache::Entry& entry) {
+  std::vector<std::string> fields = absl::StrSplit(line, '\t');
+  uint32_t port;
+  if (fields.size() < 5 || !absl::SimpleAtoi(fields[0], &entry.last_seen) ||
+      !absl::SimpleAtoi(fields[1], &port) || port == 0 || port > 65535 ||
+      fields[2].empty() || !absl::CUnescape(fields[3], &entry.info.name) ||
+      !absl::CUnescape(fields[4], &entry.info.fullname) ||
+      entry.info.fullname.empty()) {
+    return false;
+  }
+  entry.info.port = static_cast<uint16_t>(port);
+  entry.info.ip = fields[2];
+  for (size_t i = 5; i < fields.size(); ++i) {
+    size_t equals = fields[i].find('=');
+    std::string key, value;
+    if (equals == std::string::npos ||
+        !absl::CUnescape(fields[i].substr(0, equals), &key) ||
+        !absl::CUnescape(fields[i].substr(equals + 1), &value)) {
+      return false;
+    }
+    entry.info.txt[key] = value;
+  }
+  entry.info.capabilities = RaopCapabilities::FromTxt(entry.info.txt);
+  return true;
+}
+
+// mkdir -p of the directory holding path.
+void MakeParentDirs(const std::string& path) {
+  for (size_t slash = path.find('/', 1); slash != std::string::npos;
+       slash = path.find('/', slash + 1)) {
+    mkdir(path.substr(0, slash).c_str(), 0755);
+  }
+}
+}  // namespace
+
+ServiceCache::ServiceCache(const Options& options) : options_(options) {}
+
+ServiceCache::~ServiceCache() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  stop_cv_.notify_all();
+  if (confirm_thread_.joinable()) confirm_thread_.join();
+}
+
+ServiceCache::ServiceCallback ServiceCache::Attach(
+    ServiceCallback downstream) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  downstream_ = std::move(downstream);
+  return [this](EventType type, const ServiceInfo& info) {
+    OnEvent(type, info);
+  };
+}
+
+helper::ErrCode ServiceCache::Load() {
+  std::ifstream in(options_.path);
+  if (!in) {
+    return access(options_.path.c_str(), F_OK) != 0
+               ? helper::kOk
+               : helper::kErrInvalidParam;
+  }
+  std::string line;
+  if (!std::getline(in, line) || line != kHeader) {
+    ABWarningLog("ServiceCache %s is not a receiver cache",
+                 options_.path.c_str());
+    return helper::kErrInvalidParam;
+  }
+  const int64_t oldest =
+      NowSeconds() -
+      std::chrono::duration_cast<std::chrono::seconds>(options_.max_age)
+          .count();
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (std::getline(in, line)) {
+    Entry entry;
+    if (!ParseEntry(line, entry) || entry.last_seen < oldest) continue;
+    // The browser may have been quicker.
+    if (entries_.count(entry.info.fullname) != 0) continue;
+    unconfirmed_.insert(entry.info.fullname);
+    entries_[entry.info.fullname] = entry;
+    if (downstream_) downstream_(EventType::kServiceOnline, entry.info);
+  }
+  ABInfoLog("ServiceCache offered %zu cached receivers",
+            unconfirmed_.size());
+  if (!unconfirmed_.empty() && !confirm_thread_.joinable()) {
+    confirm_thread_ = std::thread(&ServiceCache::ConfirmLoop, this);
+  }
+  return helper::kOk;
+}
+
+std::vector<ServiceCache::Entry> ServiceCache::GetEntries() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Entry> entries;
+  for (const auto& [fullname, entry] : entries_) entries.push_back(entry);
+  return entries;
+}
+
+std::string ServiceCache::DefaultPath(const std::string& name) {
+  const char* xdg = getenv("XDG_CACHE_HOME");
+  if (xdg != nullptr && xdg[0] == '/') {
+    return std::string(xdg) + "/airbeam/" + name;
+  }
+  const char* home = getenv("HOME");
+  if (home == nullptr || home[0] != '/') return "/tmp/airbeam-" + name;
+#ifdef __APPLE__
+  return std::string(home) + "/Library/Caches/AirBeam/" + name;
+#else
+  return std::string(home) + "/.cache/airbeam/" + name;
+#endif
+}
+
+void ServiceCache::OnEvent(EventType type, const ServiceInfo& info) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  bool confirming = unconfirmed_.erase(info.fullname) != 0;
+  if (type == EventType::kServiceOnline) {
+    auto it = entries_.find(info.fullname);
+    bool unchanged = it != entries_.end() && it->second.info == info;
+    entries_[info.fullname] = {info, NowSeconds()};
+    Save();
+    // Already offered just like this.
+    if (confirming && unchanged) return;
+  } else {
+    entries_.erase(info.fullname);
+    Save();
+  }
+  if (downstream_) downstream_(type, info);
+}
+
+void ServiceCache::ConfirmLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (stop_cv_.wait_for(lock, options_.confirm_timeout,
+                        [this]() { return stopping_; })) {
+    return;
+  }
+  if (unconfirmed_.empty()) return;
+  for (const auto& fullname : unconfirmed_) {
+    ABInfoLog("ServiceCache %s did not answer, dropped", fullname.c_str());
+    ServiceInfo info = entries_[fullname].info;
+    entries_.erase(fullname);
+    if (downstream_) downstream_(EventType::kServiceOffline, info);
+  }
+  unconfirmed_.clear();
+  Save();
+}
+
+void ServiceCache::Save() {
+  if (options_.path.empty()) return;
+  std::vector<const Entry*> entries;
+  for (const auto& [fullname, entry] : entries_) entries.push_back(&entry);
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry* a, const Entry* b) {
+              return a->last_seen > b->last_seen;
+            });
+  if (entries.size() > options_.max_entries) {
+    entries.resize(options_.max_entries);
+  }
+
+  // Written aside and renamed over, so a reader never sees half a file.
+  MakeParentDirs(options_.path);
+  std::string temp = options_.path + ".tmp";
+  {
+    std::ofstream out(temp, std::ios::trunc);
+    out << kHeader << "\n";
+    for (const Entry* entry : entries) out << FormatEntry(*entry) << "\n";
+    if (!out.flush()) {
+      ABWarningLog("ServiceCache cannot write %s", temp.c_str());
+      return;
+    }
+  }
+  if (rename(temp.c_str(), options_.path.c_str()) != 0) {
+    ABWarningLog("ServiceCache cannot replace %s, errno=%d",
+                 options_.path.c_str(), errno);
+    unlink(temp.c_str());
+  }
+}
+}  // namespace discovery
+}  // namespace AirBeamCore
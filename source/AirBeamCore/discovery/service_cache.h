@@ -0,0 +1,84 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "discovery/service_info.h"
+#include "helper/errcode.h"
+
+namespace AirBeamCore {
+namespace discovery {
+// Remembers the receivers a browser found across runs, so they show up at
+// once at the next start instead of after a cold browse.
+//
+// Load reads the file and reports every cached service online right away.
+// The browser's events then go through the callback from Attach: a cached
+// service the browser reports again is confirmed, silently if nothing
+// changed, and one it has not reported within confirm_timeout is reported
+// offline and forgotten. The file is rewritten whenever what it holds
+// changes.
+class ServiceCache {
+ public:
+  using ServiceCallback = std::function<void(EventType, const ServiceInfo&)>;
+
+  struct Options {
+    std::string path;
+    // Entries not seen for this long are dropped on load.
+    std::chrono::hours max_age{24 * 7};
+    std::chrono::milliseconds confirm_timeout{10'000};
+    // The most recently seen are kept.
+    size_t max_entries = 64;
+  };
+
+  struct Entry {
+    ServiceInfo info;
+    // Seconds since the epoch.
+    int64_t last_seen = 0;
+  };
+
+  explicit ServiceCache(const Options& options);
+  ~ServiceCache();
+  ServiceCache(const ServiceCache&) = delete;
+  ServiceCache& operator=(const ServiceCache&) = delete;
+
+  // Returns the callback to hand the browser. Events reach downstream
+  // serialized, with the cache locked: downstream must not call back in.
+  ServiceCallback Attach(ServiceCallback downstream);
+  // Reads the file, reports its services to downstream and starts the
+  // confirm timeout. A missing file is an empty cache.
+  helper::ErrCode Load();
+  std::vector<Entry> GetEntries() const;
+
+  // $XDG_CACHE_HOME/airbeam/<name>, or the platform's cache directory
+  // under $HOME. Other state kept next to the receivers passes its own name.
+  static std::string DefaultPath(const std::string& name = "receivers");
+
+ private:
+  void OnEvent(EventType type, const ServiceInfo& info);
+  void ConfirmLoop();
+  void Save();
+
+  const Options options_;
+  ServiceCallback downstream_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable stop_cv_;
+  bool stopping_ = false;
+  // Keyed by fullname.
+  std::map<std::string, Entry> entries_;
+  // Loaded from the file and not reported by the browser yet.
+  std::set<std::string> unconfirmed_;
+  std::thread confirm_thread_;
+};
+}  // namespace discovery
+}  // namespace AirBeamCore
@@ -0,0 +1,37 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "discovery/raop_capabilities.h"
+
+namespace AirBeamCore {
+namespace discovery {
+enum class EventType {
+  kServiceOnline = 1,
+  kServiceOffline = 2,
+};
+
+// A resolved DNS-SD service instance, as either browser reports it.
+struct ServiceInfo {
+  // The instance name, e.g. "001122334455@Kitchen".
+  std::string name;
+  std::string fullname;
+  std::string ip;
+  uint16_t port = 0;
+  // TXT record keys, lowercased, and their values.
+  std::map<std::string, std::string> txt;
+  // Parsed from txt, which is what equality compares.
+  RaopCapabilities capabilities;
+
+  bool operator==(const ServiceInfo& other) const {
+    return name == other.name && fullname == other.fullname &&
+           ip == other.ip && port == other.port && txt == other.txt;
+  }
+  bool operator!=(const ServiceInfo& other) const { return !(*this == other); }
+};
+}  // namespace discovery
+}  // namespace AirBeamCore
@@ -0,0 +1,408 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "capture.h"
+
+#include <netinet/in.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "helper/logger.h"
+
+namespace AirBeamCore {
+namespace helper {
+namespace {
+// A ring entry starts with a commit word: the entry size, with kPadFlag
+// for the filler that skips to the start of the ring. Zero means not yet
+// committed.
+constexpr uint64_t kPadFlag = 1ull << 32;
+constexpr uint64_t kSizeMask = kPadFlag - 1;
+
+struct RecordHeader {
+  uint64_t time_ns;
+  uint32_t len;
+  uint32_t orig_len;
+  PacketCapture::Protocol protocol;
+  PacketCapture::Direction direction;
+  uint8_t family;
+  uint8_t reserved;
+  uint16_t local_port;
+  uint16_t remote_port;
+  uint8_t local_ip[16];
+  uint8_t remote_ip[16];
+};
+
+constexpr size_t kEntryHeader = sizeof(uint64_t) + sizeof(RecordHeader);
+
+// pcapng block types and constants.
+constexpr uint32_t kSectionHeaderBlock = 0x0A0D0D0A;
+constexpr uint32_t kInterfaceBlock = 1;
+constexpr uint32_t kEnhancedPacketBlock = 6;
+constexpr uint32_t kByteOrderMagic = 0x1A2B3C4D;
+constexpr uint16_t kLinkTypeRaw = 101;
+constexpr uint16_t kOptionEnd = 0;
+constexpr uint16_t kOptionTsResol = 9;
+constexpr uint16_t kOptionEpbFlags = 2;
+
+size_t Align(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+uint64_t RealtimeNs() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+// Copies family, address and host-order port out of addr.
+void ReadAddr(const sockaddr* addr, uint8_t& family, uint8_t* ip,
+              uint16_t& port) {
+  if (addr != nullptr && addr->sa_family == AF_INET6) {
+    auto* v6 = reinterpret_cast<const sockaddr_in6*>(addr);
+    family = AF_INET6;
+    memcpy(ip, &v6->sin6_addr, 16);
+    port = ntohs(v6->sin6_port);
+  } else if (addr != nullptr && addr->sa_family == AF_INET) {
+    auto* v4 = reinterpret_cast<const sockaddr_in*>(addr);
+    memcpy(ip, &v4->sin_addr, 4);
+    port = ntohs(v4->sin_port);
+  } else {
+    memset(ip, 0, 16);
+    port = 0;
+  }
+}
+
+template <typename T>
+void Append(std::string& out, T value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendBigEndian16(std::string& out, uint16_t value) {
+  out += static_cast<char>(value >> 8);
+  out += static_cast<char>(value);
+}
+
+void AppendBigEndian32(std::string& out, uint32_t value) {
+  AppendBigEndian16(out, value >> 16);
+  AppendBigEndian16(out, value);
+}
+
+// Pads a block body to 32 bits and wraps it in type and total length.
+std::string Block(uint32_t type, std::string body) {
+  body.resize(Align(body.size(), 4), '\0');
+  uint32_t total = static_cast<uint32_t>(body.size() + 12);
+  std::string block;
+  Append(block, type);
+  Append(block, total);
+  block += body;
+  Append(block, total);
+  return block;
+}
+
+std::string SectionHeader() {
+  std::string body;
+  Append(body, kByteOrderMagic);
+  Append<uint16_t>(body, 1);
+  Append<uint16_t>(body, 0);
+  Append<int64_t>(body, -1);
+  Append(body, kOptionEnd);
+  Append<uint16_t>(body, 0);
+  return Block(kSectionHeaderBlock, body);
+}
+
+std::string InterfaceDescription() {
+  std::string body;
+  Append(body, kLinkTypeRaw);
+  Append<uint16_t>(body, 0);
+  Append<uint32_t>(body, 0);
+  // Timestamps in nanoseconds.
+  Append(body, kOptionTsResol);
+  Append<uint16_t>(body, 1);
+  body += static_cast<char>(9);
+  body.append(3, '\0');
+  Append(body, kOptionEnd);
+  Append<uint16_t>(body, 0);
+  return Block(kInterfaceBlock, body);
+}
+
+uint16_t Ipv4Checksum(const std::string& header) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i + 1 < header.size(); i += 2) {
+    sum += (static_cast<uint8_t>(header[i]) << 8) |
+           static_cast<uint8_t>(header[i + 1]);
+  }
+  while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+  return static_cast<uint16_t>(~sum);
+}
+}  // namespace
+
+std::atomic<PacketCapture*> PacketCapture::active_ = nullptr;
+std::atomic<int> PacketCapture::tapping_ = 0;
+
+PacketCapture::PacketCapture(const Options& options) : options_(options) {
+  ring_size_ = 4096;
+  while (ring_size_ < options_.ring_bytes) ring_size_ *= 2;
+  ring_words_ = std::make_unique<uint64_t[]>(ring_size_ / sizeof(uint64_t));
+  ring_ = reinterpret_cast<uint8_t*>(ring_words_.get());
+}
+
+PacketCapture::~PacketCapture() { Stop(); }
+
+std::string PacketCapture::FilePath(uint32_t index) const {
+  const std::string kExtension = ".pcapng";
+  std::string base = options_.path;
+  if (base.size() > kExtension.size() &&
+      base.compare(base.size() - kExtension.size(), kExtension.size(),
+                   kExtension) == 0) {
+    base.resize(base.size() - kExtension.size());
+  }
+  return base + "." + std::to_string(index) + kExtension;
+}
+
+ErrCode PacketCapture::Start() {
+  if (started_) return kErrInvalidParam;
+  if (!OpenFile()) return kErrInvalidParam;
+  PacketCapture* expected = nullptr;
+  if (!active_.compare_exchange_strong(expected, this)) {
+    fclose(file_);
+    file_ = nullptr;
+    unlink(FilePath(0).c_str());
+    files_ = 0;
+    return kErrInvalidParam;
+  }
+  started_ = true;
+  writer_ = std::thread([this]() { WriterLoop(); });
+  return kOk;
+}
+
+void PacketCapture::Stop() {
+  if (!started_ || stopped_.load()) return;
+  // Sockets check active_ after announcing themselves in tapping_, so once
+  // it drops to zero no one is writing into the ring any more.
+  PacketCapture* expected = this;
+  active_.compare_exchange_strong(expected, nullptr);
+  while (tapping_.load() != 0) std::this_thread::yield();
+  stopped_ = true;
+  writer_.join();
+  if (file_ != nullptr) fclose(file_);
+  file_ = nullptr;
+}
+
+PacketCapture::Stats PacketCapture::GetStats() const {
+  Stats stats;
+  stats.packets = packets_.load(std::memory_order_relaxed);
+  stats.dropped = dropped_.load(std::memory_order_relaxed);
+  stats.bytes_written = bytes_written_.load(std::memory_order_relaxed);
+  stats.files = files_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void PacketCapture::TapActive(const Packet& packet) {
+  tapping_.fetch_add(1);
+  PacketCapture* capture = active_.load();
+  if (capture != nullptr) capture->Record(packet);
+  tapping_.fetch_sub(1);
+}
+
+void PacketCapture::Record(const Packet& packet) {
+  size_t orig_len = packet.len + packet.len2;
+  size_t len = std::min(orig_len, kSnapLen);
+  size_t size = Align(kEntryHeader + len, sizeof(uint64_t));
+
+  uint64_t head = head_.load(std::memory_order_relaxed);
+  size_t skip;
+  while (true) {
+    size_t to_end = ring_size_ - (head & (ring_size_ - 1));
+    skip = size > to_end ? to_end : 0;
+    if (head + skip + size - tail_.load(std::memory_order_acquire) >
+        ring_size_) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    if (head_.compare_exchange_weak(head, head + skip + size,
+                                    std::memory_order_relaxed)) {
+      break;
+    }
+  }
+  if (skip != 0) {
+    __atomic_store_n(
+        reinterpret_cast<uint64_t*>(ring_ + (head & (ring_size_ - 1))),
+        skip | kPadFlag, __ATOMIC_RELEASE);
+    head += skip;
+  }
+
+  uint8_t* entry = ring_ + (head & (ring_size_ - 1));
+  RecordHeader header;
+  header.time_ns = RealtimeNs();
+  header.len = static_cast<uint32_t>(len);
+  header.orig_len = static_cast<uint32_t>(orig_len);
+  header.protocol = packet.protocol;
+  header.direction = packet.direction;
+  header.family = AF_INET;
+  header.reserved = 0;
+  ReadAddr(packet.local, header.family, header.local_ip, header.local_port);
+  ReadAddr(packet.remote, header.family, header.remote_ip,
+           header.remote_port);
+  memcpy(entry + sizeof(uint64_t), &header, sizeof(header));
+  size_t first = std::min(packet.len, len);
+  memcpy(entry + kEntryHeader, packet.data, first);
+  if (len > first) {
+    memcpy(entry + kEntryHeader + first, packet.data2, len - first);
+  }
+  __atomic_store_n(reinterpret_cast<uint64_t*>(entry), size, __ATOMIC_RELEASE);
+  packets_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PacketCapture::WriterLoop() {
+  while (true) {
+    bool stopping = stopped_.load();
+    if (Drain()) continue;
+    if (file_ != nullptr) fflush(file_);
+    if (stopping) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+}
+
+bool PacketCapture::Drain() {
+  uint64_t tail = tail_.load(std::memory_order_relaxed);
+  bool drained = false;
+  while (true) {
+    uint8_t* entry = ring_ + (tail & (ring_size_ - 1));
+    uint64_t word = __atomic_load_n(reinterpret_cast<uint64_t*>(entry),
+                                    __ATOMIC_ACQUIRE);
+    if (word == 0) break;
+    size_t size = word & kSizeMask;
+    if (!(word & kPadFlag)) WriteRecord(entry + sizeof(uint64_t));
+    // Producers rely on free space reading as zero.
+    memset(entry, 0, size);
+    tail += size;
+    tail_.store(tail, std::memory_order_release);
+    drained = true;
+  }
+  return drained;
+}
+
+void PacketCapture::WriteRecord(const uint8_t* record) {
+  RecordHeader header;
+  memcpy(&header, record, sizeof(header));
+  const uint8_t* payload = record + sizeof(header);
+  bool outbound = header.direction == Direction::kOutbound;
+  const uint8_t* src_ip = outbound ? header.local_ip : header.remote_ip;
+  const uint8_t* dst_ip = outbound ? header.remote_ip : header.local_ip;
+  uint16_t src_port = outbound ? header.local_port : header.remote_port;
+  uint16_t dst_port = outbound ? header.remote_port : header.local_port;
+  bool tcp = header.protocol == Protocol::kTcp;
+  size_t ip_len = header.family == AF_INET6 ? 16 : 4;
+
+  std::string transport;
+  AppendBigEndian16(transport, src_port);
+  AppendBigEndian16(transport, dst_port);
+  if (tcp) {
+    std::string key(reinterpret_cast<const char*>(src_ip), ip_len);
+    key.append(reinterpret_cast<const char*>(dst_ip), ip_len);
+    Append(key, src_port);
+    Append(key, dst_port);
+    std::string reverse(reinterpret_cast<const char*>(dst_ip), ip_len);
+    reverse.append(reinterpret_cast<const char*>(src_ip), ip_len);
+    Append(reverse, dst_port);
+    Append(reverse, src_port);
+    uint32_t& seq = tcp_seq_.try_emplace(key, 1).first->second;
+    uint32_t ack = tcp_seq_.try_emplace(reverse, 1).first->second;
+    AppendBigEndian32(transport, seq);
+    AppendBigEndian32(transport, ack);
+    seq += header.orig_len;
+    // 20 byte header, PSH|ACK, no checksum.
+    AppendBigEndian16(transport, (5 << 12) | 0x18);
+    AppendBigEndian16(transport, 65535);
+    AppendBigEndian32(transport, 0);
+  } else {
+    // UDP length, and no checksum.
+    AppendBigEndian16(transport,
+                      static_cast<uint16_t>(8 + header.orig_len));
+    AppendBigEndian16(transport, 0);
+  }
+
+  size_t orig_ip_len = transport.size() + header.orig_len;
+  std::string ip;
+  if (header.family == AF_INET6) {
+    AppendBigEndian32(ip, 0x60000000);
+    AppendBigEndian16(ip, static_cast<uint16_t>(orig_ip_len));
+    ip += static_cast<char>(tcp ? IPPROTO_TCP : IPPROTO_UDP);
+    ip += static_cast<char>(64);
+  } else {
+    orig_ip_len += 20;
+    ip += static_cast<char>(0x45);
+    ip += '\0';
+    AppendBigEndian16(ip, static_cast<uint16_t>(orig_ip_len));
+    AppendBigEndian16(ip, ip_id_++);
+    // Don't fragment.
+    AppendBigEndian16(ip, 0x4000);
+    ip += static_cast<char>(64);
+    ip += static_cast<char>(tcp ? IPPROTO_TCP : IPPROTO_UDP);
+    AppendBigEndian16(ip, 0);
+  }
+  ip.append(reinterpret_cast<const char*>(src_ip), ip_len);
+  ip.append(reinterpret_cast<const char*>(dst_ip), ip_len);
+  if (header.family == AF_INET6) {
+    orig_ip_len += ip.size();
+  } else {
+    uint16_t checksum = Ipv4Checksum(ip);
+    ip[10] = static_cast<char>(checksum >> 8);
+    ip[11] = static_cast<char>(checksum);
+  }
+  ip += transport;
+  ip.append(reinterpret_cast<const char*>(payload), header.len);
+
+  std::string body;
+  Append<uint32_t>(body, 0);
+  Append(body, static_cast<uint32_t>(header.time_ns >> 32));
+  Append(body, static_cast<uint32_t>(header.time_ns));
+  Append(body, static_cast<uint32_t>(ip.size()));
+  Append(body, static_cast<uint32_t>(orig_ip_len));
+  body += ip;
+  body.resize(Align(body.size(), 4), '\0');
+  Append(body, kOptionEpbFlags);
+  Append<uint16_t>(body, 4);
+  Append<uint32_t>(body, outbound ? 2 : 1);
+  Append(body, kOptionEnd);
+  Append<uint16_t>(body, 0);
+  std::string block = Block(kEnhancedPacketBlock, body);
+
+  if (file_bytes_ + block.size() > options_.max_file_bytes &&
+      file_bytes_ > 0) {
+    fclose(file_);
+    file_ = nullptr;
+    if (!OpenFile()) return;
+  }
+  if (file_ != nullptr) WriteBlock(block);
+}
+
+bool PacketCapture::OpenFile() {
+  uint32_t index = files_.load(std::memory_order_relaxed);
+  file_ = fopen(FilePath(index).c_str(), "wb");
+  if (file_ == nullptr) {
+    ABWarningLog("PacketCapture failed to open %s", FilePath(index).c_str());
+    return false;
+  }
+  files_.store(index + 1, std::memory_order_relaxed);
+  if (options_.max_files != 0 && index >= options_.max_files) {
+    unlink(FilePath(index - options_.max_files).c_str());
+  }
+  file_bytes_ = 0;
+  WriteBlock(SectionHeader());
+  WriteBlock(InterfaceDescription());
+  // The headers alone never trigger a rotation.
+  file_bytes_ = 0;
+  return true;
+}
+
+void PacketCapture::WriteBlock(const std::string& block) {
+  fwrite(block.data(), 1, block.size(), file_);
+  file_bytes_ += block.size();
+  bytes_written_.fetch_add(block.size(), std::memory_order_relaxed);
+}
+}  // namespace helper
+}  // namespace AirBeamCore
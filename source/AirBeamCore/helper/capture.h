@@ -0,0 +1,119 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "helper/errcode.h"
+
+namespace AirBeamCore {
+namespace helper {
+// Records what the sockets in this process send and receive to pcapng
+// files, for reading in Wireshark. While a capture is started, UDPServer
+// and TCPClient copy every datagram and stream chunk into a preallocated
+// ring; a background thread adds synthetic IP and UDP/TCP headers and
+// writes the packets with nanosecond timestamps, starting a new file when
+// the current one reaches max_file_bytes.
+//
+// While capturing, a socket call pays a memcpy into the ring; when the
+// ring is full, packets are dropped and counted. Otherwise the tap costs
+// one relaxed load.
+class PacketCapture {
+ public:
+  enum class Protocol : uint8_t { kUdp, kTcp };
+  enum class Direction : uint8_t { kInbound, kOutbound };
+
+  struct Options {
+    // Files are named <path>.<index>.pcapng, a trailing ".pcapng" on path
+    // is moved after the index.
+    std::string path;
+    size_t ring_bytes = 8 * 1024 * 1024;
+    uint64_t max_file_bytes = 64 * 1024 * 1024;
+    // Older files are deleted past this many; 0 keeps them all.
+    uint32_t max_files = 0;
+  };
+
+  struct Stats {
+    uint64_t packets = 0;
+    uint64_t dropped = 0;
+    uint64_t bytes_written = 0;
+    uint32_t files = 0;
+  };
+
+  // What a socket saw, described by its own addresses. A packet may come in
+  // two parts, as UDPServer::WriteBatch sends them.
+  struct Packet {
+    Protocol protocol;
+    Direction direction;
+    const sockaddr* local;
+    const sockaddr* remote;
+    const uint8_t* data;
+    size_t len;
+    const uint8_t* data2 = nullptr;
+    size_t len2 = 0;
+  };
+
+  // Payload bytes kept per packet; the rest is cut, as with a snaplen.
+  static constexpr size_t kSnapLen = 65000;
+
+  explicit PacketCapture(const Options& options);
+  ~PacketCapture();
+
+  // Opens the first file and taps the sockets. Only one capture can be
+  // started at a time.
+  ErrCode Start();
+  // Stops tapping, writes out what is left in the ring and closes the file.
+  void Stop();
+  Stats GetStats() const;
+  std::string FilePath(uint32_t index) const;
+
+  // Called by the sockets.
+  static void Tap(const Packet& packet) {
+    if (active_.load(std::memory_order_relaxed) != nullptr) TapActive(packet);
+  }
+
+ private:
+  static void TapActive(const Packet& packet);
+  void Record(const Packet& packet);
+  void WriterLoop();
+  bool Drain();
+  void WriteRecord(const uint8_t* record);
+  bool OpenFile();
+  void WriteBlock(const std::string& block);
+
+  static std::atomic<PacketCapture*> active_;
+  static std::atomic<int> tapping_;
+
+  const Options options_;
+  size_t ring_size_;
+  std::unique_ptr<uint64_t[]> ring_words_;
+  uint8_t* ring_;
+  alignas(64) std::atomic<uint64_t> head_{0};
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  std::atomic<uint64_t> packets_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> bytes_written_{0};
+  std::atomic<uint32_t> files_{0};
+
+  // Owned by the writer thread once started.
+  FILE* file_ = nullptr;
+  uint64_t file_bytes_ = 0;
+  uint16_t ip_id_ = 0;
+  // Next sequence number of each TCP direction, keyed by the synthetic
+  // source and destination.
+  std::map<std::string, uint32_t> tcp_seq_;
+
+  std::atomic<bool> stopped_ = false;
+  bool started_ = false;
+  std::thread writer_;
+};
+}  // namespace helper
+}  // namespace AirBeamCore
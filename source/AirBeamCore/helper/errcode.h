@@ -11,12 +11,16 @@ enum ErrCode : uint64_t {
   // common
   kErrUnknown = 1,
   kErrInvalidParam = 2,
+  kErrPipeCreate = 3,
   // TCP
   kErrTcpSocketCreate = 65537,
   kErrTcpAddrParse = 65538,
   kErrTcpConnect = 65539,
   kErrTcpSend = 65540,
   kErrTcpRecv = 65541,
+  kErrTcpTimeout = 65542,
+  kErrTcpBind = 65543,
+  kErrTcpListen = 65544,
   // UDP
   kErrUdpSocketCreate = 131073,
   kErrUdpBind = 131074,
@@ -24,6 +28,12 @@ enum ErrCode : uint64_t {
   kErrUdpSend = 131076,
   kErrUdpRecv = 131077,
   kErrGetsockName = 131078,
+  // RTSP
+  kErrRtspStatus = 196609,
+  // A reply without a header the request needs, or with a bad one.
+  kErrRtspHeader = 196610,
+  // RAOP
+  kErrRaopUnsupportedFormat = 262145,
 };
 }  // namespace helper
 }  // namespace AirBeamCore
\ No newline at end of file
@@ -0,0 +1,380 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "logger.h"
+
+#include <stdio.h>
+#include <syslog.h>
+#include <time.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+namespace AirBeamCore {
+namespace helper {
+namespace {
+// Bounded multi-producer queue after Dmitry Vyukov's: each cell's sequence
+// tells producers whether it is free and the consumer whether it is full.
+struct Cell {
+  std::atomic<uint64_t> sequence;
+  LogRecord record;
+};
+
+struct State {
+  Cell cells[Logger::kQueueRecords];
+  alignas(64) std::atomic<uint64_t> enqueue_pos{0};
+  alignas(64) std::atomic<uint64_t> dequeue_pos{0};
+  // Records handed to the sink, which Flush waits on.
+  alignas(64) std::atomic<uint64_t> delivered{0};
+  std::atomic<uint64_t> dropped{0};
+  // Set by the drain thread before it waits on an empty queue; a producer
+  // that sees it clears it and wakes the thread.
+  alignas(64) std::atomic<bool> sleeping{false};
+  std::mutex wake_mtx;
+  std::condition_variable wake_cv;
+  std::once_flag started;
+  std::mutex sink_mtx;
+  Logger::Sink sink;
+
+  State() {
+    for (uint64_t i = 0; i < Logger::kQueueRecords; ++i) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+};
+
+// Never destroyed, so records logged during exit still have a queue.
+State& GetState() {
+  static State* state = new State();
+  return *state;
+}
+
+uint64_t RealtimeNs() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+uint32_t ThreadNumber() {
+  static std::atomic<uint32_t> next = 1;
+  thread_local uint32_t number = next.fetch_add(1, std::memory_order_relaxed);
+  return number;
+}
+
+const char* LevelLetter(LogLevel level) {
+  switch (level) {
+    case LogLevel::kDebug:
+      return "D";
+    case LogLevel::kInfo:
+      return "I";
+    case LogLevel::kWarning:
+      return "W";
+    default:
+      return "E";
+  }
+}
+
+int SyslogPriority(LogLevel level) {
+  switch (level) {
+    case LogLevel::kDebug:
+      return LOG_DEBUG;
+    case LogLevel::kInfo:
+      return LOG_INFO;
+    case LogLevel::kWarning:
+      return LOG_WARNING;
+    default:
+      return LOG_ERR;
+  }
+}
+
+void DefaultSink(LogLevel level, const std::string& line) {
+  fprintf(stderr, "%s\n", line.c_str());
+  syslog(SyslogPriority(level), "%s", line.c_str());
+}
+
+std::string Prefix(const LogRecord& record) {
+  time_t seconds = record.time_ns / 1'000'000'000;
+  tm local;
+  localtime_r(&seconds, &local);
+  const char* file = strrchr(record.file, '/');
+  file = file != nullptr ? file + 1 : record.file;
+  char prefix[160];
+  snprintf(prefix, sizeof(prefix),
+           "[AirBeam][%s] %02d:%02d:%02d.%06u %u %s:%u: ",
+           LevelLetter(record.level), local.tm_hour, local.tm_min,
+           local.tm_sec,
+           static_cast<unsigned>(record.time_ns % 1'000'000'000 / 1000),
+           record.thread, file, record.line);
+  return prefix;
+}
+
+bool Ready(State& state) {
+  uint64_t pos = state.dequeue_pos.load(std::memory_order_relaxed);
+  const Cell& cell = state.cells[pos % Logger::kQueueRecords];
+  return cell.sequence.load(std::memory_order_acquire) == pos + 1;
+}
+
+bool Pop(State& state, LogRecord& record) {
+  uint64_t pos = state.dequeue_pos.load(std::memory_order_relaxed);
+  Cell& cell = state.cells[pos % Logger::kQueueRecords];
+  if (cell.sequence.load(std::memory_order_acquire) != pos + 1) return false;
+  record = cell.record;
+  cell.sequence.store(pos + Logger::kQueueRecords, std::memory_order_release);
+  state.dequeue_pos.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+// Blocks until the queue has a record.
+void WaitForRecord(State& state) {
+  std::unique_lock lock(state.wake_mtx);
+  state.sleeping.store(true, std::memory_order_relaxed);
+  // Pairs with the fence in Push: either the producer sees sleeping, or
+  // this sees its record.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (Ready(state)) {
+    state.sleeping.store(false, std::memory_order_relaxed);
+    return;
+  }
+  state.wake_cv.wait(lock, [&state]() {
+    return !state.sleeping.load(std::memory_order_relaxed);
+  });
+}
+
+void Drain(State& state) {
+  LogRecord record;
+  while (true) {
+    if (!Pop(state, record)) {
+      WaitForRecord(state);
+      continue;
+    }
+    std::string line = Prefix(record) + record.Format();
+    {
+      std::lock_guard guard(state.sink_mtx);
+      if (state.sink) {
+        state.sink(record.level, line);
+      } else {
+        DefaultSink(record.level, line);
+      }
+    }
+    state.delivered.fetch_add(1, std::memory_order_release);
+  }
+}
+
+void Start(State& state) {
+  std::thread([&state]() { Drain(state); }).detach();
+  std::atexit([]() { Logger::Flush(); });
+}
+
+// One printf conversion applied to one recorded argument. spec holds the
+// flags, width and precision, without length modifiers.
+void FormatArg(std::string& out, std::string spec, char conversion,
+               LogRecord::Tag tag, const uint8_t* data) {
+  char buffer[512];
+  int64_t int_value = 0;
+  uint64_t uint_value = 0;
+  double double_value = 0;
+  const void* pointer = nullptr;
+  switch (tag) {
+    case LogRecord::kInt:
+      memcpy(&int_value, data, sizeof(int_value));
+      uint_value = static_cast<uint64_t>(int_value);
+      double_value = static_cast<double>(int_value);
+      break;
+    case LogRecord::kUint:
+      memcpy(&uint_value, data, sizeof(uint_value));
+      int_value = static_cast<int64_t>(uint_value);
+      double_value = static_cast<double>(uint_value);
+      break;
+    case LogRecord::kDouble:
+      memcpy(&double_value, data, sizeof(double_value));
+      int_value = static_cast<int64_t>(double_value);
+      uint_value = static_cast<uint64_t>(double_value);
+      break;
+    case LogRecord::kPointer:
+      memcpy(&pointer, data, sizeof(pointer));
+      uint_value = reinterpret_cast<uintptr_t>(pointer);
+      int_value = static_cast<int64_t>(uint_value);
+      break;
+    case LogRecord::kString: {
+      uint16_t len;
+      memcpy(&len, data, sizeof(len));
+      std::string value(reinterpret_cast<const char*>(data + sizeof(len)),
+                        len);
+      if (conversion == 's') {
+        snprintf(buffer, sizeof(buffer), (spec + 's').c_str(), value.c_str());
+        // Strings are not cut to the scratch buffer.
+        out += strlen(buffer) + 1 < sizeof(buffer) ? std::string(buffer)
+                                                   : value;
+      } else {
+        out += value;
+      }
+      return;
+    }
+  }
+
+  switch (conversion) {
+    case 'd':
+    case 'i':
+      snprintf(buffer, sizeof(buffer), (spec + "lld").c_str(),
+               static_cast<long long>(int_value));
+      break;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+      snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(),
+               static_cast<unsigned long long>(uint_value));
+      break;
+    case 'c':
+      snprintf(buffer, sizeof(buffer), (spec + 'c').c_str(),
+               static_cast<int>(int_value));
+      break;
+    case 'p':
+      snprintf(buffer, sizeof(buffer), (spec + 'p').c_str(),
+               reinterpret_cast<void*>(static_cast<uintptr_t>(uint_value)));
+      break;
+    case 's':
+      snprintf(buffer, sizeof(buffer), "%s",
+               tag == LogRecord::kDouble ? std::to_string(double_value).c_str()
+               : tag == LogRecord::kInt  ? std::to_string(int_value).c_str()
+                                         : std::to_string(uint_value).c_str());
+      break;
+    default:
+      snprintf(buffer, sizeof(buffer), (spec + conversion).c_str(),
+               double_value);
+      break;
+  }
+  out += buffer;
+}
+}  // namespace
+
+#ifdef BUILD_DEBUG
+std::atomic<LogLevel> Logger::level_ = LogLevel::kDebug;
+#else
+std::atomic<LogLevel> Logger::level_ = LogLevel::kInfo;
+#endif
+
+void LogRecord::Put(Tag tag, const void* data, size_t size) {
+  if (truncated || arg_count == kMaxArgs ||
+      payload_len + size > kPayloadSize) {
+    truncated = true;
+    return;
+  }
+  tags[arg_count++] = tag;
+  memcpy(payload + payload_len, data, size);
+  payload_len += size;
+}
+
+void LogRecord::Encode(const char* value) {
+  if (value == nullptr) value = "(null)";
+  size_t room = kPayloadSize - payload_len;
+  if (truncated || arg_count == kMaxArgs || room <= sizeof(uint16_t)) {
+    truncated = true;
+    return;
+  }
+  size_t len = strlen(value);
+  if (len > room - sizeof(uint16_t)) {
+    len = room - sizeof(uint16_t);
+    truncated = true;
+  }
+  uint16_t stored = static_cast<uint16_t>(len);
+  tags[arg_count++] = kString;
+  memcpy(payload + payload_len, &stored, sizeof(stored));
+  memcpy(payload + payload_len + sizeof(stored), value, len);
+  payload_len += sizeof(stored) + len;
+}
+
+std::string LogRecord::Format() const {
+  std::string out;
+  size_t arg = 0;
+  size_t offset = 0;
+  for (const char* p = format; *p != '\0'; ++p) {
+    if (*p != '%') {
+      out += *p;
+      continue;
+    }
+    if (p[1] == '%') {
+      out += '%';
+      ++p;
+      continue;
+    }
+    std::string spec = "%";
+    ++p;
+    while (*p != '\0' && strchr("-+ #0123456789.", *p) != nullptr) spec += *p++;
+    while (*p != '\0' && strchr("hlLqjzt", *p) != nullptr) ++p;
+    if (*p == '\0') break;
+    if (arg >= arg_count) {
+      out += "<missing>";
+      continue;
+    }
+    size_t size = sizeof(uint64_t);
+    if (tags[arg] == kString) {
+      uint16_t len;
+      memcpy(&len, payload + offset, sizeof(len));
+      size = sizeof(len) + len;
+    }
+    FormatArg(out, spec, *p, tags[arg], payload + offset);
+    offset += size;
+    ++arg;
+  }
+  if (truncated) out += " <truncated>";
+  return out;
+}
+
+void Logger::SetSink(Sink sink) {
+  State& state = GetState();
+  std::lock_guard guard(state.sink_mtx);
+  state.sink = std::move(sink);
+}
+
+uint64_t Logger::Dropped() {
+  return GetState().dropped.load(std::memory_order_relaxed);
+}
+
+void Logger::Flush() {
+  State& state = GetState();
+  uint64_t target = state.enqueue_pos.load(std::memory_order_acquire);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (state.delivered.load(std::memory_order_acquire) < target &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void Logger::Push(LogRecord& record) {
+  State& state = GetState();
+  std::call_once(state.started, Start, std::ref(state));
+  record.time_ns = RealtimeNs();
+  record.thread = ThreadNumber();
+
+  uint64_t pos = state.enqueue_pos.load(std::memory_order_relaxed);
+  while (true) {
+    Cell& cell = state.cells[pos % kQueueRecords];
+    uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+    int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+    if (diff == 0) {
+      if (state.enqueue_pos.compare_exchange_weak(
+              pos, pos + 1, std::memory_order_relaxed)) {
+        cell.record = record;
+        cell.sequence.store(pos + 1, std::memory_order_release);
+        // Only a drain thread that found the queue empty needs waking.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (state.sleeping.load(std::memory_order_relaxed)) {
+          std::lock_guard guard(state.wake_mtx);
+          state.sleeping.store(false, std::memory_order_relaxed);
+          state.wake_cv.notify_one();
+        }
+        return;
+      }
+    } else if (diff < 0) {
+      state.dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      pos = state.enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+}
+}  // namespace helper
+}  // namespace AirBeamCore
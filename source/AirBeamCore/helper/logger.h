@@ -2,17 +2,139 @@
 
 #pragma once
 
-#ifdef BUILD_DEBUG
-#include <stdio.h>
-#include <syslog.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
 
-#define ABDebugLog(format, ...)                                               \
+namespace AirBeamCore {
+namespace helper {
+enum class LogLevel : uint8_t {
+  kDebug = 0,
+  kInfo = 1,
+  kWarning = 2,
+  kError = 3,
+  kOff = 4,
+};
+
+// A fixed-size, binary log entry: the format string and file are kept as
+// pointers, and the arguments as tagged raw values. Formatting happens later,
+// on the logging thread.
+struct LogRecord {
+  static constexpr size_t kMaxArgs = 12;
+  static constexpr size_t kPayloadSize = 176;
+  enum Tag : uint8_t { kInt, kUint, kDouble, kString, kPointer };
+
+  const char* format = nullptr;
+  const char* file = nullptr;
+  uint64_t time_ns = 0;
+  uint32_t line = 0;
+  uint32_t thread = 0;
+  LogLevel level = LogLevel::kInfo;
+  uint8_t arg_count = 0;
+  // Set when arguments did not fit in the payload and were cut.
+  bool truncated = false;
+  uint16_t payload_len = 0;
+  Tag tags[kMaxArgs];
+  uint8_t payload[kPayloadSize];
+
+  void Encode(int64_t value) { Put(kInt, &value, sizeof(value)); }
+  void Encode(uint64_t value) { Put(kUint, &value, sizeof(value)); }
+  void Encode(double value) { Put(kDouble, &value, sizeof(value)); }
+  void Encode(const void* value) { Put(kPointer, &value, sizeof(value)); }
+  void Encode(const char* value);
+  void Encode(const std::string& value) { Encode(value.c_str()); }
+
+  template <typename T>
+  void EncodeArg(const T& value) {
+    if constexpr (std::is_same_v<T, bool>) {
+      Encode(static_cast<int64_t>(value));
+    } else if constexpr (std::is_enum_v<T>) {
+      Encode(static_cast<int64_t>(value));
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+      Encode(static_cast<int64_t>(value));
+    } else if constexpr (std::is_integral_v<T>) {
+      Encode(static_cast<uint64_t>(value));
+    } else if constexpr (std::is_floating_point_v<T>) {
+      Encode(static_cast<double>(value));
+    } else if constexpr (std::is_convertible_v<T, const char*>) {
+      Encode(static_cast<const char*>(value));
+    } else if constexpr (std::is_same_v<T, std::string>) {
+      Encode(value);
+    } else {
+      static_assert(std::is_pointer_v<T>, "unsupported log argument");
+      Encode(static_cast<const void*>(value));
+    }
+  }
+
+  // printf-style rendering of the format with the recorded arguments.
+  std::string Format() const;
+
+ private:
+  void Put(Tag tag, const void* data, size_t size);
+};
+
+// Asynchronous, levelled logging. Call sites check the level with one
+// relaxed load, encode their arguments into a LogRecord and push it onto a
+// bounded lock-free queue; they never format, and only block or make a
+// syscall to wake the background thread when it found the queue empty.
+// That thread formats the records and hands the lines to the sink, stderr
+// and syslog by default. When the queue is full, records are dropped
+// and counted rather than stalling the caller.
+class Logger {
+ public:
+  static constexpr size_t kQueueRecords = 2048;
+  using Sink = std::function<void(LogLevel level, const std::string& line)>;
+
+  static bool ShouldLog(LogLevel level) {
+    return level >= level_.load(std::memory_order_relaxed);
+  }
+  static void SetLevel(LogLevel level) {
+    level_.store(level, std::memory_order_relaxed);
+  }
+  static LogLevel GetLevel() { return level_.load(std::memory_order_relaxed); }
+  // Replaces the default sink; an empty one restores it. Called on the
+  // logging thread only.
+  static void SetSink(Sink sink);
+  // Waits, up to a second, until everything logged so far reached the sink.
+  static void Flush();
+  static uint64_t Dropped();
+
+  template <typename... Args>
+  static void Log(LogLevel level, const char* file, int line,
+                  const char* format, const Args&... args) {
+    LogRecord record;
+    record.level = level;
+    record.file = file;
+    record.line = line;
+    record.format = format;
+    (record.EncodeArg(args), ...);
+    Push(record);
+  }
+
+ private:
+  static void Push(LogRecord& record);
+  static std::atomic<LogLevel> level_;
+};
+}  // namespace helper
+}  // namespace AirBeamCore
+
+#define ABLog(level, format, ...)                                             \
   do {                                                                        \
-    fprintf(stderr, "[AirBeamDebug] %s:%d: " format "\n", __FILE__, __LINE__, \
-            ##__VA_ARGS__);                                                   \
-    syslog(LOG_DEBUG, "[AirBeamDebug] %s:%d: " format, __FILE__, __LINE__,    \
-           ##__VA_ARGS__);                                                    \
+    if (::AirBeamCore::helper::Logger::ShouldLog(level)) {                    \
+      ::AirBeamCore::helper::Logger::Log(level, __FILE__, __LINE__, format,   \
+                                         ##__VA_ARGS__);                      \
+    }                                                                         \
   } while (0)
-#else
-#define ABDebugLog(format, ...)
-#endif
+
+#define ABDebugLog(format, ...) \
+  ABLog(::AirBeamCore::helper::LogLevel::kDebug, format, ##__VA_ARGS__)
+#define ABInfoLog(format, ...) \
+  ABLog(::AirBeamCore::helper::LogLevel::kInfo, format, ##__VA_ARGS__)
+#define ABWarningLog(format, ...) \
+  ABLog(::AirBeamCore::helper::LogLevel::kWarning, format, ##__VA_ARGS__)
+#define ABErrorLog(format, ...) \
+  ABLog(::AirBeamCore::helper::LogLevel::kError, format, ##__VA_ARGS__)
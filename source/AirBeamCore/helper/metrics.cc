@@ -0,0 +1,88 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace AirBeamCore {
+namespace helper {
+uint64_t Counter::Value() const {
+  uint64_t total = 0;
+  for (const auto& shard : shards_) {
+    total += shard.value.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+size_t Counter::ThreadShard() {
+  static std::atomic<size_t> next_thread = 0;
+  thread_local size_t shard =
+      next_thread.fetch_add(1, std::memory_order_relaxed) % kShards;
+  return shard;
+}
+
+void Histogram::Record(uint64_t value) {
+  buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  uint64_t seen = min_.load(std::memory_order_relaxed);
+  while (value < seen &&
+         !min_.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+  }
+  seen = max_.load(std::memory_order_relaxed);
+  while (value > seen &&
+         !max_.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+  }
+}
+
+HistogramSnapshot Histogram::Snapshot() const {
+  HistogramSnapshot snapshot;
+  snapshot.buckets.resize(kBuckets);
+  // Fields are read one at a time while writers carry on, so the count is
+  // taken from the buckets to keep percentiles consistent with them.
+  for (size_t i = 0; i < kBuckets; ++i) {
+    snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    snapshot.count += snapshot.buckets[i];
+  }
+  snapshot.sum = sum_.load(std::memory_order_relaxed);
+  snapshot.max = max_.load(std::memory_order_relaxed);
+  snapshot.min =
+      snapshot.count == 0 ? 0 : min_.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+size_t Histogram::BucketIndex(uint64_t value) {
+  constexpr uint64_t kSubBuckets = 1 << kSubBucketBits;
+  if (value < kSubBuckets) return value;
+  int msb = 63 - __builtin_clzll(value);
+  if (msb >= kMaxBits) return kBuckets - 1;
+  int shift = msb - kSubBucketBits;
+  return ((msb - kSubBucketBits + 1) << kSubBucketBits) +
+         ((value >> shift) & (kSubBuckets - 1));
+}
+
+uint64_t Histogram::BucketLowerBound(size_t index) {
+  constexpr uint64_t kSubBuckets = 1 << kSubBucketBits;
+  if (index < kSubBuckets) return index;
+  int shift = (index >> kSubBucketBits) - 1;
+  return (kSubBuckets + (index & (kSubBuckets - 1))) << shift;
+}
+
+uint64_t Histogram::BucketUpperBound(size_t index) {
+  if (index + 1 == kBuckets) return UINT64_MAX;
+  return BucketLowerBound(index + 1) - 1;
+}
+
+uint64_t HistogramSnapshot::Percentile(double q) const {
+  if (count == 0) return 0;
+  uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(count))));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    seen += buckets[i];
+    if (seen >= rank) return std::min(Histogram::BucketUpperBound(i), max);
+  }
+  return max;
+}
+}  // namespace helper
+}  // namespace AirBeamCore
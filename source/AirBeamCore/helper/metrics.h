@@ -0,0 +1,87 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace AirBeamCore {
+namespace helper {
+// Metric primitives cheap enough for the packet path: every update is a
+// relaxed atomic on memory no other metric shares a cache line with.
+
+// A monotonic count. Writers on different threads land in different shards,
+// so they do not bounce one cache line; reads add the shards up.
+class Counter {
+ public:
+  void Add(uint64_t n = 1) {
+    shards_[ThreadShard()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+  uint64_t Value() const;
+
+ private:
+  static constexpr size_t kShards = 8;
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> value{0};
+  };
+  static size_t ThreadShard();
+  std::array<Shard, kShards> shards_;
+};
+
+// A value that goes up and down, such as a queue depth.
+class Gauge {
+ public:
+  void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+  void Add(int64_t delta) {
+    value_.fetch_add(delta, std::memory_order_relaxed);
+  }
+  int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  alignas(64) std::atomic<int64_t> value_{0};
+};
+
+struct HistogramSnapshot {
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t min = 0;
+  uint64_t max = 0;
+  // Per bucket counts, indexed like Histogram::BucketIndex.
+  std::vector<uint64_t> buckets;
+
+  // Upper bound of the bucket holding the value at quantile q (0..1),
+  // clamped to max; 0 when empty.
+  uint64_t Percentile(double q) const;
+  double Mean() const { return count == 0 ? 0 : double(sum) / count; }
+};
+
+// Log-linear buckets in the manner of HdrHistogram: values below 16 get a
+// bucket each, and every power of two above is split into 16 buckets, so a
+// recorded value is off by at most 1/16 of itself. Values of 2^40 and more
+// land in the last bucket; in nanoseconds that is over 18 minutes.
+class Histogram {
+ public:
+  static constexpr int kSubBucketBits = 4;
+  static constexpr int kMaxBits = 40;
+  static constexpr size_t kBuckets =
+      (kMaxBits - kSubBucketBits + 1) << kSubBucketBits;
+
+  void Record(uint64_t value);
+  HistogramSnapshot Snapshot() const;
+
+  static size_t BucketIndex(uint64_t value);
+  // Smallest and largest values that map to the bucket.
+  static uint64_t BucketLowerBound(size_t index);
+  static uint64_t BucketUpperBound(size_t index);
+
+ private:
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> min_{UINT64_MAX};
+  std::atomic<uint64_t> max_{0};
+  std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+};
+}  // namespace helper
+}  // namespace AirBeamCore
@@ -0,0 +1,198 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "metrics_registry.h"
+
+#include <cmath>
+#include <utility>
+
+#include "fmt/core.h"
+
+namespace AirBeamCore {
+namespace helper {
+namespace {
+// Prometheus and JSON escape the same three characters in label values.
+std::string Escape(const std::string& value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+std::string FormatNumber(double value) {
+  if (std::isinf(value)) return value > 0 ? "+Inf" : "-Inf";
+  if (std::isnan(value)) return "NaN";
+  return fmt::format("{}", value);
+}
+
+std::string PrometheusLabels(const MetricLabels& labels,
+                             const std::string& le = "") {
+  if (labels.empty() && le.empty()) return "";
+  std::string out = "{";
+  for (const auto& [key, value] : labels) {
+    if (out.size() > 1) out += ',';
+    out += fmt::format("{}=\"{}\"", key, Escape(value));
+  }
+  if (!le.empty()) {
+    if (out.size() > 1) out += ',';
+    out += fmt::format("le=\"{}\"", le);
+  }
+  return out + "}";
+}
+
+std::string JsonLabels(const MetricLabels& labels) {
+  std::string out = "{";
+  for (const auto& [key, value] : labels) {
+    if (out.size() > 1) out += ',';
+    out += fmt::format("\"{}\":\"{}\"", Escape(key), Escape(value));
+  }
+  return out + "}";
+}
+}  // namespace
+
+void MetricsWriter::Counter(const std::string& name, const std::string& help,
+                            const MetricLabels& labels, uint64_t value) {
+  Add(name, help, Type::kCounter, labels).value = static_cast<double>(value);
+}
+
+void MetricsWriter::Gauge(const std::string& name, const std::string& help,
+                          const MetricLabels& labels, double value) {
+  Add(name, help, Type::kGauge, labels).value = value;
+}
+
+void MetricsWriter::Histogram(const std::string& name,
+                              const std::string& help,
+                              const MetricLabels& labels,
+                              const HistogramSnapshot& snapshot,
+                              double scale) {
+  Sample& sample = Add(name, help, Type::kHistogram, labels);
+  sample.histogram = snapshot;
+  sample.scale = scale;
+}
+
+MetricsWriter::Sample& MetricsWriter::Add(const std::string& name,
+                                          const std::string& help, Type type,
+                                          const MetricLabels& labels) {
+  auto it = index_.find(name);
+  if (it == index_.end()) {
+    it = index_.emplace(name, families_.size()).first;
+    families_.push_back({name, help, type, {}});
+  }
+  auto& samples = families_[it->second].samples;
+  Sample sample;
+  sample.labels = labels;
+  samples.push_back(std::move(sample));
+  return samples.back();
+}
+
+std::string MetricsWriter::ToPrometheus() const {
+  std::string out;
+  for (const auto& family : families_) {
+    const char* type = family.type == Type::kCounter ? "counter"
+                       : family.type == Type::kGauge ? "gauge"
+                                                     : "histogram";
+    out += fmt::format("# HELP {} {}\n# TYPE {} {}\n", family.name,
+                       family.help, family.name, type);
+    for (const auto& sample : family.samples) {
+      if (family.type != Type::kHistogram) {
+        out += fmt::format("{}{} {}\n", family.name,
+                           PrometheusLabels(sample.labels),
+                           FormatNumber(sample.value));
+        continue;
+      }
+      // Power-of-two bounds line up with the log-linear buckets, so every
+      // cumulative count is exact: the bucket of 2^k starts at 2^k.
+      const auto& histogram = sample.histogram;
+      uint64_t cumulative = 0;
+      size_t next = 0;
+      for (int bit = 0; bit < helper::Histogram::kMaxBits; ++bit) {
+        size_t end = helper::Histogram::BucketIndex(uint64_t{1} << bit);
+        for (; next < end && next < histogram.buckets.size(); ++next) {
+          cumulative += histogram.buckets[next];
+        }
+        // Bounds below the first sample are left out to keep scrapes short.
+        if (cumulative == 0) continue;
+        double le = static_cast<double>(uint64_t{1} << bit) * sample.scale;
+        out += fmt::format("{}_bucket{} {}\n", family.name,
+                           PrometheusLabels(sample.labels, FormatNumber(le)),
+                           cumulative);
+      }
+      out += fmt::format("{}_bucket{} {}\n", family.name,
+                         PrometheusLabels(sample.labels, "+Inf"),
+                         histogram.count);
+      out += fmt::format("{}_sum{} {}\n", family.name,
+                         PrometheusLabels(sample.labels),
+                         FormatNumber(histogram.sum * sample.scale));
+      out += fmt::format("{}_count{} {}\n", family.name,
+                         PrometheusLabels(sample.labels), histogram.count);
+    }
+  }
+  return out;
+}
+
+std::string MetricsWriter::ToJson() const {
+  std::string out = "{";
+  for (size_t f = 0; f < families_.size(); ++f) {
+    const auto& family = families_[f];
+    const char* type = family.type == Type::kCounter ? "counter"
+                       : family.type == Type::kGauge ? "gauge"
+                                                     : "histogram";
+    if (f > 0) out += ',';
+    out += fmt::format("\"{}\":{{\"help\":\"{}\",\"type\":\"{}\",\"samples\":[",
+                       family.name, Escape(family.help), type);
+    for (size_t s = 0; s < family.samples.size(); ++s) {
+      const auto& sample = family.samples[s];
+      if (s > 0) out += ',';
+      out += fmt::format("{{\"labels\":{}", JsonLabels(sample.labels));
+      if (family.type != Type::kHistogram) {
+        out += fmt::format(",\"value\":{}}}", FormatNumber(sample.value));
+        continue;
+      }
+      const auto& histogram = sample.histogram;
+      double scale = sample.scale;
+      out += fmt::format(
+          ",\"count\":{},\"sum\":{},\"min\":{},\"max\":{},\"p50\":{},"
+          "\"p90\":{},\"p99\":{},\"p999\":{}}}",
+          histogram.count, FormatNumber(histogram.sum * scale),
+          FormatNumber(histogram.min * scale),
+          FormatNumber(histogram.max * scale),
+          FormatNumber(histogram.Percentile(0.5) * scale),
+          FormatNumber(histogram.Percentile(0.9) * scale),
+          FormatNumber(histogram.Percentile(0.99) * scale),
+          FormatNumber(histogram.Percentile(0.999) * scale));
+    }
+    out += "]}";
+  }
+  return out + "}";
+}
+
+MetricsRegistry& MetricsRegistry::Default() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+MetricsRegistry::CollectorId MetricsRegistry::Register(Collector collector) {
+  std::lock_guard guard(mtx_);
+  CollectorId id = next_id_++;
+  collectors_.emplace(id, std::move(collector));
+  return id;
+}
+
+void MetricsRegistry::Unregister(CollectorId id) {
+  std::lock_guard guard(mtx_);
+  collectors_.erase(id);
+}
+
+void MetricsRegistry::Collect(MetricsWriter& writer) {
+  std::lock_guard guard(mtx_);
+  for (const auto& [id, collector] : collectors_) collector(writer);
+}
+}  // namespace helper
+}  // namespace AirBeamCore
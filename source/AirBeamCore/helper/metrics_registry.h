@@ -0,0 +1,83 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "helper/metrics.h"
+
+namespace AirBeamCore {
+namespace helper {
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+// Collects named samples during one scrape and renders them. Samples with
+// the same name form one family and share its help text and type.
+class MetricsWriter {
+ public:
+  void Counter(const std::string& name, const std::string& help,
+               const MetricLabels& labels, uint64_t value);
+  void Gauge(const std::string& name, const std::string& help,
+             const MetricLabels& labels, double value);
+  // Recorded values are multiplied by scale on output, e.g. 1e-9 to export
+  // a nanosecond histogram in seconds.
+  void Histogram(const std::string& name, const std::string& help,
+                 const MetricLabels& labels,
+                 const HistogramSnapshot& snapshot, double scale);
+
+  // Prometheus text exposition format 0.0.4. Histograms are cut down to
+  // power-of-two bucket bounds.
+  std::string ToPrometheus() const;
+  // One object per family, with a count, sum, min, max and a few
+  // percentiles per histogram sample.
+  std::string ToJson() const;
+
+ private:
+  enum class Type { kCounter, kGauge, kHistogram };
+  struct Sample {
+    MetricLabels labels;
+    double value = 0;
+    HistogramSnapshot histogram;
+    double scale = 1;
+  };
+  struct Family {
+    std::string name;
+    std::string help;
+    Type type;
+    std::vector<Sample> samples;
+  };
+
+  Sample& Add(const std::string& name, const std::string& help, Type type,
+              const MetricLabels& labels);
+
+  std::vector<Family> families_;
+  std::map<std::string, size_t> index_;
+};
+
+// Sources of metrics, asked for their current values on every scrape. The
+// collectors read what the writers publish with relaxed atomics, so a
+// scrape never holds up the audio path.
+class MetricsRegistry {
+ public:
+  using CollectorId = uint64_t;
+  using Collector = std::function<void(MetricsWriter& writer)>;
+
+  static MetricsRegistry& Default();
+
+  CollectorId Register(Collector collector);
+  // Once this returns the collector is not running and will not run again.
+  void Unregister(CollectorId id);
+  void Collect(MetricsWriter& writer);
+
+ private:
+  std::mutex mtx_;
+  CollectorId next_id_ = 1;
+  std::map<CollectorId, Collector> collectors_;
+};
+}  // namespace helper
+}  // namespace AirBeamCore
@@ -0,0 +1,171 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "metrics_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+#include "fmt/core.h"
+#include "helper/logger.h"
+#include "helper/trace.h"
+
+namespace AirBeamCore {
+namespace helper {
+namespace {
+constexpr size_t kMaxRequestBytes = 8192;
+constexpr int kRequestTimeoutMs = 1000;
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+void SendAll(int fd, const std::string& data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, kSendFlags);
+    if (n <= 0) return;
+    sent += n;
+  }
+}
+
+std::string Response(const std::string& status,
+                     const std::string& content_type,
+                     const std::string& body) {
+  return fmt::format(
+      "HTTP/1.0 {}\r\nContent-Type: {}\r\nContent-Length: {}\r\n"
+      "Connection: close\r\n\r\n{}",
+      status, content_type, body.size(), body);
+}
+}  // namespace
+
+MetricsServer::MetricsServer(MetricsRegistry& registry)
+    : MetricsServer(registry, Options()) {}
+
+MetricsServer::MetricsServer(MetricsRegistry& registry, const Options& options)
+    : registry_(registry), options_(options) {}
+
+MetricsServer::~MetricsServer() { Stop(); }
+
+ErrCode MetricsServer::Start() {
+  ErrCode ret = Listen();
+  if (ret != kOk) {
+    // Closed so that a later Start can try again.
+    if (listen_fd_ >= 0) close(listen_fd_);
+    listen_fd_ = -1;
+    return ret;
+  }
+  thread_ = std::thread([this]() { Loop(); });
+  return kOk;
+}
+
+ErrCode MetricsServer::Listen() {
+  if (!options_.unix_path.empty()) {
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) return kErrTcpSocketCreate;
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (options_.unix_path.size() >= sizeof(addr.sun_path)) {
+      return kErrTcpAddrParse;
+    }
+    strncpy(addr.sun_path, options_.unix_path.c_str(),
+            sizeof(addr.sun_path) - 1);
+    unlink(options_.unix_path.c_str());
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) !=
+        0) {
+      return kErrTcpBind;
+    }
+  } else {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) return kErrTcpSocketCreate;
+    int reuse = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(options_.port);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) !=
+        0) {
+      return kErrTcpBind;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+  }
+  if (listen(listen_fd_, 16) != 0) return kErrTcpListen;
+  return kOk;
+}
+
+void MetricsServer::Stop() {
+  if (stopped_.exchange(true)) return;
+  if (thread_.joinable()) thread_.join();
+  if (listen_fd_ >= 0) close(listen_fd_);
+  if (!options_.unix_path.empty()) unlink(options_.unix_path.c_str());
+}
+
+void MetricsServer::Loop() {
+  while (!stopped_) {
+    pollfd pfd = {listen_fd_, POLLIN, 0};
+    if (poll(&pfd, 1, 100) <= 0) continue;
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) continue;
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    Serve(fd);
+    close(fd);
+  }
+}
+
+void MetricsServer::Serve(int fd) {
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n\r\n") == std::string::npos &&
+         request.size() < kMaxRequestBytes) {
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, kRequestTimeoutMs) <= 0) return;
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n <= 0) return;
+    request.append(buffer, n);
+  }
+
+  std::string line = request.substr(0, request.find("\r\n"));
+  size_t path_begin = line.find(' ');
+  size_t path_end = line.find(' ', path_begin + 1);
+  if (path_begin == std::string::npos || path_end == std::string::npos ||
+      line.compare(0, path_begin, "GET") != 0) {
+    SendAll(fd, Response("405 Method Not Allowed", "text/plain", ""));
+    return;
+  }
+  std::string path = line.substr(path_begin + 1, path_end - path_begin - 1);
+
+  if (path == "/metrics" || path == "/metrics.json") {
+    MetricsWriter writer;
+    registry_.Collect(writer);
+    if (path == "/metrics") {
+      SendAll(fd, Response("200 OK", "text/plain; version=0.0.4",
+                           writer.ToPrometheus()));
+    } else {
+      SendAll(fd, Response("200 OK", "application/json", writer.ToJson()));
+    }
+    return;
+  }
+  if (path == "/trace.json") {
+    SendAll(fd, Response("200 OK", "application/json",
+                         Tracer::DumpChromeJson()));
+    return;
+  }
+  ABDebugLog("MetricsServer: no route for %s", path.c_str());
+  SendAll(fd, Response("404 Not Found", "text/plain", ""));
+}
+}  // namespace helper
+}  // namespace AirBeamCore
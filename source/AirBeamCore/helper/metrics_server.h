@@ -0,0 +1,53 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "helper/errcode.h"
+#include "helper/metrics_registry.h"
+
+namespace AirBeamCore {
+namespace helper {
+// A minimal HTTP/1.0 server for scraping a MetricsRegistry, on its own
+// thread. It only listens locally: on a Unix-domain socket when unix_path
+// is set, otherwise on 127.0.0.1.
+//
+//   GET /metrics       Prometheus text
+//   GET /metrics.json  JSON
+//   GET /trace.json    Chrome trace of the spans recorded so far
+class MetricsServer {
+ public:
+  struct Options {
+    std::string unix_path;
+    // 0 picks a free port.
+    uint32_t port = 0;
+  };
+
+  explicit MetricsServer(MetricsRegistry& registry);
+  MetricsServer(MetricsRegistry& registry, const Options& options);
+  ~MetricsServer();
+
+  ErrCode Start();
+  void Stop();
+  // The TCP port, once started; 0 when serving on a Unix-domain socket.
+  uint32_t GetPort() const { return port_; }
+
+ private:
+  // Opens, binds and listens on listen_fd_.
+  ErrCode Listen();
+  void Loop();
+  void Serve(int fd);
+
+  MetricsRegistry& registry_;
+  const Options options_;
+  int listen_fd_ = -1;
+  uint32_t port_ = 0;
+  std::atomic<bool> stopped_ = false;
+  std::thread thread_;
+};
+}  // namespace helper
+}  // namespace AirBeamCore
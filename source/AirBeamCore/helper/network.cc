@@ -3,14 +3,22 @@
 #include "network.h"
 
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
+#include <cstdlib>
 #include <cstring>
 
 #include "errcode.h"
+#include "helper/capture.h"
 #include "helper/logger.h"
 
 namespace AirBeamCore {
@@ -20,50 +28,279 @@ std::string NetAddr::ToString() const {
   return ip_ + ":" + std::to_string(port_);
 }
 
+ErrCode SockAddr::Parse(const NetAddr& addr) {
+  storage = {};
+  auto* v4 = reinterpret_cast<sockaddr_in*>(&storage);
+  if (inet_pton(AF_INET, addr.ip_.c_str(), &v4->sin_addr) == 1) {
+    v4->sin_family = AF_INET;
+    v4->sin_port = htons(addr.port_);
+    len = sizeof(sockaddr_in);
+    return kOk;
+  }
+  // A link-local address carries its interface, e.g. "fe80::1%en0".
+  size_t percent = addr.ip_.find('%');
+  std::string ip = addr.ip_.substr(0, percent);
+  auto* v6 = reinterpret_cast<sockaddr_in6*>(&storage);
+  if (inet_pton(AF_INET6, ip.c_str(), &v6->sin6_addr) == 1) {
+    v6->sin6_family = AF_INET6;
+    v6->sin6_port = htons(addr.port_);
+    if (percent != std::string::npos) {
+      std::string scope = addr.ip_.substr(percent + 1);
+      v6->sin6_scope_id = if_nametoindex(scope.c_str());
+      if (v6->sin6_scope_id == 0) v6->sin6_scope_id = atoi(scope.c_str());
+    }
+    len = sizeof(sockaddr_in6);
+    return kOk;
+  }
+  len = 0;
+  return kErrUdpAddrParse;
+}
+
+int SockAddr::Family(const std::string& ip) {
+  SockAddr addr;
+  if (addr.Parse({ip, 0}) != kOk) return AF_UNSPEC;
+  return addr.storage.ss_family;
+}
+
+std::string UriHost(const std::string& ip) {
+  if (ip.find(':') == std::string::npos) return ip;
+  // RFC 3986 wants the zone's "%" escaped inside the brackets.
+  std::string host = "[";
+  for (char c : ip) {
+    if (c == '%') {
+      host += "%25";
+    } else {
+      host += c;
+    }
+  }
+  return host + "]";
+}
+
+namespace {
+using Clock = std::chrono::steady_clock;
+using Direction = PacketCapture::Direction;
+using Protocol = PacketCapture::Protocol;
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+NetAddr ToNetAddr(const sockaddr_storage& addr) {
+  NetAddr result;
+  char ip[INET6_ADDRSTRLEN] = {0};
+  if (addr.ss_family == AF_INET6) {
+    auto* v6 = reinterpret_cast<const sockaddr_in6*>(&addr);
+    inet_ntop(AF_INET6, &v6->sin6_addr, ip, sizeof(ip));
+    result.port_ = ntohs(v6->sin6_port);
+    if (v6->sin6_scope_id != 0) {
+      char name[IF_NAMESIZE] = {0};
+      result.ip_ = std::string(ip) + "%" +
+                   (if_indextoname(v6->sin6_scope_id, name) != nullptr
+                        ? std::string(name)
+                        : std::to_string(v6->sin6_scope_id));
+      return result;
+    }
+  } else {
+    auto* v4 = reinterpret_cast<const sockaddr_in*>(&addr);
+    inet_ntop(AF_INET, &v4->sin_addr, ip, sizeof(ip));
+    result.port_ = ntohs(v4->sin_port);
+  }
+  result.ip_ = ip;
+  return result;
+}
+
+void SetNonBlocking(int fd, bool non_blocking) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0) return;
+  fcntl(fd, F_SETFL, non_blocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK);
+}
+
+void SetIOTimeout(int fd, std::chrono::milliseconds timeout) {
+  timeval tv{};
+  tv.tv_sec = static_cast<decltype(tv.tv_sec)>(timeout.count() / 1000);
+  tv.tv_usec =
+      static_cast<decltype(tv.tv_usec)>((timeout.count() % 1000) * 1000);
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#ifdef SO_NOSIGPIPE
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+}  // namespace
+
+std::vector<std::string> ResolveHost(const std::string& host) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result = nullptr;
+  std::vector<std::string> addrs;
+  if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0) return addrs;
+  for (addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+    if (ai->ai_family != AF_INET && ai->ai_family != AF_INET6) continue;
+    sockaddr_storage addr{};
+    memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+    addrs.push_back(ToNetAddr(addr).ip_);
+  }
+  freeaddrinfo(result);
+  return addrs;
+}
+
 TCPClient::TCPClient() = default;
 TCPClient::~TCPClient() { Close(); }
 
 ErrCode TCPClient::Connect(const std::string& ip, int port) {
+  return Connect(std::vector<NetAddr>{{ip, static_cast<uint32_t>(port)}});
+}
+
+ErrCode TCPClient::Connect(const std::vector<std::string>& ips, int port) {
+  std::vector<NetAddr> candidates;
+  for (const auto& ip : ips) {
+    candidates.push_back({ip, static_cast<uint32_t>(port)});
+  }
+  return Connect(candidates);
+}
+
+ErrCode TCPClient::Connect(const std::vector<NetAddr>& candidates) {
   if (sockfd_ != -1) Close();
-  sockfd_ = socket(AF_INET, SOCK_STREAM, 0);
-  if (sockfd_ < 0) return kErrTcpSocketCreate;
 
-  struct sockaddr_in remote_addr {};
-  struct sockaddr_in local_addr {};
+  struct Attempt {
+    int fd;
+    const NetAddr* addr;
+  };
+  std::vector<Attempt> pending;
+  size_t next = 0;
+  auto deadline = Clock::now() + options_.connect_timeout;
+  auto next_attempt_at = Clock::now();
+  ErrCode err = kErrTcpConnect;
+  Attempt winner{-1, nullptr};
 
-  memset(&remote_addr, 0, sizeof(remote_addr));
-  remote_addr.sin_family = AF_INET;
-  remote_addr.sin_port = htons(port);
-  if (inet_pton(AF_INET, ip.c_str(), &remote_addr.sin_addr) <= 0)
-    return kErrTcpAddrParse;
-  if (connect(sockfd_, (sockaddr*)&remote_addr, sizeof(remote_addr)) < 0)
-    return kErrTcpConnect;
-  socklen_t len = sizeof(local_addr);
-  getsockname(sockfd_, (sockaddr*)&local_addr, &len);
+  while (winner.fd == -1) {
+    auto now = Clock::now();
+    if (now >= deadline) {
+      err = kErrTcpTimeout;
+      break;
+    }
+
+    if (next < candidates.size() &&
+        (now >= next_attempt_at || pending.empty())) {
+      const NetAddr& addr = candidates[next++];
+      SockAddr remote_addr;
+      if (remote_addr.Parse(addr) != kOk) {
+        err = kErrTcpAddrParse;
+        continue;
+      }
+      int fd = socket(remote_addr.storage.ss_family, SOCK_STREAM, 0);
+      if (fd < 0) {
+        err = kErrTcpSocketCreate;
+        continue;
+      }
+      SetNonBlocking(fd, true);
+      if (connect(fd, remote_addr.Get(), remote_addr.len) == 0) {
+        winner = {fd, &addr};
+        break;
+      }
+      if (errno != EINPROGRESS) {
+        ABDebugLog("connect %s failed, errno=%d", addr.ToString().c_str(),
+                   errno);
+        close(fd);
+        err = kErrTcpConnect;
+        continue;
+      }
+      pending.push_back({fd, &addr});
+      next_attempt_at = now + options_.attempt_delay;
+      continue;
+    }
+    if (pending.empty()) break;
+
+    auto wake_at = deadline;
+    if (next < candidates.size()) wake_at = std::min(wake_at, next_attempt_at);
+    int timeout_ms = static_cast<int>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(wake_at - now)
+            .count() +
+        1);
 
-  char ipaddr[INET_ADDRSTRLEN];
-  inet_ntop(AF_INET, &local_addr.sin_addr, ipaddr, sizeof(ipaddr));
+    std::vector<pollfd> fds;
+    for (const auto& attempt : pending) fds.push_back({attempt.fd, POLLOUT, 0});
+    if (poll(fds.data(), fds.size(), timeout_ms) < 0 && errno != EINTR) break;
 
-  remote_addr_.ip_ = ip;
-  remote_addr_.port_ = ntohs(remote_addr.sin_port);
+    for (size_t i = fds.size(); i-- > 0;) {
+      if (fds[i].revents == 0) continue;
+      int so_error = 0;
+      socklen_t so_len = sizeof(so_error);
+      getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &so_error, &so_len);
+      if (so_error == 0 && winner.fd == -1) {
+        winner = pending[i];
+      } else {
+        ABDebugLog("connect %s failed, errno=%d",
+                   pending[i].addr->ToString().c_str(), so_error);
+        close(fds[i].fd);
+        err = kErrTcpConnect;
+        // A failed attempt hands over to the next candidate right away.
+        next_attempt_at = now;
+      }
+      pending.erase(pending.begin() + i);
+    }
+  }
+
+  for (const auto& attempt : pending) {
+    if (attempt.fd != winner.fd) close(attempt.fd);
+  }
+  if (winner.fd == -1) return err;
 
-  local_addr_.ip_ = ipaddr;
-  local_addr_.port_ = ntohs(local_addr.sin_port);
+  sockfd_ = winner.fd;
+  SetNonBlocking(sockfd_, false);
+  SetIOTimeout(sockfd_, options_.io_timeout);
+
+  sockaddr_storage local_addr{};
+  socklen_t len = sizeof(local_addr);
+  getsockname(sockfd_, (sockaddr*)&local_addr, &len);
+
+  remote_addr_ = *winner.addr;
+  local_addr_ = ToNetAddr(local_addr);
+  SockAddr remote_sockaddr;
+  remote_sockaddr.Parse(remote_addr_);
+  remote_sockaddr_ = remote_sockaddr.storage;
+  local_sockaddr_ = local_addr;
   return kOk;
 }
 
-ErrCode TCPClient::Write(const std::string& data) {
+ErrCode TCPClient::Write(const std::string& data, bool wait) {
   if (sockfd_ < 0) return kErrTcpSocketCreate;
-  ssize_t sent = send(sockfd_, data.data(), data.size(), 0);
-  return sent < 0 ? kErrTcpSend : kOk;
+  const int flags = wait ? kSendFlags : kSendFlags | MSG_DONTWAIT;
+  size_t offset = 0;
+  while (offset < data.size()) {
+    ssize_t sent =
+        send(sockfd_, data.data() + offset, data.size() - offset, flags);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK ? kErrTcpTimeout
+                                                     : kErrTcpSend;
+    }
+    offset += sent;
+  }
+  PacketCapture::Tap({Protocol::kTcp, Direction::kOutbound,
+                      reinterpret_cast<const sockaddr*>(&local_sockaddr_),
+                      reinterpret_cast<const sockaddr*>(&remote_sockaddr_),
+                      reinterpret_cast<const uint8_t*>(data.data()),
+                      data.size()});
+  return kOk;
 }
 
-ErrCode TCPClient::Read(std::string& data) {
+ErrCode TCPClient::Read(std::string& data, bool wait) {
   if (sockfd_ < 0) return kErrTcpSocketCreate;
   char buf[4096];
-  ssize_t n = recv(sockfd_, buf, sizeof(buf), 0);
+  ssize_t n = recv(sockfd_, buf, sizeof(buf), wait ? 0 : MSG_DONTWAIT);
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return kErrTcpTimeout;
   if (n <= 0) return kErrTcpRecv;
   data.assign(buf, n);
+  PacketCapture::Tap({Protocol::kTcp, Direction::kInbound,
+                      reinterpret_cast<const sockaddr*>(&local_sockaddr_),
+                      reinterpret_cast<const sockaddr*>(&remote_sockaddr_),
+                      reinterpret_cast<const uint8_t*>(buf),
+                      static_cast<size_t>(n)});
   return kOk;
 }
 
@@ -77,55 +314,127 @@ void TCPClient::Close() {
 UDPServer::UDPServer() = default;
 UDPServer::~UDPServer() { Close(); }
 
-ErrCode UDPServer::Bind() {
+ErrCode UDPServer::Bind(int family) {
   if (sockfd_ != -1) Close();
-  sockfd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  sockfd_ = socket(family, SOCK_DGRAM, 0);
   if (sockfd_ < 0) return kErrUdpSocketCreate;
-  struct sockaddr_in local_addr {};
-  memset(&local_addr, 0, sizeof(local_addr));
-  local_addr.sin_family = AF_INET;
-  local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-  local_addr.sin_port = htons(0);  // random
-  if (bind(sockfd_, (sockaddr*)&local_addr, sizeof(local_addr)) < 0)
-    return kErrUdpBind;
-
-  socklen_t addr_len = sizeof(local_addr);
+  sockaddr_storage local_addr{};
+  socklen_t addr_len;
+  if (family == AF_INET6) {
+    auto* v6 = reinterpret_cast<sockaddr_in6*>(&local_addr);
+    v6->sin6_family = AF_INET6;
+    v6->sin6_addr = in6addr_any;
+    v6->sin6_port = htons(0);  // random
+    addr_len = sizeof(sockaddr_in6);
+  } else {
+    auto* v4 = reinterpret_cast<sockaddr_in*>(&local_addr);
+    v4->sin_family = AF_INET;
+    v4->sin_addr.s_addr = htonl(INADDR_ANY);
+    v4->sin_port = htons(0);  // random
+    addr_len = sizeof(sockaddr_in);
+  }
+  if (bind(sockfd_, (sockaddr*)&local_addr, addr_len) < 0) return kErrUdpBind;
+
+  addr_len = sizeof(local_addr);
   if (getsockname(sockfd_, (sockaddr*)&local_addr, &addr_len) < 0)
     return kErrGetsockName;
 
-  char ip[INET_ADDRSTRLEN];
-  inet_ntop(AF_INET, &local_addr.sin_addr, ip, sizeof(ip));
-
-  local_addr_.ip_ = ip;
-  local_addr_.port_ = ntohs(local_addr.sin_port);
+  local_addr_ = ToNetAddr(local_addr);
+  local_sockaddr_ = local_addr;
 
   return kOk;
 }
 
 ErrCode UDPServer::Write(const NetAddr& remote_addr, const std::string& data) {
   if (sockfd_ < 0) return kErrUdpSocketCreate;
-  sockaddr_in dest{};
-  dest.sin_family = AF_INET;
-  dest.sin_port = htons(remote_addr.port_);
-  if (inet_pton(AF_INET, remote_addr.ip_.c_str(), &dest.sin_addr) <= 0)
-    return kErrUdpAddrParse;
-  ssize_t sent = sendto(sockfd_, data.data(), data.size(), 0, (sockaddr*)&dest,
-                        sizeof(dest));
-  return sent < 0 ? kErrUdpSend : kOk;
+  SockAddr dest;
+  if (dest.Parse(remote_addr) != kOk) return kErrUdpAddrParse;
+  ssize_t sent =
+      sendto(sockfd_, data.data(), data.size(), 0, dest.Get(), dest.len);
+  if (sent < 0) return kErrUdpSend;
+  PacketCapture::Tap({Protocol::kUdp, Direction::kOutbound,
+                      reinterpret_cast<const sockaddr*>(&local_sockaddr_),
+                      dest.Get(), reinterpret_cast<const uint8_t*>(data.data()),
+                      data.size()});
+  return kOk;
+}
+
+ErrCode UDPServer::WriteBatch(const std::vector<UDPMessage>& messages,
+                              std::vector<size_t>* failed) {
+  std::vector<size_t>& skipped = failed != nullptr ? *failed : batch_failed_;
+  skipped.clear();
+  if (sockfd_ < 0) return kErrUdpSocketCreate;
+  // resize keeps the capacity, so a steady batch size allocates nothing.
+  batch_iovs_.resize(messages.size() * 2);
+  batch_hdrs_.resize(messages.size());
+  for (size_t i = 0; i < messages.size(); ++i) {
+    const auto& message = messages[i];
+    batch_iovs_[i * 2] = {const_cast<uint8_t*>(message.header),
+                          message.header_len};
+    batch_iovs_[i * 2 + 1] = {const_cast<uint8_t*>(message.payload),
+                              message.payload_len};
+    batch_hdrs_[i] = {};
+    batch_hdrs_[i].msg_name = const_cast<sockaddr*>(message.remote_addr->Get());
+    batch_hdrs_[i].msg_namelen = message.remote_addr->len;
+    batch_hdrs_[i].msg_iov = &batch_iovs_[i * 2];
+    batch_hdrs_[i].msg_iovlen = 2;
+  }
+
+#ifdef __linux__
+  batch_mmsgs_.resize(messages.size());
+  for (size_t i = 0; i < messages.size(); ++i) {
+    batch_mmsgs_[i] = {batch_hdrs_[i], 0};
+  }
+  // sendmmsg stops at the first message that fails, and fails itself only
+  // when that is the first one; the next call then skips it.
+  size_t sent = 0;
+  while (sent < batch_mmsgs_.size()) {
+    int n = sendmmsg(sockfd_, batch_mmsgs_.data() + sent,
+                     batch_mmsgs_.size() - sent, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      ABDebugLog("sendmmsg of message %zu failed, errno=%d", sent, errno);
+      skipped.push_back(sent++);
+      continue;
+    }
+    sent += n;
+  }
+#else
+  for (size_t i = 0; i < batch_hdrs_.size(); ++i) {
+    if (sendmsg(sockfd_, &batch_hdrs_[i], 0) >= 0) continue;
+    ABDebugLog("sendmsg of message %zu failed, errno=%d", i, errno);
+    skipped.push_back(i);
+  }
+#endif
+  size_t next_skipped = 0;
+  for (size_t i = 0; i < messages.size(); ++i) {
+    if (next_skipped < skipped.size() && skipped[next_skipped] == i) {
+      next_skipped++;
+      continue;
+    }
+    PacketCapture::Tap({Protocol::kUdp, Direction::kOutbound,
+                        reinterpret_cast<const sockaddr*>(&local_sockaddr_),
+                        messages[i].remote_addr->Get(),
+                        messages[i].header, messages[i].header_len,
+                        messages[i].payload, messages[i].payload_len});
+  }
+  return skipped.empty() ? kOk : kErrUdpSend;
 }
 
 ErrCode UDPServer::Read(NetAddr& remote_addr, std::string& data) {
   if (sockfd_ < 0) return kErrUdpSocketCreate;
   char buf[4096];
-  sockaddr_in src{};
+  sockaddr_storage src{};
   socklen_t len = sizeof(src);
   ssize_t n = recvfrom(sockfd_, buf, sizeof(buf), 0, (sockaddr*)&src, &len);
   if (n <= 0) return kErrUdpRecv;
   data.assign(buf, n);
-  char ipbuf[INET_ADDRSTRLEN];
-  inet_ntop(AF_INET, &src.sin_addr, ipbuf, sizeof(ipbuf));
-  remote_addr.ip_ = ipbuf;
-  remote_addr.port_ = ntohs(src.sin_port);
+  remote_addr = ToNetAddr(src);
+  PacketCapture::Tap({Protocol::kUdp, Direction::kInbound,
+                      reinterpret_cast<const sockaddr*>(&local_sockaddr_),
+                      reinterpret_cast<const sockaddr*>(&src),
+                      reinterpret_cast<const uint8_t*>(buf),
+                      static_cast<size_t>(n)});
   return kOk;
 }
 
@@ -3,8 +3,12 @@
 #pragma once
 
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
+#include <chrono>
 #include <string>
+#include <vector>
 
 #include "errcode.h"
 
@@ -18,20 +22,74 @@ struct NetAddr {
 
 class TCPClient {
  public:
+  struct Options {
+    // Overall deadline for Connect, across all candidate addresses.
+    std::chrono::milliseconds connect_timeout = std::chrono::seconds(3);
+    // Delay before racing the next candidate address while the previous
+    // attempts are still pending (happy eyeballs).
+    std::chrono::milliseconds attempt_delay = std::chrono::milliseconds(250);
+    // SO_RCVTIMEO/SO_SNDTIMEO for every Read/Write after connecting.
+    std::chrono::milliseconds io_timeout = std::chrono::seconds(5);
+  };
+
   TCPClient();
   virtual ~TCPClient();
 
+  void SetOptions(const Options& options) { options_ = options; }
+  const Options& GetOptions() const { return options_; }
+
   ErrCode Connect(const std::string& ip, int port);
-  ErrCode Write(const std::string& data);
-  ErrCode Read(std::string& data);
+  ErrCode Connect(const std::vector<std::string>& ips, int port);
+  // Races non-blocking connects to the candidates in order, starting one every
+  // attempt_delay; the first to complete wins and the others are dropped.
+  ErrCode Connect(const std::vector<NetAddr>& candidates);
+  // Without wait, both fail with kErrTcpTimeout where they would block.
+  ErrCode Write(const std::string& data, bool wait = true);
+  ErrCode Read(std::string& data, bool wait = true);
   const NetAddr& GetLocalNetAddr() { return local_addr_; };
   const NetAddr& GetRemoteNetAddr() { return remote_addr_; }
+  int GetFd() const { return sockfd_; }
   void Close();
 
  private:
   int sockfd_ = -1;
+  Options options_;
   NetAddr remote_addr_;
   NetAddr local_addr_;
+  // The same addresses, for PacketCapture.
+  sockaddr_storage remote_sockaddr_{};
+  sockaddr_storage local_sockaddr_{};
+};
+
+// A NetAddr parsed once, for sending to the same peer many times.
+struct SockAddr {
+  sockaddr_storage storage{};
+  socklen_t len = 0;
+
+  // Takes an IPv4 or IPv6 literal, the latter with an optional "%zone";
+  // fails with kErrUdpAddrParse.
+  ErrCode Parse(const NetAddr& addr);
+  // AF_INET or AF_INET6 for a literal, AF_UNSPEC for anything else.
+  static int Family(const std::string& ip);
+  const sockaddr* Get() const {
+    return reinterpret_cast<const sockaddr*>(&storage);
+  }
+};
+
+// ip as the host part of a URI: IPv6 literals go in brackets.
+std::string UriHost(const std::string& ip);
+// Every address host resolves to, as literals for TCPClient::Connect; an
+// IPv6 one keeps its "%zone". Empty when host does not resolve.
+std::vector<std::string> ResolveHost(const std::string& host);
+
+// One outgoing datagram made of a header and a payload, so a payload shared by
+// several receivers can go out without being copied per receiver.
+struct UDPMessage {
+  const SockAddr* remote_addr;
+  const uint8_t* header;
+  size_t header_len;
+  const uint8_t* payload;
+  size_t payload_len;
 };
 
 class UDPServer {
@@ -39,15 +97,33 @@ class UDPServer {
   UDPServer();
   virtual ~UDPServer();
 
-  ErrCode Bind();
+  // Binds an ephemeral port on every local address of the family; peers
+  // must be of the same family.
+  ErrCode Bind(int family = AF_INET);
   ErrCode Write(const NetAddr& remote_addr, const std::string& data);
+  // Sends all messages, with a single sendmmsg where available. A message
+  // the kernel refuses is skipped and the rest still go out; then it fails
+  // with kErrUdpSend and, given failed, lists the skipped indexes there.
+  // Reuses the server's scratch buffers, so calls on one server must not
+  // overlap.
+  ErrCode WriteBatch(const std::vector<UDPMessage>& messages,
+                     std::vector<size_t>* failed = nullptr);
   ErrCode Read(NetAddr& remote_addr, std::string& data);
   const NetAddr& GetLocalNetAddr() { return local_addr_; };
+  int GetFd() const { return sockfd_; }
   void Close();
 
  private:
   int sockfd_ = -1;
   NetAddr local_addr_;
+  sockaddr_storage local_sockaddr_{};
+  // WriteBatch's, kept across calls.
+  std::vector<iovec> batch_iovs_;
+  std::vector<msghdr> batch_hdrs_;
+  std::vector<size_t> batch_failed_;
+#ifdef __linux__
+  std::vector<mmsghdr> batch_mmsgs_;
+#endif
 };
 
 }  // namespace helper
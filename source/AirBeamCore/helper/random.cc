@@ -22,7 +22,7 @@ uint64_t RandomGenerator::GenU64() {
   return dis(gen);
 }
 const std::string RandomGenerator::GenNumStr(int length) {
-  static std::mt19937 gen(std::random_device{}());
+  thread_local std::mt19937 gen(std::random_device{}());
   std::uniform_int_distribution<int> dist(0, 9);
   std::string result;
   result.reserve(length);
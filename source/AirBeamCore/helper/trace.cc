@@ -0,0 +1,202 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "trace.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "fmt/core.h"
+
+namespace AirBeamCore {
+namespace helper {
+namespace {
+// A seqlock per slot: the owner thread makes the version odd while it
+// writes, so a concurrent dump can tell a torn slot and skip it.
+struct Slot {
+  std::atomic<uint32_t> version{0};
+  std::atomic<const char*> name{nullptr};
+  std::atomic<uint32_t> seq{0};
+  std::atomic<uint64_t> begin_ns{0};
+  std::atomic<uint64_t> end_ns{0};
+};
+
+struct Ring {
+  uint32_t tid = 0;
+  // Guarded by Registry::mtx.
+  std::string thread_name;
+  bool exited = false;
+  std::atomic<uint64_t> head{0};
+  std::unique_ptr<Slot[]> slots{new Slot[Tracer::kRingEvents]};
+};
+
+struct Registry {
+  std::mutex mtx;
+  // In creation order. Rings outlive their threads until the next dump, so
+  // spans of finished threads still show up once.
+  std::vector<std::shared_ptr<Ring>> rings;
+  uint32_t next_tid = 1;
+  std::atomic<uint64_t> cleared_ns{0};
+};
+
+Registry& GetRegistry() {
+  static Registry* registry = new Registry();
+  return *registry;
+}
+
+// Marks the thread's ring exited when the thread ends, and frees the
+// oldest exited ring past Tracer::kExitedRings.
+struct RingOwner {
+  std::shared_ptr<Ring> ring = std::make_shared<Ring>();
+
+  RingOwner() {
+    Registry& registry = GetRegistry();
+    std::lock_guard guard(registry.mtx);
+    ring->tid = registry.next_tid++;
+    registry.rings.push_back(ring);
+  }
+
+  ~RingOwner() {
+    Registry& registry = GetRegistry();
+    std::lock_guard guard(registry.mtx);
+    ring->exited = true;
+    size_t exited = 0;
+    for (const auto& other : registry.rings) exited += other->exited;
+    if (exited <= Tracer::kExitedRings) return;
+    auto oldest = std::find_if(
+        registry.rings.begin(), registry.rings.end(),
+        [](const std::shared_ptr<Ring>& other) { return other->exited; });
+    registry.rings.erase(oldest);
+  }
+};
+
+Ring& ThreadRing() {
+  thread_local RingOwner owner;
+  return *owner.ring;
+}
+
+struct Event {
+  const char* name;
+  uint32_t seq;
+  uint64_t begin_ns;
+  uint64_t end_ns;
+};
+}  // namespace
+
+std::atomic<bool> Tracer::enabled_ = false;
+
+void Tracer::Enable(bool enabled) {
+  enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t Tracer::NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Tracer::Record(const char* name, uint32_t seq, uint64_t begin_ns,
+                    uint64_t end_ns) {
+  Ring& ring = ThreadRing();
+  uint64_t head = ring.head.load(std::memory_order_relaxed);
+  Slot& slot = ring.slots[head % kRingEvents];
+  uint32_t version = slot.version.load(std::memory_order_relaxed);
+  slot.version.store(version + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.seq.store(seq, std::memory_order_relaxed);
+  slot.begin_ns.store(begin_ns, std::memory_order_relaxed);
+  slot.end_ns.store(end_ns, std::memory_order_relaxed);
+  slot.version.store(version + 2, std::memory_order_release);
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+void Tracer::SetThreadName(const std::string& name) {
+  Ring& ring = ThreadRing();
+  std::lock_guard guard(GetRegistry().mtx);
+  ring.thread_name = name;
+}
+
+void Tracer::Clear() {
+  GetRegistry().cleared_ns.store(NowNs(), std::memory_order_relaxed);
+}
+
+std::string Tracer::DumpChromeJson() {
+  Registry& registry = GetRegistry();
+  uint64_t cleared_ns = registry.cleared_ns.load(std::memory_order_relaxed);
+  std::vector<std::shared_ptr<Ring>> rings;
+  std::vector<std::string> names;
+  {
+    std::lock_guard guard(registry.mtx);
+    rings = registry.rings;
+    for (const auto& ring : rings) names.push_back(ring->thread_name);
+    // Exited threads record nothing more, so this dump is their last.
+    registry.rings.erase(
+        std::remove_if(
+            registry.rings.begin(), registry.rings.end(),
+            [](const std::shared_ptr<Ring>& ring) { return ring->exited; }),
+        registry.rings.end());
+  }
+
+  int pid = getpid();
+  std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  auto append = [&](const std::string& event) {
+    if (!first) out += ',';
+    out += event;
+    first = false;
+  };
+
+  std::vector<Event> events;
+  for (size_t r = 0; r < rings.size(); ++r) {
+    const Ring& ring = *rings[r];
+    if (!names[r].empty()) {
+      append(fmt::format(
+          "{{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":{},\"tid\":{},"
+          "\"args\":{{\"name\":\"{}\"}}}}",
+          pid, ring.tid, names[r]));
+    }
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    uint64_t begin = head > kRingEvents ? head - kRingEvents : 0;
+    events.clear();
+    for (uint64_t i = begin; i < head; ++i) {
+      const Slot& slot = ring.slots[i % kRingEvents];
+      uint32_t version = slot.version.load(std::memory_order_acquire);
+      if (version % 2 != 0) continue;
+      Event event = {slot.name.load(std::memory_order_relaxed),
+                     slot.seq.load(std::memory_order_relaxed),
+                     slot.begin_ns.load(std::memory_order_relaxed),
+                     slot.end_ns.load(std::memory_order_relaxed)};
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.version.load(std::memory_order_relaxed) != version) continue;
+      if (event.name == nullptr || event.begin_ns < cleared_ns) continue;
+      events.push_back(event);
+    }
+    for (const auto& event : events) {
+      std::string args =
+          event.seq == kNoSeq
+              ? ""
+              : fmt::format(",\"args\":{{\"seq\":{}}}", event.seq);
+      append(fmt::format(
+          "{{\"ph\":\"X\",\"cat\":\"airbeam\",\"name\":\"{}\",\"pid\":{},"
+          "\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}{}}}",
+          event.name, pid, ring.tid, event.begin_ns / 1000.0,
+          (event.end_ns - event.begin_ns) / 1000.0, args));
+    }
+  }
+  return out + "]}";
+}
+
+ErrCode Tracer::WriteChromeTrace(const std::string& path) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) return kErrInvalidParam;
+  out << DumpChromeJson();
+  return out.good() ? kOk : kErrUnknown;
+}
+}  // namespace helper
+}  // namespace AirBeamCore
@@ -0,0 +1,80 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "helper/errcode.h"
+
+namespace AirBeamCore {
+namespace helper {
+// Span tracing for the audio pipeline. Every thread records into its own
+// ring of the last kRingEvents spans, without locks, and the rings are
+// dumped on demand as Chrome trace-event JSON (chrome://tracing, Perfetto).
+// Spans carry the RTP seq of the packet they worked on, so one packet can
+// be followed from ingest to the wire.
+//
+// The ring of a thread that has exited goes out in the next dump and is
+// then freed; until that dump only the kExitedRings latest are kept.
+//
+// Disabled, a span costs one relaxed load and a branch.
+class Tracer {
+ public:
+  static constexpr uint32_t kNoSeq = UINT32_MAX;
+  static constexpr size_t kRingEvents = 8192;
+  static constexpr size_t kExitedRings = 16;
+
+  static void Enable(bool enabled);
+  static bool IsEnabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  static uint64_t NowNs();
+
+  // Records a finished span on the calling thread's ring. name must outlive
+  // the tracer; in practice, a string literal.
+  static void Record(const char* name, uint32_t seq, uint64_t begin_ns,
+                     uint64_t end_ns);
+  // Shown instead of the thread id in the trace viewer.
+  static void SetThreadName(const std::string& name);
+
+  // Every span still in the rings, oldest first per thread.
+  static std::string DumpChromeJson();
+  static ErrCode WriteChromeTrace(const std::string& path);
+  // Drops what has been recorded so far from later dumps.
+  static void Clear();
+
+ private:
+  static std::atomic<bool> enabled_;
+};
+
+// Records the enclosing scope as a span, when tracing is enabled at entry.
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name, uint32_t seq = Tracer::kNoSeq)
+      : name_(name),
+        seq_(seq),
+        begin_ns_(Tracer::IsEnabled() ? Tracer::NowNs() : 0) {}
+  ~TraceScope() {
+    if (begin_ns_ != 0) Tracer::Record(name_, seq_, begin_ns_, Tracer::NowNs());
+  }
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+  // For spans that learn their packet part way through.
+  void SetSeq(uint32_t seq) { seq_ = seq; }
+
+ private:
+  const char* name_;
+  uint32_t seq_;
+  uint64_t begin_ns_;
+};
+}  // namespace helper
+}  // namespace AirBeamCore
+
+#define AB_TRACE_CONCAT_INNER(a, b) a##b
+#define AB_TRACE_CONCAT(a, b) AB_TRACE_CONCAT_INNER(a, b)
+#define ABTraceScope(name, ...)                       \
+  ::AirBeamCore::helper::TraceScope AB_TRACE_CONCAT( \
+      ab_trace_scope_, __LINE__)(name, ##__VA_ARGS__)
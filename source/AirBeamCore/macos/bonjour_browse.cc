@@ -2,15 +2,11 @@
 
 #include "bonjour_browse.h"
 
+#include "absl/strings/ascii.h"
 #include "helper/logger.h"
 
 namespace AirBeamCore {
 namespace macos {
-bool BonjourBrowse::ServiceInfo::operator==(const ServiceInfo& other) const {
-  return name == other.name && fullname == other.fullname && ip == other.ip &&
-         port == other.port;
-}
-
 BonjourBrowse::BonjourBrowse() : browseRef_(nullptr), running_(false) {}
 
 BonjourBrowse::~BonjourBrowse() { stop(); }
@@ -131,7 +127,24 @@ void DNSSD_API BonjourBrowse::ResolveCallback(
 
   port = ntohs(port);
 
-  ContextForAddr* ctx = new ContextForAddr{self, "", fullname, port};
+  std::map<std::string, std::string> txt;
+  uint16_t count = TXTRecordGetCount(txtLen, txtRecord);
+  for (uint16_t i = 0; i < count; ++i) {
+    char key[256];
+    uint8_t valueLen = 0;
+    const void* value = nullptr;
+    if (TXTRecordGetItemAtIndex(txtLen, txtRecord, i, sizeof(key), key,
+                                &valueLen, &value) != kDNSServiceErr_NoError) {
+      continue;
+    }
+    // Keys are case-insensitive; the first occurrence wins.
+    txt.emplace(absl::AsciiStrToLower(key),
+                value ? std::string(static_cast<const char*>(value), valueLen)
+                      : "");
+  }
+
+  ContextForAddr* ctx =
+      new ContextForAddr{self, "", fullname, port, std::move(txt)};
 
   DNSServiceRef addrRef;
   DNSServiceErrorType err = DNSServiceGetAddrInfo(
@@ -182,6 +195,9 @@ void DNSSD_API BonjourBrowse::GetAddrInfoCallback(
     service_info.fullname = ctx->fullName;
     service_info.ip = ipStr;
     service_info.port = ctx->port;
+    service_info.txt = ctx->txt;
+    service_info.capabilities =
+        discovery::RaopCapabilities::FromTxt(service_info.txt);
     self->callback_(EventType::kServiceOnline, service_info);
   }
 
@@ -9,24 +9,18 @@
 #include <atomic>
 #include <cstring>
 #include <functional>
+#include <map>
 #include <string>
 #include <thread>
 
+#include "discovery/service_info.h"
+
 namespace AirBeamCore {
 namespace macos {
 class BonjourBrowse {
  public:
-  enum class EventType {
-    kServiceOnline = 1,
-    kServiceOffline = 2,
-  };
-  struct ServiceInfo {
-    std::string name;
-    std::string fullname;
-    std::string ip;
-    uint16_t port;
-    bool operator==(const ServiceInfo& other) const;
-  };
+  using EventType = discovery::EventType;
+  using ServiceInfo = discovery::ServiceInfo;
 
  protected:
   struct ContextForAddr {
@@ -34,6 +28,7 @@ class BonjourBrowse {
     std::string serviceName;
     std::string fullName;
     uint16_t port;
+    std::map<std::string, std::string> txt;
   };
 
  public:
@@ -2,56 +2,143 @@
 
 #include "codec.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "raop/rtp.h"
 
-#ifdef SIMD_ARM
+#if defined(__ARM_NEON) || defined(SIMD_ARM)
 #include <arm_neon.h>
+#define AIRBEAM_CODEC_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AIRBEAM_CODEC_SSE2
+#endif
 
 namespace AirBeamCore {
 namespace raop {
-void PCMCodec::Encode(const RtpAudioPacketChunk& input,
-                      RtpAudioPacketChunk& output) {
-  size_t len = input.len_;
-  const uint8_t* in = input.data_;
-  uint8_t* out = output.data_;
-  memset(out, 0, len);
+namespace {
+// Every kernel swaps len bytes, a multiple of 4, and returns how many it
+// handled; the scalar loop finishes the rest.
+size_t SwapScalar(const uint8_t* in, uint8_t* out, size_t len) {
+  for (size_t offset = 0; offset < len; offset += 4) {
+    out[offset] = in[offset + 1];
+    out[offset + 1] = in[offset];
+    out[offset + 2] = in[offset + 3];
+    out[offset + 3] = in[offset + 2];
+  }
+  return len;
+}
 
+#ifdef AIRBEAM_CODEC_NEON
+size_t SwapNeon(const uint8_t* in, uint8_t* out, size_t len) {
   size_t offset = 0;
-
   for (; offset + 16 <= len; offset += 16) {
-    uint8x16_t v = vld1q_u8(in + offset);
-    uint8x16_t r = vrev32q_u8(v);
-    vst1q_u8(out + offset, r);
+    // Reverse bytes within each 16-bit lane; vrev32 would also swap the
+    // left and right samples.
+    vst1q_u8(out + offset, vrev16q_u8(vld1q_u8(in + offset)));
   }
+  return offset;
+}
+#endif
 
-  for (; offset + 3 < len; offset += 4) {
-    out[offset] = in[offset + 1];
-    out[offset + 1] = in[offset];
-    out[offset + 2] = in[offset + 3];
-    out[offset + 3] = in[offset + 2];
+#ifdef AIRBEAM_CODEC_SSE2
+size_t SwapSse2(const uint8_t* in, uint8_t* out, size_t len) {
+  size_t offset = 0;
+  for (; offset + 16 <= len; offset += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + offset));
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + offset), v);
   }
+  return offset;
 }
-}  // namespace raop
-}  // namespace AirBeamCore
+#endif
+}  // namespace
 
-#else
-namespace AirBeamCore {
-namespace raop {
 void PCMCodec::Encode(const RtpAudioPacketChunk& input,
                       RtpAudioPacketChunk& output) {
-  size_t len = input.len_;
-  memset(output.data_, 0, sizeof(output.data_));
+  Encode(BestLevel(), input, output);
+}
+
+void PCMCodec::Encode(PCMCodecLevel level, const RtpAudioPacketChunk& input,
+                      RtpAudioPacketChunk& output) {
+  size_t len = output.len_;
+  Encode(level, input.data_, std::min<size_t>(input.len_, sizeof(input.data_)),
+         output);
+  output.len_ = len;
+}
 
-  for (size_t offset = 0; offset < len; offset += 4) {
-    if (offset + 3 < len) {
-      output.data_[offset] = input.data_[offset + 1];
-      output.data_[offset + 1] = input.data_[offset];
-      output.data_[offset + 2] = input.data_[offset + 3];
-      output.data_[offset + 3] = input.data_[offset + 2];
-    }
+void PCMCodec::Encode(const uint8_t* input, size_t len,
+                      RtpAudioPacketChunk& output) {
+  Encode(BestLevel(), input, len, output);
+}
+
+void PCMCodec::Encode(PCMCodecLevel level, const uint8_t* input, size_t len,
+                      RtpAudioPacketChunk& output) {
+  output.len_ = std::min(len, sizeof(output.data_));
+  len = output.len_ & ~size_t{3};
+  const uint8_t* in = input;
+  uint8_t* out = output.data_;
+
+  size_t done = 0;
+  switch (level) {
+#ifdef AIRBEAM_CODEC_NEON
+    case PCMCodecLevel::kNeon:
+      done = SwapNeon(in, out, len);
+      break;
+#endif
+#ifdef AIRBEAM_CODEC_SSE2
+    case PCMCodecLevel::kSse2:
+      done = SwapSse2(in, out, len);
+      break;
+#endif
+    default:
+      break;
   }
+  done += SwapScalar(in + done, out + done, len - done);
+  memset(out + done, 0, sizeof(output.data_) - done);
 }
-}  // namespace raop
-}  // namespace AirBeamCore
 
+bool PCMCodec::IsSupported(PCMCodecLevel level) {
+  switch (level) {
+    case PCMCodecLevel::kScalar:
+      return true;
+    case PCMCodecLevel::kSse2:
+#ifdef AIRBEAM_CODEC_SSE2
+      return true;
+#else
+      return false;
+#endif
+    case PCMCodecLevel::kNeon:
+#ifdef AIRBEAM_CODEC_NEON
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+PCMCodecLevel PCMCodec::BestLevel() {
+#if defined(AIRBEAM_CODEC_NEON)
+  return PCMCodecLevel::kNeon;
+#elif defined(AIRBEAM_CODEC_SSE2)
+  return PCMCodecLevel::kSse2;
+#else
+  return PCMCodecLevel::kScalar;
 #endif
+}
+
+const char* PCMCodec::LevelName(PCMCodecLevel level) {
+  switch (level) {
+    case PCMCodecLevel::kScalar:
+      return "scalar";
+    case PCMCodecLevel::kSse2:
+      return "sse2";
+    case PCMCodecLevel::kNeon:
+      return "neon";
+  }
+  return "unknown";
+}
+}  // namespace raop
+}  // namespace AirBeamCore
@@ -7,10 +7,31 @@
 namespace AirBeamCore {
 
 namespace raop {
+// Kernels the encoder can run with. Which ones exist depends on the target
+// the library was compiled for, not on the machine it runs on.
+enum class PCMCodecLevel { kScalar, kSse2, kNeon };
+
 class PCMCodec {
  public:
+  // Swaps host-order 16-bit samples to network order. Trailing bytes that
+  // do not make up a whole stereo frame, and the rest of output, are zeroed.
   static void Encode(const RtpAudioPacketChunk& input,
                      RtpAudioPacketChunk& output);
+  // Same as above with a given kernel; unsupported levels fall back to
+  // kScalar.
+  static void Encode(PCMCodecLevel level, const RtpAudioPacketChunk& input,
+                     RtpAudioPacketChunk& output);
+  // Encodes up to one chunk straight from a caller's buffer, such as a
+  // mapped file, and sets output.len_ to the bytes taken from it.
+  static void Encode(const uint8_t* input, size_t len,
+                     RtpAudioPacketChunk& output);
+  static void Encode(PCMCodecLevel level, const uint8_t* input, size_t len,
+                     RtpAudioPacketChunk& output);
+
+  static bool IsSupported(PCMCodecLevel level);
+  // The level Encode uses by default.
+  static PCMCodecLevel BestLevel();
+  static const char* LevelName(PCMCodecLevel level);
 };
 }  // namespace raop
 }  // namespace AirBeamCore
@@ -8,6 +8,7 @@ namespace AirBeamCore {
 
 namespace raop {
 constexpr uint64_t kSampleRate44100 = 44'100;
+constexpr uint64_t kSampleRate48000 = 48'000;
 constexpr uint64_t kPCMChunkLength = 352;
 }  // namespace raop
 }  // namespace AirBeamCore
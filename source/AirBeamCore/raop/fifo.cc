@@ -2,30 +2,39 @@
 
 #include "fifo.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace AirBeamCore {
 namespace raop {
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Waits on cv for ready under lock, until deadline when there is a timeout.
+// Returns ready().
+template <typename Predicate>
+bool WaitFor(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+             std::chrono::microseconds timeout, Clock::time_point deadline,
+             Predicate ready) {
+  if (timeout == std::chrono::microseconds(0)) {
+    cv.wait(lock, ready);
+    return true;
+  }
+  return cv.wait_until(lock, deadline, ready);
+}
+}  // namespace
+
 size_t ConcurrentByteFIFO::Write(const uint8_t* data, size_t length,
-                                 std::chrono::milliseconds timeout) {
+                                 std::chrono::microseconds timeout) {
+  const auto deadline = Clock::now() + timeout;
   size_t written = 0;
   while (written < length) {
     std::unique_lock<std::mutex> lock(mutex_);
-    bool timeout_occurred = false;
-    if (size_ == capacity_) {
-      if (timeout == std::chrono::milliseconds(0)) {
-        not_full_cv_.wait(lock, [this]() { return size_ < capacity_; });
-      } else {
-        timeout_occurred = !not_full_cv_.wait_for(
-            lock, timeout, [this]() { return size_ < capacity_; });
-      }
-    }
-
-    if (timeout_occurred) {
+    if (!WaitFor(not_full_cv_, lock, timeout, deadline,
+                 [this]() { return size_ < capacity_; })) {
       break;
     }
-
-    buffer_[head_] = data[written++];
-    head_ = (head_ + 1) % capacity_;
-    ++size_;
+    written += PushLocked(data + written, length - written);
     lock.unlock();
     not_empty_cv_.notify_one();
   }
@@ -33,33 +42,58 @@ size_t ConcurrentByteFIFO::Write(const uint8_t* data, size_t length,
 }
 
 size_t ConcurrentByteFIFO::Read(uint8_t* data, size_t length,
-                                std::chrono::milliseconds timeout) {
+                                std::chrono::microseconds timeout) {
+  const auto deadline = Clock::now() + timeout;
   size_t read_count = 0;
   while (read_count < length) {
     std::unique_lock<std::mutex> lock(mutex_);
-    bool timeout_occurred = false;
-    if (size_ == 0) {
-      if (timeout == std::chrono::milliseconds(0)) {
-        not_empty_cv_.wait(lock, [this]() { return size_ > 0; });
-      } else {
-        timeout_occurred = !not_empty_cv_.wait_for(
-            lock, timeout, [this]() { return size_ > 0; });
-      }
-    }
-
-    if (timeout_occurred) {
+    if (!WaitFor(not_empty_cv_, lock, timeout, deadline,
+                 [this]() { return size_ > 0; })) {
       break;
     }
-
-    data[read_count++] = buffer_[tail_];
-    tail_ = (tail_ + 1) % capacity_;
-    --size_;
+    read_count += PopLocked(data + read_count, length - read_count);
     lock.unlock();
     not_full_cv_.notify_one();
   }
   return read_count;
 }
 
+size_t ConcurrentByteFIFO::ReadFull(uint8_t* data, size_t length,
+                                    std::chrono::microseconds timeout) {
+  const auto deadline = Clock::now() + timeout;
+  std::unique_lock<std::mutex> lock(mutex_);
+  // More than the ring holds never arrives.
+  if (length > capacity_ ||
+      !WaitFor(not_empty_cv_, lock, timeout, deadline,
+               [this, length]() { return size_ >= length; })) {
+    return 0;
+  }
+  PopLocked(data, length);
+  lock.unlock();
+  not_full_cv_.notify_one();
+  return length;
+}
+
+size_t ConcurrentByteFIFO::PushLocked(const uint8_t* data, size_t length) {
+  size_t count = std::min(length, capacity_ - size_);
+  size_t first = std::min(count, capacity_ - head_);
+  memcpy(buffer_.data() + head_, data, first);
+  memcpy(buffer_.data(), data + first, count - first);
+  head_ = (head_ + count) % capacity_;
+  size_ += count;
+  return count;
+}
+
+size_t ConcurrentByteFIFO::PopLocked(uint8_t* data, size_t length) {
+  size_t count = std::min(length, size_);
+  size_t first = std::min(count, capacity_ - tail_);
+  memcpy(data, buffer_.data() + tail_, first);
+  memcpy(data + first, buffer_.data(), count - first);
+  tail_ = (tail_ + count) % capacity_;
+  size_ -= count;
+  return count;
+}
+
 bool ConcurrentByteFIFO::Full() const {
   std::lock_guard<std::mutex> lock(mutex_);
   return size_ == capacity_;
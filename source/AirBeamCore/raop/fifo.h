@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <vector>
@@ -13,12 +14,20 @@ class ConcurrentByteFIFO {
   explicit ConcurrentByteFIFO(size_t capacity)
       : buffer_(capacity), capacity_(capacity), head_(0), tail_(0), size_(0) {}
 
+  // Both return what fit or arrived before timeout, which bounds the whole
+  // call, not each wait; 0 waits as long as it takes.
   size_t Write(
       const uint8_t* data, size_t length,
-      std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+      std::chrono::microseconds timeout = std::chrono::microseconds(0));
 
   size_t Read(uint8_t* data, size_t length,
-              std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+              std::chrono::microseconds timeout = std::chrono::microseconds(0));
+
+  // Reads exactly length bytes, or nothing if they are not all there by
+  // timeout; a packet is then either whole or an underrun, and what did
+  // arrive stays for the next call.
+  size_t ReadFull(uint8_t* data, size_t length,
+                  std::chrono::microseconds timeout);
 
   bool Empty() const {
     std::lock_guard<std::mutex> lock(mutex_);
@@ -27,7 +36,16 @@ class ConcurrentByteFIFO {
 
   bool Full() const;
 
+  size_t Size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+  }
+
  private:
+  // Moves up to length bytes in or out of the ring; the lock is held.
+  size_t PushLocked(const uint8_t* data, size_t length);
+  size_t PopLocked(uint8_t* data, size_t length);
+
   std::vector<uint8_t> buffer_;
   const size_t capacity_;
   size_t head_;
@@ -0,0 +1,175 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "group.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include "helper/logger.h"
+#include "helper/trace.h"
+#include "raop/constants.h"
+
+namespace AirBeamCore {
+namespace raop {
+
+using namespace helper;
+
+RaopGroup::RaopGroup(const std::vector<std::shared_ptr<Raop>>& members)
+    : members_(members) {
+  memset(silence_chunk_.data_, 0, sizeof(silence_chunk_.data_));
+}
+
+ErrCode RaopGroup::Start() {
+  if (members_.empty()) return kErrTcpConnect;
+  format_ = members_.front()->GetStreamFormat();
+  std::vector<std::shared_ptr<Raop>> matching;
+  for (const auto& member : members_) {
+    if (!(member->GetStreamFormat() == format_)) {
+      ABWarningLog("RaopGroup member %s streams %s, the group %s; dropped",
+                   member->GetRtspIpAddr().c_str(),
+                   member->GetStreamFormat().Rtpmap().c_str(),
+                   format_.Rtpmap().c_str());
+      continue;
+    }
+    matching.push_back(member);
+  }
+  members_ = std::move(matching);
+  silence_chunk_.len_ = format_.PacketBytes();
+
+  std::vector<ErrCode> results(members_.size(), kOk);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < members_.size(); ++i) {
+    threads.emplace_back(
+        [this, &results, i]() { results[i] = members_[i]->StartSession(); });
+  }
+  for (auto& thread : threads) thread.join();
+
+  // One socket sends to every member, so they share the address family of
+  // the first one started.
+  std::vector<std::shared_ptr<Raop>> started;
+  int family = AF_UNSPEC;
+  for (size_t i = 0; i < members_.size(); ++i) {
+    if (results[i] != kOk) {
+      ABWarningLog("RaopGroup member %s failed, ret=%d",
+                   members_[i]->GetRtspIpAddr().c_str(),
+                   static_cast<int>(results[i]));
+      continue;
+    }
+    int member_family =
+        members_[i]->GetRemoteAudioSockAddr().storage.ss_family;
+    if (family == AF_UNSPEC) family = member_family;
+    if (member_family != family) {
+      ABWarningLog("RaopGroup member %s is of another address family; "
+                   "dropped",
+                   members_[i]->GetRtspIpAddr().c_str());
+      members_[i]->Stop();
+      continue;
+    }
+    started.push_back(members_[i]);
+  }
+  members_ = std::move(started);
+  if (members_.empty()) return kErrTcpConnect;
+
+  ErrCode ret = audio_server_.Bind(family);
+  if (ret != kOk) return ret;
+
+  latency_ = 0;
+  for (const auto& member : members_) {
+    latency_ = std::max(latency_, member->GetLatency());
+  }
+  for (const auto& member : members_) member->SetSyncLatency(latency_);
+
+  auto anchor = NtpTime::Now();
+  timeline_.Reset(anchor.IntoTimestamp(format_.sample_rate), anchor);
+  std::vector<std::shared_ptr<Raop>> streaming;
+  for (const auto& member : members_) {
+    ret = member->BeginStream(anchor);
+    if (ret != kOk) {
+      ABWarningLog("RaopGroup member %s failed its first sync, ret=%d",
+                   member->GetRtspIpAddr().c_str(), static_cast<int>(ret));
+      member->Stop();
+      continue;
+    }
+    streaming.push_back(member);
+  }
+  members_ = std::move(streaming);
+  if (members_.empty()) return ret;
+  next_sync_ts_ = timeline_.Load().anchor_ts + format_.sample_rate;
+
+  headers_.resize(members_.size());
+  messages_.resize(members_.size());
+  is_started_ = true;
+  return kOk;
+}
+
+void RaopGroup::AcceptFrame() {
+  if (!is_started_) return;
+  ABTraceScope("pace");
+  Raop::PaceTo(timeline_.Load().head_ts, format_.frames_per_packet,
+               format_.sample_rate);
+}
+
+void RaopGroup::SendChunk(const RtpAudioPacketChunk& encoded) {
+  if (!is_started_) return;
+  // Keyed by the first member's seq; the members count separately.
+  TraceScope trace("group_send");
+
+  // An empty chunk is an underrun; the group always fills it with silence so
+  // the shared timeline stays continuous.
+  const RtpAudioPacketChunk* chunk = &encoded;
+  RtpAudioPacketChunk padded;
+  if (encoded.len_ == 0) {
+    chunk = &silence_chunk_;
+  } else if (encoded.len_ < format_.PacketBytes()) {
+    memcpy(padded.data_, encoded.data_, encoded.len_);
+    memset(padded.data_ + encoded.len_, 0,
+           format_.PacketBytes() - encoded.len_);
+    padded.len_ = format_.PacketBytes();
+    chunk = &padded;
+  }
+
+  if (timeline_.Load().head_ts >= next_sync_ts_) SendSyncToAll(false);
+
+  RtpAudioPacket packet;
+  for (size_t i = 0; i < members_.size(); ++i) {
+    members_[i]->NextPacketHeader(packet);
+    if (i == 0) trace.SetSeq(packet.header.seq);
+    packet.SerializeHeader(headers_[i].data());
+    members_[i]->KeepForRetransmit(packet.header.seq, headers_[i].data(),
+                                   headers_[i].size(), chunk->data_,
+                                   chunk->len_);
+    messages_[i] = {&members_[i]->GetRemoteAudioSockAddr(), headers_[i].data(),
+                    headers_[i].size(), chunk->data_, chunk->len_};
+  }
+  ErrCode ret;
+  {
+    ABTraceScope("sendmmsg");
+    ret = audio_server_.WriteBatch(messages_, &failed_);
+  }
+  // A member whose packet did not go costs only itself that packet.
+  if (ret != kOk) {
+    ABDebugLog("audio_server_.WriteBatch failed, ret=%d",
+               static_cast<int>(ret));
+    for (size_t i : failed_) members_[i]->RecordSendError();
+  }
+  timeline_.Advance(format_.frames_per_packet);
+}
+
+void RaopGroup::SetVolume(uint8_t volume) {
+  for (const auto& member : members_) member->SetVolume(volume);
+}
+
+void RaopGroup::SendSyncToAll(bool first) {
+  // One clock read for every member, so they all get the same mapping.
+  auto now = NtpTime::Now();
+  for (const auto& member : members_) member->SendSyncAt(now, first);
+
+  auto timeline = timeline_.Load();
+  uint64_t elapsed = timeline.head_ts - timeline.anchor_ts;
+  next_sync_ts_ = timeline.anchor_ts +
+                  (elapsed / format_.sample_rate + 1) * format_.sample_rate;
+}
+
+}  // namespace raop
+}  // namespace AirBeamCore
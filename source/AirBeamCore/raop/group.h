@@ -0,0 +1,61 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "helper/errcode.h"
+#include "helper/network.h"
+#include "raop/raop.h"
+#include "raop/rtp.h"
+#include "raop/timeline.h"
+
+namespace AirBeamCore {
+namespace raop {
+
+// Plays one stream on several receivers in sync. Each chunk is encoded once
+// by the caller and fanned out to every member with one batched send; all
+// members share the group's media clock, and sync packets announce the
+// largest member latency so faster receivers wait for the slowest one.
+class RaopGroup {
+ public:
+  explicit RaopGroup(const std::vector<std::shared_ptr<Raop>>& members);
+
+  // Drops members whose negotiated format differs from the first member's,
+  // runs the RTSP handshakes concurrently, drops members that fail or whose
+  // address family differs from the first one started, then anchors
+  // everyone to the same NTP time. Fails if no member is left.
+  helper::ErrCode Start();
+  void AcceptFrame();
+  void SendChunk(const RtpAudioPacketChunk& encoded);
+  void SetVolume(uint8_t volume);
+
+  size_t Size() const { return members_.size(); }
+  const StreamFormat& GetStreamFormat() const { return format_; }
+  uint64_t GetLatency() const { return latency_; }
+  TimelineSnapshot GetTimeline() const { return timeline_.Load(); }
+
+ private:
+  void SendSyncToAll(bool first);
+
+  std::vector<std::shared_ptr<Raop>> members_;
+  helper::UDPServer audio_server_;
+  // Every member streams this, so one encoded payload serves them all.
+  StreamFormat format_;
+  RtpTimeline timeline_{0};
+  uint64_t latency_ = 0;
+  uint64_t next_sync_ts_ = 0;
+  bool is_started_ = false;
+
+  RtpAudioPacketChunk silence_chunk_;
+  std::vector<std::array<uint8_t, RtpAudioPacket::kHeaderSize>> headers_;
+  std::vector<helper::UDPMessage> messages_;
+  // Indexes of the members whose packet WriteBatch could not send.
+  std::vector<size_t> failed_;
+};
+
+}  // namespace raop
+}  // namespace AirBeamCore
@@ -0,0 +1,52 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "packetizer.h"
+
+namespace AirBeamCore {
+namespace raop {
+namespace {
+template <typename Layout>
+Packetizer Entry() {
+  return {Layout::Format(), Layout::kPayloadBytes, Layout::kInputBytes,
+          &Packetize<Layout>};
+}
+
+// Stereo s24 takes half the usual frames to stay within one packet.
+template <uint32_t kRate>
+void AddRate(std::vector<Packetizer>& table) {
+  table.push_back(
+      Entry<PacketLayout<kRate, SampleFormat::kS16, 1, kPCMChunkLength>>());
+  table.push_back(
+      Entry<PacketLayout<kRate, SampleFormat::kS24, 1, kPCMChunkLength>>());
+  table.push_back(
+      Entry<PacketLayout<kRate, SampleFormat::kS16, 2, kPCMChunkLength>>());
+  table.push_back(
+      Entry<PacketLayout<kRate, SampleFormat::kS24, 2, kPCMChunkLength / 2>>());
+}
+
+std::vector<Packetizer> BuildTable() {
+  std::vector<Packetizer> table;
+  AddRate<kSampleRate44100>(table);
+  AddRate<kSampleRate48000>(table);
+  std::stable_sort(table.begin(), table.end(),
+                   [](const Packetizer& a, const Packetizer& b) {
+                     return a.format.BytesPerFrame() * a.format.sample_rate <
+                            b.format.BytesPerFrame() * b.format.sample_rate;
+                   });
+  return table;
+}
+}  // namespace
+
+const std::vector<Packetizer>& Packetizers() {
+  static const std::vector<Packetizer> table = BuildTable();
+  return table;
+}
+
+const Packetizer* FindPacketizer(const StreamFormat& format) {
+  for (const auto& packetizer : Packetizers()) {
+    if (packetizer.format == format) return &packetizer;
+  }
+  return nullptr;
+}
+}  // namespace raop
+}  // namespace AirBeamCore
@@ -0,0 +1,114 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "raop/codec.h"
+#include "raop/constants.h"
+#include "raop/rtp.h"
+#include "raop/stream_format.h"
+
+namespace AirBeamCore {
+namespace raop {
+// The pipeline hands the packetizer host-order s16 stereo frames, as
+// audio::kOutputFrameBytes describes; the packetizer turns them into
+// whatever the session negotiated.
+constexpr size_t kPipelineFrameBytes = 4;
+
+enum class SampleFormat : uint8_t {
+  kS16 = 16,
+  kS24 = 24,
+};
+
+// The RTP payload of one L16 or L24 stream, fixed at compile time.
+template <uint32_t kRate, SampleFormat kSampleFormat, uint32_t kChannelCount,
+          uint32_t kFrames>
+struct PacketLayout {
+  static constexpr uint32_t kSampleRate = kRate;
+  static constexpr SampleFormat kFormat = kSampleFormat;
+  static constexpr uint32_t kChannels = kChannelCount;
+  static constexpr uint32_t kFramesPerPacket = kFrames;
+  static constexpr size_t kFrameBytes =
+      static_cast<size_t>(kSampleFormat) / 8 * kChannelCount;
+  static constexpr size_t kPayloadBytes = kFrameBytes * kFrames;
+  static constexpr size_t kInputBytes = kPipelineFrameBytes * kFrames;
+
+  static_assert(kChannels == 1 || kChannels == 2);
+  static_assert(kPayloadBytes <= sizeof(RtpAudioPacketChunk::data_),
+                "a packet must fit RtpAudioPacketChunk");
+
+  static constexpr StreamFormat Format() {
+    return {discovery::RaopCodec::kPcm, kSampleRate,
+            static_cast<uint32_t>(kFormat), kChannels, kFramesPerPacket};
+  }
+};
+
+// Writes one sample, big-endian, and returns the byte after it.
+template <SampleFormat kFormat>
+inline uint8_t* WriteSample(int32_t sample, uint8_t* out) {
+  if constexpr (kFormat == SampleFormat::kS16) {
+    out[0] = static_cast<uint8_t>(sample >> 8);
+    out[1] = static_cast<uint8_t>(sample);
+    return out + 2;
+  } else {
+    // s16 widened; the low byte is zero.
+    out[0] = static_cast<uint8_t>(sample >> 8);
+    out[1] = static_cast<uint8_t>(sample);
+    out[2] = 0;
+    return out + 3;
+  }
+}
+
+// Encodes up to one packet of pipeline frames from input into output in
+// Layout's format, zeroing the rest of output, and returns the input bytes
+// it took. output.len_ is the payload bytes written.
+template <typename Layout>
+size_t Packetize(const uint8_t* input, size_t len,
+                 RtpAudioPacketChunk& output) {
+  const size_t frames =
+      std::min<size_t>(len / kPipelineFrameBytes, Layout::kFramesPerPacket);
+  if constexpr (Layout::kFormat == SampleFormat::kS16 &&
+                Layout::kChannels == 2) {
+    // The pipeline's own layout, byte-swapped: the SIMD codec does it.
+    PCMCodec::Encode(input, frames * kPipelineFrameBytes, output);
+  } else {
+    uint8_t* out = output.data_;
+    for (size_t i = 0; i < frames; ++i) {
+      int16_t left, right;
+      memcpy(&left, input + i * kPipelineFrameBytes, 2);
+      memcpy(&right, input + i * kPipelineFrameBytes + 2, 2);
+      if constexpr (Layout::kChannels == 1) {
+        out = WriteSample<Layout::kFormat>((left + right) / 2, out);
+      } else {
+        out = WriteSample<Layout::kFormat>(left, out);
+        out = WriteSample<Layout::kFormat>(right, out);
+      }
+    }
+    memset(out, 0, output.data_ + sizeof(output.data_) - out);
+    output.len_ = frames * Layout::kFrameBytes;
+  }
+  return frames * kPipelineFrameBytes;
+}
+
+// One instantiation of Packetize, as the runtime table holds it; a session
+// looks its entry up once, then makes one indirect call per packet.
+struct Packetizer {
+  StreamFormat format;
+  size_t payload_bytes;
+  // Pipeline bytes making up one packet.
+  size_t input_bytes;
+  size_t (*packetize)(const uint8_t* input, size_t len,
+                      RtpAudioPacketChunk& output);
+};
+
+// Every format the sender can packetize, least bytes on the wire first.
+const std::vector<Packetizer>& Packetizers();
+// The entry for format, or nullptr.
+const Packetizer* FindPacketizer(const StreamFormat& format);
+}  // namespace raop
+}  // namespace AirBeamCore
@@ -4,9 +4,12 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
 #include <cstdint>
 #include <cstdlib>
@@ -20,6 +23,7 @@
 #include "helper/logger.h"
 #include "helper/network.h"
 #include "helper/random.h"
+#include "helper/trace.h"
 #include "rtp.h"
 #include "rtsp.h"
 
@@ -29,74 +33,408 @@ namespace raop {
 
 using namespace helper;
 
-void Raop::Start() {
-  int ret = rtsp_client_.Connect(rtsp_ip_addr_, rtsp_port_);
+namespace {
+uint64_t SteadyNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// An SDP connection address, "IP4 <addr>" or "IP6 <addr>". SDP has no
+// syntax for an IPv6 zone, so it is left out.
+std::string SdpAddress(const std::string& ip) {
+  if (SockAddr::Family(ip) != AF_INET6) return "IP4 " + ip;
+  return "IP6 " + ip.substr(0, ip.find('%'));
+}
+}  // namespace
+
+Raop::Raop(const std::vector<std::string>& rtsp_ip_addrs, uint32_t rtsp_port)
+    : rtsp_ip_addrs_(rtsp_ip_addrs),
+      rtsp_ip_addr_(rtsp_ip_addrs.empty() ? "" : rtsp_ip_addrs.front()),
+      rtsp_port_(rtsp_port) {
+  packetizer_ = FindPacketizer(format_);
+  memset(silence_chunk_.data_, 0, sizeof(silence_chunk_.data_));
+  silence_chunk_.len_ = packetizer_->payload_bytes;
+  retransmit_buffer_.resize(kRetransmitPackets);
+}
+
+Raop::~Raop() { StopThreads(); }
+
+ErrCode Raop::SetReceiverCapabilities(
+    const discovery::RaopCapabilities& capabilities) {
+  format_status_ = NegotiateStreamFormat(capabilities, format_);
+  if (format_status_ == kOk) {
+    packetizer_ = FindPacketizer(format_);
+    silence_chunk_.len_ = packetizer_->payload_bytes;
+    ABDebugLog("Raop %s negotiated %s, %u frames per packet",
+               rtsp_ip_addr_.c_str(), format_.Rtpmap().c_str(),
+               format_.frames_per_packet);
+  }
+  return format_status_;
+}
+
+ErrCode Raop::Connect() {
+  if (is_connected_) return kOk;
+  if (format_status_ != kOk) return format_status_;
+  ErrCode ret = rtsp_client_.Connect(rtsp_ip_addrs_, rtsp_port_);
   if (ret != kOk) {
-    ABDebugLog("rtsp_client_.Connect failed, ret=%d", ret);
-    return;
+    ABWarningLog("rtsp_client_.Connect failed, ret=%d", static_cast<int>(ret));
+    return ret;
   }
+  rtsp_ip_addr_ = rtsp_client_.GetRemoteNetAddr().ip_;
 
   GenerateID();
-  Announce();
-  BindCtrlAndTimePort();
-  Setup();
-  Record();
-  SyncStart();
-  KeepAlive();
-  FirstSendSync();
+  ret = Options();
+  if (ret != kOk) {
+    ABWarningLog("Raop::Options failed, ret=%d", static_cast<int>(ret));
+    rtsp_client_.Close();
+    return ret;
+  }
+  ret = BindPorts();
+  if (ret != kOk) {
+    rtsp_client_.Close();
+    return ret;
+  }
+  is_connected_ = true;
+  return kOk;
+}
+
+ErrCode Raop::Options() {
+  auto request =
+      AirBeamCore::raop::RtspMsgBuilder<AirBeamCore::raop::RtspReqMessage>()
+          .SetMethod("OPTIONS")
+          .SetUri("*")
+          .AddHeader("CSeq", std::to_string(status_.cseq++))
+          .AddHeader("User-Agent", "iTunes/7.6.2 (Windows; N;)")
+          .AddHeader("Client-Instance", sci_)
+          .Build();
+  RtspRespMessage response;
+  return Request(request, response);
+}
+
+ErrCode Raop::Request(const RtspReqMessage& request,
+                      RtspRespMessage& response) {
+  int ret = rtsp_client_.DoRequest(request, response);
+  if (ret != kOk) {
+    ABDebugLog("rtsp_client_.DoRequest failed, ret=%d", ret);
+    return static_cast<ErrCode>(ret);
+  }
+  if (response.GetStartLine().find(" 200 ") == std::string::npos) {
+    ABDebugLog("%s rejected, %s", request.GetStartLine().c_str(),
+               response.GetStartLine().c_str());
+    return kErrRtspStatus;
+  }
+  return kOk;
+}
+
+ErrCode Raop::Start() {
+  ErrCode ret = StartSession();
+  if (ret != kOk) return ret;
+  ret = BeginStream(NtpTime::Now());
+  if (ret != kOk) Stop();
+  return ret;
+}
+
+void Raop::Stop() {
+  // The keepalive thread shares the RTSP connection, so it goes first.
+  StopThreads();
+  is_started_ = false;
+  if (is_recording_) {
+    Teardown();
+    is_recording_ = false;
+  }
+  if (is_connected_) {
+    rtsp_client_.Close();
+    ctrl_server_.Close();
+    time_server_.Close();
+    audio_server_.Close();
+    is_connected_ = false;
+  }
+}
+
+ErrCode Raop::StartSession() {
+  ErrCode ret = Connect();
+  if (ret != kOk) return ret;
+
+  ret = Announce();
+  if (ret == kOk && !managed_ && pipe(stop_pipe_) != 0) {
+    ret = kErrPipeCreate;
+  }
+  if (ret == kOk && !managed_) TimingStart();
+  if (ret == kOk) ret = Setup();
+  if (ret == kOk) ret = Record();
+  if (ret != kOk) {
+    Stop();
+    return ret;
+  }
+  is_recording_ = true;
+  if (!managed_) {
+    ControlStart();
+    KeepAlive();
+  }
   {
     ssrc_ =
         static_cast<uint32_t>(helper::RandomGenerator::GetInstance().GenU64());
   }
+  return kOk;
+}
+
+ErrCode Raop::BeginStream(NtpTime anchor) {
+  status_.timeline.Reset(anchor.IntoTimestamp(format_.sample_rate), anchor);
+  ErrCode ret = SendSyncAt(anchor, true);
+  if (ret != kOk) return ret;
   is_started_ = true;
+  return kOk;
 }
 
 void Raop::AcceptFrame() {
   if (!is_started_) return;
+  auto timeline = status_.timeline.Load();
+  ABTraceScope("pace", timeline.next_seq);
+  int64_t late_ns = PaceTo(timeline.head_ts, format_.frames_per_packet,
+                           format_.sample_rate);
+  pacing_error_.Record(late_ns < 0 ? -late_ns : late_ns);
+}
+
+int64_t Raop::PaceTo(uint64_t head_ts, uint64_t frames,
+                     uint64_t sample_rate) {
   auto now = NtpTime::Now();
-  uint64_t now_ts = now.IntoTimestamp(kSampleRate44100);
-  if (now_ts < (status_.head_ts + kPCMChunkLength)) {
-    uint64_t sleep_frames = (status_.head_ts + kPCMChunkLength) - now_ts;
+  uint64_t now_ts = now.IntoTimestamp(sample_rate);
+  uint64_t due_ts = head_ts + frames;
+  if (now_ts < due_ts) {
+    uint64_t sleep_frames = due_ts - now_ts;
     auto sleep_duration =
-        std::chrono::seconds(sleep_frames / kSampleRate44100) +
-        std::chrono::nanoseconds(static_cast<uint32_t>(
-            (sleep_frames % kSampleRate44100) *
-            static_cast<uint64_t>(UINT32_MAX) / (kSampleRate44100 - 1)));
+        std::chrono::seconds(sleep_frames / sample_rate) +
+        std::chrono::nanoseconds((sleep_frames % sample_rate) *
+                                 1'000'000'000 / sample_rate);
     std::this_thread::sleep_for(sleep_duration);
+    now = NtpTime::Now();
   }
+  return static_cast<int64_t>(now.IntoNanoseconds()) -
+         static_cast<int64_t>(
+             NtpTime::FromTimestamp(due_ts, sample_rate).IntoNanoseconds());
 }
 
-void Raop::SendChunk(const RtpAudioPacketChunk& chunk) {
-  if (!is_started_) return;
-  status_.seq_number += 1;
+ErrCode Raop::SendChunk(const RtpAudioPacketChunk& chunk) {
+  ErrCode ret = thread_error_.load(std::memory_order_relaxed);
+  if (ret != kOk) return ret;
+  if (!is_started_) return kOk;
+  if (chunk.len_ == 0) return OnUnderrun();
+  if (paused_) {
+    ret = Resume();
+    if (ret != kOk) return ret;
+  }
+  return SendPacket(chunk);
+}
+
+ErrCode Raop::OnUnderrun() {
+  if (!is_started_) return kOk;
+  if (underrun_policy_ == UnderrunPolicy::kSilenceFill) {
+    underruns_.Add();
+    silence_packets_.Add();
+    return SendPacket(silence_chunk_);
+  }
+  if (!paused_) {
+    underruns_.Add();
+    paused_ = true;
+  }
+  return kOk;
+}
+
+ErrCode Raop::Resume() {
+  // Jump the timeline to the present; the seq keeps counting.
+  auto now = NtpTime::Now();
+  status_.timeline.Reset(now.IntoTimestamp(format_.sample_rate), now);
+  first_pkt_ = true;
+  paused_ = false;
+  resyncs_.Add();
+  // The only break in the timeline the sender makes; the receiver gets the
+  // new mapping ahead of the packet that starts it.
+  return SendSync(true);
+}
+
+RetransmitStats Raop::GetRetransmitStats() const {
+  RetransmitStats stats;
+  stats.requests = retransmit_requests_.Value();
+  stats.packets = retransmit_packets_.Value();
+  stats.misses = retransmit_misses_.Value();
+  return stats;
+}
+
+void Raop::KeepForRetransmit(uint16_t seq, const uint8_t* header,
+                             size_t header_len, const uint8_t* payload,
+                             size_t payload_len) {
+  std::lock_guard guard(retransmit_mtx_);
+  auto& entry = retransmit_buffer_[seq % kRetransmitPackets];
+  entry.seq = seq;
+  // The slot's capacity is reused once the ring has gone round.
+  entry.data.resize(header_len + payload_len);
+  memcpy(entry.data.data(), header, header_len);
+  if (payload_len > 0) {
+    memcpy(entry.data.data() + header_len, payload, payload_len);
+  }
+}
+
+void Raop::Retransmit(uint16_t seq, uint16_t count) {
+  ABTraceScope("retransmit", seq);
+  retransmit_requests_.Add();
+  // Resent packets are wrapped in a 4-byte control header.
+  std::string data;
+  for (uint16_t i = 0; i < count && i < kRetransmitPackets; ++i) {
+    uint16_t lost = seq + i;
+    {
+      std::lock_guard guard(retransmit_mtx_);
+      const auto& entry = retransmit_buffer_[lost % kRetransmitPackets];
+      if (entry.data.empty() || entry.seq != lost) {
+        retransmit_misses_.Add();
+        continue;
+      }
+      data.resize(4 + entry.data.size());
+      memcpy(data.data() + 4, entry.data.data(), entry.data.size());
+    }
+    RtpHeader header = {0x80, 0x56 | 0x80, lost};
+    header.Serialize(reinterpret_cast<uint8_t*>(data.data()));
+    ErrCode ret = ctrl_server_.Write(remote_ctrl_addr_, data);
+    if (ret != kOk) {
+      ABDebugLog("ctrl_server_.Write failed, ret=%d", static_cast<int>(ret));
+      return;
+    }
+    retransmit_packets_.Add();
+  }
+}
+
+RaopStats Raop::GetStats() const {
+  RaopStats stats;
+  stats.packets_sent = packets_sent_.Value();
+  stats.bytes_sent = bytes_sent_.Value();
+  stats.send_errors = send_errors_.Value();
+  stats.syncs_sent = syncs_sent_.Value();
+  stats.timing_replies = timing_replies_.Value();
+  stats.fifo_depth_bytes = fifo_depth_.Value();
+  stats.underrun = GetUnderrunStats();
+  stats.retransmit = GetRetransmitStats();
+  stats.send_latency = send_latency_.Snapshot();
+  stats.pacing_error = pacing_error_.Snapshot();
+  stats.rtsp_round_trip = rtsp_client_.GetRoundTrip().Snapshot();
+  stats.timing_reply_delay = timing_reply_delay_.Snapshot();
+  return stats;
+}
+
+void Raop::WriteMetrics(MetricsWriter& writer) const {
+  auto stats = GetStats();
+  MetricLabels labels = {
+      {"receiver", fmt::format("{}:{}", rtsp_ip_addr_, rtsp_port_)}};
+  writer.Counter("airbeam_raop_packets_sent_total", "Audio packets sent.",
+                 labels, stats.packets_sent);
+  writer.Counter("airbeam_raop_bytes_sent_total", "Audio bytes sent.", labels,
+                 stats.bytes_sent);
+  writer.Counter("airbeam_raop_send_errors_total",
+                 "Audio packets the socket refused to send.", labels,
+                 stats.send_errors);
+  writer.Counter("airbeam_raop_syncs_sent_total", "Sync packets sent.",
+                 labels, stats.syncs_sent);
+  writer.Counter("airbeam_raop_timing_replies_total",
+                 "Timing requests answered.", labels, stats.timing_replies);
+  writer.Gauge("airbeam_raop_fifo_depth_bytes",
+               "Bytes buffered ahead of the sender.", labels,
+               stats.fifo_depth_bytes);
+  writer.Counter("airbeam_raop_underruns_total",
+                 "Packets due with no audio to send.", labels,
+                 stats.underrun.underruns);
+  writer.Counter("airbeam_raop_silence_packets_total",
+                 "Silence packets sent to fill underruns.", labels,
+                 stats.underrun.silence_packets);
+  writer.Counter("airbeam_raop_resyncs_total",
+                 "Streams restarted after an underrun.", labels,
+                 stats.underrun.resyncs);
+  writer.Counter("airbeam_raop_retransmit_requests_total",
+                 "Retransmit requests received.", labels,
+                 stats.retransmit.requests);
+  writer.Counter("airbeam_raop_retransmit_packets_total",
+                 "Packets resent on request.", labels,
+                 stats.retransmit.packets);
+  writer.Counter("airbeam_raop_retransmit_misses_total",
+                 "Requested packets no longer buffered.", labels,
+                 stats.retransmit.misses);
+  writer.Histogram("airbeam_raop_send_latency_seconds",
+                   "Time spent in the audio send syscall.", labels,
+                   stats.send_latency, 1e-9);
+  writer.Histogram("airbeam_raop_pacing_error_seconds",
+                   "Distance between when a packet was due and was sent.",
+                   labels, stats.pacing_error, 1e-9);
+  writer.Histogram("airbeam_raop_rtsp_round_trip_seconds",
+                   "RTSP request to response.", labels, stats.rtsp_round_trip,
+                   1e-9);
+  writer.Histogram("airbeam_raop_timing_reply_delay_seconds",
+                   "Timing request read to reply sent.", labels,
+                   stats.timing_reply_delay, 1e-9);
+}
+
+UnderrunStats Raop::GetUnderrunStats() const {
+  UnderrunStats stats;
+  stats.underruns = underruns_.Value();
+  stats.silence_packets = silence_packets_.Value();
+  stats.padded_packets = padded_packets_.Value();
+  stats.resyncs = resyncs_.Value();
+  return stats;
+}
+
+ErrCode Raop::SendPacket(const RtpAudioPacketChunk& chunk) {
+  TraceScope trace("send_packet");
+  ErrCode ret = MaybeSendSync(status_.timeline.Load());
+  if (ret != kOk) return ret;
   RtpAudioPacket packet;
-  packet.header.proto = 0x80;
-  packet.header.type = first_pkt_ ? 0xE0 : 0x60;
-  packet.header.seq = status_.seq_number;
-  packet.timestamp = status_.head_ts;
-  packet.ssrc = ssrc_;
   packet.data = chunk;
-  first_pkt_ = false;
+  if (packet.data.len_ < packetizer_->payload_bytes) {
+    // Every packet advances the timeline by a whole packet of frames, so it
+    // has to carry that many.
+    memset(packet.data.data_ + packet.data.len_, 0,
+           packetizer_->payload_bytes - packet.data.len_);
+    packet.data.len_ = packetizer_->payload_bytes;
+    padded_packets_.Add();
+  }
+  NextPacketHeader(packet);
+  trace.SetSeq(packet.header.seq);
   std::vector<uint8_t> buffer;
   packet.Serialize(buffer);
+  KeepForRetransmit(packet.header.seq, buffer.data(), buffer.size(), nullptr,
+                    0);
   std::string data;
   data.resize(buffer.size());
   memcpy(const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(data.c_str())),
          buffer.data(), buffer.size());
-  int ret = audio_server_.Write(remote_audio_addr_, data);
+  uint64_t begin_ns = SteadyNowNs();
+  ret = audio_server_.Write(remote_audio_addr_, data);
+  uint64_t end_ns = SteadyNowNs();
+  send_latency_.Record(end_ns - begin_ns);
+  if (Tracer::IsEnabled()) {
+    Tracer::Record("sendto", packet.header.seq, begin_ns, end_ns);
+  }
   if (ret != kOk) {
-    ABDebugLog("audio_server_.Write failed, ret=%d", ret);
-    exit(-1);
-    return;
+    ABDebugLog("audio_server_.Write failed, ret=%d", static_cast<int>(ret));
+    send_errors_.Add();
+    return ret;
   }
-  status_.head_ts += kPCMChunkLength;
+  packets_sent_.Add();
+  bytes_sent_.Add(data.size());
+  return kOk;
 }
 
-void Raop::SetVolume(uint8_t volume_percent) {
-  status_.seq_number += 1;
+void Raop::NextPacketHeader(RtpAudioPacket& packet) {
+  auto timeline = status_.timeline.Load();
+  packet.header.proto = 0x80;
+  packet.header.type = first_pkt_ ? 0xE0 : 0x60;
+  packet.header.seq = timeline.next_seq;
+  packet.timestamp = timeline.head_ts;
+  packet.ssrc = ssrc_;
+  first_pkt_ = false;
+  status_.timeline.Advance(format_.frames_per_packet);
+}
+
+ErrCode Raop::SetVolume(uint8_t volume_percent) {
   Volume volume = Volume::FromPercent(volume_percent);
   std::string body = fmt::format("volume: {}\r\n", volume.GetValue());
-  std::string uri = fmt::format("rtsp://{}/{}", rtsp_ip_addr_, sid_);
+  std::string uri = SessionUri();
 
   auto request =
       AirBeamCore::raop::RtspMsgBuilder<AirBeamCore::raop::RtspReqMessage>()
@@ -104,19 +442,14 @@ void Raop::SetVolume(uint8_t volume_percent) {
           .SetUri(uri)
           .AddHeader("Content-Type", "text/parameters")
           .AddHeader("Content-Length", std::to_string(body.size()))
-          .AddHeader("CSeq", std::to_string(status_.seq_number++))
+          .AddHeader("CSeq", std::to_string(status_.cseq++))
           .AddHeader("User-Agent", "iTunes/7.6.2 (Windows; N;)")
           .AddHeader("Client-Instance", sci_)
           .AddHeader("Session", "1")
           .SetBody(body)
           .Build();
   RtspRespMessage response;
-  int ret = rtsp_client_.DoRequest(request, response);
-  if (ret != kOk) {
-    ABDebugLog("rtsp_client_.DoRequest failed, ret=%d", ret);
-    exit(-1);
-    return;
-  }
+  return Request(request, response);
 }
 
 void Raop::GenerateID() {
@@ -126,18 +459,18 @@ void Raop::GenerateID() {
   sci_ = helper::RandomGenerator::GetInstance().GenHexStr(kSciLen);
 }
 
-void Raop::Announce() {
-  std::string uri = fmt::format("rtsp://{}/{}", rtsp_ip_addr_, sid_);
+ErrCode Raop::Announce() {
+  std::string uri = SessionUri();
 
   std::vector<std::tuple<std::string, std::string>> sdp_map = {
       {"v", "0"},
-      {"o", fmt::format("iTunes {} 0 IN IP4 {}", sid_,
-                        rtsp_client_.GetLocalNetAddr().ip_)},
+      {"o", fmt::format("iTunes {} 0 IN {}", sid_,
+                        SdpAddress(rtsp_client_.GetLocalNetAddr().ip_))},
       {"s", "iTunes"},
-      {"c", fmt::format("IN IP4 {}", rtsp_ip_addr_)},
+      {"c", fmt::format("IN {}", SdpAddress(rtsp_ip_addr_))},
       {"t", "0 0"},
       {"m", "audio 0 RTP/AVP 96"},
-      {"a", "rtpmap:96 L16/44100/2"}};
+      {"a", "rtpmap:96 " + format_.Rtpmap()}};
   std::string sdp = JoinKVStrOrdered(sdp_map, "=", "\r\n") + "\r\n";
 
   auto request =
@@ -146,82 +479,121 @@ void Raop::Announce() {
           .SetUri(uri)
           .AddHeader("Content-Type", "application/sdp")
           .AddHeader("Content-Length", std::to_string(sdp.size()))
-          .AddHeader("CSeq", std::to_string(status_.seq_number++))
+          .AddHeader("CSeq", std::to_string(status_.cseq++))
           .AddHeader("User-Agent", "iTunes/7.6.2 (Windows; N;)")
           .AddHeader("Client-Instance", sci_)
           .SetBody(sdp)
           .Build();
   RtspRespMessage response;
-  int ret = rtsp_client_.DoRequest(request, response);
-  if (ret != kOk) {
-    ABDebugLog("rtsp_client_.DoRequest failed, ret=%d", ret);
-    exit(-1);
-    return;
-  }
+  return Request(request, response);
+}
+
+std::string Raop::SessionUri() const {
+  return fmt::format("rtsp://{}/{}", UriHost(rtsp_ip_addr_), sid_);
 }
 
-void Raop::BindCtrlAndTimePort() {
-  int ret = 0;
-  ret = ctrl_server_.Bind();
+ErrCode Raop::BindPorts() {
+  // The receiver's UDP ports are on the address RTSP connected to.
+  const int family = SockAddr::Family(rtsp_ip_addr_);
+  ErrCode ret = ctrl_server_.Bind(family);
   if (ret != kOk) {
-    ABDebugLog("ctrl_server_.Bind, ret=%d", ret);
-    exit(-1);
-    return;
+    ABDebugLog("ctrl_server_.Bind, ret=%d", static_cast<int>(ret));
+    return ret;
   }
-  ret = time_server_.Bind();
+  ret = time_server_.Bind(family);
   if (ret != kOk) {
-    ABDebugLog("time_server_.Bind, ret=%d", ret);
-    exit(-1);
-    return;
-  }
-  (new std::thread([&]() {
-    helper::NetAddr remote_addr;
-    uint8_t buffer[32];
-    std::string data;
+    ABDebugLog("time_server_.Bind, ret=%d", static_cast<int>(ret));
+    return ret;
+  }
+  ret = audio_server_.Bind(family);
+  if (ret != kOk) {
+    ABDebugLog("audio_server_.Bind failed, ret=%d", static_cast<int>(ret));
+    return ret;
+  }
+  return kOk;
+}
+
+void Raop::TimingStart() {
+  SpawnThread(time_server_.GetFd(), std::chrono::milliseconds(-1),
+              &Raop::HandleTiming);
+}
+
+void Raop::SpawnThread(int fd, std::chrono::milliseconds period,
+                       ErrCode (Raop::*handler)()) {
+  threads_.emplace_back([this, fd, period, handler]() {
     while (true) {
-      memset(buffer, 0, sizeof(buffer));
-      int ret = time_server_.Read(remote_addr, data);
-      if (ret != kOk) {
-        ABDebugLog("time_server_.Read failed, ret=%d", ret);
-        exit(-1);
-        return;
-      }
-      memcpy(buffer, data.data(), data.size());
-      auto recv_pkt = RtpTimePacket::Deserialize(buffer, data.size());
-      RtpTimePacket send_pkt;
-      send_pkt.header.proto = recv_pkt.header.proto;
-      send_pkt.header.type = 0x53 | 0x80;
-      send_pkt.header.seq = recv_pkt.header.seq;
-      send_pkt.dummy = 0;
-      send_pkt.recv_time = NtpTime::Now();
-      send_pkt.ref_time = recv_pkt.send_time;
-      send_pkt.send_time = NtpTime::Now();
-      memset(buffer, 0, 32);
-      send_pkt.Serialize(buffer);
-      data.resize(sizeof(buffer), '\0');
-      memcpy(data.data(), buffer, sizeof(buffer));
-      ret = time_server_.Write(remote_addr, data);
+      pollfd fds[] = {{stop_pipe_[0], POLLIN, 0}, {fd, POLLIN, 0}};
+      int ready = poll(fds, fd < 0 ? 1 : 2, static_cast<int>(period.count()));
+      if (ready < 0 && errno == EINTR) continue;
+      if (fds[0].revents != 0) return;
+      if (fd >= 0 && !(fds[1].revents & POLLIN)) continue;
+      ErrCode ret = (this->*handler)();
       if (ret != kOk) {
-        ABDebugLog("time_server_.Write failed, ret=%d", ret);
-        exit(-1);
+        // The session is dead; the owner learns it from the next SendChunk.
+        ErrCode none = kOk;
+        thread_error_.compare_exchange_strong(none, ret);
         return;
       }
     }
-  }))->detach();
-  ret = audio_server_.Bind();
-  if (ret != kOk) {
-    ABDebugLog("audio_server_.Bind failed, ret=%d", ret);
-    exit(-1);
+  });
+}
+
+void Raop::StopThreads() {
+  if (stop_pipe_[1] >= 0) {
+    char byte = 0;
+    while (write(stop_pipe_[1], &byte, 1) < 0 && errno == EINTR) {
+    }
+  }
+  for (auto& thread : threads_) thread.join();
+  threads_.clear();
+  for (int& fd : stop_pipe_) {
+    if (fd >= 0) close(fd);
+    fd = -1;
   }
 }
 
-void Raop::Setup() {
-  int ret = 0;
+ErrCode Raop::HandleTiming() {
+  ABTraceScope("timing_reply");
+  helper::NetAddr remote_addr;
+  uint8_t buffer[32];
+  std::string data;
+  memset(buffer, 0, sizeof(buffer));
+  ErrCode ret = time_server_.Read(remote_addr, data);
+  if (ret != kOk) {
+    ABDebugLog("time_server_.Read failed, ret=%d", static_cast<int>(ret));
+    return ret;
+  }
+  uint64_t begin_ns = SteadyNowNs();
+  size_t len = std::min(data.size(), sizeof(buffer));
+  memcpy(buffer, data.data(), len);
+  auto recv_pkt = RtpTimePacket::Deserialize(buffer, len);
+  RtpTimePacket send_pkt;
+  send_pkt.header.proto = recv_pkt.header.proto;
+  send_pkt.header.type = 0x53 | 0x80;
+  send_pkt.header.seq = recv_pkt.header.seq;
+  send_pkt.dummy = 0;
+  send_pkt.recv_time = NtpTime::Now();
+  send_pkt.ref_time = recv_pkt.send_time;
+  send_pkt.send_time = NtpTime::Now();
+  memset(buffer, 0, 32);
+  send_pkt.Serialize(buffer);
+  data.resize(sizeof(buffer), '\0');
+  memcpy(data.data(), buffer, sizeof(buffer));
+  ret = time_server_.Write(remote_addr, data);
+  if (ret != kOk) {
+    ABDebugLog("time_server_.Write failed, ret=%d", static_cast<int>(ret));
+    return ret;
+  }
+  timing_reply_delay_.Record(SteadyNowNs() - begin_ns);
+  timing_replies_.Add();
+  return kOk;
+}
 
+ErrCode Raop::Setup() {
   ABDebugLog("Raop::Setup ctrl server port =%d",
              ctrl_server_.GetLocalNetAddr().port_);
 
-  std::string uri = fmt::format("rtsp://{}/{}", rtsp_ip_addr_, sid_);
+  std::string uri = SessionUri();
   std::vector<std::tuple<std::string, std::string>> transport_params = {
       {"interleaved", "0-1"},
       {"mode", "record"},
@@ -236,47 +608,46 @@ void Raop::Setup() {
           .SetMethod("SETUP")
           .SetUri(uri)
           .AddHeader("Transport", transport)
-          .AddHeader("CSeq", std::to_string(status_.seq_number++))
+          .AddHeader("CSeq", std::to_string(status_.cseq++))
           .AddHeader("User-Agent", "iTunes/7.6.2 (Windows; N;)")
           .AddHeader("Client-Instance", sci_)
           .Build();
   RtspRespMessage response;
-  ret = rtsp_client_.DoRequest(request, response);
-  if (ret != kOk) {
-    ABDebugLog("rtsp_client_.DoRequest failed, ret=%d", ret);
-    exit(-1);
-    return;
-  }
+  ErrCode ret = Request(request, response);
+  if (ret != kOk) return ret;
 
   auto transport_map = ParseKVStr(response.GetHeader("Transport"), "=", ";");
   if (!absl::SimpleAtoi(transport_map["server_port"],
                         &remote_audio_addr_.port_)) {
     ABDebugLog("absl::SimpleAtoi(transport_map[\"server_port\"], ...) failed");
-    exit(-1);
-    return;
+    return kErrRtspHeader;
   }
   if (!absl::SimpleAtoi(transport_map["control_port"],
                         &remote_ctrl_addr_.port_)) {
     ABDebugLog("absl::SimpleAtoi(transport_map[\"control_port\"], ...) failed");
-    exit(-1);
-    return;
+    return kErrRtspHeader;
   }
   if (!absl::SimpleAtoi(transport_map["timing_port"],
                         &remote_time_addr_.port_)) {
     ABDebugLog("absl::SimpleAtoi(transport_map[\"timing_port\"], ...) failed");
-    exit(-1);
-    return;
+    return kErrRtspHeader;
   }
 
   remote_audio_addr_.ip_ = rtsp_client_.GetRemoteNetAddr().ip_;
   remote_ctrl_addr_.ip_ = rtsp_client_.GetRemoteNetAddr().ip_;
   remote_time_addr_.ip_ = rtsp_client_.GetRemoteNetAddr().ip_;
+  if (remote_audio_sockaddr_.Parse(remote_audio_addr_) != kOk) {
+    ABDebugLog("remote_audio_sockaddr_.Parse(%s) failed",
+               remote_audio_addr_.ToString().c_str());
+    return kErrUdpAddrParse;
+  }
+  return kOk;
 }
 
-void Raop::Record() {
-  uint64_t start_seq = status_.seq_number++;
-  uint64_t start_ts = NtpTime::Now().IntoTimestamp(kSampleRate44100);
-  std::string uri = fmt::format("rtsp://{}/{}", rtsp_ip_addr_, sid_);
+ErrCode Raop::Record() {
+  uint16_t start_seq = status_.timeline.Load().next_seq;
+  uint64_t start_ts = NtpTime::Now().IntoTimestamp(format_.sample_rate);
+  std::string uri = SessionUri();
   std::string range = "npt=0-";
   std::vector<std::tuple<std::string, std::string>> rtp_info_map = {
       {"seq", std::to_string(start_seq)},
@@ -289,105 +660,146 @@ void Raop::Record() {
           .SetUri(uri)
           .AddHeader("Range", range)
           .AddHeader("RTP-Info", rtp_info)
-          .AddHeader("CSeq", std::to_string(start_seq))
+          .AddHeader("CSeq", std::to_string(status_.cseq++))
           .AddHeader("User-Agent", "iTunes/7.6.2 (Windows; N;)")
           .AddHeader("Client-Instance", sci_)
           .AddHeader("Session", "1")
           .Build();
 
   RtspRespMessage response;
-  int ret = rtsp_client_.DoRequest(request, response);
-  if (ret != kOk) {
-    ABDebugLog("rtsp_client_.DoRequest failed, ret=%d", ret);
-    exit(-1);
-    return;
-  }
-  response.GetHeader("Audio-Latency");
+  ErrCode ret = Request(request, response);
+  if (ret != kOk) return ret;
   if (!absl::SimpleAtoi(response.GetHeader("Audio-Latency"), &latency_)) {
     ABDebugLog(
         "absl::SimpleAtoi(response.GetHeader(\"Audio-Latency\"), ...) failed");
-    exit(-1);
-    return;
+    return kErrRtspHeader;
   }
+  return kOk;
 }
 
-void Raop::SyncStart() {
-  (new std::thread([this]() {
-    NetAddr ctrl_remote_addr;
-    while (true) {
-      std::string buffer;
-      int ret = ctrl_server_.Read(ctrl_remote_addr, buffer);
-      if (ret != kOk) {
-        ABDebugLog("ctrl_server_.Read failed, ret=%d", ret);
-        exit(-1);
-        return;
-      }
-      auto recv_pkt = RtpLostPacket::Deserialize(
-          reinterpret_cast<uint8_t*>(buffer.data()), buffer.size());
-    }
-  }))->detach();
-  (new std::thread([this]() {
-    while (true) {
-      auto rsp = RtpSyncPacket::Build(status_.head_ts, kSampleRate44100,
-                                      latency_, false);
-      uint8_t buffer[sizeof(RtpSyncPacket)];
-      rsp.Serialize(buffer);
-      std::string data;
-      data.resize(sizeof(RtpSyncPacket), '\0');
-      memcpy(data.data(), buffer, sizeof(RtpSyncPacket));
-      int ret = ctrl_server_.Write(remote_ctrl_addr_, data);
-      if (ret != kOk) {
-        ABDebugLog("ctrl_server_.Write failed, ret=%d", ret);
-        exit(-1);
-        return;
-      }
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-    }
-  }))->detach();
+void Raop::ControlStart() {
+  SpawnThread(ctrl_server_.GetFd(), std::chrono::milliseconds(-1),
+              &Raop::HandleControl);
+}
+
+ErrCode Raop::HandleControl() {
+  NetAddr ctrl_remote_addr;
+  std::string buffer;
+  ErrCode ret = ctrl_server_.Read(ctrl_remote_addr, buffer);
+  if (ret != kOk) {
+    ABDebugLog("ctrl_server_.Read failed, ret=%d", static_cast<int>(ret));
+    return ret;
+  }
+  if (buffer.size() < RtpLostPacket::kSize) return kOk;
+  auto recv_pkt = RtpLostPacket::Deserialize(
+      reinterpret_cast<uint8_t*>(buffer.data()), buffer.size());
+  if ((recv_pkt.header.type & 0x7f) != 0x55) return kOk;
+  ABDebugLog("retransmit request seq=%u n=%u, next_seq=%u",
+             recv_pkt.seq_number, recv_pkt.n,
+             status_.timeline.Load().next_seq);
+  Retransmit(recv_pkt.seq_number, recv_pkt.n);
+  return kOk;
 }
 
 void Raop::KeepAlive() {
-  (new std::thread([this]() {
-    while (true) {
-      std::this_thread::sleep_for(std::chrono::seconds(5));
-      auto request =
-          AirBeamCore::raop::RtspMsgBuilder<AirBeamCore::raop::RtspReqMessage>()
-              .SetMethod("OPTIONS")
-              .SetUri("*")
-              .AddHeader("CSeq", std::to_string(status_.seq_number++))
-              .AddHeader("User-Agent", "iTunes/7.6.2 (Windows; N;)")
-              .AddHeader("Client-Instance", sci_)
-              .AddHeader("Session", "1")
-              .Build();
-      RtspRespMessage response;
-      int ret = rtsp_client_.DoRequest(request, response);
-      if (ret != kOk) {
-        ABDebugLog("rtsp_client_.DoRequest failed, ret=%d", ret);
-        exit(-1);
-        return;
-      }
-    }
-  }))->detach();
+  SpawnThread(-1, std::chrono::seconds(5), &Raop::SendKeepAlive);
+}
+
+RtspReqMessage Raop::KeepAliveRequest() {
+  return AirBeamCore::raop::RtspMsgBuilder<AirBeamCore::raop::RtspReqMessage>()
+      .SetMethod("OPTIONS")
+      .SetUri("*")
+      .AddHeader("CSeq", std::to_string(status_.cseq++))
+      .AddHeader("User-Agent", "iTunes/7.6.2 (Windows; N;)")
+      .AddHeader("Client-Instance", sci_)
+      .AddHeader("Session", "1")
+      .Build();
 }
 
-void Raop::FirstSendSync() {
-  uint64_t now_ts = NtpTime::Now().IntoTimestamp(kSampleRate44100);
-  status_.head_ts = now_ts;
-  status_.first_ts = status_.head_ts;
-  auto pkt =
-      RtpSyncPacket::Build(status_.head_ts, kSampleRate44100, latency_, true);
+ErrCode Raop::SendKeepAlive() {
+  RtspRespMessage response;
+  int ret = rtsp_client_.DoRequest(KeepAliveRequest(), response);
+  if (ret != kOk) {
+    ABDebugLog("rtsp_client_.DoRequest failed, ret=%d", ret);
+    return static_cast<ErrCode>(ret);
+  }
+  return kOk;
+}
+
+ErrCode Raop::BeginKeepAlive() {
+  int ret = rtsp_client_.Send(KeepAliveRequest());
+  if (ret != kOk) {
+    ABDebugLog("rtsp_client_.Send failed, ret=%d", ret);
+    return static_cast<ErrCode>(ret);
+  }
+  return kOk;
+}
+
+ErrCode Raop::HandleRtsp() {
+  RtspRespMessage response;
+  int ret = rtsp_client_.Receive(response);
+  if (ret != kOk) {
+    ABDebugLog("rtsp_client_.Receive failed, ret=%d", ret);
+    return static_cast<ErrCode>(ret);
+  }
+  return kOk;
+}
+
+ErrCode Raop::Teardown() {
+  std::string uri = SessionUri();
+  auto request =
+      AirBeamCore::raop::RtspMsgBuilder<AirBeamCore::raop::RtspReqMessage>()
+          .SetMethod("TEARDOWN")
+          .SetUri(uri)
+          .AddHeader("CSeq", std::to_string(status_.cseq++))
+          .AddHeader("User-Agent", "iTunes/7.6.2 (Windows; N;)")
+          .AddHeader("Client-Instance", sci_)
+          .AddHeader("Session", "1")
+          .Build();
+  RtspRespMessage response;
+  int ret = rtsp_client_.DoRequest(request, response);
+  if (ret != kOk) {
+    ABDebugLog("rtsp_client_.DoRequest failed, ret=%d", ret);
+    return static_cast<ErrCode>(ret);
+  }
+  return kOk;
+}
+
+ErrCode Raop::MaybeSendSync(const TimelineSnapshot& timeline) {
+  if (timeline.head_ts < next_sync_ts_) return kOk;
+  return SendSync(false);
+}
+
+ErrCode Raop::SendSync(bool first) {
+  return SendSyncAt(NtpTime::Now(), first);
+}
+
+ErrCode Raop::SendSyncAt(NtpTime now, bool first) {
+  // The NTP time and the RTP timestamp come from one clock read, mapped
+  // through the timeline anchor, rather than deriving NTP from RTP.
+  auto timeline = status_.timeline.Load();
+  uint64_t now_ts =
+      RtpTimeline::TimestampAt(timeline, now, format_.sample_rate);
+  uint64_t latency = sync_latency_ != 0 ? sync_latency_ : latency_;
+  auto pkt = RtpSyncPacket::Build(now_ts, now, latency, first);
+
+  // Next sync on the following whole second of audio past the head.
+  uint64_t elapsed = timeline.head_ts - timeline.anchor_ts;
+  next_sync_ts_ = timeline.anchor_ts +
+                  (elapsed / format_.sample_rate + 1) * format_.sample_rate;
+
   uint8_t buffer[sizeof(RtpSyncPacket)];
   pkt.Serialize(buffer);
   std::string data;
   data.resize(sizeof(RtpSyncPacket), '\0');
   memcpy(data.data(), buffer, sizeof(RtpSyncPacket));
-  int ret = ctrl_server_.Write(remote_ctrl_addr_, data);
-  ABDebugLog("ctrl_server_.Write,len=%lu", data.size());
+  ErrCode ret = ctrl_server_.Write(remote_ctrl_addr_, data);
   if (ret != kOk) {
-    ABDebugLog("ctrl_server_.Write failed, ret=%d", ret);
-    exit(-1);
-    return;
+    ABDebugLog("ctrl_server_.Write failed, ret=%d", static_cast<int>(ret));
+    return ret;
   }
+  syncs_sent_.Add();
+  return kOk;
 }
 }  // namespace raop
 
@@ -6,27 +6,82 @@
 #include <sys/socket.h>
 
 #include <atomic>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "helper/metrics.h"
+#include "helper/metrics_registry.h"
 #include "helper/network.h"
 #include "helper/random.h"
+#include "raop/constants.h"
 #include "raop/rtp.h"
+#include "raop/packetizer.h"
 #include "raop/rtsp_client.h"
+#include "raop/stream_format.h"
+#include "raop/timeline.h"
 
 namespace AirBeamCore {
 namespace raop {
+enum class UnderrunPolicy {
+  // Keep the RTP timeline continuous by sending silence packets on schedule.
+  kSilenceFill = 1,
+  // Stop sending, then resume with a fresh first-packet marker and sync.
+  kResync = 2,
+};
+
+struct UnderrunStats {
+  uint64_t underruns = 0;
+  uint64_t silence_packets = 0;
+  uint64_t padded_packets = 0;
+  uint64_t resyncs = 0;
+};
+
+struct RetransmitStats {
+  uint64_t requests = 0;
+  uint64_t packets = 0;
+  // Requested packets that had already left the retransmit buffer.
+  uint64_t misses = 0;
+};
+
+// A point-in-time copy of a session's metrics. Durations are in
+// nanoseconds.
+struct RaopStats {
+  uint64_t packets_sent = 0;
+  uint64_t bytes_sent = 0;
+  // Audio packets the socket refused to send.
+  uint64_t send_errors = 0;
+  uint64_t syncs_sent = 0;
+  uint64_t timing_replies = 0;
+  // Bytes buffered ahead of the sender, as last reported by the producer.
+  int64_t fifo_depth_bytes = 0;
+  UnderrunStats underrun;
+  RetransmitStats retransmit;
+  // Time spent in the audio send syscall.
+  helper::HistogramSnapshot send_latency;
+  // How far from its due time each packet went out.
+  helper::HistogramSnapshot pacing_error;
+  helper::HistogramSnapshot rtsp_round_trip;
+  // From reading a timing request to having sent the reply.
+  helper::HistogramSnapshot timing_reply_delay;
+};
+
 struct RaopStatus {
  public:
-  std::atomic<uint16_t> seq_number =
-      std::atomic<uint16_t>(helper::RandomGenerator::GetInstance().GenU64());
-  uint64_t head_ts = 0;
-  uint64_t first_ts = 0;
+  // RTSP CSeq, independent from the RTP sequence numbers.
+  std::atomic<uint32_t> cseq = 0;
+  RtpTimeline timeline{static_cast<uint16_t>(
+      helper::RandomGenerator::GetInstance().GenU64())};
 };
 
 class Raop {
  public:
   Raop(const std::string rtsp_ip_addr, uint32_t rtsp_port)
-      : rtsp_ip_addr_(rtsp_ip_addr), rtsp_port_(rtsp_port) {}
+      : Raop(std::vector<std::string>{rtsp_ip_addr}, rtsp_port) {}
+  // A receiver resolving to several addresses; Connect races them.
+  Raop(const std::vector<std::string>& rtsp_ip_addrs, uint32_t rtsp_port);
+  ~Raop();
 
  private:
   raop::RTSPClient rtsp_client_;
@@ -36,6 +91,8 @@ class Raop {
   helper::UDPServer audio_server_;
 
   helper::NetAddr remote_audio_addr_;
+  // The same, parsed once at SETUP for senders that batch their own writes.
+  helper::SockAddr remote_audio_sockaddr_;
   helper::NetAddr remote_time_addr_;
   helper::NetAddr remote_ctrl_addr_;
 
@@ -43,6 +100,7 @@ class Raop {
   std::string sci_;
 
   uint64_t latency_ = 0;
+  uint64_t sync_latency_ = 0;
 
   bool first_pkt_ = true;
 
@@ -50,26 +108,192 @@ class Raop {
 
   RaopStatus status_;
 
+  StreamFormat format_;
+  const Packetizer* packetizer_;
+  // Set when negotiation found nothing to send; Connect then fails early.
+  helper::ErrCode format_status_ = helper::kOk;
+
+  // Sync packets are emitted by the sender once per second of audio.
+  uint64_t next_sync_ts_ = 0;
+
+  UnderrunPolicy underrun_policy_ = UnderrunPolicy::kSilenceFill;
+  RtpAudioPacketChunk silence_chunk_;
+  bool paused_ = false;
+  helper::Counter underruns_;
+  helper::Counter silence_packets_;
+  helper::Counter padded_packets_;
+  helper::Counter resyncs_;
+
+  // The last packets sent, serialized and indexed by seq, for answering
+  // retransmit requests on the control channel.
+  static constexpr size_t kRetransmitPackets = 64;
+  struct SentPacket {
+    uint16_t seq = 0;
+    std::vector<uint8_t> data;
+  };
+  std::mutex retransmit_mtx_;
+  std::vector<SentPacket> retransmit_buffer_;
+  helper::Counter retransmit_requests_;
+  helper::Counter retransmit_packets_;
+  helper::Counter retransmit_misses_;
+
+  helper::Counter packets_sent_;
+  helper::Counter bytes_sent_;
+  helper::Counter send_errors_;
+  helper::Counter syncs_sent_;
+  helper::Counter timing_replies_;
+  helper::Gauge fifo_depth_;
+  helper::Histogram send_latency_;
+  helper::Histogram pacing_error_;
+  helper::Histogram timing_reply_delay_;
+
+  bool is_connected_ = false;
   bool is_started_ = false;
+  bool is_recording_ = false;
+  bool managed_ = false;
 
-  const std::string rtsp_ip_addr_;
+  // The timing, control and keepalive threads of an unmanaged session. A
+  // byte written to stop_pipe_ wakes them all to exit.
+  std::vector<std::thread> threads_;
+  int stop_pipe_[2] = {-1, -1};
+  // The first error one of them stopped on, for SendChunk to report.
+  std::atomic<helper::ErrCode> thread_error_{helper::kOk};
+
+  const std::vector<std::string> rtsp_ip_addrs_;
+  // The address that won the connect race.
+  std::string rtsp_ip_addr_;
   const uint32_t rtsp_port_;
 
  public:
-  void Start();
+  helper::ErrCode Connect();
+  helper::ErrCode Options();
+  bool IsConnected() const { return is_connected_; }
+  void SetConnectOptions(const helper::TCPClient::Options& options) {
+    rtsp_client_.SetOptions(options);
+  }
+  // Picks the stream format from the receiver's TXT record. Without it the
+  // session announces L16/44100/2. On failure Connect fails the same way,
+  // before any RTSP.
+  helper::ErrCode SetReceiverCapabilities(
+      const discovery::RaopCapabilities& capabilities);
+  const StreamFormat& GetStreamFormat() const { return format_; }
+  // Encodes up to one packet of pipeline frames in the negotiated format
+  // for SendChunk, and returns the input bytes taken.
+  size_t Packetize(const uint8_t* input, size_t len,
+                   RtpAudioPacketChunk& output) const {
+    return packetizer_->packetize(input, len, output);
+  }
+  // Pipeline bytes that make up one packet.
+  size_t GetPacketInputBytes() const { return packetizer_->input_bytes; }
+  const std::string& GetRtspIpAddr() const { return rtsp_ip_addr_; }
+  uint32_t GetRtspPort() const { return rtsp_port_; }
+
+  // Managed sessions spawn no threads of their own. Set before
+  // StartSession; the owner then polls GetTimingFd/GetControlFd/GetRtspFd,
+  // calls HandleTiming/HandleControl/HandleRtsp when they are readable, and
+  // calls BeginKeepAlive every few seconds.
+  void SetManaged(bool managed) { managed_ = managed; }
+  int GetTimingFd() const { return time_server_.GetFd(); }
+  int GetControlFd() const { return ctrl_server_.GetFd(); }
+  int GetRtspFd() const { return rtsp_client_.GetFd(); }
+  // Each handles one pending datagram.
+  helper::ErrCode HandleTiming();
+  helper::ErrCode HandleControl();
+  // Reads the keepalive reply, or fails once the receiver hung up.
+  helper::ErrCode HandleRtsp();
+  // Sends a keepalive and waits for the reply.
+  helper::ErrCode SendKeepAlive();
+  // Sends a keepalive without waiting; HandleRtsp takes the reply. Fails if
+  // the previous one is still unanswered.
+  helper::ErrCode BeginKeepAlive();
+
+  // The RTSP handshake and the first sync; returns the first step that
+  // failed, with whatever it opened closed again.
+  helper::ErrCode Start();
+  // Ends the session: stops its threads, sends TEARDOWN if it was
+  // recording, and closes its sockets. The receiver is then free for
+  // another sender; a new session takes a new Raop.
+  void Stop();
+  // Start() in two steps: the RTSP handshake, then the first sync anchoring
+  // the RTP timeline to the given NTP time. Lets a group of sessions share
+  // one anchor. A failed handshake closes what it opened.
+  helper::ErrCode StartSession();
+  helper::ErrCode BeginStream(NtpTime anchor);
   void AcceptFrame();
-  void SendChunk(const RtpAudioPacketChunk& chunk);
-  void SetVolume(uint8_t volume);
+  // Sleeps until the packet of frames after head_ts is due on the wall
+  // clock, and returns how late it woke up, in nanoseconds; negative if
+  // early.
+  static int64_t PaceTo(uint64_t head_ts, uint64_t frames,
+                        uint64_t sample_rate);
+  // A chunk shorter than a packet is padded with silence; an empty one is
+  // handled as an underrun. Fails when the packet or its sync could not be
+  // sent, or, for an unmanaged session, once one of its threads failed; the
+  // session is then dead and only Stop is left to call.
+  helper::ErrCode SendChunk(const RtpAudioPacketChunk& chunk);
+  // Called by the sender when no audio arrived in time for the next packet.
+  helper::ErrCode OnUnderrun();
+  void SetUnderrunPolicy(UnderrunPolicy policy) { underrun_policy_ = policy; }
+  UnderrunStats GetUnderrunStats() const;
+  RetransmitStats GetRetransmitStats() const;
+  RaopStats GetStats() const;
+  // Writes GetStats() as airbeam_raop_* metrics labelled with the receiver.
+  void WriteMetrics(helper::MetricsWriter& writer) const;
+  // For owners that pace the session themselves instead of AcceptFrame.
+  void RecordPacingError(uint64_t error_ns) { pacing_error_.Record(error_ns); }
+  // For owners that send the audio themselves, when a packet did not go.
+  void RecordSendError() { send_errors_.Add(); }
+  // For the producer feeding SendChunk to report its buffer.
+  void SetFifoDepth(size_t bytes) { fifo_depth_.Set(bytes); }
+
+  // Receiver-reported Audio-Latency, in frames.
+  uint64_t GetLatency() const { return latency_; }
+  // Latency announced in sync packets instead of the receiver's own, to hold
+  // back a faster receiver in a group.
+  void SetSyncLatency(uint64_t frames) { sync_latency_ = frames; }
+  // Sends a sync packet pairing the given NTP time with its RTP timestamp.
+  helper::ErrCode SendSyncAt(NtpTime now, bool first);
+  // For senders that serialize the packet themselves: fills in the RTP
+  // header of the next packet and advances the timeline past it.
+  void NextPacketHeader(RtpAudioPacket& packet);
+  const helper::NetAddr& GetRemoteAudioAddr() const {
+    return remote_audio_addr_;
+  }
+  const helper::SockAddr& GetRemoteAudioSockAddr() const {
+    return remote_audio_sockaddr_;
+  }
+  // Also for those senders: keeps a packet they sent, header then payload,
+  // so a retransmit request for its seq can be answered.
+  void KeepForRetransmit(uint16_t seq, const uint8_t* header,
+                         size_t header_len, const uint8_t* payload,
+                         size_t payload_len);
+  helper::ErrCode SetVolume(uint8_t volume);
+  TimelineSnapshot GetTimeline() const { return status_.timeline.Load(); }
 
  private:
   void GenerateID();
-  void Announce();
-  void BindCtrlAndTimePort();
-  void Setup();
-  void Record();
-  void SyncStart();
+  // DoRequest, failing with kErrRtspStatus unless the reply is a 200.
+  helper::ErrCode Request(const RtspReqMessage& request,
+                          RtspRespMessage& response);
+  helper::ErrCode Announce();
+  helper::ErrCode BindPorts();
+  std::string SessionUri() const;
+  void TimingStart();
+  helper::ErrCode Setup();
+  helper::ErrCode Record();
+  void ControlStart();
   void KeepAlive();
-  void FirstSendSync();
+  // Runs handler whenever fd is readable, or every period when fd is -1,
+  // until StopThreads.
+  void SpawnThread(int fd, std::chrono::milliseconds period,
+                   helper::ErrCode (Raop::*handler)());
+  void StopThreads();
+  helper::ErrCode Teardown();
+  RtspReqMessage KeepAliveRequest();
+  helper::ErrCode MaybeSendSync(const TimelineSnapshot& timeline);
+  helper::ErrCode SendSync(bool first);
+  helper::ErrCode SendPacket(const RtpAudioPacketChunk& chunk);
+  helper::ErrCode Resume();
+  void Retransmit(uint16_t seq, uint16_t count);
 };
 }  // namespace raop
 }  // namespace AirBeamCore
@@ -4,8 +4,10 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <string>
 
 #include "constants.h"
@@ -121,12 +123,17 @@ uint64_t NtpTime::IntoTimestamp(uint64_t sample_rate) const {
   return ((ntp >> 16) * sample_rate) >> 16;
 }
 
+uint64_t NtpTime::IntoNanoseconds() const {
+  return static_cast<uint64_t>(seconds) * 1'000'000'000 +
+         ((static_cast<uint64_t>(fraction) * 1'000'000'000) >> 32);
+}
+
 NtpTime NtpTime::FromTimestamp(uint64_t ts, uint64_t sample_rate) {
-  uint64_t ntp = (ts << 16) / (sample_rate << 16);
   NtpTime result;
 
-  result.seconds = static_cast<uint32_t>((ntp >> 32));
-  result.fraction = static_cast<uint32_t>(ntp & 0xffffffff);
+  result.seconds = static_cast<uint32_t>(ts / sample_rate);
+  result.fraction =
+      static_cast<uint32_t>(((ts % sample_rate) << 32) / sample_rate);
 
   return result;
 }
@@ -170,6 +177,12 @@ RtpLostPacket RtpLostPacket::Deserialize(const uint8_t* data, size_t size) {
   return packet;
 }
 
+void RtpLostPacket::Serialize(uint8_t* data) const {
+  header.Serialize(data);
+  write_be16(data + 4, seq_number);
+  write_be16(data + 6, n);
+}
+
 std::string RtpLostPacket::ToString() const {
   return fmt::format("proto: {}, type: {}, seq: {}, seq_number: {}, n: {}",
                      header.proto, header.type, header.seq, seq_number, n);
@@ -177,11 +190,17 @@ std::string RtpLostPacket::ToString() const {
 
 RtpSyncPacket RtpSyncPacket::Build(uint64_t timestamp, uint64_t sample_rate,
                                    uint64_t latency, bool first) {
+  return Build(timestamp, NtpTime::FromTimestamp(timestamp, sample_rate),
+               latency, first);
+}
+
+RtpSyncPacket RtpSyncPacket::Build(uint64_t timestamp, NtpTime curr_time,
+                                   uint64_t latency, bool first) {
   RtpSyncPacket pkt;
   pkt.header.proto = 0x80 | (first ? 0x10 : 0x00);
   pkt.header.type = 0x54 | 0x80;
   pkt.header.seq = 7;
-  pkt.curr_time = NtpTime::FromTimestamp(timestamp, kSampleRate44100);
+  pkt.curr_time = curr_time;
 
   pkt.rtp_timestamp = static_cast<uint32_t>(timestamp);
   pkt.rtp_timestamp_latency =
@@ -190,6 +209,15 @@ RtpSyncPacket RtpSyncPacket::Build(uint64_t timestamp, uint64_t sample_rate,
   return pkt;
 }
 
+RtpSyncPacket RtpSyncPacket::Deserialize(const uint8_t* data, size_t size) {
+  RtpSyncPacket packet;
+  packet.header = RtpHeader::Deserialize(data, size);
+  packet.rtp_timestamp_latency = read_be32(data + 4);
+  packet.curr_time = NtpTime::Deserialize(data + 8, 8);
+  packet.rtp_timestamp = read_be32(data + 16);
+  return packet;
+}
+
 std::string RtpSyncPacket::ToString() const {
   return fmt::format(
       "proto: {}, type: {}, seq: {}, rtp_timestamp_latency: {}, "
@@ -205,15 +233,30 @@ void RtpSyncPacket::Serialize(uint8_t* data) const {
   write_be32(data + 16, rtp_timestamp);
 }
 
+RtpAudioPacket RtpAudioPacket::Deserialize(const uint8_t* data, size_t size) {
+  RtpAudioPacket packet;
+  packet.header = RtpHeader::Deserialize(data, size);
+  packet.timestamp = read_be32(data + 4);
+  packet.ssrc = read_be32(data + 8);
+  size_t len = size > kHeaderSize ? size - kHeaderSize : 0;
+  packet.data.len_ = std::min(len, sizeof(packet.data.data_));
+  memcpy(packet.data.data_, data + kHeaderSize, packet.data.len_);
+  return packet;
+}
+
 void RtpAudioPacket::Serialize(std::vector<uint8_t>& buffer) const {
   buffer.clear();
-  buffer.resize(12, 0);
-  header.Serialize(buffer.data());
-  write_be32(buffer.data() + 4, timestamp);
-  write_be32(buffer.data() + 8, ssrc);
+  buffer.resize(kHeaderSize, 0);
+  SerializeHeader(buffer.data());
   buffer.insert(buffer.end(), data.data_, data.data_ + data.len_);
 }
 
+void RtpAudioPacket::SerializeHeader(uint8_t* buffer) const {
+  header.Serialize(buffer);
+  write_be32(buffer + 4, timestamp);
+  write_be32(buffer + 8, ssrc);
+}
+
 Volume Volume::FromPercent(uint8_t percent) {
   constexpr float kMinVolume = -30.0;
   constexpr float kMaxVolume = 0.0;
@@ -28,6 +28,7 @@ struct NtpTime {
   void Serialize(uint8_t* data) const;
 
   uint64_t IntoTimestamp(uint64_t sample_rate) const;
+  uint64_t IntoNanoseconds() const;
 };
 
 struct RtpTimePacket {
@@ -48,9 +49,11 @@ struct RtpLostPacket {
   uint16_t seq_number;
   uint16_t n;
 
+  static constexpr size_t kSize = 8;
   static RtpLostPacket Deserialize(const uint8_t* data, size_t size);
 
   std::string ToString() const;
+  void Serialize(uint8_t* data) const;
 };
 
 struct RtpSyncPacket {
@@ -61,6 +64,10 @@ struct RtpSyncPacket {
 
   static RtpSyncPacket Build(uint64_t timestamp, uint64_t sample_rate,
                              uint64_t latency, bool first);
+  // Pairs the RTP timestamp with an NTP time read from the same clock.
+  static RtpSyncPacket Build(uint64_t timestamp, NtpTime curr_time,
+                             uint64_t latency, bool first);
+  static RtpSyncPacket Deserialize(const uint8_t* data, size_t size);
 
   std::string ToString() const;
   void Serialize(uint8_t* data) const;
@@ -77,7 +84,11 @@ struct RtpAudioPacket {
   uint32_t ssrc;
   RtpAudioPacketChunk data;
 
+  static constexpr size_t kHeaderSize = 12;
+  // The payload is truncated to what RtpAudioPacketChunk holds.
+  static RtpAudioPacket Deserialize(const uint8_t* data, size_t size);
   void Serialize(std::vector<uint8_t>& data) const;
+  void SerializeHeader(uint8_t* data) const;
 };
 
 struct Volume {
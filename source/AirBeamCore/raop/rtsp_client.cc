@@ -2,6 +2,7 @@
 
 #include "rtsp_client.h"
 
+#include <chrono>
 #include <mutex>
 
 #include "helper/errcode.h"
@@ -14,22 +15,62 @@ namespace raop {
 int RTSPClient::DoRequest(const RtspReqMessage& request,
                           RtspRespMessage& response) {
   std::lock_guard guard(mtx_);
+  if (pending_) {
+    // A response owed to Send would otherwise be taken for this one.
+    RtspRespMessage stale;
+    int ret = ReadResponseLocked(stale, true);
+    if (ret != helper::kOk) return ret;
+  }
   ABDebugLog("RTSPClient::DoRequestBegin\n%s", request.ToString().c_str());
 
+  sent_at_ = std::chrono::steady_clock::now();
   int ret = helper::TCPClient::Write(request.ToString());
-  if (ret < 0) {
+  if (ret != helper::kOk) {
+    return ret;
+  }
+  pending_ = true;
+  ret = ReadResponseLocked(response, true);
+  if (ret != helper::kOk) {
     return ret;
   }
+  ABDebugLog("RTSPClient::DoRequestEnd\n%s", response.ToString().c_str());
 
+  return helper::kOk;
+}
+
+int RTSPClient::Send(const RtspReqMessage& request) {
+  std::lock_guard guard(mtx_);
+  if (pending_) return helper::kErrTcpTimeout;
+  ABDebugLog("RTSPClient::Send\n%s", request.ToString().c_str());
+  sent_at_ = std::chrono::steady_clock::now();
+  int ret = helper::TCPClient::Write(request.ToString(), false);
+  if (ret != helper::kOk) return ret;
+  pending_ = true;
+  return helper::kOk;
+}
+
+int RTSPClient::Receive(RtspRespMessage& response) {
+  std::lock_guard guard(mtx_);
+  int ret = ReadResponseLocked(response, false);
+  // Readable, but DoRequest on another thread got there first.
+  if (ret == helper::kErrTcpTimeout) return helper::kOk;
+  return ret;
+}
+
+int RTSPClient::ReadResponseLocked(RtspRespMessage& response, bool wait) {
   std::string buffer;
-  ret = helper::TCPClient::Read(buffer);
-  if (ret < 0) {
+  int ret = helper::TCPClient::Read(buffer, wait);
+  if (ret != helper::kOk) {
     return ret;
   }
+  if (pending_) {
+    round_trip_.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - sent_at_)
+                           .count());
+    pending_ = false;
+  }
   auto response_msg = RtspMessage::Parse(buffer);
   response = *static_cast<RtspRespMessage*>(&response_msg);
-  ABDebugLog("RTSPClient::DoRequestEnd\n%s", response.ToString().c_str());
-
   return helper::kOk;
 }
 }  // namespace raop
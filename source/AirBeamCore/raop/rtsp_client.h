@@ -2,8 +2,10 @@
 
 #pragma once
 
+#include <chrono>
 #include <mutex>
 
+#include "helper/metrics.h"
 #include "helper/network.h"
 #include "rtsp.h"
 
@@ -12,9 +14,23 @@ namespace raop {
 class RTSPClient : public helper::TCPClient {
  public:
   int DoRequest(const RtspReqMessage& request, RtspRespMessage& response);
+  // DoRequest in two halves for callers polling GetFd, neither of which
+  // blocks. Send fails with kErrTcpTimeout while an earlier request is still
+  // unanswered; Receive reads whatever has arrived, and fails once the peer
+  // has closed the connection.
+  int Send(const RtspReqMessage& request);
+  int Receive(RtspRespMessage& response);
+  // Request to response, in nanoseconds, for every successful request.
+  const helper::Histogram& GetRoundTrip() const { return round_trip_; }
 
  private:
+  int ReadResponseLocked(RtspRespMessage& response, bool wait);
+
   std::mutex mtx_;
+  helper::Histogram round_trip_;
+  // Set while a request from Send awaits its response.
+  bool pending_ = false;
+  std::chrono::steady_clock::time_point sent_at_;
 };
 }  // namespace raop
 }  // namespace AirBeamCore
\ No newline at end of file
@@ -0,0 +1,438 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "session_manager.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "helper/logger.h"
+#include "helper/metrics.h"
+#include "helper/random.h"
+#include "helper/trace.h"
+#include "raop/constants.h"
+#include "raop/timer_wheel.h"
+
+namespace AirBeamCore {
+namespace raop {
+
+using namespace helper;
+
+namespace {
+enum TimerKind : uint32_t {
+  kTimerAudio = 0,
+  kTimerKeepAlive = 1,
+};
+
+// The sockets each session contributes to a worker's poll set.
+enum class PollKind : uint8_t {
+  kTiming,
+  kControl,
+  kRtsp,
+};
+
+uint64_t NowNs() { return NtpTime::Now().IntoNanoseconds(); }
+
+// Wall time, on the NtpTime::Now clock, at which the given RTP timestamp is
+// due.
+uint64_t TimestampToNs(uint64_t ts, uint64_t sample_rate) {
+  return ts / sample_rate * 1'000'000'000 +
+         ts % sample_rate * 1'000'000'000 / sample_rate;
+}
+
+// When the packet after the session's head is due.
+uint64_t NextPacketNs(const Raop& raop) {
+  const auto& format = raop.GetStreamFormat();
+  return TimestampToNs(
+      raop.GetTimeline().head_ts + format.frames_per_packet,
+      format.sample_rate);
+}
+}  // namespace
+
+class SessionManager::Worker {
+ public:
+  // on_failure is called on the worker thread for every session it drops
+  // after an error.
+  Worker(const Options& options, std::function<void(SessionId)> on_failure)
+      : options_(options),
+        on_failure_(std::move(on_failure)),
+        tick_ns_(std::chrono::nanoseconds(options.tick).count()),
+        wheel_(options.wheel_slots, NowNs() / tick_ns_) {
+    if (pipe(wake_fds_) == 0) {
+      fcntl(wake_fds_[0], F_SETFL, O_NONBLOCK);
+      fcntl(wake_fds_[1], F_SETFL, O_NONBLOCK);
+    }
+    thread_ = std::thread([this]() { Loop(); });
+  }
+
+  ~Worker() {
+    stopped_ = true;
+    Wake();
+    thread_.join();
+    close(wake_fds_[0]);
+    close(wake_fds_[1]);
+  }
+
+  void Add(SessionId id, std::shared_ptr<Raop> raop, ChunkSource source) {
+    std::lock_guard guard(mtx_);
+    load_++;
+    pending_.push_back({id, std::move(raop), std::move(source)});
+    Wake();
+  }
+
+  void Remove(SessionId id) {
+    std::lock_guard guard(mtx_);
+    load_--;
+    pending_.push_back({id, nullptr, nullptr});
+    Wake();
+  }
+
+  size_t Load() {
+    std::lock_guard guard(mtx_);
+    return load_;
+  }
+
+  void CollectStats(Stats& stats, HistogramSnapshot& pacing_error) {
+    stats.worker_sessions.push_back(Load());
+    stats.packets += packets_.load(std::memory_order_relaxed);
+    stats.keepalives += keepalives_.load(std::memory_order_relaxed);
+    stats.failures += failures_.load(std::memory_order_relaxed);
+    auto snapshot = pacing_error_.Snapshot();
+    pacing_error.count += snapshot.count;
+    pacing_error.max = std::max(pacing_error.max, snapshot.max);
+    pacing_error.buckets.resize(snapshot.buckets.size());
+    for (size_t i = 0; i < snapshot.buckets.size(); ++i) {
+      pacing_error.buckets[i] += snapshot.buckets[i];
+    }
+  }
+
+ private:
+  // Hot per-session state; the Raop itself is only touched when a timer
+  // fires or one of its sockets is readable.
+  struct Session {
+    SessionId id = 0;
+    std::shared_ptr<Raop> raop;
+    ChunkSource source;
+    uint64_t due_ns = 0;
+    uint32_t generation = 0;
+    bool active = false;
+  };
+
+  struct Command {
+    SessionId id;
+    // Null for a removal.
+    std::shared_ptr<Raop> raop;
+    ChunkSource source;
+  };
+
+  void Wake() {
+    char byte = 0;
+    (void)!write(wake_fds_[1], &byte, 1);
+  }
+
+  void Loop() {
+    std::vector<TimerWheel::Timer> expired;
+    while (!stopped_) {
+      DrainCommands();
+      if (poll_dirty_) RebuildPollSet();
+
+      int ready = poll(poll_fds_.data(), poll_fds_.size(), PollTimeoutMs());
+      if (ready > 0) HandleReadable();
+
+      wheel_.Advance(NowNs() / tick_ns_, expired);
+      for (const auto& timer : expired) Fire(timer);
+      expired.clear();
+    }
+  }
+
+  // Until the next timer is due, rounded up to poll's milliseconds; -1 to
+  // sleep until a socket or Wake when there is no timer.
+  int PollTimeoutMs() const {
+    uint64_t deadline = wheel_.NextDeadline();
+    if (deadline == UINT64_MAX) return -1;
+    uint64_t deadline_ns = deadline * tick_ns_;
+    uint64_t now_ns = NowNs();
+    if (deadline_ns <= now_ns) return 0;
+    uint64_t wait_ms = (deadline_ns - now_ns + 999'999) / 1'000'000;
+    return static_cast<int>(std::min<uint64_t>(wait_ms, INT32_MAX));
+  }
+
+  void DrainCommands() {
+    std::vector<Command> commands;
+    {
+      std::lock_guard guard(mtx_);
+      commands.swap(pending_);
+    }
+    for (auto& command : commands) {
+      if (command.raop) {
+        Insert(command);
+      } else {
+        auto it = index_.find(command.id);
+        if (it != index_.end()) Drop(it->second);
+      }
+    }
+  }
+
+  void Insert(Command& command) {
+    uint32_t index;
+    if (free_.empty()) {
+      index = static_cast<uint32_t>(sessions_.size());
+      sessions_.emplace_back();
+    } else {
+      index = free_.back();
+      free_.pop_back();
+    }
+    Session& session = sessions_[index];
+    session.id = command.id;
+    session.raop = std::move(command.raop);
+    session.source = std::move(command.source);
+    session.active = true;
+    index_[session.id] = index;
+
+    session.due_ns = NextPacketNs(*session.raop);
+    Schedule(index, kTimerAudio, session.due_ns);
+
+    // Spread keepalives over the interval instead of sending them in bursts.
+    uint64_t interval_ns =
+        std::chrono::nanoseconds(options_.keepalive_interval).count();
+    uint64_t offset = RandomGenerator::GetInstance().GenU64() % interval_ns;
+    Schedule(index, kTimerKeepAlive, NowNs() + interval_ns / 2 + offset / 2);
+    poll_dirty_ = true;
+  }
+
+  void Drop(uint32_t index) {
+    Session& session = sessions_[index];
+    index_.erase(session.id);
+    session.raop.reset();
+    session.source = nullptr;
+    session.active = false;
+    session.generation++;
+    free_.push_back(index);
+    poll_dirty_ = true;
+  }
+
+  void Schedule(uint32_t index, TimerKind kind, uint64_t deadline_ns) {
+    uint32_t tag = (sessions_[index].generation << 1) | kind;
+    wheel_.Schedule({deadline_ns / tick_ns_, index, tag});
+  }
+
+  void RebuildPollSet() {
+    poll_fds_.clear();
+    poll_owners_.clear();
+    poll_fds_.push_back({wake_fds_[0], POLLIN, 0});
+    poll_owners_.push_back({0, PollKind::kTiming});
+    for (uint32_t i = 0; i < sessions_.size(); ++i) {
+      if (!sessions_[i].active) continue;
+      const Raop& raop = *sessions_[i].raop;
+      poll_fds_.push_back({raop.GetTimingFd(), POLLIN, 0});
+      poll_owners_.push_back({i, PollKind::kTiming});
+      poll_fds_.push_back({raop.GetControlFd(), POLLIN, 0});
+      poll_owners_.push_back({i, PollKind::kControl});
+      poll_fds_.push_back({raop.GetRtspFd(), POLLIN, 0});
+      poll_owners_.push_back({i, PollKind::kRtsp});
+    }
+    poll_dirty_ = false;
+  }
+
+  void HandleReadable() {
+    if (poll_fds_[0].revents & POLLIN) {
+      char buffer[64];
+      while (read(wake_fds_[0], buffer, sizeof(buffer)) > 0) {
+      }
+    }
+    for (size_t i = 1; i < poll_fds_.size(); ++i) {
+      if (!(poll_fds_[i].revents & (POLLIN | POLLERR | POLLHUP))) continue;
+      const PollOwner& owner = poll_owners_[i];
+      Session& session = sessions_[owner.index];
+      if (!session.active) continue;
+      ErrCode ret = kOk;
+      switch (owner.kind) {
+        case PollKind::kTiming:
+          ret = session.raop->HandleTiming();
+          break;
+        case PollKind::kControl:
+          ret = session.raop->HandleControl();
+          break;
+        case PollKind::kRtsp:
+          ret = session.raop->HandleRtsp();
+          break;
+      }
+      if (ret != kOk) Fail(owner.index);
+    }
+  }
+
+  void Fire(const TimerWheel::Timer& timer) {
+    if (timer.id >= sessions_.size()) return;
+    Session& session = sessions_[timer.id];
+    if (!session.active || (timer.tag >> 1) != session.generation) return;
+
+    if ((timer.tag & 1) == kTimerKeepAlive) {
+      // The reply comes in through the poll set. One still unanswered from
+      // the previous interval fails the session.
+      if (session.raop->BeginKeepAlive() != kOk) {
+        Fail(timer.id);
+        return;
+      }
+      keepalives_.fetch_add(1, std::memory_order_relaxed);
+      Schedule(timer.id, kTimerKeepAlive,
+               NowNs() + std::chrono::nanoseconds(
+                             options_.keepalive_interval).count());
+      return;
+    }
+
+    auto before = session.raop->GetTimeline();
+    uint64_t head_ts = before.head_ts;
+    chunk_.len_ = 0;
+    {
+      ABTraceScope("source", before.next_seq);
+      session.source(chunk_);
+    }
+    if (session.raop->SendChunk(chunk_) != kOk) {
+      Fail(timer.id);
+      return;
+    }
+    uint64_t now_ns = NowNs();
+    auto timeline = session.raop->GetTimeline();
+    if (timeline.head_ts != head_ts) {
+      packets_.fetch_add(1, std::memory_order_relaxed);
+      uint64_t error_ns = now_ns > session.due_ns ? now_ns - session.due_ns
+                                                  : session.due_ns - now_ns;
+      pacing_error_.Record(error_ns);
+      session.raop->RecordPacingError(error_ns);
+    }
+    session.due_ns = NextPacketNs(*session.raop);
+    Schedule(timer.id, kTimerAudio, session.due_ns);
+  }
+
+  void Fail(uint32_t index) {
+    ABWarningLog("SessionManager dropping session %s",
+                 sessions_[index].raop->GetRtspIpAddr().c_str());
+    failures_.fetch_add(1, std::memory_order_relaxed);
+    SessionId id = sessions_[index].id;
+    Drop(index);
+    on_failure_(id);
+  }
+
+  struct PollOwner {
+    uint32_t index;
+    PollKind kind;
+  };
+
+  const Options options_;
+  const std::function<void(SessionId)> on_failure_;
+  const uint64_t tick_ns_;
+  TimerWheel wheel_;
+  int wake_fds_[2] = {-1, -1};
+  std::atomic<bool> stopped_ = false;
+  std::thread thread_;
+
+  std::mutex mtx_;
+  std::vector<Command> pending_;
+  size_t load_ = 0;
+
+  // Owned by the worker thread.
+  std::vector<Session> sessions_;
+  std::vector<uint32_t> free_;
+  std::unordered_map<SessionId, uint32_t> index_;
+  std::vector<pollfd> poll_fds_;
+  std::vector<PollOwner> poll_owners_;
+  bool poll_dirty_ = true;
+  RtpAudioPacketChunk chunk_;
+
+  std::atomic<uint64_t> packets_ = 0;
+  std::atomic<uint64_t> keepalives_ = 0;
+  std::atomic<uint64_t> failures_ = 0;
+  Histogram pacing_error_;
+};
+
+SessionManager::SessionManager() : SessionManager(Options()) {}
+
+SessionManager::SessionManager(const Options& options) : options_(options) {
+  size_t workers = std::max<size_t>(options_.workers, 1);
+  for (size_t i = 0; i < workers; ++i) {
+    // A failed session leaves the manager the way Remove takes it out.
+    workers_.push_back(std::make_unique<Worker>(
+        options_, [this](SessionId id) { Remove(id); }));
+  }
+  if (options_.registry != nullptr) {
+    collector_id_ = options_.registry->Register(
+        [this](MetricsWriter& writer) { WriteMetrics(writer); });
+  }
+}
+
+SessionManager::~SessionManager() {
+  if (options_.registry != nullptr) {
+    options_.registry->Unregister(collector_id_);
+  }
+  // Before mtx_ and owners_ go, since a worker may still report a failure.
+  workers_.clear();
+}
+
+ErrCode SessionManager::Add(std::shared_ptr<Raop> raop, ChunkSource source,
+                            SessionId& id) {
+  raop->SetManaged(true);
+  ErrCode ret = raop->StartSession();
+  if (ret != kOk) return ret;
+  ret = raop->BeginStream(NtpTime::Now());
+  if (ret != kOk) {
+    raop->Stop();
+    return ret;
+  }
+
+  std::lock_guard guard(mtx_);
+  Worker* worker = workers_.front().get();
+  for (const auto& candidate : workers_) {
+    if (candidate->Load() < worker->Load()) worker = candidate.get();
+  }
+  id = next_id_++;
+  owners_[id] = {worker, raop};
+  worker->Add(id, std::move(raop), std::move(source));
+  return kOk;
+}
+
+void SessionManager::Remove(SessionId id) {
+  std::lock_guard guard(mtx_);
+  auto it = owners_.find(id);
+  if (it == owners_.end()) return;
+  it->second.worker->Remove(id);
+  owners_.erase(it);
+}
+
+size_t SessionManager::Size() {
+  std::lock_guard guard(mtx_);
+  return owners_.size();
+}
+
+SessionManager::Stats SessionManager::GetStats() {
+  Stats stats;
+  HistogramSnapshot pacing_error;
+  stats.sessions = Size();
+  for (const auto& worker : workers_) {
+    worker->CollectStats(stats, pacing_error);
+  }
+  stats.pacing_error_p50_us = pacing_error.Percentile(0.5) / 1000;
+  stats.pacing_error_p99_us = pacing_error.Percentile(0.99) / 1000;
+  stats.pacing_error_max_us = pacing_error.max / 1000;
+  return stats;
+}
+
+void SessionManager::WriteMetrics(MetricsWriter& writer) {
+  auto stats = GetStats();
+  writer.Gauge("airbeam_session_manager_sessions", "Sessions added.", {},
+               stats.sessions);
+  writer.Counter("airbeam_session_manager_packets_total",
+                 "Audio packets sent by the workers.", {}, stats.packets);
+  writer.Counter("airbeam_session_manager_keepalives_total",
+                 "Keepalives sent by the workers.", {}, stats.keepalives);
+  writer.Counter("airbeam_session_manager_failures_total",
+                 "Sessions dropped after an error.", {}, stats.failures);
+  std::lock_guard guard(mtx_);
+  for (const auto& [id, owner] : owners_) owner.raop->WriteMetrics(writer);
+}
+
+}  // namespace raop
+}  // namespace AirBeamCore
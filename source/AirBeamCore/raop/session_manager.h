@@ -0,0 +1,88 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "helper/errcode.h"
+#include "helper/metrics_registry.h"
+#include "raop/raop.h"
+#include "raop/rtp.h"
+
+namespace AirBeamCore {
+namespace raop {
+
+// Runs many Raop sessions on a small fixed pool of worker threads. Sessions
+// are put in managed mode, so they spawn no threads of their own; each
+// worker multiplexes the timing, control and RTSP sockets of its sessions
+// with poll() and drives packet deadlines and keepalives from a TimerWheel.
+class SessionManager {
+ public:
+  using SessionId = uint64_t;
+  // Fills the next chunk of a session on its worker thread. Leaving len_ at 0
+  // reports an underrun, handled by the session's UnderrunPolicy.
+  using ChunkSource = std::function<void(RtpAudioPacketChunk& chunk)>;
+
+  struct Options {
+    size_t workers = 2;
+    std::chrono::microseconds tick = std::chrono::milliseconds(1);
+    size_t wheel_slots = 1024;
+    std::chrono::milliseconds keepalive_interval = std::chrono::seconds(5);
+    // When set, the manager and its sessions are exported to it.
+    helper::MetricsRegistry* registry = nullptr;
+  };
+
+  struct Stats {
+    uint64_t sessions = 0;
+    uint64_t packets = 0;
+    uint64_t keepalives = 0;
+    // Sessions dropped after a socket or RTSP error, or a keepalive left
+    // unanswered for a whole interval. They leave the manager as if removed.
+    uint64_t failures = 0;
+    // Sessions on each worker.
+    std::vector<uint64_t> worker_sessions;
+    // Distance between when a packet was due and when it was sent.
+    uint64_t pacing_error_p50_us = 0;
+    uint64_t pacing_error_p99_us = 0;
+    uint64_t pacing_error_max_us = 0;
+  };
+
+  SessionManager();
+  explicit SessionManager(const Options& options);
+  ~SessionManager();
+
+  // Runs the RTSP handshake on the calling thread, then hands the session to
+  // the least loaded worker, which starts pulling chunks from source. A
+  // receiver that refuses the handshake fails only its own Add.
+  helper::ErrCode Add(std::shared_ptr<Raop> raop, ChunkSource source,
+                      SessionId& id);
+  // The worker closes the session asynchronously.
+  void Remove(SessionId id);
+  size_t Size();
+  Stats GetStats();
+
+ private:
+  class Worker;
+  struct Owner {
+    Worker* worker;
+    std::shared_ptr<Raop> raop;
+  };
+
+  void WriteMetrics(helper::MetricsWriter& writer);
+
+  const Options options_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::mutex mtx_;
+  SessionId next_id_ = 1;
+  std::unordered_map<SessionId, Owner> owners_;
+  helper::MetricsRegistry::CollectorId collector_id_ = 0;
+};
+
+}  // namespace raop
+}  // namespace AirBeamCore
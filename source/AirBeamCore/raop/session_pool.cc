@@ -0,0 +1,227 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "session_pool.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "fmt/core.h"
+#include "helper/errcode.h"
+#include "helper/logger.h"
+
+namespace AirBeamCore {
+namespace raop {
+
+RaopSessionPool::RaopSessionPool() : RaopSessionPool(Options()) {}
+
+RaopSessionPool::RaopSessionPool(const Options& options) : options_(options) {
+  LoadRecent();
+  if (options_.background_maintenance) {
+    reaper_thread_ = std::thread(&RaopSessionPool::ReaperLoop, this);
+  }
+}
+
+RaopSessionPool::~RaopSessionPool() {
+  {
+    std::lock_guard<std::mutex> guard(mtx_);
+    stopped_ = true;
+  }
+  reaper_cv_.notify_all();
+  if (reaper_thread_.joinable()) reaper_thread_.join();
+}
+
+std::string RaopSessionPool::MakeKey(const std::string& ip, uint32_t port) {
+  return fmt::format("{}:{}", ip, port);
+}
+
+bool RaopSessionPool::Warm(const std::string& ip, uint32_t port) {
+  std::string key = MakeKey(ip, port);
+  {
+    std::lock_guard<std::mutex> guard(mtx_);
+    for (const auto& entry : entries_) {
+      if (entry.key == key) return true;
+    }
+  }
+
+  auto raop = std::make_shared<Raop>(ip, port);
+  if (raop->Connect() != helper::kOk) {
+    ABWarningLog("RaopSessionPool::Warm failed %s", key.c_str());
+    std::lock_guard<std::mutex> guard(mtx_);
+    metrics_.warm_failures++;
+    return false;
+  }
+
+  std::lock_guard<std::mutex> guard(mtx_);
+  for (const auto& entry : entries_) {
+    // Lost the race against a concurrent Warm, keep the existing one.
+    if (entry.key == key) return true;
+  }
+  auto now = Clock::now();
+  entries_.push_front({key, raop, now, now});
+  metrics_.warmed++;
+  EvictOverCapLocked();
+  return true;
+}
+
+void RaopSessionPool::WarmAsync(const std::string& ip, uint32_t port) {
+  {
+    std::lock_guard<std::mutex> guard(mtx_);
+    warm_queue_.emplace_back(ip, port);
+  }
+  reaper_cv_.notify_all();
+}
+
+std::shared_ptr<Raop> RaopSessionPool::Acquire(const std::string& ip,
+                                               uint32_t port) {
+  std::string key = MakeKey(ip, port);
+  std::lock_guard<std::mutex> guard(mtx_);
+  recent_[key] = WallClock::now();
+  SaveRecentLocked();
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it->key == key) {
+      auto raop = it->raop;
+      entries_.erase(it);
+      metrics_.hits++;
+      return raop;
+    }
+  }
+  metrics_.misses++;
+  return std::make_shared<Raop>(ip, port);
+}
+
+bool RaopSessionPool::IsRecentlyUsed(const std::string& ip, uint32_t port) {
+  std::lock_guard<std::mutex> guard(mtx_);
+  auto it = recent_.find(MakeKey(ip, port));
+  if (it == recent_.end()) return false;
+  return WallClock::now() - it->second < options_.recent_ttl;
+}
+
+size_t RaopSessionPool::Size() {
+  std::lock_guard<std::mutex> guard(mtx_);
+  return entries_.size();
+}
+
+RaopSessionPool::Metrics RaopSessionPool::GetMetrics() {
+  std::lock_guard<std::mutex> guard(mtx_);
+  return metrics_;
+}
+
+void RaopSessionPool::Maintain() {
+  std::vector<std::pair<std::string, uint32_t>> to_warm;
+  {
+    std::lock_guard<std::mutex> guard(mtx_);
+    to_warm.swap(warm_queue_);
+  }
+  for (const auto& [ip, port] : to_warm) Warm(ip, port);
+
+  std::vector<Entry> to_validate;
+  auto now = Clock::now();
+  {
+    std::lock_guard<std::mutex> guard(mtx_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      if (now - it->warmed_at >= options_.idle_timeout) {
+        ABDebugLog("RaopSessionPool evict idle %s", it->key.c_str());
+        metrics_.evicted_idle++;
+        it = entries_.erase(it);
+      } else if (now - it->validated_at >= options_.keepalive_interval) {
+        to_validate.push_back(std::move(*it));
+        it = entries_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    auto wall_now = WallClock::now();
+    size_t recent = recent_.size();
+    for (auto it = recent_.begin(); it != recent_.end();) {
+      it = wall_now - it->second >= options_.recent_ttl ? recent_.erase(it)
+                                                        : std::next(it);
+    }
+    if (recent_.size() != recent) SaveRecentLocked();
+  }
+
+  // OPTIONS blocks on the network, so it runs outside the lock. Sessions under
+  // validation are invisible to Acquire, which simply takes the cold path.
+  for (auto& entry : to_validate) {
+    bool alive = entry.raop->Options() == helper::kOk;
+    std::lock_guard<std::mutex> guard(mtx_);
+    if (!alive) {
+      ABDebugLog("RaopSessionPool evict dead %s", entry.key.c_str());
+      metrics_.evicted_dead++;
+      continue;
+    }
+    entry.validated_at = Clock::now();
+    entries_.push_back(std::move(entry));
+    EvictOverCapLocked();
+  }
+}
+
+void RaopSessionPool::EvictOverCapLocked() {
+  while (entries_.size() > options_.max_sessions) {
+    ABDebugLog("RaopSessionPool evict cap %s", entries_.back().key.c_str());
+    entries_.pop_back();
+    metrics_.evicted_cap++;
+  }
+}
+
+void RaopSessionPool::ReaperLoop() {
+  auto period = std::min(options_.keepalive_interval, options_.idle_timeout);
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (!stopped_) {
+    reaper_cv_.wait_for(lock, period,
+                        [this]() { return stopped_ || !warm_queue_.empty(); });
+    if (stopped_) break;
+    lock.unlock();
+    Maintain();
+    lock.lock();
+  }
+}
+
+// One receiver per line: ip:port, a tab, and the last Acquire in seconds
+// since the epoch.
+void RaopSessionPool::LoadRecent() {
+  if (options_.recent_path.empty()) return;
+  std::ifstream in(options_.recent_path);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::vector<std::string> fields = absl::StrSplit(line, '\t');
+    int64_t seconds;
+    if (fields.size() != 2 || !absl::SimpleAtoi(fields[1], &seconds)) {
+      continue;
+    }
+    recent_[fields[0]] = WallClock::time_point(std::chrono::seconds(seconds));
+  }
+}
+
+void RaopSessionPool::SaveRecentLocked() {
+  if (options_.recent_path.empty()) return;
+  const std::string& path = options_.recent_path;
+  for (size_t slash = path.find('/', 1); slash != std::string::npos;
+       slash = path.find('/', slash + 1)) {
+    mkdir(path.substr(0, slash).c_str(), 0755);
+  }
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    for (const auto& [key, used_at] : recent_) {
+      out << key << '\t'
+          << std::chrono::duration_cast<std::chrono::seconds>(
+                 used_at.time_since_epoch())
+                 .count()
+          << '\n';
+    }
+    if (!out) {
+      ABDebugLog("RaopSessionPool cannot write %s", tmp.c_str());
+      return;
+    }
+  }
+  std::rename(tmp.c_str(), path.c_str());
+}
+
+}  // namespace raop
+}  // namespace AirBeamCore
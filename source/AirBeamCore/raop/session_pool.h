@@ -0,0 +1,106 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "raop/raop.h"
+
+namespace AirBeamCore {
+namespace raop {
+
+// Keeps RTSP connections to recently used receivers open, OPTIONS-validated
+// and with their UDP ports bound, so that switching output to one of them
+// only costs ANNOUNCE/SETUP/RECORD.
+class RaopSessionPool {
+ public:
+  struct Options {
+    size_t max_sessions = 4;
+    std::chrono::milliseconds idle_timeout = std::chrono::seconds(60);
+    std::chrono::milliseconds keepalive_interval = std::chrono::seconds(5);
+    // How long a receiver counts as "recently used" after its last Acquire.
+    std::chrono::milliseconds recent_ttl = std::chrono::minutes(30);
+    // Where recently used receivers are kept across restarts; empty keeps
+    // them in memory only.
+    std::string recent_path;
+    // Run Maintain() from a background reaper thread.
+    bool background_maintenance = true;
+  };
+
+  struct Metrics {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t warmed = 0;
+    uint64_t warm_failures = 0;
+    uint64_t evicted_idle = 0;
+    uint64_t evicted_cap = 0;
+    uint64_t evicted_dead = 0;
+  };
+
+  RaopSessionPool();
+  explicit RaopSessionPool(const Options& options);
+  ~RaopSessionPool();
+
+  // Opens a warm session to the receiver unless one is already pooled. Blocks
+  // on the RTSP connect and OPTIONS round trip.
+  bool Warm(const std::string& ip, uint32_t port);
+  // Warm without blocking: the reaper thread does it, or without
+  // background_maintenance, the next Maintain().
+  void WarmAsync(const std::string& ip, uint32_t port);
+
+  // Hands out the pooled session for the receiver, or a new cold one when the
+  // pool has none. Either way the receiver is remembered as recently used.
+  std::shared_ptr<Raop> Acquire(const std::string& ip, uint32_t port);
+
+  bool IsRecentlyUsed(const std::string& ip, uint32_t port);
+  size_t Size();
+  Metrics GetMetrics();
+
+  // Runs queued warms, drops sessions idle for longer than idle_timeout and
+  // re-validates the rest with OPTIONS. Also run periodically by the reaper
+  // thread.
+  void Maintain();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+  using WallClock = std::chrono::system_clock;
+
+  struct Entry {
+    std::string key;
+    std::shared_ptr<Raop> raop;
+    Clock::time_point warmed_at;
+    Clock::time_point validated_at;
+  };
+
+  static std::string MakeKey(const std::string& ip, uint32_t port);
+  void EvictOverCapLocked();
+  void ReaperLoop();
+  void LoadRecent();
+  void SaveRecentLocked();
+
+  const Options options_;
+  std::mutex mtx_;
+  // Most recently warmed first.
+  std::list<Entry> entries_;
+  // Wall clock, as it is persisted.
+  std::map<std::string, WallClock::time_point> recent_;
+  std::vector<std::pair<std::string, uint32_t>> warm_queue_;
+  Metrics metrics_;
+
+  bool stopped_ = false;
+  std::condition_variable reaper_cv_;
+  std::thread reaper_thread_;
+};
+
+}  // namespace raop
+}  // namespace AirBeamCore
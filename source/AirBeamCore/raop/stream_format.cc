@@ -0,0 +1,64 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "stream_format.h"
+
+#include "fmt/core.h"
+#include "helper/logger.h"
+#include "raop/packetizer.h"
+
+namespace AirBeamCore {
+namespace raop {
+namespace {
+using discovery::RaopCapabilities;
+using discovery::RaopCodec;
+using discovery::RaopEncryption;
+
+bool Plays(const RaopCapabilities& capabilities, const StreamFormat& format) {
+  // RAOP receivers advertise a single rate, size and channel count.
+  return capabilities.Supports(format.codec) &&
+         capabilities.sample_rate == format.sample_rate &&
+         capabilities.sample_size == format.sample_size &&
+         capabilities.channels == format.channels;
+}
+}  // namespace
+
+std::string StreamFormat::Rtpmap() const {
+  switch (codec) {
+    case RaopCodec::kPcm:
+      return fmt::format("L{}/{}/{}", sample_size, sample_rate, channels);
+    case RaopCodec::kAlac:
+      return "AppleLossless";
+    case RaopCodec::kAac:
+    case RaopCodec::kAacEld:
+      return fmt::format("mpeg4-generic/{}/{}", sample_rate, channels);
+  }
+  return "";
+}
+
+helper::ErrCode NegotiateStreamFormat(const RaopCapabilities& capabilities,
+                                      StreamFormat& format) {
+  if (!capabilities.Supports(RaopEncryption::kNone)) {
+    ABWarningLog("receiver %s requires encryption, et=0x%x",
+                 capabilities.model.c_str(), capabilities.encryptions);
+    return helper::kErrRaopUnsupportedFormat;
+  }
+  if (!capabilities.udp) {
+    ABWarningLog("receiver %s does not take RTP over UDP",
+                 capabilities.model.c_str());
+    return helper::kErrRaopUnsupportedFormat;
+  }
+  // Only uncompressed PCM so far; an ALAC encoder would come first.
+  for (const auto& packetizer : Packetizers()) {
+    if (Plays(capabilities, packetizer.format)) {
+      format = packetizer.format;
+      return helper::kOk;
+    }
+  }
+  ABWarningLog("receiver %s plays no format we send, cn=0x%x %u/%u/%u",
+               capabilities.model.c_str(), capabilities.codecs,
+               capabilities.sample_rate, capabilities.sample_size,
+               capabilities.channels);
+  return helper::kErrRaopUnsupportedFormat;
+}
+}  // namespace raop
+}  // namespace AirBeamCore
@@ -0,0 +1,48 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "discovery/raop_capabilities.h"
+#include "helper/errcode.h"
+#include "raop/constants.h"
+
+namespace AirBeamCore {
+namespace raop {
+// What a session streams, as announced in the SDP.
+struct StreamFormat {
+  discovery::RaopCodec codec = discovery::RaopCodec::kPcm;
+  uint32_t sample_rate = kSampleRate44100;
+  uint32_t sample_size = 16;
+  uint32_t channels = 2;
+  uint32_t frames_per_packet = kPCMChunkLength;
+
+  uint32_t BytesPerFrame() const { return sample_size / 8 * channels; }
+  // RTP payload bytes of one full packet.
+  uint32_t PacketBytes() const { return BytesPerFrame() * frames_per_packet; }
+  // Play time of one packet.
+  std::chrono::microseconds PacketDuration() const {
+    return std::chrono::microseconds(uint64_t{frames_per_packet} *
+                                     1'000'000 / sample_rate);
+  }
+  // The rtpmap attribute's encoding, e.g. "L16/44100/2".
+  std::string Rtpmap() const;
+
+  bool operator==(const StreamFormat& other) const {
+    return codec == other.codec && sample_rate == other.sample_rate &&
+           sample_size == other.sample_size && channels == other.channels &&
+           frames_per_packet == other.frames_per_packet;
+  }
+};
+
+// Picks the cheapest format on the wire that both the packetizer table and
+// the receiver can do. Fails with kErrRaopUnsupportedFormat, leaving format
+// alone, when there is none or the receiver wants encryption or a
+// transport this sender lacks.
+helper::ErrCode NegotiateStreamFormat(
+    const discovery::RaopCapabilities& capabilities, StreamFormat& format);
+}  // namespace raop
+}  // namespace AirBeamCore
@@ -0,0 +1,71 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "timeline.h"
+
+namespace AirBeamCore {
+namespace raop {
+
+RtpTimeline::RtpTimeline(uint16_t initial_seq)
+    : next_seq_(initial_seq), current_{initial_seq, 0, 0, {0, 0}} {}
+
+void RtpTimeline::Reset(uint64_t anchor_ts, NtpTime anchor_ntp) {
+  current_.head_ts = anchor_ts;
+  current_.anchor_ts = anchor_ts;
+  current_.anchor_ntp = anchor_ntp;
+  Publish(current_);
+}
+
+void RtpTimeline::Advance(uint64_t frames) {
+  current_.next_seq += 1;
+  current_.head_ts += frames;
+  Publish(current_);
+}
+
+void RtpTimeline::Publish(const TimelineSnapshot& snapshot) {
+  uint32_t version = version_.load(std::memory_order_relaxed);
+  version_.store(version + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  next_seq_.store(snapshot.next_seq, std::memory_order_relaxed);
+  head_ts_.store(snapshot.head_ts, std::memory_order_relaxed);
+  anchor_ts_.store(snapshot.anchor_ts, std::memory_order_relaxed);
+  anchor_ntp_.store((static_cast<uint64_t>(snapshot.anchor_ntp.seconds) << 32) |
+                        snapshot.anchor_ntp.fraction,
+                    std::memory_order_relaxed);
+
+  version_.store(version + 2, std::memory_order_release);
+}
+
+TimelineSnapshot RtpTimeline::Load() const {
+  TimelineSnapshot snapshot;
+  uint32_t before, after;
+  do {
+    before = version_.load(std::memory_order_acquire);
+    snapshot.next_seq =
+        static_cast<uint16_t>(next_seq_.load(std::memory_order_relaxed));
+    snapshot.head_ts = head_ts_.load(std::memory_order_relaxed);
+    snapshot.anchor_ts = anchor_ts_.load(std::memory_order_relaxed);
+    uint64_t ntp = anchor_ntp_.load(std::memory_order_relaxed);
+    snapshot.anchor_ntp = {static_cast<uint32_t>(ntp >> 32),
+                           static_cast<uint32_t>(ntp)};
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = version_.load(std::memory_order_relaxed);
+  } while ((before & 1) || before != after);
+  return snapshot;
+}
+
+uint64_t RtpTimeline::TimestampAt(const TimelineSnapshot& snapshot,
+                                  NtpTime ntp, uint64_t sample_rate) {
+  auto to_u64 = [](NtpTime t) {
+    return (static_cast<uint64_t>(t.seconds) << 32) | t.fraction;
+  };
+  uint64_t now = to_u64(ntp);
+  uint64_t anchor = to_u64(snapshot.anchor_ntp);
+  if (now >= anchor) {
+    return snapshot.anchor_ts + (((now - anchor) >> 16) * sample_rate >> 16);
+  }
+  return snapshot.anchor_ts - (((anchor - now) >> 16) * sample_rate >> 16);
+}
+
+}  // namespace raop
+}  // namespace AirBeamCore
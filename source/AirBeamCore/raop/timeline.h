@@ -0,0 +1,54 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "raop/rtp.h"
+
+namespace AirBeamCore {
+namespace raop {
+
+struct TimelineSnapshot {
+  // RTP sequence number and timestamp of the next audio packet.
+  uint16_t next_seq;
+  uint64_t head_ts;
+  // RTP timestamp of the first packet and the NTP time it was anchored to.
+  uint64_t anchor_ts;
+  NtpTime anchor_ntp;
+};
+
+// RTP seq/timestamp state of one stream. The audio sender is the only writer;
+// the sync, retransmit and stats threads read consistent snapshots without
+// taking a lock (seqlock over atomic fields).
+class RtpTimeline {
+ public:
+  explicit RtpTimeline(uint16_t initial_seq);
+
+  // Writer side.
+  void Reset(uint64_t anchor_ts, NtpTime anchor_ntp);
+  void Advance(uint64_t frames);
+
+  // Reader side, callable from any thread.
+  TimelineSnapshot Load() const;
+
+  // RTP timestamp that corresponds to the given NTP time on this timeline.
+  static uint64_t TimestampAt(const TimelineSnapshot& snapshot, NtpTime ntp,
+                              uint64_t sample_rate);
+
+ private:
+  void Publish(const TimelineSnapshot& snapshot);
+
+  std::atomic<uint32_t> version_{0};
+  std::atomic<uint32_t> next_seq_;
+  std::atomic<uint64_t> head_ts_{0};
+  std::atomic<uint64_t> anchor_ts_{0};
+  std::atomic<uint64_t> anchor_ntp_{0};
+
+  // Writer-private copy, so Advance never has to read the shared fields.
+  TimelineSnapshot current_;
+};
+
+}  // namespace raop
+}  // namespace AirBeamCore
@@ -0,0 +1,73 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "timer_wheel.h"
+
+#include <algorithm>
+
+namespace AirBeamCore {
+namespace raop {
+
+TimerWheel::TimerWheel(size_t slots, uint64_t now_tick)
+    : current_tick_(now_tick) {
+  size_t size = 1;
+  while (size < slots) size <<= 1;
+  slots_.resize(size);
+  mask_ = size - 1;
+}
+
+void TimerWheel::Schedule(const Timer& timer) {
+  uint64_t tick =
+      timer.deadline < current_tick_ ? current_tick_ : timer.deadline;
+  slots_[tick & mask_].push_back(timer);
+  size_++;
+}
+
+void TimerWheel::Advance(uint64_t now_tick, std::vector<Timer>& expired) {
+  if (now_tick < current_tick_) return;
+  if (now_tick - current_tick_ >= slots_.size()) {
+    // Fell behind by more than a revolution: every slot is due.
+    for (size_t slot = 0; slot < slots_.size(); ++slot) {
+      ExpireSlot(slot, now_tick, expired);
+    }
+  } else {
+    for (uint64_t tick = current_tick_; tick <= now_tick; ++tick) {
+      ExpireSlot(tick & mask_, now_tick, expired);
+    }
+  }
+  current_tick_ = now_tick + 1;
+}
+
+uint64_t TimerWheel::NextDeadline() const {
+  if (size_ == 0) return UINT64_MAX;
+  // A timer fires in the first tick of its slot that has reached its
+  // deadline; one scheduled in the past sits in the current slot.
+  for (uint64_t tick = current_tick_; tick < current_tick_ + slots_.size();
+       ++tick) {
+    for (const auto& timer : slots_[tick & mask_]) {
+      if (timer.deadline <= tick) return tick;
+    }
+  }
+  uint64_t next = UINT64_MAX;
+  for (const auto& slot : slots_) {
+    for (const auto& timer : slot) next = std::min(next, timer.deadline);
+  }
+  return next;
+}
+
+void TimerWheel::ExpireSlot(size_t slot, uint64_t now_tick,
+                            std::vector<Timer>& expired) {
+  auto& timers = slots_[slot];
+  for (size_t i = 0; i < timers.size();) {
+    if (timers[i].deadline > now_tick) {
+      ++i;
+      continue;
+    }
+    expired.push_back(timers[i]);
+    timers[i] = timers.back();
+    timers.pop_back();
+    size_--;
+  }
+}
+
+}  // namespace raop
+}  // namespace AirBeamCore
@@ -0,0 +1,47 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace AirBeamCore {
+namespace raop {
+
+// Hashed timing wheel with one slot per tick. Scheduling and expiring are
+// O(1) per timer; a timer further away than one revolution stays in its slot
+// and is skipped until its round comes up. Not thread-safe.
+class TimerWheel {
+ public:
+  struct Timer {
+    // Absolute deadline, in ticks.
+    uint64_t deadline;
+    uint32_t id;
+    uint32_t tag;
+  };
+
+  // slots is rounded up to a power of two.
+  TimerWheel(size_t slots, uint64_t now_tick);
+
+  // A deadline already in the past fires on the next Advance.
+  void Schedule(const Timer& timer);
+  // Moves every timer due at or before now_tick to expired.
+  void Advance(uint64_t now_tick, std::vector<Timer>& expired);
+  // The tick the next Advance has to reach for a timer to fire; UINT64_MAX
+  // when there is none. Looks one revolution ahead, then at every timer.
+  uint64_t NextDeadline() const;
+  size_t Size() const { return size_; }
+
+ private:
+  void ExpireSlot(size_t slot, uint64_t now_tick, std::vector<Timer>& expired);
+
+  std::vector<std::vector<Timer>> slots_;
+  size_t mask_;
+  // The first tick not yet expired.
+  uint64_t current_tick_;
+  size_t size_ = 0;
+};
+
+}  // namespace raop
+}  // namespace AirBeamCore
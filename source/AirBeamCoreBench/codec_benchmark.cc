@@ -0,0 +1,54 @@
+#include <benchmark/benchmark.h>
+
+#include "raop/codec.h"
+#include "raop/packetizer.h"
+#include "raop/rtp.h"
+
+using namespace AirBeamCore::raop;
+
+namespace {
+// Registers the kernels this build has, and only those.
+void SupportedLevels(benchmark::internal::Benchmark* benchmark) {
+  for (auto level : {PCMCodecLevel::kScalar, PCMCodecLevel::kSse2,
+                     PCMCodecLevel::kNeon}) {
+    if (PCMCodec::IsSupported(level)) {
+      benchmark->Arg(static_cast<int>(level));
+    }
+  }
+}
+
+void BM_PCMCodecEncode(benchmark::State& state) {
+  auto level = static_cast<PCMCodecLevel>(state.range(0));
+  state.SetLabel(PCMCodec::LevelName(level));
+
+  RtpAudioPacketChunk input;
+  for (size_t i = 0; i < sizeof(input.data_); ++i) input.data_[i] = i;
+  input.len_ = sizeof(input.data_);
+  RtpAudioPacketChunk output;
+  for (auto _ : state) {
+    PCMCodec::Encode(level, input, output);
+    benchmark::DoNotOptimize(output.data_);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * input.len_);
+}
+BENCHMARK(BM_PCMCodecEncode)->Apply(SupportedLevels);
+
+// One packet through each entry of the runtime table, as a session sends
+// it once negotiated.
+void BM_Packetize(benchmark::State& state) {
+  const auto& packetizer = Packetizers()[state.range(0)];
+  state.SetLabel(packetizer.format.Rtpmap());
+
+  RtpAudioPacketChunk input;
+  for (size_t i = 0; i < sizeof(input.data_); ++i) input.data_[i] = i;
+  RtpAudioPacketChunk output;
+  for (auto _ : state) {
+    packetizer.packetize(input.data_, packetizer.input_bytes, output);
+    benchmark::DoNotOptimize(output.data_);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * packetizer.input_bytes);
+}
+BENCHMARK(BM_Packetize)->DenseRange(0, Packetizers().size() - 1);
+}  // namespace
@@ -0,0 +1,107 @@
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "audio/audio_source.h"
+#include "audio_files.h"
+
+using namespace AirBeamCore;
+using AirBeamCore::audio::PCMFormat;
+
+namespace {
+// Ten seconds of stereo, long enough that the file does not fit in one
+// read buffer.
+constexpr size_t kFrames = 441'000;
+
+std::vector<int16_t> Music() {
+  std::vector<int16_t> samples(kFrames * 2);
+  uint32_t noise = 1;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    noise = noise * 1103515245 + 12345;
+    samples[i] = static_cast<int16_t>(
+        12000 * std::sin(i * 0.0123) + 6000 * std::sin(i * 0.311) +
+        static_cast<int>(noise >> 24) - 128);
+  }
+  return samples;
+}
+
+std::string WriteFile(const std::string& name, const std::string& contents) {
+  std::string path = "/tmp/airbeam_" + name + "_" + std::to_string(getpid());
+  std::ofstream out(path, std::ios::binary);
+  out << contents;
+  return path;
+}
+
+enum class Container { kWav16, kWav24, kAiff, kFlac };
+
+std::string MakeFile(Container container) {
+  auto samples = Music();
+  PCMFormat format;
+  switch (container) {
+    case Container::kWav16:
+      return WriteFile("wav16", AirBeamTesting::MakeWav(
+                                    format, AirBeamTesting::PackPCM(
+                                                samples, format)));
+    case Container::kWav24:
+      format.bits = 24;
+      return WriteFile("wav24", AirBeamTesting::MakeWav(
+                                    format, AirBeamTesting::PackPCM(
+                                                samples, format)));
+    case Container::kAiff:
+      format.big_endian = true;
+      return WriteFile("aiff", AirBeamTesting::MakeAiff(
+                                   format, AirBeamTesting::PackPCM(
+                                               samples, format)));
+    case Container::kFlac: {
+      AirBeamTesting::FlacOptions options;
+      options.subframe = AirBeamTesting::FlacOptions::Subframe::kLpc;
+      options.order = 2;
+      options.stereo = AirBeamTesting::FlacOptions::Stereo::kMidSide;
+      options.partition_order = 4;
+      return WriteFile("flac",
+                       AirBeamTesting::EncodeFlac(
+                           {samples.begin(), samples.end()}, 2, options));
+    }
+  }
+  return "";
+}
+
+// Decodes the whole file per iteration, in packet-sized pulls as the
+// sender makes them.
+void BM_DecodeFile(benchmark::State& state) {
+  auto container = static_cast<Container>(state.range(0));
+  static const char* kNames[] = {"wav16", "wav24", "aiff", "flac"};
+  state.SetLabel(kNames[state.range(0)]);
+  std::string path = MakeFile(container);
+
+  std::unique_ptr<audio::AudioSource> source;
+  if (audio::OpenAudioSource(path, source) != helper::kOk) {
+    state.SkipWithError("open failed");
+    return;
+  }
+  const uint8_t* data;
+  size_t frames = 0;
+  for (auto _ : state) {
+    source->Rewind();
+    while (size_t len = source->Next(352 * 4, data)) {
+      benchmark::DoNotOptimize(data);
+      frames += len / 4;
+    }
+  }
+  // Output bytes, so containers compare directly.
+  state.SetBytesProcessed(frames * 4);
+  state.counters["x_realtime"] = benchmark::Counter(
+      static_cast<double>(frames) / 44'100, benchmark::Counter::kIsRate);
+  source.reset();
+  remove(path.c_str());
+}
+BENCHMARK(BM_DecodeFile)
+    ->DenseRange(0, 3)
+    ->Unit(benchmark::kMillisecond);
+}  // namespace
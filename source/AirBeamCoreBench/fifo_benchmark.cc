@@ -0,0 +1,52 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "raop/fifo.h"
+
+using AirBeamCore::raop::ConcurrentByteFIFO;
+
+namespace {
+constexpr size_t kCapacity = 1 << 20;
+
+// Write then read back on one thread, so no call ever waits.
+void BM_FifoWriteRead(benchmark::State& state) {
+  size_t chunk = state.range(0);
+  ConcurrentByteFIFO fifo(kCapacity);
+  std::vector<uint8_t> in(chunk, 0x5a), out(chunk);
+  for (auto _ : state) {
+    fifo.Write(in.data(), chunk);
+    benchmark::DoNotOptimize(fifo.Read(out.data(), chunk));
+  }
+  state.SetBytesProcessed(state.iterations() * chunk);
+}
+BENCHMARK(BM_FifoWriteRead)->Arg(64)->Arg(1024)->Arg(1408)->Arg(16384);
+
+// Thread 0 produces and thread 1 consumes, the way the driver and the
+// sender share the FIFO. Both run the same number of iterations, so every
+// byte written is read.
+void BM_FifoProducerConsumer(benchmark::State& state) {
+  static std::unique_ptr<ConcurrentByteFIFO> fifo;
+  size_t chunk = state.range(0);
+  if (state.thread_index() == 0) {
+    fifo = std::make_unique<ConcurrentByteFIFO>(kCapacity);
+  }
+  std::vector<uint8_t> buffer(chunk, 0x5a);
+  for (auto _ : state) {
+    if (state.thread_index() == 0) {
+      fifo->Write(buffer.data(), chunk, std::chrono::milliseconds(100));
+    } else {
+      fifo->Read(buffer.data(), chunk, std::chrono::milliseconds(100));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * chunk);
+}
+BENCHMARK(BM_FifoProducerConsumer)
+    ->Arg(64)
+    ->Arg(1408)
+    ->Arg(16384)
+    ->Threads(2)
+    ->UseRealTime();
+}  // namespace
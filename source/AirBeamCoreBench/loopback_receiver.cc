@@ -0,0 +1,95 @@
+#include "loopback_receiver.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+uint32_t BindLoopback(int fd) {
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    return 0;
+  }
+  socklen_t len = sizeof(addr);
+  getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+  return ntohs(addr.sin_port);
+}
+}  // namespace
+
+LoopbackReceiver::~LoopbackReceiver() { Stop(); }
+
+bool LoopbackReceiver::Start() {
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  int udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  port_ = BindLoopback(listen_fd);
+  uint32_t udp_port = BindLoopback(udp_fd);
+  if (port_ == 0 || udp_port == 0 || listen(listen_fd, 1024) != 0) {
+    close(listen_fd);
+    close(udp_fd);
+    return false;
+  }
+  int buffer_size = 4 << 20;
+  setsockopt(udp_fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+
+  pid_ = fork();
+  if (pid_ == 0) {
+    Serve(listen_fd, udp_fd, udp_port);
+    _exit(0);
+  }
+  close(listen_fd);
+  close(udp_fd);
+  return pid_ > 0;
+}
+
+void LoopbackReceiver::Stop() {
+  if (pid_ <= 0) return;
+  kill(pid_, SIGTERM);
+  waitpid(pid_, nullptr, 0);
+  pid_ = -1;
+}
+
+void LoopbackReceiver::Serve(int listen_fd, int udp_fd, uint32_t udp_port) {
+  std::string port = std::to_string(udp_port);
+  std::string response =
+      "RTSP/1.0 200 OK\r\nCSeq: 1\r\nSession: 1\r\n"
+      "Audio-Latency: 11025\r\n"
+      "Transport: RTP/AVP/UDP;unicast;mode=record;server_port=" +
+      port + ";control_port=" + port + ";timing_port=" + port + "\r\n\r\n";
+
+  std::vector<pollfd> fds = {{listen_fd, POLLIN, 0}, {udp_fd, POLLIN, 0}};
+  while (true) {
+    if (poll(fds.data(), fds.size(), -1) <= 0) continue;
+    if (fds[0].revents & POLLIN) {
+      int conn = accept(listen_fd, nullptr, nullptr);
+      if (conn >= 0) fds.push_back({conn, POLLIN, 0});
+    }
+    if (fds[1].revents & POLLIN) {
+      char buffer[2048];
+      while (recv(udp_fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+      }
+    }
+    for (size_t i = 2; i < fds.size();) {
+      if (fds[i].revents & (POLLIN | POLLHUP)) {
+        char buffer[4096];
+        if (recv(fds[i].fd, buffer, sizeof(buffer), 0) <= 0) {
+          close(fds[i].fd);
+          fds[i] = fds.back();
+          fds.pop_back();
+          continue;
+        }
+        send(fds[i].fd, response.data(), response.size(), 0);
+      }
+      ++i;
+    }
+  }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+
+// A RAOP receiver stub in a child process, so its CPU time is not charged to
+// the sender being measured. It accepts any number of RTSP connections,
+// answers every request with what the handshake needs, and drains the audio,
+// control and timing datagrams on one UDP port.
+class LoopbackReceiver {
+ public:
+  LoopbackReceiver() = default;
+  ~LoopbackReceiver();
+
+  // Forks the receiver; returns false if it could not start.
+  bool Start();
+  void Stop();
+  uint32_t GetPort() const { return port_; }
+
+ private:
+  static void Serve(int listen_fd, int udp_fd, uint32_t udp_port);
+
+  pid_t pid_ = -1;
+  uint32_t port_ = 0;
+};
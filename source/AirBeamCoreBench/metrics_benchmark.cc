@@ -0,0 +1,25 @@
+#include <benchmark/benchmark.h>
+
+#include "helper/metrics.h"
+
+using namespace AirBeamCore::helper;
+
+namespace {
+void BM_CounterAdd(benchmark::State& state) {
+  static Counter counter;
+  for (auto _ : state) counter.Add();
+  benchmark::DoNotOptimize(counter.Value());
+}
+BENCHMARK(BM_CounterAdd)->ThreadRange(1, 4);
+
+void BM_HistogramRecord(benchmark::State& state) {
+  Histogram histogram;
+  uint64_t value = 12345;
+  for (auto _ : state) {
+    histogram.Record(value);
+    value = value * 6364136223846793005ULL + 1442695040888963407ULL;
+    value >>= 40;
+  }
+}
+BENCHMARK(BM_HistogramRecord);
+}  // namespace
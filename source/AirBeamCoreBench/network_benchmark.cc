@@ -0,0 +1,90 @@
+#include <benchmark/benchmark.h>
+
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "helper/capture.h"
+#include "helper/network.h"
+#include "raop/rtp.h"
+
+using namespace AirBeamCore;
+
+namespace {
+// One audio packet to a loopback socket nobody reads, so the kernel drops
+// what overflows the receive buffer and the sender never blocks.
+void BM_UDPWriteLoopback(benchmark::State& state) {
+  helper::UDPServer sink;
+  helper::UDPServer sender;
+  if (sink.Bind() != helper::kOk || sender.Bind() != helper::kOk) {
+    state.SkipWithError("bind failed");
+    return;
+  }
+  helper::NetAddr to = {"127.0.0.1", sink.GetLocalNetAddr().port_};
+  std::string packet(raop::RtpAudioPacket::kHeaderSize +
+                         sizeof(raop::RtpAudioPacketChunk::data_),
+                     '\x5a');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sender.Write(to, packet));
+  }
+  state.SetBytesProcessed(state.iterations() * packet.size());
+}
+BENCHMARK(BM_UDPWriteLoopback);
+
+// The same, with every packet copied into a PacketCapture ring.
+void BM_UDPWriteLoopbackCaptured(benchmark::State& state) {
+  helper::UDPServer sink;
+  helper::UDPServer sender;
+  if (sink.Bind() != helper::kOk || sender.Bind() != helper::kOk) {
+    state.SkipWithError("bind failed");
+    return;
+  }
+  helper::PacketCapture::Options options;
+  options.path = "/tmp/airbeam-bench-" + std::to_string(getpid());
+  helper::PacketCapture capture(options);
+  if (capture.Start() != helper::kOk) {
+    state.SkipWithError("capture failed");
+    return;
+  }
+  helper::NetAddr to = {"127.0.0.1", sink.GetLocalNetAddr().port_};
+  std::string packet(raop::RtpAudioPacket::kHeaderSize +
+                         sizeof(raop::RtpAudioPacketChunk::data_),
+                     '\x5a');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sender.Write(to, packet));
+  }
+  state.SetBytesProcessed(state.iterations() * packet.size());
+  capture.Stop();
+  state.counters["dropped"] = capture.GetStats().dropped;
+  for (uint32_t i = 0; i < capture.GetStats().files; ++i) {
+    unlink(capture.FilePath(i).c_str());
+  }
+}
+BENCHMARK(BM_UDPWriteLoopbackCaptured);
+
+// A group's per-chunk send: one header per receiver around a shared
+// payload, in one WriteBatch.
+void BM_UDPWriteBatchLoopback(benchmark::State& state) {
+  size_t receivers = state.range(0);
+  helper::UDPServer sink;
+  helper::UDPServer sender;
+  if (sink.Bind() != helper::kOk || sender.Bind() != helper::kOk) {
+    state.SkipWithError("bind failed");
+    return;
+  }
+  helper::SockAddr to;
+  to.Parse({"127.0.0.1", sink.GetLocalNetAddr().port_});
+  uint8_t header[raop::RtpAudioPacket::kHeaderSize] = {0x80, 0x60};
+  uint8_t payload[sizeof(raop::RtpAudioPacketChunk::data_)];
+  memset(payload, 0x5a, sizeof(payload));
+  std::vector<helper::UDPMessage> messages(
+      receivers, {&to, header, sizeof(header), payload, sizeof(payload)});
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sender.WriteBatch(messages));
+  }
+  state.SetItemsProcessed(state.iterations() * receivers);
+}
+BENCHMARK(BM_UDPWriteBatchLoopback)->Arg(1)->Arg(4)->Arg(16);
+}  // namespace
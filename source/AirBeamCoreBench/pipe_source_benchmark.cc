@@ -0,0 +1,52 @@
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#include "audio/pipe_source.h"
+
+using AirBeamCore::audio::PipeSource;
+
+namespace {
+// A writer thread pushes 16 MB through a pipe in pieces of the given size,
+// as ffmpeg would; the sender pulls 352-frame packets.
+void BM_PipeSourceThroughput(benchmark::State& state) {
+  constexpr size_t kBytes = 16 * 1024 * 1024;
+  size_t piece = state.range(0);
+  std::vector<uint8_t> buffer(piece, 0x5a);
+  size_t total = 0;
+  for (auto _ : state) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+      state.SkipWithError("pipe failed");
+      return;
+    }
+    PipeSource source{PipeSource::Options()};
+    source.Open(fds[0]);
+    std::thread writer([&]() {
+      for (size_t sent = 0; sent < kBytes;) {
+        ssize_t len = write(fds[1], buffer.data(), piece);
+        if (len <= 0) break;
+        sent += len;
+      }
+      close(fds[1]);
+    });
+    const uint8_t* data;
+    while (true) {
+      size_t len = source.Next(352 * 4, data);
+      if (len == 0 && source.AtEnd()) break;
+      benchmark::DoNotOptimize(data);
+      total += len;
+    }
+    writer.join();
+    close(fds[0]);
+  }
+  state.SetBytesProcessed(total);
+}
+BENCHMARK(BM_PipeSourceThroughput)
+    ->Arg(4096)
+    ->Arg(65536)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+}  // namespace
@@ -0,0 +1,57 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <vector>
+
+#include "raop/rtp.h"
+
+using namespace AirBeamCore::raop;
+
+namespace {
+RtpAudioPacket AudioPacket() {
+  RtpAudioPacket packet;
+  packet.header = {0x80, 0x60, 1};
+  packet.timestamp = 352;
+  packet.ssrc = 0x12345678;
+  memset(packet.data.data_, 0x5a, sizeof(packet.data.data_));
+  packet.data.len_ = sizeof(packet.data.data_);
+  return packet;
+}
+
+void BM_RtpAudioPacketSerialize(benchmark::State& state) {
+  RtpAudioPacket packet = AudioPacket();
+  std::vector<uint8_t> buffer;
+  for (auto _ : state) {
+    packet.Serialize(buffer);
+    benchmark::DoNotOptimize(buffer.data());
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_RtpAudioPacketSerialize);
+
+void BM_RtpAudioPacketSerializeHeader(benchmark::State& state) {
+  RtpAudioPacket packet = AudioPacket();
+  uint8_t header[RtpAudioPacket::kHeaderSize];
+  for (auto _ : state) {
+    packet.SerializeHeader(header);
+    benchmark::DoNotOptimize(header);
+  }
+}
+BENCHMARK(BM_RtpAudioPacketSerializeHeader);
+
+void BM_RtpTimePacketRoundTrip(benchmark::State& state) {
+  RtpTimePacket packet;
+  packet.header = {0x80, 0xd3, 7};
+  packet.dummy = 0;
+  packet.ref_time = NtpTime::Now();
+  packet.recv_time = packet.ref_time;
+  packet.send_time = packet.ref_time;
+  uint8_t buffer[32];
+  for (auto _ : state) {
+    packet.Serialize(buffer);
+    packet = RtpTimePacket::Deserialize(buffer, sizeof(buffer));
+    benchmark::DoNotOptimize(packet);
+  }
+}
+BENCHMARK(BM_RtpTimePacketRoundTrip);
+}  // namespace
@@ -0,0 +1,56 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "raop/rtsp.h"
+
+using namespace AirBeamCore::raop;
+
+namespace {
+const char kSetupResponse[] =
+    "RTSP/1.0 200 OK\r\n"
+    "CSeq: 3\r\n"
+    "Session: 1\r\n"
+    "Transport: RTP/AVP/UDP;unicast;mode=record;server_port=6000;"
+    "control_port=6001;timing_port=6002\r\n"
+    "Audio-Latency: 11025\r\n"
+    "Audio-Jack-Status: connected; type=analog\r\n"
+    "Server: AirTunes/105.1\r\n"
+    "\r\n";
+
+void BM_RtspMessageParse(benchmark::State& state) {
+  std::string content = kSetupResponse;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(RtspMessage::Parse(content));
+  }
+  state.SetBytesProcessed(state.iterations() * content.size());
+}
+BENCHMARK(BM_RtspMessageParse);
+
+void BM_RtspMessageToString(benchmark::State& state) {
+  auto request =
+      RtspMsgBuilder<RtspReqMessage>()
+          .SetMethod("SETUP")
+          .SetUri("rtsp://127.0.0.1/1234567890")
+          .AddHeader("CSeq", "3")
+          .AddHeader("Transport",
+                     "RTP/AVP/UDP;unicast;interleaved=0-1;mode=record;"
+                     "control_port=6001;timing_port=6002")
+          .AddHeader("User-Agent", "AirBeam/1.0")
+          .Build();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(request.ToString());
+  }
+}
+BENCHMARK(BM_RtspMessageToString);
+
+void BM_ParseKVStr(benchmark::State& state) {
+  std::string transport =
+      "RTP/AVP/UDP;unicast;mode=record;server_port=6000;control_port=6001;"
+      "timing_port=6002";
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ParseKVStr(transport, "=", ";"));
+  }
+}
+BENCHMARK(BM_ParseKVStr);
+}  // namespace
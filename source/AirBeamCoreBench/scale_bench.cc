@@ -0,0 +1,138 @@
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "fmt/core.h"
+#include "loopback_receiver.h"
+#include "raop/raop.h"
+#include "raop/session_manager.h"
+
+ABSL_FLAG(std::string, sessions, "1,10,100,500",
+          "Comma separated session counts to measure.");
+ABSL_FLAG(int, workers, 2, "SessionManager worker threads.");
+ABSL_FLAG(int, seconds, 5, "Measurement window per session count.");
+
+using namespace AirBeamCore::raop;
+
+namespace {
+double CpuSeconds() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// Current resident set size, in bytes.
+uint64_t ResidentBytes() {
+#ifdef __APPLE__
+  mach_task_basic_info info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) {
+    return 0;
+  }
+  return info.resident_size;
+#else
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// Every session keeps four sockets open.
+void RaiseFdLimit() {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return;
+  limit.rlim_cur = limit.rlim_max;
+#ifdef __APPLE__
+  limit.rlim_cur = std::min<rlim_t>(limit.rlim_cur, OPEN_MAX);
+#endif
+  setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+void SilenceSource(RtpAudioPacketChunk& chunk) {
+  memset(chunk.data_, 0, sizeof(chunk.data_));
+  chunk.len_ = sizeof(chunk.data_);
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  std::vector<int> counts;
+  for (auto part : absl::StrSplit(absl::GetFlag(FLAGS_sessions), ',')) {
+    int count;
+    if (!absl::SimpleAtoi(part, &count) || count <= 0) {
+      std::cerr << "bad --sessions entry: " << part << std::endl;
+      return 1;
+    }
+    counts.push_back(count);
+  }
+
+  RaiseFdLimit();
+  LoopbackReceiver receiver;
+  if (!receiver.Start()) {
+    std::cerr << "failed to start loopback receiver" << std::endl;
+    return 1;
+  }
+
+  std::cout << fmt::format("{:>8} {:>7} {:>7} {:>9} {:>9} {:>9} {:>9} {:>8}",
+                           "sessions", "workers", "cpu%", "rss_mb", "p50_us",
+                           "p99_us", "max_us", "failed")
+            << std::endl;
+  for (int count : counts) {
+    SessionManager::Options options;
+    options.workers = absl::GetFlag(FLAGS_workers);
+    auto manager = std::make_unique<SessionManager>(options);
+
+    int failed = 0;
+    for (int i = 0; i < count; ++i) {
+      auto raop = std::make_shared<Raop>("127.0.0.1", receiver.GetPort());
+      SessionManager::SessionId id;
+      if (manager->Add(raop, SilenceSource, id) != AirBeamCore::helper::kOk) {
+        failed++;
+      }
+    }
+
+    // Let the handshakes settle, then measure a steady window.
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    double cpu_begin = CpuSeconds();
+    auto wall_begin = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(
+        std::chrono::seconds(absl::GetFlag(FLAGS_seconds)));
+    double cpu = CpuSeconds() - cpu_begin;
+    double wall = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - wall_begin)
+                      .count();
+    uint64_t rss = ResidentBytes();
+    auto stats = manager->GetStats();
+
+    std::cout << fmt::format(
+                     "{:>8} {:>7} {:>7.1f} {:>9.1f} {:>9} {:>9} {:>9} {:>8}",
+                     count, options.workers, 100.0 * cpu / wall,
+                     rss / (1024.0 * 1024.0), stats.pacing_error_p50_us,
+                     stats.pacing_error_p99_us, stats.pacing_error_max_us,
+                     failed + stats.failures)
+              << std::endl;
+    manager.reset();
+  }
+  receiver.Stop();
+  return 0;
+}
@@ -0,0 +1,29 @@
+#include <benchmark/benchmark.h>
+
+#include "helper/trace.h"
+
+using AirBeamCore::helper::Tracer;
+
+namespace {
+// What every instrumented scope costs while tracing is off.
+void BM_TraceScopeDisabled(benchmark::State& state) {
+  Tracer::Enable(false);
+  uint32_t seq = 0;
+  for (auto _ : state) {
+    ABTraceScope("bench", seq++);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_TraceScopeDisabled);
+
+void BM_TraceScopeEnabled(benchmark::State& state) {
+  Tracer::Enable(true);
+  uint32_t seq = 0;
+  for (auto _ : state) {
+    ABTraceScope("bench", seq++);
+    benchmark::ClobberMemory();
+  }
+  Tracer::Enable(false);
+}
+BENCHMARK(BM_TraceScopeEnabled);
+}  // namespace
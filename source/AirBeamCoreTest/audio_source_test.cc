@@ -0,0 +1,127 @@
+#include "audio/audio_source.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "audio/flac_decoder.h"
+#include "audio/mapped_pcm_file.h"
+#include "audio/wav_decoder.h"
+#include "audio_files.h"
+
+using namespace AirBeamCore;
+using AirBeamCore::audio::AudioSource;
+using AirBeamCore::audio::PCMFormat;
+
+namespace {
+std::string WriteFile(const std::string& name, const std::string& contents) {
+  std::string path =
+      testing::TempDir() + name + "_" + std::to_string(getpid());
+  std::ofstream out(path, std::ios::binary);
+  out << contents;
+  return path;
+}
+
+std::string FirstBytes(AudioSource& source, size_t len) {
+  const uint8_t* data;
+  size_t got = source.Next(len, data);
+  return std::string(reinterpret_cast<const char*>(data), got);
+}
+}  // namespace
+
+TEST(AudioSourceTest, PicksTheDecoderFromTheHeader) {
+  std::vector<int16_t> samples(4096);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    samples[i] = static_cast<int16_t>(i * 31);
+  }
+  PCMFormat native;
+  std::string pcm = AirBeamTesting::PackPCM(samples, native);
+  PCMFormat big_endian = native;
+  big_endian.big_endian = true;
+  std::vector<int32_t> wide(samples.begin(), samples.end());
+
+  std::unique_ptr<AudioSource> source;
+  ASSERT_EQ(audio::OpenAudioSource(
+                WriteFile("detect_wav", AirBeamTesting::MakeWav(native, pcm)),
+                source),
+            helper::kOk);
+  EXPECT_NE(dynamic_cast<audio::WavDecoder*>(source.get()), nullptr);
+  EXPECT_EQ(FirstBytes(*source, 64), pcm.substr(0, 64));
+
+  ASSERT_EQ(audio::OpenAudioSource(
+                WriteFile("detect_aiff",
+                          AirBeamTesting::MakeAiff(
+                              big_endian,
+                              AirBeamTesting::PackPCM(samples, big_endian))),
+                source),
+            helper::kOk);
+  EXPECT_NE(dynamic_cast<audio::AiffDecoder*>(source.get()), nullptr);
+  EXPECT_EQ(FirstBytes(*source, 64), pcm.substr(0, 64));
+
+  ASSERT_EQ(audio::OpenAudioSource(
+                WriteFile("detect_flac",
+                          AirBeamTesting::EncodeFlac(
+                              wide, 2, AirBeamTesting::FlacOptions())),
+                source),
+            helper::kOk);
+  EXPECT_NE(dynamic_cast<audio::FlacDecoder*>(source.get()), nullptr);
+  EXPECT_EQ(FirstBytes(*source, 64), pcm.substr(0, 64));
+
+  // Anything else is raw PCM, header bytes and all.
+  ASSERT_EQ(audio::OpenAudioSource(WriteFile("detect_raw", pcm), source),
+            helper::kOk);
+  EXPECT_NE(dynamic_cast<audio::MappedPCMFile*>(source.get()), nullptr);
+  EXPECT_EQ(source->GetInputFormat().bits, 16);
+  EXPECT_EQ(FirstBytes(*source, 64), pcm.substr(0, 64));
+
+  // A file that claims a format but does not parse is an error.
+  EXPECT_NE(audio::OpenAudioSource(WriteFile("detect_bad", "RIFF....WAVEfmt "),
+                                   source),
+            helper::kOk);
+  EXPECT_NE(audio::OpenAudioSource(testing::TempDir() + "no_such", source),
+            helper::kOk);
+}
+
+TEST(AudioSourceTest, NextFullStitchesBlocksAndLoops) {
+  // 1000-frame FLAC blocks, read in 352-frame packets.
+  std::vector<int32_t> samples(2 * 2500);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    samples[i] = static_cast<int16_t>(i * 13);
+  }
+  AirBeamTesting::FlacOptions options;
+  options.block_size = 1000;
+  std::unique_ptr<AudioSource> source;
+  ASSERT_EQ(audio::OpenAudioSource(
+                WriteFile("next_full",
+                          AirBeamTesting::EncodeFlac(samples, 2, options)),
+                source),
+            helper::kOk);
+
+  constexpr size_t kPacket = 352 * 4;
+  uint8_t buffer[kPacket];
+  const uint8_t* data;
+  uint64_t loops = 0;
+  std::vector<int16_t> played;
+  while (played.size() < samples.size() * 3) {
+    ASSERT_EQ(audio::NextFull(*source, kPacket, buffer, data, true, &loops),
+              kPacket);
+    auto* frames = reinterpret_cast<const int16_t*>(data);
+    played.insert(played.end(), frames, frames + kPacket / 2);
+  }
+  EXPECT_EQ(loops, played.size() / samples.size());
+  for (size_t i = 0; i < played.size(); ++i) {
+    ASSERT_EQ(played[i], samples[i % samples.size()]) << i;
+  }
+
+  // Without loop the last packet comes up short, then nothing.
+  ASSERT_EQ(source->Rewind(), helper::kOk);
+  size_t total = 0;
+  while (size_t len =
+             audio::NextFull(*source, kPacket, buffer, data, false)) {
+    total += len;
+  }
+  EXPECT_EQ(total, samples.size() * 2);
+}
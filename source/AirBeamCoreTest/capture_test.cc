@@ -0,0 +1,303 @@
+#include "helper/capture.h"
+
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "helper/network.h"
+
+using namespace AirBeamCore::helper;
+
+namespace {
+struct CapturedPacket {
+  uint64_t time_ns;
+  uint32_t orig_len;
+  uint32_t flags;
+  std::string data;
+};
+
+uint32_t Read32(const std::string& s, size_t pos) {
+  uint32_t value;
+  memcpy(&value, s.data() + pos, sizeof(value));
+  return value;
+}
+
+uint16_t ReadBigEndian16(const std::string& s, size_t pos) {
+  return static_cast<uint16_t>((static_cast<uint8_t>(s[pos]) << 8) |
+                               static_cast<uint8_t>(s[pos + 1]));
+}
+
+uint32_t ReadBigEndian32(const std::string& s, size_t pos) {
+  return (static_cast<uint32_t>(ReadBigEndian16(s, pos)) << 16) |
+         ReadBigEndian16(s, pos + 2);
+}
+
+// Parses a pcapng file with one section and interface, as PacketCapture
+// writes them.
+std::vector<CapturedPacket> ReadPcapng(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream buffer;
+  buffer << in.rdbuf();
+  std::string file = buffer.str();
+
+  std::vector<CapturedPacket> packets;
+  size_t pos = 0;
+  int blocks = 0;
+  while (pos + 12 <= file.size()) {
+    uint32_t type = Read32(file, pos);
+    uint32_t len = Read32(file, pos + 4);
+    EXPECT_EQ(len % 4, 0u);
+    EXPECT_EQ(Read32(file, pos + len - 4), len);
+    if (blocks == 0) {
+      EXPECT_EQ(type, 0x0A0D0D0Au);
+      EXPECT_EQ(Read32(file, pos + 8), 0x1A2B3C4Du);
+    } else if (blocks == 1) {
+      // Raw IP link type.
+      EXPECT_EQ(type, 1u);
+      EXPECT_EQ(Read32(file, pos + 8) & 0xFFFF, 101u);
+    } else {
+      EXPECT_EQ(type, 6u);
+      CapturedPacket packet;
+      packet.time_ns = (static_cast<uint64_t>(Read32(file, pos + 12)) << 32) |
+                       Read32(file, pos + 16);
+      uint32_t captured = Read32(file, pos + 20);
+      packet.orig_len = Read32(file, pos + 24);
+      packet.data = file.substr(pos + 28, captured);
+      size_t option = pos + 28 + (captured + 3) / 4 * 4;
+      EXPECT_EQ(Read32(file, option) & 0xFFFF, 2u);
+      packet.flags = Read32(file, option + 4);
+      packets.push_back(packet);
+    }
+    pos += len;
+    blocks++;
+  }
+  EXPECT_EQ(pos, file.size());
+  return packets;
+}
+
+std::string TempPrefix(const std::string& name) {
+  return testing::TempDir() + "capture_" + name + "_" +
+         std::to_string(getpid());
+}
+
+NetAddr Loopback(UDPServer& server) {
+  return {"127.0.0.1", server.GetLocalNetAddr().port_};
+}
+}  // namespace
+
+TEST(PacketCaptureTest, RecordsUdpBothWays) {
+  PacketCapture::Options options;
+  options.path = TempPrefix("udp") + ".pcapng";
+  PacketCapture capture(options);
+  ASSERT_EQ(capture.Start(), kOk);
+
+  UDPServer sender, receiver;
+  ASSERT_EQ(sender.Bind(), kOk);
+  ASSERT_EQ(receiver.Bind(), kOk);
+  ASSERT_EQ(sender.Write(Loopback(receiver), "hello"), kOk);
+  NetAddr from;
+  std::string data;
+  ASSERT_EQ(receiver.Read(from, data), kOk);
+  uint8_t header[] = {'a', 'b'};
+  std::string payload = "cdef";
+  SockAddr to;
+  ASSERT_EQ(to.Parse(Loopback(receiver)), kOk);
+  ASSERT_EQ(sender.WriteBatch({{&to, header, sizeof(header),
+                                reinterpret_cast<const uint8_t*>(
+                                    payload.data()),
+                                payload.size()}}),
+            kOk);
+  capture.Stop();
+
+  auto stats = capture.GetStats();
+  EXPECT_EQ(stats.packets, 3u);
+  EXPECT_EQ(stats.dropped, 0u);
+  EXPECT_EQ(stats.files, 1u);
+  EXPECT_EQ(capture.FilePath(0), TempPrefix("udp") + ".0.pcapng");
+
+  auto packets = ReadPcapng(capture.FilePath(0));
+  ASSERT_EQ(packets.size(), 3u);
+  // Outbound, inbound, then the batch.
+  EXPECT_EQ(packets[0].flags, 2u);
+  EXPECT_EQ(packets[1].flags, 1u);
+  EXPECT_EQ(packets[2].flags, 2u);
+  for (const auto& packet : packets) {
+    const std::string& ip = packet.data;
+    ASSERT_GE(ip.size(), 28u);
+    EXPECT_EQ(static_cast<uint8_t>(ip[0]), 0x45);
+    EXPECT_EQ(static_cast<uint8_t>(ip[9]), IPPROTO_UDP);
+    EXPECT_EQ(ReadBigEndian16(ip, 2), ip.size());
+    EXPECT_EQ(packet.orig_len, ip.size());
+    EXPECT_EQ(ReadBigEndian16(ip, 24), ip.size() - 20);
+    EXPECT_GT(packet.time_ns, 0u);
+  }
+  EXPECT_EQ(packets[0].data.substr(28), "hello");
+  EXPECT_EQ(ReadBigEndian16(packets[0].data, 20),
+            sender.GetLocalNetAddr().port_);
+  EXPECT_EQ(ReadBigEndian16(packets[0].data, 22),
+            receiver.GetLocalNetAddr().port_);
+  // Inbound packets go from the remote peer to the socket.
+  EXPECT_EQ(ReadBigEndian16(packets[1].data, 20),
+            sender.GetLocalNetAddr().port_);
+  EXPECT_EQ(ReadBigEndian32(packets[1].data, 12), INADDR_LOOPBACK);
+  EXPECT_EQ(packets[2].data.substr(28), "abcdef");
+  EXPECT_LE(packets[0].time_ns, packets[2].time_ns);
+
+  unlink(capture.FilePath(0).c_str());
+}
+
+TEST(PacketCaptureTest, RecordsTcpWithSequenceNumbers) {
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  listen(listen_fd, 1);
+  socklen_t len = sizeof(addr);
+  getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+
+  PacketCapture::Options options;
+  options.path = TempPrefix("tcp");
+  PacketCapture capture(options);
+  ASSERT_EQ(capture.Start(), kOk);
+
+  TCPClient client;
+  ASSERT_EQ(client.Connect("127.0.0.1", ntohs(addr.sin_port)), kOk);
+  int peer = accept(listen_fd, nullptr, nullptr);
+  ASSERT_EQ(client.Write("OPTIONS"), kOk);
+  ASSERT_EQ(client.Write("SETUP"), kOk);
+  ASSERT_EQ(send(peer, "RTSP/1.0", 8, 0), 8);
+  std::string data;
+  ASSERT_EQ(client.Read(data), kOk);
+  capture.Stop();
+  close(peer);
+  close(listen_fd);
+
+  auto packets = ReadPcapng(capture.FilePath(0));
+  ASSERT_EQ(packets.size(), 3u);
+  for (const auto& packet : packets) {
+    EXPECT_EQ(static_cast<uint8_t>(packet.data[9]), IPPROTO_TCP);
+    // PSH|ACK with a 20 byte header.
+    EXPECT_EQ(ReadBigEndian16(packet.data, 32), (5 << 12) | 0x18);
+  }
+  EXPECT_EQ(packets[0].data.substr(40), "OPTIONS");
+  EXPECT_EQ(packets[1].data.substr(40), "SETUP");
+  EXPECT_EQ(packets[2].data.substr(40), "RTSP/1.0");
+  // Each direction counts its own bytes, and acknowledges the other's.
+  EXPECT_EQ(ReadBigEndian32(packets[1].data, 24),
+            ReadBigEndian32(packets[0].data, 24) + 7);
+  EXPECT_EQ(ReadBigEndian32(packets[2].data, 28),
+            ReadBigEndian32(packets[1].data, 24) + 5);
+
+  unlink(capture.FilePath(0).c_str());
+}
+
+TEST(PacketCaptureTest, RotatesBySize) {
+  PacketCapture::Options options;
+  options.path = TempPrefix("rotate");
+  options.max_file_bytes = 4096;
+  options.max_files = 2;
+  PacketCapture capture(options);
+  ASSERT_EQ(capture.Start(), kOk);
+
+  UDPServer sender, receiver;
+  ASSERT_EQ(sender.Bind(), kOk);
+  ASSERT_EQ(receiver.Bind(), kOk);
+  std::string payload(1000, 'x');
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_EQ(sender.Write(Loopback(receiver), payload), kOk);
+  }
+  capture.Stop();
+
+  auto stats = capture.GetStats();
+  EXPECT_EQ(stats.packets, 20u);
+  EXPECT_GT(stats.files, 2u);
+  // Only the newest max_files are kept.
+  for (uint32_t i = 0; i + 2 < stats.files; ++i) {
+    EXPECT_NE(access(capture.FilePath(i).c_str(), F_OK), 0);
+  }
+  size_t kept = 0;
+  for (uint32_t i = stats.files - 2; i < stats.files; ++i) {
+    auto packets = ReadPcapng(capture.FilePath(i));
+    EXPECT_GE(packets.size(), 1u);
+    kept += packets.size();
+    std::ifstream file(capture.FilePath(i), std::ios::binary | std::ios::ate);
+    // One packet may go past the limit only when it is alone in the file.
+    EXPECT_LE(static_cast<size_t>(file.tellg()), 4096u + 1200u);
+    unlink(capture.FilePath(i).c_str());
+  }
+  EXPECT_GE(kept, 2u);
+}
+
+TEST(PacketCaptureTest, WrapsAroundTheRing) {
+  PacketCapture::Options options;
+  options.path = TempPrefix("wrap");
+  options.ring_bytes = 4096;
+  PacketCapture capture(options);
+  ASSERT_EQ(capture.Start(), kOk);
+
+  UDPServer sender, receiver;
+  ASSERT_EQ(sender.Bind(), kOk);
+  ASSERT_EQ(receiver.Bind(), kOk);
+  for (int i = 0; i < 40; ++i) {
+    std::string payload(300 + i, static_cast<char>('a' + i % 26));
+    ASSERT_EQ(sender.Write(Loopback(receiver), payload), kOk);
+    // Leave the writer time to free the ring.
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  capture.Stop();
+
+  EXPECT_EQ(capture.GetStats().dropped, 0u);
+  auto packets = ReadPcapng(capture.FilePath(0));
+  ASSERT_EQ(packets.size(), 40u);
+  for (int i = 0; i < 40; ++i) {
+    EXPECT_EQ(packets[i].data.substr(28),
+              std::string(300 + i, static_cast<char>('a' + i % 26)));
+  }
+  unlink(capture.FilePath(0).c_str());
+}
+
+TEST(PacketCaptureTest, DropsWhenRingIsFull) {
+  PacketCapture::Options options;
+  options.path = TempPrefix("drop");
+  options.ring_bytes = 4096;
+  PacketCapture capture(options);
+  ASSERT_EQ(capture.Start(), kOk);
+
+  UDPServer sender, receiver;
+  ASSERT_EQ(sender.Bind(), kOk);
+  ASSERT_EQ(receiver.Bind(), kOk);
+  // Larger than the whole ring.
+  std::string payload(8000, 'x');
+  ASSERT_EQ(sender.Write(Loopback(receiver), payload), kOk);
+  ASSERT_EQ(sender.Write(Loopback(receiver), "small"), kOk);
+  capture.Stop();
+
+  auto stats = capture.GetStats();
+  EXPECT_EQ(stats.packets, 1u);
+  EXPECT_EQ(stats.dropped, 1u);
+  EXPECT_EQ(ReadPcapng(capture.FilePath(0)).size(), 1u);
+  unlink(capture.FilePath(0).c_str());
+}
+
+TEST(PacketCaptureTest, OnlyOneCaptureAtATime) {
+  PacketCapture::Options options;
+  options.path = TempPrefix("first");
+  PacketCapture first(options);
+  ASSERT_EQ(first.Start(), kOk);
+  options.path = TempPrefix("second");
+  PacketCapture second(options);
+  EXPECT_NE(second.Start(), kOk);
+  first.Stop();
+  unlink(first.FilePath(0).c_str());
+}
@@ -3,6 +3,7 @@
 #include <gtest/gtest.h>
 
 #include <cstring>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "raop/rtp.h"
@@ -79,4 +80,66 @@ TEST(PCMCodecTest, EncodeHandlesExactMultipleOf4) {
   uint8_t expected[] = {0x02, 0x01, 0x04, 0x03, 0x06, 0x05, 0x08, 0x07};
 
   EXPECT_EQ(0, memcmp(expected, output.data_, 8));
-}
\ No newline at end of file
+}
+
+TEST(PCMCodecTest, EveryLevelMatchesScalar) {
+  RtpAudioPacketChunk input;
+  for (size_t i = 0; i < sizeof(input.data_); ++i) {
+    input.data_[i] = static_cast<uint8_t>(i * 37 + 11);
+  }
+
+  // Odd lengths leave a scalar tail after the vector loop.
+  for (size_t len : {sizeof(input.data_), size_t{4}, size_t{20}, size_t{70}}) {
+    input.len_ = len;
+    RtpAudioPacketChunk expected;
+    PCMCodec::Encode(PCMCodecLevel::kScalar, input, expected);
+    for (auto level : {PCMCodecLevel::kSse2, PCMCodecLevel::kNeon}) {
+      if (!PCMCodec::IsSupported(level)) continue;
+      RtpAudioPacketChunk output;
+      memset(output.data_, 0xff, sizeof(output.data_));
+      PCMCodec::Encode(level, input, output);
+      EXPECT_EQ(0, memcmp(expected.data_, output.data_, sizeof(output.data_)))
+          << PCMCodec::LevelName(level) << " len " << len;
+    }
+  }
+}
+
+TEST(PCMCodecTest, EncodeKeepsChannelOrder) {
+  RtpAudioPacketChunk input;
+  auto samples = reinterpret_cast<int16_t*>(input.data_);
+  for (size_t i = 0; i < kPCMChunkLength; ++i) {
+    samples[i * 2] = 0x0102;      // left
+    samples[i * 2 + 1] = 0x0304;  // right
+  }
+  input.len_ = sizeof(input.data_);
+
+  RtpAudioPacketChunk output;
+  PCMCodec::Encode(input, output);
+  for (size_t i = 0; i < kPCMChunkLength; ++i) {
+    ASSERT_EQ(output.data_[i * 4], 0x01) << "frame " << i;
+    ASSERT_EQ(output.data_[i * 4 + 1], 0x02) << "frame " << i;
+    ASSERT_EQ(output.data_[i * 4 + 2], 0x03) << "frame " << i;
+    ASSERT_EQ(output.data_[i * 4 + 3], 0x04) << "frame " << i;
+  }
+}
+
+TEST(PCMCodecTest, EncodeFromPointerMatchesChunk) {
+  RtpAudioPacketChunk input;
+  for (size_t i = 0; i < sizeof(input.data_); ++i) {
+    input.data_[i] = static_cast<uint8_t>(i * 13 + 5);
+  }
+  input.len_ = 100;
+  RtpAudioPacketChunk expected;
+  PCMCodec::Encode(input, expected);
+
+  RtpAudioPacketChunk output;
+  output.len_ = 0;
+  PCMCodec::Encode(input.data_, 100, output);
+  EXPECT_EQ(output.len_, 100u);
+  EXPECT_EQ(0, memcmp(expected.data_, output.data_, sizeof(output.data_)));
+
+  // More than a chunk is cut to one.
+  std::vector<uint8_t> big(sizeof(input.data_) * 2, 0x12);
+  PCMCodec::Encode(big.data(), big.size(), output);
+  EXPECT_EQ(output.len_, sizeof(output.data_));
+}
@@ -0,0 +1,291 @@
+#include "audio/datagram_source.h"
+
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace AirBeamCore;
+using AirBeamCore::audio::DatagramSource;
+
+namespace {
+constexpr size_t kPacketFrames = 352;
+
+// Stereo frames from first on whose samples count up, so reordering, loss
+// and concealment show.
+std::vector<int16_t> Frames(size_t first, size_t count) {
+  std::vector<int16_t> samples(count * 2);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    samples[i] = static_cast<int16_t>(first * 2 + i);
+  }
+  return samples;
+}
+
+// An RTP L16 packet of big-endian samples.
+std::string Rtp(uint16_t seq, uint32_t timestamp,
+                const std::vector<int16_t>& samples, uint8_t type = 10) {
+  std::string packet(12, '\0');
+  packet[0] = static_cast<char>(0x80);
+  packet[1] = static_cast<char>(type);
+  packet[2] = static_cast<char>(seq >> 8);
+  packet[3] = static_cast<char>(seq);
+  for (int i = 0; i < 4; ++i) {
+    packet[4 + i] = static_cast<char>(timestamp >> (24 - 8 * i));
+  }
+  for (int16_t sample : samples) {
+    packet.push_back(static_cast<char>(static_cast<uint16_t>(sample) >> 8));
+    packet.push_back(static_cast<char>(sample));
+  }
+  return packet;
+}
+
+std::string Raw(const std::vector<int16_t>& samples) {
+  return std::string(reinterpret_cast<const char*>(samples.data()),
+                     samples.size() * sizeof(int16_t));
+}
+
+class Sender {
+ public:
+  explicit Sender(uint16_t port) : fd_(socket(AF_INET, SOCK_DGRAM, 0)) {
+    addr_.sin_family = AF_INET;
+    addr_.sin_port = htons(port);
+    addr_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  }
+  ~Sender() { close(fd_); }
+
+  void Send(const std::string& packet) {
+    ASSERT_EQ(sendto(fd_, packet.data(), packet.size(), 0,
+                     reinterpret_cast<const sockaddr*>(&addr_),
+                     sizeof(addr_)),
+              static_cast<ssize_t>(packet.size()));
+  }
+
+ private:
+  int fd_;
+  sockaddr_in addr_{};
+};
+
+void WaitForPackets(const DatagramSource& source, uint64_t packets) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (source.GetStats().packets < packets &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(source.GetStats().packets, packets);
+}
+
+// Pulls frames as the sender does, a packet at a time, until there are
+// count or the source keeps coming back empty.
+std::vector<int16_t> Play(audio::AudioSource& source, size_t count) {
+  std::vector<int16_t> samples;
+  const uint8_t* data;
+  for (int empty = 0; samples.size() < count * 2 && empty < 100;) {
+    size_t len = source.Next(
+        std::min(kPacketFrames, count - samples.size() / 2) * 4, data);
+    if (len == 0) {
+      ++empty;
+      continue;
+    }
+    const int16_t* frames = reinterpret_cast<const int16_t*>(data);
+    samples.insert(samples.end(), frames, frames + len / 2);
+  }
+  return samples;
+}
+
+DatagramSource::Options UdpOptions() {
+  DatagramSource::Options options;
+  options.address = "udp://127.0.0.1:0";
+  options.depth = std::chrono::milliseconds(5);
+  options.read_timeout = std::chrono::milliseconds(2);
+  return options;
+}
+}  // namespace
+
+TEST(DatagramSourceTest, PlaysRawPcmInArrivalOrder) {
+  DatagramSource source(UdpOptions());
+  ASSERT_EQ(source.Open(), helper::kOk);
+  ASSERT_NE(source.GetLocalPort(), 0);
+  Sender sender(source.GetLocalPort());
+  for (size_t i = 0; i < 8; ++i) {
+    sender.Send(Raw(Frames(i * kPacketFrames, kPacketFrames)));
+  }
+  // Not whole frames.
+  sender.Send("abcdef");
+  WaitForPackets(source, 9);
+
+  EXPECT_EQ(Play(source, 8 * kPacketFrames), Frames(0, 8 * kPacketFrames));
+  auto stats = source.GetStats();
+  EXPECT_EQ(stats.rejected, 1u);
+  EXPECT_EQ(stats.concealed_frames, 0u);
+  EXPECT_NE(source.Rewind(), helper::kOk);
+}
+
+TEST(DatagramSourceTest, OrdersRtpByTimestamp) {
+  DatagramSource source(UdpOptions());
+  ASSERT_EQ(source.Open(), helper::kOk);
+  Sender sender(source.GetLocalPort());
+  // Timestamps near the 32-bit wrap, sent out of order.
+  const uint32_t base = 0xffffffff - 500;
+  for (uint32_t i : {0, 2, 1, 4, 3}) {
+    sender.Send(Rtp(i, base + i * kPacketFrames,
+                    Frames(i * kPacketFrames, kPacketFrames)));
+  }
+  WaitForPackets(source, 5);
+
+  EXPECT_EQ(Play(source, 5 * kPacketFrames), Frames(0, 5 * kPacketFrames));
+  auto stats = source.GetStats();
+  EXPECT_EQ(stats.late, 0u);
+  EXPECT_EQ(stats.concealed_frames, 0u);
+}
+
+TEST(DatagramSourceTest, CopiesRtpMonoToBothSides) {
+  auto options = UdpOptions();
+  options.payload = DatagramSource::Payload::kRtp;
+  DatagramSource source(options);
+  ASSERT_EQ(source.Open(), helper::kOk);
+  Sender sender(source.GetLocalPort());
+  std::vector<int16_t> mono = {1, -2, 300, -400};
+  for (int i = 0; i < 100; ++i) {
+    sender.Send(Rtp(i, i * mono.size(), mono, 11));
+  }
+  WaitForPackets(source, 100);
+
+  auto played = Play(source, 400);
+  ASSERT_EQ(played.size(), 800u);
+  for (size_t i = 0; i < played.size(); ++i) {
+    EXPECT_EQ(played[i], mono[i / 2 % mono.size()]) << i;
+  }
+}
+
+TEST(DatagramSourceTest, ConcealsLostPackets) {
+  for (auto concealment : {DatagramSource::Concealment::kRepeat,
+                           DatagramSource::Concealment::kFade}) {
+    auto options = UdpOptions();
+    options.concealment = concealment;
+    DatagramSource source(options);
+    ASSERT_EQ(source.Open(), helper::kOk);
+    Sender sender(source.GetLocalPort());
+    // The third packet is lost.
+    for (uint32_t i : {0, 1, 3}) {
+      sender.Send(Rtp(i, i * kPacketFrames,
+                      Frames(i * kPacketFrames, kPacketFrames)));
+    }
+    WaitForPackets(source, 3);
+
+    auto played = Play(source, 4 * kPacketFrames);
+    ASSERT_EQ(played.size(), 8 * kPacketFrames);
+    // The last packet before the gap, played again.
+    auto last = Frames(kPacketFrames, kPacketFrames);
+    for (size_t i = 0; i < 2 * kPacketFrames; ++i) {
+      int32_t expected = last[i];
+      if (concealment == DatagramSource::Concealment::kFade) {
+        expected = expected * (441 - static_cast<int32_t>(i / 2)) / 441;
+      }
+      ASSERT_EQ(played[4 * kPacketFrames + i], expected) << i;
+    }
+    EXPECT_TRUE(std::equal(played.begin() + 6 * kPacketFrames, played.end(),
+                           Frames(3 * kPacketFrames, kPacketFrames).begin()));
+    EXPECT_EQ(source.GetStats().concealed_frames, kPacketFrames);
+  }
+}
+
+TEST(DatagramSourceTest, DropsLateAndDuplicatePackets) {
+  DatagramSource source(UdpOptions());
+  ASSERT_EQ(source.Open(), helper::kOk);
+  Sender sender(source.GetLocalPort());
+  for (uint32_t i : {0, 1, 2}) {
+    sender.Send(Rtp(i, i * kPacketFrames,
+                    Frames(i * kPacketFrames, kPacketFrames)));
+  }
+  WaitForPackets(source, 3);
+  EXPECT_EQ(Play(source, 2 * kPacketFrames), Frames(0, 2 * kPacketFrames));
+
+  // The first is already played; the third is here already.
+  sender.Send(Rtp(0, 0, Frames(0, kPacketFrames)));
+  sender.Send(Rtp(2, 2 * kPacketFrames,
+                  Frames(2 * kPacketFrames, kPacketFrames)));
+  sender.Send(Rtp(3, 3 * kPacketFrames,
+                  Frames(3 * kPacketFrames, kPacketFrames)));
+  WaitForPackets(source, 6);
+  auto stats = source.GetStats();
+  EXPECT_EQ(stats.late, 1u);
+  EXPECT_EQ(stats.duplicates, 1u);
+  EXPECT_EQ(stats.buffered_frames, 2 * kPacketFrames);
+  EXPECT_EQ(Play(source, 2 * kPacketFrames),
+            Frames(2 * kPacketFrames, 2 * kPacketFrames));
+}
+
+TEST(DatagramSourceTest, BuffersAgainAfterAnUnderrun) {
+  DatagramSource source(UdpOptions());
+  ASSERT_EQ(source.Open(), helper::kOk);
+  Sender sender(source.GetLocalPort());
+  const uint8_t* data;
+  // Waiting for the first audio is not an underrun.
+  EXPECT_EQ(source.Next(4096, data), 0u);
+  EXPECT_EQ(source.GetStats().underruns, 0u);
+
+  sender.Send(Raw(Frames(0, kPacketFrames)));
+  WaitForPackets(source, 1);
+  EXPECT_EQ(Play(source, kPacketFrames), Frames(0, kPacketFrames));
+  EXPECT_EQ(source.Next(4096, data), 0u);
+  EXPECT_FALSE(source.AtEnd());
+  EXPECT_EQ(source.GetStats().underruns, 1u);
+
+  sender.Send(Raw(Frames(kPacketFrames, kPacketFrames)));
+  WaitForPackets(source, 2);
+  EXPECT_EQ(Play(source, kPacketFrames), Frames(kPacketFrames, kPacketFrames));
+  EXPECT_EQ(source.GetStats().underruns, 1u);
+}
+
+TEST(DatagramSourceTest, DropsTheOldestAudioPastMaxDepth) {
+  auto options = UdpOptions();
+  options.max_depth = std::chrono::milliseconds(50);
+  DatagramSource source(options);
+  ASSERT_EQ(source.Open(), helper::kOk);
+  Sender sender(source.GetLocalPort());
+  for (size_t i = 0; i < 20; ++i) {
+    sender.Send(Raw(Frames(i * kPacketFrames, kPacketFrames)));
+  }
+  WaitForPackets(source, 20);
+
+  // 50 ms is 2205 frames.
+  auto stats = source.GetStats();
+  EXPECT_EQ(stats.buffered_frames, 2205u);
+  EXPECT_EQ(stats.overflow_frames, 20 * kPacketFrames - 2205);
+  EXPECT_EQ(Play(source, 2205), Frames(20 * kPacketFrames - 2205, 2205));
+}
+
+TEST(DatagramSourceTest, OpenAudioSourceListensOnUnixSockets) {
+  std::string path =
+      testing::TempDir() + "datagram_source_" + std::to_string(getpid());
+  std::unique_ptr<audio::AudioSource> source;
+  ASSERT_EQ(audio::OpenAudioSource("unix://" + path, source), helper::kOk);
+  auto* datagrams = dynamic_cast<DatagramSource*>(source.get());
+  ASSERT_NE(datagrams, nullptr);
+
+  int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  for (size_t i = 0; i < 8; ++i) {
+    auto packet = Raw(Frames(i * kPacketFrames, kPacketFrames));
+    ASSERT_EQ(sendto(fd, packet.data(), packet.size(), 0,
+                     reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)),
+              static_cast<ssize_t>(packet.size()));
+  }
+  close(fd);
+  WaitForPackets(*datagrams, 8);
+  EXPECT_EQ(Play(*source, 8 * kPacketFrames), Frames(0, 8 * kPacketFrames));
+
+  source.reset();
+  // The socket file goes with the source.
+  EXPECT_NE(access(path.c_str(), F_OK), 0);
+}
@@ -0,0 +1,113 @@
+#include "discovery/dns_message.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using namespace AirBeamCore::discovery;
+
+namespace {
+DnsMessage Decode(const std::string& packet) {
+  DnsMessage message;
+  EXPECT_TRUE(DecodeDnsMessage(
+      reinterpret_cast<const uint8_t*>(packet.data()), packet.size(),
+      message));
+  return message;
+}
+}  // namespace
+
+TEST(DnsMessageTest, RoundTripsRecordsWithCompression) {
+  const std::string instance = JoinDnsName({"00:11@Living.Room"}) +
+                               "._raop._tcp.local";
+  EXPECT_EQ(instance, "00:11@Living\\.Room._raop._tcp.local");
+
+  DnsMessage message;
+  message.id = 0x1234;
+  message.flags = DnsMessage::kResponseFlags;
+  message.questions.push_back({"_raop._tcp.local", RecordType::kPtr, true});
+  DnsRecord ptr;
+  ptr.name = "_raop._tcp.local";
+  ptr.type = RecordType::kPtr;
+  ptr.ttl = 4500;
+  ptr.target = instance;
+  DnsRecord srv;
+  srv.name = instance;
+  srv.type = RecordType::kSrv;
+  srv.cache_flush = true;
+  srv.ttl = 120;
+  srv.port = 7000;
+  srv.target = "living-room.local";
+  DnsRecord txt;
+  txt.name = instance;
+  txt.type = RecordType::kTxt;
+  txt.txt = {"cn=0,1", "et=0", "sr=44100"};
+  DnsRecord a;
+  a.name = "living-room.local";
+  a.type = RecordType::kA;
+  a.address = "192.168.1.20";
+  DnsRecord aaaa = a;
+  aaaa.type = RecordType::kAaaa;
+  aaaa.address = "fe80::1";
+  message.answers = {ptr};
+  message.additionals = {srv, txt, a, aaaa};
+
+  std::string packet = EncodeDnsMessage(message);
+  // Every repeat of a name is a 2-byte pointer.
+  EXPECT_LT(packet.size(), 200u);
+  DnsMessage decoded = Decode(packet);
+  EXPECT_EQ(decoded.id, 0x1234);
+  EXPECT_TRUE(decoded.IsResponse());
+  ASSERT_EQ(decoded.questions.size(), 1u);
+  EXPECT_TRUE(decoded.questions[0].unicast_response);
+  ASSERT_EQ(decoded.answers.size(), 1u);
+  EXPECT_EQ(decoded.answers[0].target, instance);
+  EXPECT_EQ(decoded.answers[0].ttl, 4500u);
+  ASSERT_EQ(decoded.additionals.size(), 4u);
+  EXPECT_EQ(decoded.additionals[0].name, instance);
+  EXPECT_TRUE(decoded.additionals[0].cache_flush);
+  EXPECT_EQ(decoded.additionals[0].port, 7000);
+  EXPECT_EQ(decoded.additionals[0].target, "living-room.local");
+  EXPECT_EQ(decoded.additionals[1].txt, txt.txt);
+  EXPECT_EQ(decoded.additionals[2].address, "192.168.1.20");
+  EXPECT_EQ(decoded.additionals[3].address, "fe80::1");
+
+  EXPECT_EQ(SplitDnsName(instance).front(), "00:11@Living.Room");
+  EXPECT_TRUE(DnsNameEquals("_RAOP._tcp.Local", "_raop._tcp.local"));
+}
+
+TEST(DnsMessageTest, SkipsUnknownTypesAndUnencodableRecords) {
+  DnsMessage message;
+  DnsRecord bad;
+  bad.name = "host.local";
+  bad.type = RecordType::kA;
+  bad.address = "not an address";
+  DnsRecord good = bad;
+  good.address = "10.0.0.1";
+  message.answers = {bad, good};
+  DnsMessage decoded = Decode(EncodeDnsMessage(message));
+  ASSERT_EQ(decoded.answers.size(), 1u);
+  EXPECT_EQ(decoded.answers[0].address, "10.0.0.1");
+
+  // An HINFO record (type 13) between two known ones.
+  std::string packet("\0\0\x84\0\0\0\0\x01\0\0\0\0", 12);
+  packet += std::string("\x04host\x05local\0", 12);
+  packet += std::string("\0\x0d\0\x01\0\0\0\x78\0\x02\0\0", 12);
+  EXPECT_TRUE(Decode(packet).answers.empty());
+}
+
+TEST(DnsMessageTest, RejectsMalformedPackets) {
+  DnsMessage message;
+  message.questions.push_back({"_raop._tcp.local", RecordType::kPtr});
+  std::string packet = EncodeDnsMessage(message);
+  DnsMessage decoded;
+  for (size_t len = 0; len < packet.size(); ++len) {
+    EXPECT_FALSE(DecodeDnsMessage(
+        reinterpret_cast<const uint8_t*>(packet.data()), len, decoded))
+        << len;
+  }
+
+  // A name that points at itself.
+  std::string loop("\0\0\0\0\0\x01\0\0\0\0\0\0\xc0\x0c\0\x0c\0\x01", 18);
+  EXPECT_FALSE(DecodeDnsMessage(reinterpret_cast<const uint8_t*>(loop.data()),
+                                loop.size(), decoded));
+}
@@ -0,0 +1,402 @@
+#include "fake_receiver.h"
+
+#include <gtest/gtest.h>
+#include <poll.h>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "raop/codec.h"
+#include "raop/group.h"
+#include "raop/raop.h"
+
+using namespace AirBeamCore;
+using namespace AirBeamCore::raop;
+using AirBeamTesting::FakeReceiver;
+
+namespace {
+// Host-order stereo frames whose sample values count up from start.
+RtpAudioPacketChunk RampChunk(int16_t start) {
+  RtpAudioPacketChunk pcm;
+  auto samples = reinterpret_cast<int16_t*>(pcm.data_);
+  for (size_t i = 0; i < kPCMChunkLength * 2; ++i) {
+    samples[i] = static_cast<int16_t>(start + i);
+  }
+  pcm.len_ = sizeof(pcm.data_);
+
+  RtpAudioPacketChunk encoded;
+  PCMCodec::Encode(pcm, encoded);
+  encoded.len_ = pcm.len_;
+  return encoded;
+}
+
+// Managed sessions spawn no threads, so nothing outlives the test.
+std::shared_ptr<Raop> StartManaged(uint32_t port) {
+  auto raop = std::make_shared<Raop>("127.0.0.1", port);
+  raop->SetManaged(true);
+  if (raop->StartSession() != helper::kOk) return nullptr;
+  raop->BeginStream(NtpTime::Now());
+  return raop;
+}
+
+bool Readable(int fd, int timeout_ms) {
+  pollfd pfd = {fd, POLLIN, 0};
+  return poll(&pfd, 1, timeout_ms) > 0;
+}
+}  // namespace
+
+TEST(FakeReceiverTest, ReceivesPacedStream) {
+  FakeReceiver receiver;
+  ASSERT_EQ(receiver.Start(), helper::kOk);
+  auto raop = StartManaged(receiver.GetPort());
+  ASSERT_NE(raop, nullptr);
+
+  constexpr int kPackets = 50;
+  for (int i = 0; i < kPackets; ++i) {
+    raop->AcceptFrame();
+    raop->SendChunk(RampChunk(static_cast<int16_t>(i * kPCMChunkLength * 2)));
+  }
+  ASSERT_TRUE(receiver.WaitForPackets(kPackets, std::chrono::seconds(1)));
+
+  std::vector<std::string> expected = {"OPTIONS", "ANNOUNCE", "SETUP",
+                                       "RECORD"};
+  EXPECT_EQ(receiver.GetMethods(), expected);
+  EXPECT_TRUE(receiver.IsRecording());
+
+  auto stats = receiver.GetStats();
+  EXPECT_EQ(stats.packets, kPackets);
+  EXPECT_EQ(stats.lost, 0);
+  EXPECT_EQ(stats.duplicates, 0);
+  EXPECT_GE(stats.syncs, 1);
+  EXPECT_EQ(stats.sync_latency, 11025);
+  EXPECT_GE(stats.startup_latency_us, 0);
+  EXPECT_LT(stats.startup_latency_us, 200000);
+  // A packet leaves once its frames have been captured, one chunk (8 ms)
+  // after its timestamp.
+  EXPECT_GT(stats.schedule_offset_p50_us, 0);
+  EXPECT_LT(stats.schedule_offset_p50_us, 50000);
+
+  auto packets = receiver.GetPackets();
+  EXPECT_TRUE(packets.front().marker);
+  for (size_t i = 1; i < packets.size(); ++i) {
+    EXPECT_EQ(static_cast<uint16_t>(packets[i].seq - packets[i - 1].seq), 1);
+    EXPECT_EQ(packets[i].timestamp - packets[i - 1].timestamp,
+              kPCMChunkLength);
+    EXPECT_FALSE(packets[i].marker);
+  }
+
+  auto raop_stats = raop->GetStats();
+  EXPECT_EQ(raop_stats.packets_sent, kPackets);
+  EXPECT_EQ(raop_stats.bytes_sent,
+            kPackets * (RtpAudioPacket::kHeaderSize + kPCMChunkLength * 4));
+  EXPECT_GE(raop_stats.syncs_sent, 1);
+  EXPECT_EQ(raop_stats.send_latency.count, kPackets);
+  EXPECT_EQ(raop_stats.pacing_error.count, kPackets);
+  // OPTIONS, ANNOUNCE, SETUP and RECORD.
+  EXPECT_EQ(raop_stats.rtsp_round_trip.count, 4);
+  EXPECT_GT(raop_stats.rtsp_round_trip.min, 0);
+
+  auto samples = receiver.GetSamples();
+  ASSERT_EQ(samples.size(), kPackets * kPCMChunkLength * 2);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    ASSERT_EQ(samples[i], static_cast<int16_t>(i)) << "sample " << i;
+  }
+}
+
+TEST(FakeReceiverTest, RecordsVolume) {
+  FakeReceiver receiver;
+  ASSERT_EQ(receiver.Start(), helper::kOk);
+  auto raop = StartManaged(receiver.GetPort());
+  ASSERT_NE(raop, nullptr);
+
+  raop->SetVolume(0);
+  EXPECT_EQ(receiver.GetStats().volume, -144);
+  EXPECT_EQ(receiver.GetMethods().back(), "SET_PARAMETER");
+}
+
+TEST(FakeReceiverTest, StopTearsDownSession) {
+  FakeReceiver receiver;
+  ASSERT_EQ(receiver.Start(), helper::kOk);
+  // Unmanaged, with timing, control and keepalive threads of its own.
+  Raop raop("127.0.0.1", receiver.GetPort());
+  ASSERT_EQ(raop.Start(), helper::kOk);
+  ASSERT_TRUE(receiver.IsRecording());
+
+  raop.Stop();
+  EXPECT_FALSE(receiver.IsRecording());
+  EXPECT_EQ(receiver.GetMethods().back(), "TEARDOWN");
+  EXPECT_FALSE(raop.IsConnected());
+}
+
+TEST(FakeReceiverTest, AnswersTimingThroughSender) {
+  FakeReceiver::Options options;
+  options.timing_interval = std::chrono::milliseconds(20);
+  FakeReceiver receiver(options);
+  ASSERT_EQ(receiver.Start(), helper::kOk);
+  auto raop = StartManaged(receiver.GetPort());
+  ASSERT_NE(raop, nullptr);
+
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(Readable(raop->GetTimingFd(), 1000));
+    ASSERT_EQ(raop->HandleTiming(), helper::kOk);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  auto stats = receiver.GetStats();
+  EXPECT_GE(stats.timing_replies, 3);
+  EXPECT_GE(stats.round_trip_us, 0);
+  // Same host, same clock.
+  EXPECT_LT(std::abs(stats.clock_offset_us), 10000);
+}
+
+TEST(FakeReceiverTest, StreamsOverIpv6Loopback) {
+  FakeReceiver::Options options;
+  options.ipv6 = true;
+  options.timing_interval = std::chrono::milliseconds(20);
+  FakeReceiver receiver(options);
+  ASSERT_EQ(receiver.Start(), helper::kOk);
+  auto raop = std::make_shared<Raop>("::1", receiver.GetPort());
+  raop->SetManaged(true);
+  ASSERT_EQ(raop->StartSession(), helper::kOk);
+  raop->BeginStream(NtpTime::Now());
+
+  for (int i = 0; i < 5; ++i) {
+    raop->AcceptFrame();
+    raop->SendChunk(RampChunk(0));
+  }
+  ASSERT_TRUE(receiver.WaitForPackets(5, std::chrono::seconds(1)));
+  ASSERT_TRUE(Readable(raop->GetTimingFd(), 1000));
+  EXPECT_EQ(raop->HandleTiming(), helper::kOk);
+
+  EXPECT_NE(receiver.GetSdp().find("c=IN IP6 ::1\r\n"), std::string::npos);
+  EXPECT_NE(receiver.GetSdp().find("o=iTunes "), std::string::npos);
+  EXPECT_EQ(receiver.GetSdp().find("IP4"), std::string::npos);
+  for (const auto& uri : receiver.GetUris()) {
+    if (uri != "*") EXPECT_EQ(uri.rfind("rtsp://[::1]/", 0), 0u) << uri;
+  }
+  EXPECT_EQ(receiver.GetStats().lost, 0);
+}
+
+TEST(FakeReceiverTest, RequestsRetransmitOfGap) {
+  FakeReceiver receiver;
+  ASSERT_EQ(receiver.Start(), helper::kOk);
+  auto raop = StartManaged(receiver.GetPort());
+  ASSERT_NE(raop, nullptr);
+
+  raop->SendChunk(RampChunk(0));
+  ASSERT_TRUE(receiver.WaitForPackets(1, std::chrono::seconds(1)));
+
+  // Skip two sequence numbers by hand.
+  RtpAudioPacket packet;
+  packet.data = RampChunk(0);
+  raop->NextPacketHeader(packet);
+  raop->NextPacketHeader(packet);
+  raop->NextPacketHeader(packet);
+  std::vector<uint8_t> buffer;
+  packet.Serialize(buffer);
+  helper::UDPServer injector;
+  ASSERT_EQ(injector.Bind(), helper::kOk);
+  ASSERT_EQ(injector.Write(raop->GetRemoteAudioAddr(),
+                           std::string(buffer.begin(), buffer.end())),
+            helper::kOk);
+  ASSERT_TRUE(receiver.WaitForPackets(2, std::chrono::seconds(1)));
+
+  auto stats = receiver.GetStats();
+  EXPECT_EQ(stats.lost, 2);
+  EXPECT_EQ(stats.retransmit_requests, 1);
+  ASSERT_TRUE(Readable(raop->GetControlFd(), 1000));
+  EXPECT_EQ(raop->HandleControl(), helper::kOk);
+  // The skipped packets were never sent, so there is nothing to resend.
+  EXPECT_EQ(raop->GetRetransmitStats().requests, 1);
+  EXPECT_EQ(raop->GetRetransmitStats().misses, 2);
+}
+
+TEST(FakeReceiverTest, ResyncAfterUnderrunMarksNewStream) {
+  FakeReceiver receiver;
+  ASSERT_EQ(receiver.Start(), helper::kOk);
+  auto raop = StartManaged(receiver.GetPort());
+  ASSERT_NE(raop, nullptr);
+  raop->SetUnderrunPolicy(UnderrunPolicy::kResync);
+
+  for (int i = 0; i < 5; ++i) {
+    raop->AcceptFrame();
+    raop->SendChunk(RampChunk(0));
+  }
+  RtpAudioPacketChunk empty;
+  empty.len_ = 0;
+  raop->SendChunk(empty);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  for (int i = 0; i < 5; ++i) {
+    raop->AcceptFrame();
+    raop->SendChunk(RampChunk(0));
+  }
+  ASSERT_TRUE(receiver.WaitForPackets(10, std::chrono::seconds(1)));
+
+  auto packets = receiver.GetPackets();
+  EXPECT_TRUE(packets[0].marker);
+  EXPECT_TRUE(packets[5].marker);
+  // The timeline jumped over the 50 ms gap.
+  EXPECT_GT(packets[5].timestamp - packets[4].timestamp,
+            kSampleRate44100 * 40 / 1000);
+  auto stats = receiver.GetStats();
+  EXPECT_EQ(stats.lost, 0);
+  EXPECT_GE(stats.syncs, 2);
+  EXPECT_EQ(raop->GetUnderrunStats().resyncs, 1);
+}
+
+TEST(FakeReceiverTest, SilenceFillKeepsTimelineContinuous) {
+  FakeReceiver receiver;
+  ASSERT_EQ(receiver.Start(), helper::kOk);
+  auto raop = StartManaged(receiver.GetPort());
+  ASSERT_NE(raop, nullptr);
+  raop->SetUnderrunPolicy(UnderrunPolicy::kSilenceFill);
+
+  RtpAudioPacketChunk empty;
+  empty.len_ = 0;
+  for (int i = 0; i < 6; ++i) {
+    raop->AcceptFrame();
+    raop->SendChunk(i % 2 == 0 ? RampChunk(1) : empty);
+  }
+  ASSERT_TRUE(receiver.WaitForPackets(6, std::chrono::seconds(1)));
+
+  auto packets = receiver.GetPackets();
+  for (size_t i = 1; i < packets.size(); ++i) {
+    EXPECT_EQ(packets[i].timestamp - packets[i - 1].timestamp,
+              kPCMChunkLength);
+    EXPECT_FALSE(packets[i].marker);
+  }
+  auto samples = receiver.GetSamples();
+  EXPECT_EQ(samples[kPCMChunkLength * 2], 0);
+  EXPECT_EQ(raop->GetUnderrunStats().silence_packets, 3);
+}
+
+TEST(FakeReceiverTest, GroupSharesTimelineAndLatency) {
+  FakeReceiver::Options fast_options;
+  fast_options.latency = 11025;
+  FakeReceiver fast(fast_options);
+  FakeReceiver::Options slow_options;
+  slow_options.latency = 22050;
+  FakeReceiver slow(slow_options);
+  ASSERT_EQ(fast.Start(), helper::kOk);
+  ASSERT_EQ(slow.Start(), helper::kOk);
+
+  std::vector<std::shared_ptr<Raop>> members;
+  for (uint32_t port : {fast.GetPort(), slow.GetPort()}) {
+    auto raop = std::make_shared<Raop>("127.0.0.1", port);
+    raop->SetManaged(true);
+    members.push_back(raop);
+  }
+  RaopGroup group(members);
+  ASSERT_EQ(group.Start(), helper::kOk);
+  EXPECT_EQ(group.GetLatency(), 22050);
+
+  constexpr int kPackets = 20;
+  for (int i = 0; i < kPackets; ++i) {
+    group.AcceptFrame();
+    group.SendChunk(RampChunk(static_cast<int16_t>(i)));
+  }
+  ASSERT_TRUE(fast.WaitForPackets(kPackets, std::chrono::seconds(1)));
+  ASSERT_TRUE(slow.WaitForPackets(kPackets, std::chrono::seconds(1)));
+
+  EXPECT_EQ(fast.GetStats().sync_latency, 22050);
+  EXPECT_EQ(slow.GetStats().sync_latency, 22050);
+  auto fast_packets = fast.GetPackets();
+  auto slow_packets = slow.GetPackets();
+  for (int i = 0; i < kPackets; ++i) {
+    EXPECT_EQ(fast_packets[i].timestamp, slow_packets[i].timestamp);
+  }
+  EXPECT_EQ(fast.GetSamples(), slow.GetSamples());
+}
+
+TEST(FakeReceiverTest, GroupDropsMembersOfAnotherFormat) {
+  FakeReceiver first, other;
+  ASSERT_EQ(first.Start(), helper::kOk);
+  ASSERT_EQ(other.Start(), helper::kOk);
+  auto matching = std::make_shared<Raop>("127.0.0.1", first.GetPort());
+  matching->SetManaged(true);
+  auto mismatched = std::make_shared<Raop>("127.0.0.1", other.GetPort());
+  mismatched->SetManaged(true);
+  ASSERT_EQ(mismatched->SetReceiverCapabilities(
+                discovery::RaopCapabilities::FromTxt({{"sr", "48000"}})),
+            helper::kOk);
+
+  RaopGroup group({matching, mismatched});
+  ASSERT_EQ(group.Start(), helper::kOk);
+  EXPECT_EQ(group.Size(), 1u);
+  EXPECT_EQ(group.GetStreamFormat(), matching->GetStreamFormat());
+  // Dropped before its handshake.
+  EXPECT_TRUE(other.GetMethods().empty());
+
+  RtpAudioPacketChunk empty;
+  empty.len_ = 0;
+  group.SendChunk(empty);
+  ASSERT_TRUE(first.WaitForPackets(1, std::chrono::seconds(1)));
+  EXPECT_EQ(first.GetStats().payload_bytes,
+            group.GetStreamFormat().PacketBytes());
+}
+
+TEST(FakeReceiverTest, GroupAnswersRetransmits) {
+  FakeReceiver receiver;
+  ASSERT_EQ(receiver.Start(), helper::kOk);
+  auto member = std::make_shared<Raop>("127.0.0.1", receiver.GetPort());
+  member->SetManaged(true);
+  RaopGroup group({member});
+  ASSERT_EQ(group.Start(), helper::kOk);
+  for (int i = 0; i < 3; ++i) {
+    group.AcceptFrame();
+    group.SendChunk(RampChunk(static_cast<int16_t>(i)));
+  }
+  ASSERT_TRUE(receiver.WaitForPackets(3, std::chrono::seconds(1)));
+  const uint16_t first_seq = receiver.GetPackets()[0].seq;
+
+  // Ask for the first two, as a receiver that lost them would.
+  RtpLostPacket request;
+  request.header = {0x80, 0x80 | 0x55, 1};
+  request.seq_number = first_seq;
+  request.n = 2;
+  uint8_t buffer[RtpLostPacket::kSize];
+  request.Serialize(buffer);
+  sockaddr_in ctrl{};
+  socklen_t len = sizeof(ctrl);
+  ASSERT_EQ(getsockname(member->GetControlFd(),
+                        reinterpret_cast<sockaddr*>(&ctrl), &len),
+            0);
+  helper::UDPServer injector;
+  ASSERT_EQ(injector.Bind(), helper::kOk);
+  ASSERT_EQ(injector.Write({"127.0.0.1", ntohs(ctrl.sin_port)},
+                           std::string(reinterpret_cast<char*>(buffer),
+                                       sizeof(buffer))),
+            helper::kOk);
+  ASSERT_TRUE(Readable(member->GetControlFd(), 1000));
+  EXPECT_EQ(member->HandleControl(), helper::kOk);
+  EXPECT_EQ(member->GetRetransmitStats().packets, 2);
+  EXPECT_EQ(member->GetRetransmitStats().misses, 0);
+
+  // The receiver never lost them, so both arrive as duplicates.
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (receiver.GetStats().duplicates < 2 &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(receiver.GetStats().duplicates, 2);
+}
+
+TEST(FakeReceiverTest, RejectsUnknownMethod) {
+  FakeReceiver receiver;
+  ASSERT_EQ(receiver.Start(), helper::kOk);
+  RTSPClient client;
+  ASSERT_EQ(client.Connect("127.0.0.1", receiver.GetPort()), helper::kOk);
+  auto request = RtspMsgBuilder<RtspReqMessage>()
+                     .SetMethod("DESCRIBE")
+                     .SetUri("*")
+                     .AddHeader("CSeq", "3")
+                     .Build();
+  RtspRespMessage response;
+  ASSERT_EQ(client.DoRequest(request, response), helper::kOk);
+  EXPECT_EQ(response.GetStartLine(), "RTSP/1.0 501 Not Implemented");
+  EXPECT_EQ(response.GetHeader("CSeq"), "3");
+}
@@ -123,4 +123,51 @@ TEST(ConcurrentByteFIFOTest, ReadTimeoutWhenEmpty) {
   EXPECT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
                 .count(),
             25);
-}
\ No newline at end of file
+}
+
+TEST(ConcurrentByteFIFOTest, TimeoutBoundsTheWholeRead) {
+  ConcurrentByteFIFO fifo(8);
+  // One byte every 10 ms: each wait is shorter than the timeout, the whole
+  // read is not.
+  std::thread writer([&fifo]() {
+    for (uint8_t i = 0; i < 8; ++i) {
+      fifo.Write(&i, 1);
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  });
+  uint8_t buf[8];
+  auto start = std::chrono::steady_clock::now();
+  size_t read = fifo.Read(buf, 8, std::chrono::milliseconds(25));
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  writer.join();
+  EXPECT_GT(read, 0);
+  EXPECT_LT(read, 8);
+  EXPECT_LT(elapsed, std::chrono::milliseconds(60));
+}
+
+TEST(ConcurrentByteFIFOTest, ReadFullIsAllOrNothing) {
+  ConcurrentByteFIFO fifo(8);
+  std::vector<uint8_t> input = {1, 2, 3, 4, 5, 6};
+  fifo.Write(input.data(), 2);
+
+  uint8_t buf[4] = {0};
+  EXPECT_EQ(fifo.ReadFull(buf, 4, std::chrono::milliseconds(20)), 0);
+  EXPECT_EQ(fifo.Size(), 2);
+
+  std::thread writer([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    fifo.Write(input.data() + 2, 4);
+  });
+  EXPECT_EQ(fifo.ReadFull(buf, 4, std::chrono::milliseconds(500)), 4);
+  writer.join();
+  EXPECT_EQ(std::vector<uint8_t>(buf, buf + 4),
+            std::vector<uint8_t>(input.begin(), input.begin() + 4));
+  EXPECT_EQ(fifo.Size(), 2);
+  // Wraps around the end of the ring.
+  fifo.Write(input.data(), 6);
+  uint8_t all[8];
+  EXPECT_EQ(fifo.ReadFull(all, 8, std::chrono::milliseconds(20)), 8);
+  EXPECT_EQ(all[0], 5);
+  EXPECT_EQ(all[7], 6);
+  EXPECT_EQ(fifo.ReadFull(all, 9, std::chrono::milliseconds(1)), 0);
+}
@@ -0,0 +1,181 @@
+#include "audio/flac_decoder.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "audio_files.h"
+
+using namespace AirBeamCore;
+using AirBeamCore::audio::FlacDecoder;
+using AirBeamTesting::FlacOptions;
+
+namespace {
+std::string WriteFile(const std::string& name, const std::string& contents) {
+  std::string path =
+      testing::TempDir() + name + "_" + std::to_string(getpid()) + ".flac";
+  std::ofstream out(path, std::ios::binary);
+  out << contents;
+  return path;
+}
+
+std::vector<int16_t> ReadAll(FlacDecoder& decoder, size_t chunk) {
+  std::vector<int16_t> samples;
+  const uint8_t* data;
+  while (size_t len = decoder.Next(chunk, data)) {
+    size_t old_size = samples.size();
+    samples.resize(old_size + len / 2);
+    memcpy(samples.data() + old_size, data, len);
+  }
+  return samples;
+}
+
+// A two-tone signal with some noise, a silent stretch (CONSTANT subframes)
+// and a stretch of only even values (wasted bits).
+std::vector<int32_t> Music(size_t frames, int channels, int bits) {
+  std::vector<int32_t> samples(frames * channels);
+  double peak = std::ldexp(0.45, bits - 1);
+  uint32_t noise = 12345;
+  for (size_t i = 0; i < frames; ++i) {
+    for (int c = 0; c < channels; ++c) {
+      noise = noise * 1103515245 + 12345;
+      double value = peak * std::sin(i * (0.01 + 0.003 * c)) +
+                     peak * std::sin(i * 0.173) * 0.5 +
+                     peak * 0.05 * ((noise >> 16) / 32768.0 - 1);
+      auto sample = static_cast<int32_t>(value);
+      if (i >= 5000 && i < 9200) sample = 0;
+      if (i >= 9200 && i < 13300) sample &= ~3;
+      samples[i * channels + c] = sample;
+    }
+  }
+  return samples;
+}
+
+std::vector<int16_t> Expected(const std::vector<int32_t>& samples,
+                              int channels, int bits) {
+  std::vector<int16_t> out;
+  for (size_t i = 0; i < samples.size(); i += channels) {
+    for (int c = 0; c < 2; ++c) {
+      int32_t sample = samples[i + (channels > 1 ? c : 0)];
+      out.push_back(static_cast<int16_t>(
+          bits >= 16 ? sample >> (bits - 16) : sample * (1 << (16 - bits))));
+    }
+  }
+  return out;
+}
+
+constexpr size_t kFrames = 20'000;
+}  // namespace
+
+TEST(FlacDecoderTest, DecodesEverySubframeTypeAndStereoMode) {
+  for (auto subframe :
+       {FlacOptions::Subframe::kVerbatim, FlacOptions::Subframe::kFixed,
+        FlacOptions::Subframe::kLpc}) {
+    for (auto stereo :
+         {FlacOptions::Stereo::kIndependent, FlacOptions::Stereo::kLeftSide,
+          FlacOptions::Stereo::kSideRight, FlacOptions::Stereo::kMidSide}) {
+      for (int order = 0; order <= 4; ++order) {
+        if (subframe == FlacOptions::Subframe::kVerbatim && order > 0) break;
+        FlacOptions options;
+        options.subframe = subframe;
+        options.stereo = stereo;
+        options.order = order;
+        auto samples = Music(kFrames, 2, 16);
+        std::string path =
+            WriteFile("flac", AirBeamTesting::EncodeFlac(samples, 2, options));
+        FlacDecoder decoder;
+        ASSERT_EQ(decoder.Open(path), helper::kOk);
+        EXPECT_EQ(decoder.GetTotalFrames(), kFrames);
+        ASSERT_EQ(ReadAll(decoder, 1000), Expected(samples, 2, 16))
+            << "subframe " << static_cast<int>(subframe) << " stereo "
+            << static_cast<int>(stereo) << " order " << order;
+        EXPECT_EQ(decoder.GetCorruptFrames(), 0u);
+      }
+    }
+  }
+}
+
+TEST(FlacDecoderTest, DecodesOtherWidthsRatesAndLayouts) {
+  struct Case {
+    int channels;
+    int bits;
+    uint32_t sample_rate;
+    uint32_t block_size;
+    bool escape;
+  } cases[] = {
+      {2, 24, 96'000, 4608, false}, {1, 16, 48'000, 1152, false},
+      {2, 8, 22'050, 200, false},   {2, 16, 44'100, 4096, true},
+      {3, 20, 44'100, 1000, false}, {2, 24, 44'100, 4096, true},
+  };
+  for (const auto& test : cases) {
+    FlacOptions options;
+    options.bits = test.bits;
+    options.sample_rate = test.sample_rate;
+    options.block_size = test.block_size;
+    options.escape = test.escape;
+    options.stereo = FlacOptions::Stereo::kMidSide;
+    options.padding = 100;
+    auto samples = Music(kFrames, test.channels, test.bits);
+    std::string path = WriteFile(
+        "flac_formats",
+        AirBeamTesting::EncodeFlac(samples, test.channels, options));
+    FlacDecoder decoder;
+    ASSERT_EQ(decoder.Open(path), helper::kOk);
+    EXPECT_EQ(decoder.GetInputFormat().sample_rate, test.sample_rate);
+    EXPECT_EQ(decoder.GetInputFormat().channels, test.channels);
+    EXPECT_EQ(decoder.GetInputFormat().bits, test.bits);
+    EXPECT_EQ(ReadAll(decoder, 4096),
+              Expected(samples, test.channels, test.bits))
+        << test.channels << " channels, " << test.bits << " bits";
+  }
+}
+
+TEST(FlacDecoderTest, SkipsCorruptFramesAndRewinds) {
+  FlacOptions options;
+  options.block_size = 1024;
+  auto samples = Music(kFrames, 2, 16);
+  std::string flac = AirBeamTesting::EncodeFlac(samples, 2, options);
+  // Damage the channel assignment of the third frame, which starts where
+  // a stream of the first two would end.
+  size_t offset = AirBeamTesting::EncodeFlac(
+                      {samples.begin(), samples.begin() + 2 * 1024 * 2}, 2,
+                      options)
+                      .size();
+  ASSERT_EQ(static_cast<uint8_t>(flac[offset]), 0xFF);
+  flac[offset + 3] ^= 0x10;
+  std::string path = WriteFile("flac_corrupt", flac);
+
+  FlacDecoder decoder;
+  ASSERT_EQ(decoder.Open(path), helper::kOk);
+  auto out = ReadAll(decoder, 4096);
+  auto expected = Expected(samples, 2, 16);
+  // The third frame is gone, everything else decodes. Sync codes found
+  // inside it also count.
+  EXPECT_GE(decoder.GetCorruptFrames(), 1u);
+  ASSERT_EQ(out.size(), expected.size() - 1024 * 2);
+  expected.erase(expected.begin() + 2 * 1024 * 2,
+                 expected.begin() + 3 * 1024 * 2);
+  EXPECT_EQ(out, expected);
+
+  ASSERT_EQ(decoder.Rewind(), helper::kOk);
+  EXPECT_EQ(ReadAll(decoder, 999 * 4), out);
+}
+
+TEST(FlacDecoderTest, SkipsAnId3Tag) {
+  auto samples = Music(3000, 2, 16);
+  std::string tag("ID3\x04\x00\x00\x00\x00\x01\x05", 10);
+  tag.append(133, 'x');
+  std::string path = WriteFile(
+      "flac_id3", tag + AirBeamTesting::EncodeFlac(samples, 2, FlacOptions()));
+  FlacDecoder decoder;
+  ASSERT_EQ(decoder.Open(path), helper::kOk);
+  EXPECT_EQ(ReadAll(decoder, 4096), Expected(samples, 2, 16));
+
+  std::string short_info("fLaC\x80\0\0\x02xx", 10);
+  EXPECT_NE(decoder.Open(WriteFile("flac_bad", short_info)), helper::kOk);
+}
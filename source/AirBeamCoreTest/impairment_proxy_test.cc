@@ -0,0 +1,144 @@
+#include "impairment_proxy.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "fake_receiver.h"
+#include "fmt/core.h"
+#include "raop/raop.h"
+#include "raop/session_manager.h"
+
+using namespace AirBeamCore;
+using namespace AirBeamCore::raop;
+using namespace AirBeamTesting;
+
+namespace {
+struct ScenarioResult {
+  FakeReceiver::Stats receiver;
+  ImpairmentProxy::Stats proxy;
+  RetransmitStats sender;
+};
+
+void SilenceSource(RtpAudioPacketChunk& chunk) {
+  memset(chunk.data_, 0, sizeof(chunk.data_));
+  chunk.len_ = sizeof(chunk.data_);
+}
+
+// Streams one second of silence from a managed session through the proxy
+// and prints one report line for the profile.
+ScenarioResult RunScenario(const std::string& name,
+                           const ImpairmentProfile& forward) {
+  ScenarioResult result;
+  FakeReceiver receiver;
+  EXPECT_EQ(receiver.Start(), helper::kOk);
+  ImpairmentProxy::Options options;
+  options.forward = forward;
+  ImpairmentProxy proxy("127.0.0.1", receiver.GetPort(), options);
+  EXPECT_EQ(proxy.Start(), helper::kOk);
+
+  SessionManager::Options manager_options;
+  manager_options.workers = 1;
+  SessionManager manager(manager_options);
+  auto raop = std::make_shared<Raop>("127.0.0.1", proxy.GetPort());
+  SessionManager::SessionId id;
+  EXPECT_EQ(manager.Add(raop, SilenceSource, id), helper::kOk);
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  manager.Remove(id);
+  // Late retransmits and delayed datagrams still in flight.
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  result.receiver = receiver.GetStats();
+  result.proxy = proxy.GetStats();
+  result.sender = raop->GetRetransmitStats();
+  proxy.Stop();
+  receiver.Stop();
+
+  const auto& r = result.receiver;
+  std::cout << fmt::format(
+                   "[{:>10}] packets={} dropped={} lost={} recovered={} "
+                   "recovery_p50_us={} recovery_max_us={} audible_gaps={} "
+                   "dup={} ooo={} jitter_us={:.0f} rtx_req={} rtx_sent={} "
+                   "rtx_miss={}",
+                   name, r.packets,
+                   result.proxy.forward.dropped +
+                       result.proxy.forward.queue_dropped,
+                   r.lost, r.recovered, r.recovery_p50_us, r.recovery_max_us,
+                   r.audible_gaps, r.duplicates, r.out_of_order, r.jitter_us,
+                   result.sender.requests, result.sender.packets,
+                   result.sender.misses)
+            << std::endl;
+  return result;
+}
+}  // namespace
+
+TEST(ImpairmentProxyTest, CleanLink) {
+  auto result = RunScenario("clean", ImpairmentProfile());
+  EXPECT_GT(result.receiver.packets, 100);
+  EXPECT_EQ(result.receiver.lost, 0);
+  EXPECT_EQ(result.receiver.audible_gaps, 0);
+  EXPECT_EQ(result.sender.requests, 0);
+}
+
+TEST(ImpairmentProxyTest, RandomLossIsRecovered) {
+  ImpairmentProfile profile;
+  profile.loss = 0.05;
+  auto result = RunScenario("bernoulli", profile);
+  ASSERT_GT(result.proxy.forward.dropped, 0);
+  EXPECT_GT(result.sender.packets, 0);
+  EXPECT_GT(result.receiver.recovered, 0);
+  // Retransmits can be lost too, but most gaps close in time.
+  EXPECT_LE(result.receiver.audible_gaps, result.proxy.forward.dropped / 2);
+}
+
+TEST(ImpairmentProxyTest, BurstLossIsRecovered) {
+  ImpairmentProfile profile;
+  profile.ge_good_to_bad = 0.02;
+  profile.ge_bad_to_good = 0.3;
+  auto result = RunScenario("burst", profile);
+  ASSERT_GT(result.proxy.forward.dropped, 0);
+  EXPECT_GT(result.receiver.recovered, 0);
+}
+
+TEST(ImpairmentProxyTest, JitterAndReorder) {
+  ImpairmentProfile profile;
+  profile.delay = std::chrono::milliseconds(5);
+  profile.jitter = std::chrono::milliseconds(5);
+  profile.reorder = 0.05;
+  auto result = RunScenario("reorder", profile);
+  EXPECT_GT(result.receiver.out_of_order, 0);
+  EXPECT_GT(result.receiver.jitter_us, 100);
+  // Nothing is dropped, and 20 ms of reordering is well within the latency.
+  EXPECT_EQ(result.receiver.audible_gaps, 0);
+}
+
+TEST(ImpairmentProxyTest, Duplication) {
+  ImpairmentProfile profile;
+  profile.duplicate = 0.1;
+  auto result = RunScenario("duplicate", profile);
+  EXPECT_GT(result.receiver.duplicates, 0);
+  EXPECT_EQ(result.receiver.audible_gaps, 0);
+}
+
+TEST(ImpairmentProxyTest, BandwidthCap) {
+  // 16-bit stereo at 44.1 kHz is 1.41 Mbps before headers.
+  ImpairmentProfile roomy;
+  roomy.bandwidth_bps = 2'000'000;
+  auto fits = RunScenario("cap 2M", roomy);
+  EXPECT_EQ(fits.proxy.forward.queue_dropped, 0);
+  EXPECT_EQ(fits.receiver.audible_gaps, 0);
+
+  ImpairmentProfile tight;
+  tight.bandwidth_bps = 1'000'000;
+  tight.queue_bytes = 16 * 1024;
+  auto starved = RunScenario("cap 1M", tight);
+  // Retransmits cover the deficit for a while, but they share the link, so
+  // the backlog only grows.
+  EXPECT_GT(starved.proxy.forward.queue_dropped, 0);
+  EXPECT_GT(starved.sender.requests, 0);
+}
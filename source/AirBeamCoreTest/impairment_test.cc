@@ -0,0 +1,123 @@
+#include "impairment.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace AirBeamTesting;
+
+namespace {
+constexpr int64_t kMs = 1'000'000;
+
+// Feeds n datagrams 8 ms apart and returns which ones got through.
+std::vector<bool> Deliveries(Impairment& impairment, int n) {
+  std::vector<bool> delivered;
+  std::vector<int64_t> release_ns;
+  for (int i = 0; i < n; ++i) {
+    release_ns.clear();
+    impairment.Apply(1420, i * 8 * kMs, release_ns);
+    delivered.push_back(!release_ns.empty());
+  }
+  return delivered;
+}
+}  // namespace
+
+TEST(ImpairmentTest, PerfectLinkPassesThrough) {
+  Impairment impairment(ImpairmentProfile(), 1);
+  std::vector<int64_t> release_ns;
+  impairment.Apply(100, 42, release_ns);
+  ASSERT_EQ(release_ns.size(), 1);
+  EXPECT_EQ(release_ns[0], 42);
+}
+
+TEST(ImpairmentTest, BernoulliLossRate) {
+  ImpairmentProfile profile;
+  profile.loss = 0.1;
+  Impairment impairment(profile, 7);
+  Deliveries(impairment, 20000);
+  double rate = static_cast<double>(impairment.GetStats().dropped) / 20000;
+  EXPECT_NEAR(rate, 0.1, 0.01);
+}
+
+TEST(ImpairmentTest, SameSeedSameDecisions) {
+  ImpairmentProfile profile;
+  profile.loss = 0.3;
+  Impairment a(profile, 99);
+  Impairment b(profile, 99);
+  Impairment c(profile, 100);
+  auto da = Deliveries(a, 500);
+  EXPECT_EQ(da, Deliveries(b, 500));
+  EXPECT_NE(da, Deliveries(c, 500));
+}
+
+TEST(ImpairmentTest, GilbertElliottLosesInBursts) {
+  ImpairmentProfile profile;
+  profile.ge_good_to_bad = 0.02;
+  profile.ge_bad_to_good = 0.25;
+  Impairment impairment(profile, 3);
+  auto delivered = Deliveries(impairment, 50000);
+
+  int bursts = 0;
+  int lost = 0;
+  for (size_t i = 0; i < delivered.size(); ++i) {
+    if (delivered[i]) continue;
+    lost++;
+    if (i == 0 || delivered[i - 1]) bursts++;
+  }
+  ASSERT_GT(bursts, 0);
+  // Mean sojourn in the bad state is 1 / ge_bad_to_good packets.
+  EXPECT_NEAR(static_cast<double>(lost) / bursts, 4.0, 0.5);
+  // Stationary loss is p / (p + r).
+  EXPECT_NEAR(static_cast<double>(lost) / delivered.size(), 0.02 / 0.27,
+              0.01);
+}
+
+TEST(ImpairmentTest, DelayJitterAndReorder) {
+  ImpairmentProfile profile;
+  profile.delay = std::chrono::milliseconds(10);
+  profile.jitter = std::chrono::milliseconds(4);
+  profile.reorder = 0.5;
+  profile.reorder_delay = std::chrono::milliseconds(30);
+  Impairment impairment(profile, 5);
+
+  std::vector<int64_t> release_ns;
+  for (int i = 0; i < 1000; ++i) {
+    release_ns.clear();
+    impairment.Apply(100, 0, release_ns);
+    ASSERT_EQ(release_ns.size(), 1);
+    int64_t extra = release_ns[0] - 10 * kMs;
+    EXPECT_GE(extra, 0);
+    EXPECT_TRUE(extra <= 4 * kMs ||
+                (extra >= 30 * kMs && extra <= 34 * kMs));
+  }
+  EXPECT_NEAR(impairment.GetStats().reordered, 500, 60);
+}
+
+TEST(ImpairmentTest, DuplicatesCopies) {
+  ImpairmentProfile profile;
+  profile.duplicate = 1;
+  Impairment impairment(profile, 1);
+  std::vector<int64_t> release_ns;
+  impairment.Apply(100, 0, release_ns);
+  EXPECT_EQ(release_ns.size(), 2);
+  EXPECT_EQ(impairment.GetStats().duplicated, 1);
+}
+
+TEST(ImpairmentTest, BandwidthSerializesAndTailDrops) {
+  ImpairmentProfile profile;
+  profile.bandwidth_bps = 8'000'000;  // 1 byte per microsecond.
+  profile.queue_bytes = 3000;
+  Impairment impairment(profile, 1);
+
+  std::vector<int64_t> release_ns;
+  for (int i = 0; i < 4; ++i) impairment.Apply(1000, 0, release_ns);
+  ASSERT_EQ(release_ns.size(), 3);
+  EXPECT_EQ(release_ns[0], 1'000'000);
+  EXPECT_EQ(release_ns[1], 2'000'000);
+  EXPECT_EQ(release_ns[2], 3'000'000);
+  EXPECT_EQ(impairment.GetStats().queue_dropped, 1);
+
+  // Once the queue drains there is room again.
+  impairment.Apply(1000, 3'000'000, release_ns);
+  EXPECT_EQ(release_ns.back(), 4'000'000);
+}
@@ -0,0 +1,156 @@
+#include "helper/logger.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace AirBeamCore::helper;
+
+namespace {
+template <typename... Args>
+std::string Render(const char* format, const Args&... args) {
+  LogRecord record;
+  record.format = format;
+  (record.EncodeArg(args), ...);
+  return record.Format();
+}
+
+// Collects what reaches the sink; the logger is process wide, so every test
+// restores the default sink and level.
+class LoggerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    Logger::Flush();
+    saved_level_ = Logger::GetLevel();
+    Logger::SetLevel(LogLevel::kDebug);
+    Logger::SetSink([this](LogLevel level, const std::string& line) {
+      std::lock_guard guard(mtx_);
+      lines_.push_back(line);
+    });
+  }
+
+  void TearDown() override {
+    Logger::Flush();
+    Logger::SetSink(nullptr);
+    Logger::SetLevel(saved_level_);
+  }
+
+  std::vector<std::string> Lines() {
+    Logger::Flush();
+    std::lock_guard guard(mtx_);
+    return lines_;
+  }
+
+  LogLevel saved_level_;
+  std::mutex mtx_;
+  std::vector<std::string> lines_;
+};
+}  // namespace
+
+TEST(LogRecordTest, FormatsLikePrintf) {
+  EXPECT_EQ(Render("%d %u %s", -3, 7u, "abc"), "-3 7 abc");
+  EXPECT_EQ(Render("%lu|%5.2f|%%|%-4s|", 42ul, 3.14159, "x"),
+            "42| 3.14|%|x   |");
+  EXPECT_EQ(Render("%x %04X %c", 255, 10u, 'A'), "ff 000A A");
+  EXPECT_EQ(Render("%s", std::string("string")), "string");
+  EXPECT_EQ(Render("%s", static_cast<const char*>(nullptr)), "(null)");
+  EXPECT_EQ(Render("%d %d", 1), "1 <missing>");
+
+  int value = 0;
+  char expected[32];
+  snprintf(expected, sizeof(expected), "%p", static_cast<void*>(&value));
+  EXPECT_EQ(Render("%p", &value), expected);
+}
+
+TEST(LogRecordTest, TruncatesLongArguments) {
+  std::string long_string(LogRecord::kPayloadSize * 2, 'a');
+  LogRecord record;
+  record.format = "%s %d";
+  record.EncodeArg(long_string);
+  record.EncodeArg(1);
+  EXPECT_TRUE(record.truncated);
+  std::string text = record.Format();
+  EXPECT_LT(text.size(), long_string.size());
+  EXPECT_NE(text.find("<truncated>"), std::string::npos);
+}
+
+TEST_F(LoggerTest, FiltersByLevel) {
+  Logger::SetLevel(LogLevel::kWarning);
+  ABDebugLog("debug %d", 1);
+  ABInfoLog("info %d", 2);
+  ABWarningLog("warning %d", 3);
+  ABErrorLog("error %d", 4);
+
+  auto lines = Lines();
+  ASSERT_EQ(lines.size(), 2u);
+  EXPECT_NE(lines[0].find("[AirBeam][W]"), std::string::npos);
+  EXPECT_NE(lines[0].find("logger_test.cc:"), std::string::npos);
+  EXPECT_NE(lines[0].find("warning 3"), std::string::npos);
+  EXPECT_NE(lines[1].find("[AirBeam][E]"), std::string::npos);
+}
+
+TEST_F(LoggerTest, SkipsArgumentsBelowLevel) {
+  Logger::SetLevel(LogLevel::kOff);
+  int evaluated = 0;
+  ABErrorLog("%d", ++evaluated);
+  EXPECT_EQ(evaluated, 0);
+  EXPECT_TRUE(Lines().empty());
+}
+
+TEST_F(LoggerTest, DeliversFromManyThreads) {
+  constexpr int kThreads = 4;
+  constexpr int kPerThread = 200;
+  uint64_t dropped = Logger::Dropped();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([t]() {
+      for (int i = 0; i < kPerThread; ++i) {
+        ABInfoLog("thread %d line %d", t, i);
+        if (i % 32 == 0) std::this_thread::yield();
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  EXPECT_EQ(Lines().size() + (Logger::Dropped() - dropped),
+            static_cast<size_t>(kThreads * kPerThread));
+}
+
+TEST_F(LoggerTest, WakesTheIdleDrainThread) {
+  for (int i = 0; i < 5; ++i) {
+    // Long enough for the drain thread to find the queue empty and wait.
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    auto start = std::chrono::steady_clock::now();
+    ABInfoLog("after idle %d", i);
+    while (true) {
+      {
+        std::lock_guard guard(mtx_);
+        if (lines_.size() == static_cast<size_t>(i + 1)) break;
+      }
+      ASSERT_LT(std::chrono::steady_clock::now() - start,
+                std::chrono::seconds(1));
+      std::this_thread::yield();
+    }
+  }
+}
+
+TEST_F(LoggerTest, DropsWhenFull) {
+  std::atomic<bool> release = false;
+  Logger::SetSink([&release](LogLevel, const std::string&) {
+    while (!release) std::this_thread::yield();
+  });
+  uint64_t dropped = Logger::Dropped();
+  for (size_t i = 0; i < Logger::kQueueRecords * 2; ++i) {
+    ABInfoLog("fill %zu", i);
+  }
+  EXPECT_GT(Logger::Dropped(), dropped);
+  release = true;
+  // The sink refers to release, so drain before it goes out of scope.
+  Logger::Flush();
+  Logger::SetSink(nullptr);
+}
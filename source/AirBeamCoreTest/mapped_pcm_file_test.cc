@@ -0,0 +1,105 @@
+#include "audio/mapped_pcm_file.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace AirBeamCore;
+using AirBeamCore::audio::MappedPCMFile;
+
+namespace {
+// Writes frames whose bytes count up from 0, plus extra stray bytes.
+std::string WritePCM(const std::string& name, size_t frames,
+                     size_t extra = 0) {
+  std::string path =
+      testing::TempDir() + name + "_" + std::to_string(getpid()) + ".pcm";
+  std::ofstream out(path, std::ios::binary);
+  for (size_t i = 0; i < frames * MappedPCMFile::kFrameBytes + extra; ++i) {
+    out.put(static_cast<char>(i));
+  }
+  return path;
+}
+
+// Reads everything Next returns, up to limit bytes.
+std::vector<uint8_t> ReadAll(MappedPCMFile& file, size_t chunk,
+                             size_t limit) {
+  std::vector<uint8_t> bytes;
+  const uint8_t* data;
+  while (bytes.size() < limit) {
+    size_t len = file.Next(chunk, data);
+    if (len == 0) break;
+    bytes.insert(bytes.end(), data, data + len);
+  }
+  return bytes;
+}
+}  // namespace
+
+TEST(MappedPCMFileTest, ReadsWholeFramesToTheEnd) {
+  std::string path = WritePCM("mapped_end", 1000, 3);
+  MappedPCMFile file;
+  ASSERT_EQ(file.Open(path), helper::kOk);
+  EXPECT_EQ(file.GetFrames(), 1000u);
+
+  // A chunk size that is not a whole number of frames is rounded down.
+  auto bytes = ReadAll(file, 1409, SIZE_MAX);
+  ASSERT_EQ(bytes.size(), 4000u);
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    ASSERT_EQ(bytes[i], static_cast<uint8_t>(i)) << i;
+  }
+  EXPECT_EQ(file.GetFrame(), 1000u);
+  EXPECT_EQ(file.GetLoops(), 0u);
+  unlink(path.c_str());
+}
+
+TEST(MappedPCMFileTest, LoopsWithoutGaps) {
+  std::string path = WritePCM("mapped_loop", 300);
+  MappedPCMFile file;
+  ASSERT_EQ(file.Open(path), helper::kOk);
+  file.SetLoop(true);
+
+  // 1408-byte chunks do not divide the 1200-byte file, and each one is
+  // longer than it, so every chunk crosses the loop point.
+  auto bytes = ReadAll(file, 1408, 1408 * 10);
+  ASSERT_EQ(bytes.size(), 1408u * 10);
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    ASSERT_EQ(bytes[i], static_cast<uint8_t>(i % 1200)) << i;
+  }
+  EXPECT_EQ(file.GetLoops(), 1408u * 10 / 1200);
+  EXPECT_EQ(file.GetFrame(), 1408u * 10 % 1200 / 4);
+  unlink(path.c_str());
+}
+
+TEST(MappedPCMFileTest, Seeks) {
+  std::string path = WritePCM("mapped_seek", 100);
+  MappedPCMFile file;
+  ASSERT_EQ(file.Open(path), helper::kOk);
+  const uint8_t* data;
+
+  file.Seek(90);
+  EXPECT_EQ(file.Next(1024, data), 40u);
+  EXPECT_EQ(data[0], static_cast<uint8_t>(360));
+  // Past the end clamps without looping, and wraps with it.
+  file.Seek(250);
+  EXPECT_EQ(file.Next(1024, data), 0u);
+  file.SetLoop(true);
+  file.Seek(250);
+  EXPECT_EQ(file.GetFrame(), 50u);
+  EXPECT_EQ(file.Next(8, data), 8u);
+  EXPECT_EQ(data[0], static_cast<uint8_t>(200));
+  unlink(path.c_str());
+}
+
+TEST(MappedPCMFileTest, RejectsMissingAndEmptyFiles) {
+  MappedPCMFile file;
+  EXPECT_NE(file.Open(testing::TempDir() + "does_not_exist.pcm"),
+            helper::kOk);
+  std::string path = WritePCM("mapped_empty", 0, 3);
+  EXPECT_NE(file.Open(path), helper::kOk);
+  EXPECT_FALSE(file.IsOpen());
+  const uint8_t* data;
+  EXPECT_EQ(file.Next(1024, data), 0u);
+  unlink(path.c_str());
+}
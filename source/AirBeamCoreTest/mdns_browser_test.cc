@@ -0,0 +1,168 @@
+#include "discovery/mdns_browser.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "fake_mdns_responder.h"
+
+using namespace AirBeamCore;
+using AirBeamCore::discovery::EventType;
+using AirBeamCore::discovery::MdnsBrowser;
+using AirBeamCore::discovery::RecordType;
+using AirBeamCore::discovery::ServiceInfo;
+using AirBeamTesting::FakeMdnsResponder;
+
+namespace {
+// Collects the browser's events for the test thread to wait on.
+class Events {
+ public:
+  MdnsBrowser::ServiceCallback Callback() {
+    return [this](EventType type, const ServiceInfo& info) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      events_.push_back({type, info});
+      changed_.notify_all();
+    };
+  }
+
+  // Waits for count events of the type in all.
+  bool WaitFor(EventType type, size_t count,
+               std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return changed_.wait_for(lock, timeout,
+                             [&]() { return Count(type) >= count; });
+  }
+
+  std::vector<ServiceInfo> Get(EventType type) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<ServiceInfo> infos;
+    for (const auto& [event, info] : events_) {
+      if (event == type) infos.push_back(info);
+    }
+    return infos;
+  }
+
+ private:
+  size_t Count(EventType type) const {
+    size_t count = 0;
+    for (const auto& event : events_) count += event.first == type;
+    return count;
+  }
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::vector<std::pair<EventType, ServiceInfo>> events_;
+};
+
+MdnsBrowser::Options BrowserOptions(const FakeMdnsResponder& responder) {
+  MdnsBrowser::Options options;
+  options.peer_ip = "127.0.0.1";
+  options.peer_port = responder.GetPort();
+  options.local_port = 0;
+  options.query_interval = std::chrono::milliseconds(200);
+  return options;
+}
+
+FakeMdnsResponder::Service Receiver(const std::string& name, uint16_t port) {
+  FakeMdnsResponder::Service service;
+  service.instance = "0011223344" + std::to_string(port) + "@" + name;
+  service.host = name + ".local";
+  service.port = port;
+  service.txt = {"cn=0,1", "sr=44100", "am=AirPort10,115"};
+  return service;
+}
+}  // namespace
+
+TEST(MdnsBrowserTest, ResolvesFromOneResponse) {
+  FakeMdnsResponder responder;
+  ASSERT_EQ(responder.Start(), helper::kOk);
+  auto service = Receiver("Kitchen.Speaker", 7000);
+  responder.AddService(service);
+
+  Events events;
+  MdnsBrowser browser(BrowserOptions(responder));
+  ASSERT_EQ(browser.Start("_raop._tcp", events.Callback()), helper::kOk);
+  ASSERT_TRUE(events.WaitFor(EventType::kServiceOnline, 1));
+
+  auto online = events.Get(EventType::kServiceOnline);
+  EXPECT_EQ(online[0].name, service.instance);
+  EXPECT_EQ(online[0].fullname, service.FullName());
+  EXPECT_EQ(online[0].ip, "127.0.0.1");
+  EXPECT_EQ(online[0].port, 7000);
+  EXPECT_EQ(online[0].txt.at("am"), "AirPort10,115");
+  EXPECT_EQ(online[0].txt.at("cn"), "0,1");
+  EXPECT_EQ(online[0].capabilities.model, "AirPort10,115");
+  ASSERT_EQ(browser.GetServices().size(), 1u);
+  EXPECT_EQ(browser.GetServices()[0], online[0]);
+  // Everything came with the PTR answer.
+  EXPECT_EQ(responder.GetQuestions(RecordType::kSrv), 0u);
+}
+
+TEST(MdnsBrowserTest, ResolvesInstancesConcurrently) {
+  FakeMdnsResponder::Options responder_options;
+  responder_options.additional_records = false;
+  responder_options.answer_delay = std::chrono::milliseconds(150);
+  FakeMdnsResponder responder(responder_options);
+  ASSERT_EQ(responder.Start(), helper::kOk);
+  constexpr int kReceivers = 8;
+  for (int i = 0; i < kReceivers; ++i) {
+    responder.AddService(Receiver("room" + std::to_string(i), 7000 + i));
+  }
+
+  Events events;
+  MdnsBrowser browser(BrowserOptions(responder));
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(browser.Start("_raop._tcp", events.Callback()), helper::kOk);
+  ASSERT_TRUE(events.WaitFor(EventType::kServiceOnline, kReceivers));
+  // SRV and TXT, then A, for all of them at once: two delays, not 16.
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(150 * 5));
+  EXPECT_EQ(browser.GetServices().size(), static_cast<size_t>(kReceivers));
+  EXPECT_GE(responder.GetQuestions(RecordType::kSrv),
+            static_cast<size_t>(kReceivers));
+}
+
+TEST(MdnsBrowserTest, GoodbyeAndExpiryTakeServicesOffline) {
+  FakeMdnsResponder responder;
+  ASSERT_EQ(responder.Start(), helper::kOk);
+  auto leaving = Receiver("leaving", 7000);
+  auto fading = Receiver("fading", 7001);
+  fading.ttl = 1;
+  responder.AddService(leaving);
+  responder.AddService(fading);
+
+  Events events;
+  MdnsBrowser browser(BrowserOptions(responder));
+  ASSERT_EQ(browser.Start("_raop._tcp", events.Callback()), helper::kOk);
+  ASSERT_TRUE(events.WaitFor(EventType::kServiceOnline, 2));
+
+  // One says goodbye; the other just stops answering.
+  responder.RemoveService(leaving.instance, browser.GetLocalPort());
+  responder.RemoveService(fading.instance, 0);
+  ASSERT_TRUE(events.WaitFor(EventType::kServiceOffline, 2));
+  EXPECT_TRUE(browser.GetServices().empty());
+  EXPECT_EQ(browser.GetStats().offline_events, 2u);
+}
+
+TEST(MdnsBrowserTest, ReportsChangesAgain) {
+  FakeMdnsResponder responder;
+  ASSERT_EQ(responder.Start(), helper::kOk);
+  auto service = Receiver("moving", 7000);
+  responder.AddService(service);
+
+  Events events;
+  MdnsBrowser browser(BrowserOptions(responder));
+  ASSERT_EQ(browser.Start("_raop._tcp", events.Callback()), helper::kOk);
+  ASSERT_TRUE(events.WaitFor(EventType::kServiceOnline, 1));
+
+  service.port = 7100;
+  responder.AddService(service);
+  responder.Announce(service, browser.GetLocalPort());
+  ASSERT_TRUE(events.WaitFor(EventType::kServiceOnline, 2));
+  EXPECT_EQ(events.Get(EventType::kServiceOnline)[1].port, 7100);
+  EXPECT_TRUE(events.Get(EventType::kServiceOffline).empty());
+}
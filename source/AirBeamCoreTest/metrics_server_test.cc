@@ -0,0 +1,194 @@
+#include "helper/metrics_server.h"
+
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "fake_receiver.h"
+#include "helper/metrics.h"
+#include "helper/metrics_registry.h"
+#include "raop/raop.h"
+#include "raop/session_manager.h"
+
+using namespace AirBeamCore;
+using namespace AirBeamCore::helper;
+
+namespace {
+std::string Get(int fd, const std::string& path) {
+  std::string request = "GET " + path + " HTTP/1.0\r\n\r\n";
+  send(fd, request.data(), request.size(), 0);
+  std::string response;
+  char buffer[4096];
+  ssize_t n;
+  while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    response.append(buffer, n);
+  }
+  close(fd);
+  return response;
+}
+
+std::string GetTcp(uint32_t port, const std::string& path) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return "";
+  }
+  return Get(fd, path);
+}
+
+std::string GetUnix(const std::string& socket_path, const std::string& path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return "";
+  }
+  return Get(fd, path);
+}
+
+bool Contains(const std::string& haystack, const std::string& needle) {
+  return haystack.find(needle) != std::string::npos;
+}
+}  // namespace
+
+TEST(MetricsWriterTest, PrometheusText) {
+  MetricsWriter writer;
+  writer.Counter("packets_total", "Packets.", {{"receiver", "a\"b"}}, 3);
+  writer.Counter("packets_total", "Packets.", {{"receiver", "c"}}, 4);
+  writer.Gauge("depth", "Depth.", {}, -2);
+  Histogram histogram;
+  histogram.Record(3);
+  histogram.Record(5);
+  histogram.Record(100);
+  writer.Histogram("latency_seconds", "Latency.", {},
+                   histogram.Snapshot(), 1);
+  std::string text = writer.ToPrometheus();
+
+  EXPECT_TRUE(Contains(text, "# HELP packets_total Packets.\n"
+                             "# TYPE packets_total counter\n"
+                             "packets_total{receiver=\"a\\\"b\"} 3\n"
+                             "packets_total{receiver=\"c\"} 4\n"));
+  EXPECT_TRUE(Contains(text, "# TYPE depth gauge\ndepth -2\n"));
+  EXPECT_TRUE(Contains(text, "# TYPE latency_seconds histogram\n"));
+  // Cumulative counts at power-of-two bounds, starting at the first one
+  // holding a sample.
+  EXPECT_FALSE(Contains(text, "latency_seconds_bucket{le=\"2\"}"));
+  EXPECT_TRUE(Contains(text, "latency_seconds_bucket{le=\"4\"} 1\n"));
+  EXPECT_TRUE(Contains(text, "latency_seconds_bucket{le=\"8\"} 2\n"));
+  EXPECT_TRUE(Contains(text, "latency_seconds_bucket{le=\"64\"} 2\n"));
+  EXPECT_TRUE(Contains(text, "latency_seconds_bucket{le=\"128\"} 3\n"));
+  EXPECT_TRUE(Contains(text, "latency_seconds_bucket{le=\"+Inf\"} 3\n"));
+  EXPECT_TRUE(Contains(text, "latency_seconds_sum 108\n"));
+  EXPECT_TRUE(Contains(text, "latency_seconds_count 3\n"));
+}
+
+TEST(MetricsWriterTest, Json) {
+  MetricsWriter writer;
+  writer.Counter("packets_total", "Packets.", {{"receiver", "c"}}, 4);
+  Histogram histogram;
+  histogram.Record(2000);
+  writer.Histogram("latency_seconds", "Latency.", {}, histogram.Snapshot(),
+                   1e-3);
+  EXPECT_EQ(writer.ToJson(),
+            "{\"packets_total\":{\"help\":\"Packets.\",\"type\":\"counter\","
+            "\"samples\":[{\"labels\":{\"receiver\":\"c\"},\"value\":4}]},"
+            "\"latency_seconds\":{\"help\":\"Latency.\",\"type\":"
+            "\"histogram\",\"samples\":[{\"labels\":{},\"count\":1,"
+            "\"sum\":2,\"min\":2,\"max\":2,\"p50\":2,\"p90\":2,\"p99\":2,"
+            "\"p999\":2}]}}");
+}
+
+TEST(MetricsServerTest, ServesTcpAndUnix) {
+  MetricsRegistry registry;
+  Counter counter;
+  counter.Add(7);
+  auto id = registry.Register([&](MetricsWriter& writer) {
+    writer.Counter("hits_total", "Hits.", {}, counter.Value());
+  });
+
+  MetricsServer tcp(registry);
+  ASSERT_EQ(tcp.Start(), kOk);
+  std::string response = GetTcp(tcp.GetPort(), "/metrics");
+  EXPECT_TRUE(Contains(response, "HTTP/1.0 200 OK\r\n"));
+  EXPECT_TRUE(Contains(response, "text/plain; version=0.0.4"));
+  EXPECT_TRUE(Contains(response, "hits_total 7\n"));
+  response = GetTcp(tcp.GetPort(), "/metrics.json");
+  EXPECT_TRUE(Contains(response, "application/json"));
+  EXPECT_TRUE(Contains(response, "\"value\":7"));
+  EXPECT_TRUE(Contains(GetTcp(tcp.GetPort(), "/"), "404 Not Found"));
+
+  MetricsServer::Options options;
+  options.unix_path = "/tmp/airbeam_metrics_test_" +
+                      std::to_string(getpid()) + ".sock";
+  MetricsServer unix_server(registry, options);
+  ASSERT_EQ(unix_server.Start(), kOk);
+  EXPECT_EQ(unix_server.GetPort(), 0);
+  EXPECT_TRUE(Contains(GetUnix(options.unix_path, "/metrics"),
+                       "hits_total 7\n"));
+
+  registry.Unregister(id);
+  EXPECT_FALSE(Contains(GetTcp(tcp.GetPort(), "/metrics"), "hits_total"));
+}
+
+TEST(MetricsServerTest, StartsAgainAfterAFailedStart) {
+  MetricsRegistry registry;
+  MetricsServer first(registry);
+  ASSERT_EQ(first.Start(), kOk);
+  MetricsServer::Options options;
+  options.port = first.GetPort();
+  MetricsServer second(registry, options);
+  EXPECT_EQ(second.Start(), kErrTcpBind);
+
+  first.Stop();
+  ASSERT_EQ(second.Start(), kOk);
+  EXPECT_TRUE(Contains(GetTcp(options.port, "/metrics"), "200 OK"));
+}
+
+TEST(MetricsServerTest, ExportsManagedSessions) {
+  AirBeamTesting::FakeReceiver receiver;
+  ASSERT_EQ(receiver.Start(), kOk);
+  MetricsRegistry registry;
+  raop::SessionManager::Options options;
+  options.workers = 1;
+  options.registry = &registry;
+  raop::SessionManager manager(options);
+  auto raop = std::make_shared<raop::Raop>("127.0.0.1", receiver.GetPort());
+  raop::SessionManager::SessionId id;
+  ASSERT_EQ(manager.Add(
+                raop,
+                [](raop::RtpAudioPacketChunk& chunk) {
+                  memset(chunk.data_, 0, sizeof(chunk.data_));
+                  chunk.len_ = sizeof(chunk.data_);
+                },
+                id),
+            kOk);
+  ASSERT_TRUE(receiver.WaitForPackets(5, std::chrono::seconds(1)));
+
+  MetricsServer server(registry);
+  ASSERT_EQ(server.Start(), kOk);
+  std::string text = GetTcp(server.GetPort(), "/metrics");
+  std::string receiver_label =
+      "receiver=\"127.0.0.1:" + std::to_string(receiver.GetPort()) + "\"";
+  EXPECT_TRUE(Contains(text, "airbeam_session_manager_sessions 1\n"));
+  EXPECT_TRUE(
+      Contains(text, "airbeam_raop_packets_sent_total{" + receiver_label));
+  EXPECT_TRUE(Contains(text, "airbeam_raop_pacing_error_seconds_count{" +
+                                 receiver_label));
+  EXPECT_TRUE(Contains(text, "airbeam_raop_rtsp_round_trip_seconds_count{" +
+                                 receiver_label + "} 4\n"));
+}
@@ -0,0 +1,67 @@
+#include "helper/metrics.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+using namespace AirBeamCore::helper;
+
+TEST(MetricsTest, CounterSumsAcrossThreads) {
+  Counter counter;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 10000; ++i) counter.Add();
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  counter.Add(5);
+  EXPECT_EQ(counter.Value(), 40005);
+}
+
+TEST(MetricsTest, GaugeGoesBothWays) {
+  Gauge gauge;
+  gauge.Set(10);
+  gauge.Add(-15);
+  EXPECT_EQ(gauge.Value(), -5);
+}
+
+TEST(MetricsTest, BucketsAreContiguous) {
+  EXPECT_EQ(Histogram::BucketIndex(0), 0);
+  EXPECT_EQ(Histogram::BucketIndex(15), 15);
+  EXPECT_EQ(Histogram::BucketIndex(16), 16);
+  for (size_t i = 0; i + 1 < Histogram::kBuckets; ++i) {
+    uint64_t low = Histogram::BucketLowerBound(i);
+    uint64_t high = Histogram::BucketUpperBound(i);
+    ASSERT_LE(low, high);
+    ASSERT_EQ(Histogram::BucketIndex(low), i);
+    ASSERT_EQ(Histogram::BucketIndex(high), i);
+    ASSERT_EQ(Histogram::BucketLowerBound(i + 1), high + 1);
+    // Relative bucket width stays within 1/16.
+    ASSERT_LE((high - low) * 16, std::max<uint64_t>(low, 16));
+  }
+  EXPECT_EQ(Histogram::BucketIndex(uint64_t{1} << 50),
+            Histogram::kBuckets - 1);
+}
+
+TEST(MetricsTest, HistogramPercentiles) {
+  Histogram histogram;
+  for (uint64_t v = 1; v <= 1000; ++v) histogram.Record(v * 1000);
+  auto snapshot = histogram.Snapshot();
+  EXPECT_EQ(snapshot.count, 1000);
+  EXPECT_EQ(snapshot.min, 1000);
+  EXPECT_EQ(snapshot.max, 1000000);
+  EXPECT_DOUBLE_EQ(snapshot.Mean(), 500500);
+  EXPECT_NEAR(snapshot.Percentile(0.5), 500000, 500000 / 16);
+  EXPECT_NEAR(snapshot.Percentile(0.99), 990000, 990000 / 16);
+  EXPECT_EQ(snapshot.Percentile(1), 1000000);
+}
+
+TEST(MetricsTest, EmptyHistogram) {
+  Histogram histogram;
+  auto snapshot = histogram.Snapshot();
+  EXPECT_EQ(snapshot.count, 0);
+  EXPECT_EQ(snapshot.min, 0);
+  EXPECT_EQ(snapshot.Percentile(0.5), 0);
+}
@@ -0,0 +1,266 @@
+#include "helper/network.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace AirBeamCore::helper;
+
+namespace {
+int Listen(int backlog, uint32_t& port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(fd, (sockaddr*)&addr, sizeof(addr));
+  listen(fd, backlog);
+  socklen_t len = sizeof(addr);
+  getsockname(fd, (sockaddr*)&addr, &len);
+  port = ntohs(addr.sin_port);
+  return fd;
+}
+
+// A listener that never accepts and whose backlog is full, so further SYNs
+// are dropped and connects to it hang.
+class BlackholeListener {
+ public:
+  BlackholeListener() {
+    listen_fd_ = Listen(0, port_);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port_);
+    for (int i = 0; i < 64; ++i) {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      fcntl(fd, F_SETFL, O_NONBLOCK);
+      fillers_.push_back(fd);
+      if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) continue;
+      pollfd pfd{fd, POLLOUT, 0};
+      if (poll(&pfd, 1, 50) == 0) break;
+    }
+  }
+  ~BlackholeListener() {
+    for (int fd : fillers_) close(fd);
+    close(listen_fd_);
+  }
+  uint32_t GetPort() const { return port_; }
+
+ private:
+  int listen_fd_ = -1;
+  uint32_t port_ = 0;
+  std::vector<int> fillers_;
+};
+
+int64_t ElapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+}  // namespace
+
+TEST(TCPClientTest, ConnectOnLoopback) {
+  uint32_t port;
+  int listen_fd = Listen(4, port);
+
+  TCPClient client;
+  EXPECT_EQ(client.Connect("127.0.0.1", port), kOk);
+  EXPECT_EQ(client.GetRemoteNetAddr().ip_, "127.0.0.1");
+  EXPECT_EQ(client.GetRemoteNetAddr().port_, port);
+  EXPECT_EQ(client.GetLocalNetAddr().ip_, "127.0.0.1");
+  EXPECT_NE(client.GetLocalNetAddr().port_, 0);
+  close(listen_fd);
+}
+
+TEST(TCPClientTest, ConnectRejectsBadAddress) {
+  TCPClient client;
+  EXPECT_EQ(client.Connect("not-an-ip", 80), kErrTcpAddrParse);
+}
+
+TEST(TCPClientTest, ConnectRefused) {
+  uint32_t port;
+  close(Listen(1, port));
+
+  TCPClient client;
+  EXPECT_EQ(client.Connect("127.0.0.1", port), kErrTcpConnect);
+}
+
+TEST(TCPClientTest, ConnectTimesOut) {
+  BlackholeListener blackhole;
+
+  TCPClient client;
+  TCPClient::Options options;
+  options.connect_timeout = std::chrono::milliseconds(100);
+  client.SetOptions(options);
+
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(client.Connect("127.0.0.1", blackhole.GetPort()), kErrTcpTimeout);
+  EXPECT_GE(ElapsedMs(start), 95);
+  EXPECT_LT(ElapsedMs(start), 1000);
+}
+
+TEST(TCPClientTest, RacesPastHangingCandidate) {
+  BlackholeListener blackhole;
+  uint32_t port;
+  int listen_fd = Listen(4, port);
+
+  TCPClient client;
+  TCPClient::Options options;
+  options.connect_timeout = std::chrono::seconds(2);
+  options.attempt_delay = std::chrono::milliseconds(30);
+  client.SetOptions(options);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<NetAddr> candidates = {{"127.0.0.1", blackhole.GetPort()},
+                                     {"127.0.0.1", port}};
+  EXPECT_EQ(client.Connect(candidates), kOk);
+  EXPECT_EQ(client.GetRemoteNetAddr().port_, port);
+  EXPECT_LT(ElapsedMs(start), 1000);
+  close(listen_fd);
+}
+
+TEST(TCPClientTest, FailedCandidateFallsThrough) {
+  uint32_t refused_port;
+  close(Listen(1, refused_port));
+  uint32_t port;
+  int listen_fd = Listen(4, port);
+
+  TCPClient client;
+  TCPClient::Options options;
+  options.attempt_delay = std::chrono::seconds(10);
+  client.SetOptions(options);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<NetAddr> candidates = {{"127.0.0.1", refused_port},
+                                     {"127.0.0.1", port}};
+  EXPECT_EQ(client.Connect(candidates), kOk);
+  EXPECT_EQ(client.GetRemoteNetAddr().port_, port);
+  EXPECT_LT(ElapsedMs(start), 1000);
+  close(listen_fd);
+}
+
+TEST(TCPClientTest, ReadTimesOut) {
+  uint32_t port;
+  int listen_fd = Listen(4, port);
+
+  TCPClient client;
+  TCPClient::Options options;
+  options.io_timeout = std::chrono::milliseconds(50);
+  client.SetOptions(options);
+  ASSERT_EQ(client.Connect("127.0.0.1", port), kOk);
+
+  std::string data;
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(client.Read(data), kErrTcpTimeout);
+  EXPECT_GE(ElapsedMs(start), 45);
+  close(listen_fd);
+}
+
+TEST(UDPServerTest, WriteBatchSendsHeaderAndSharedPayload) {
+  UDPServer sender, receiver_a, receiver_b;
+  ASSERT_EQ(sender.Bind(), kOk);
+  ASSERT_EQ(receiver_a.Bind(), kOk);
+  ASSERT_EQ(receiver_b.Bind(), kOk);
+
+  SockAddr addr_a, addr_b, bad;
+  ASSERT_EQ(addr_a.Parse({"127.0.0.1", receiver_a.GetLocalNetAddr().port_}),
+            kOk);
+  ASSERT_EQ(addr_b.Parse({"127.0.0.1", receiver_b.GetLocalNetAddr().port_}),
+            kOk);
+  EXPECT_EQ(bad.Parse({"receiver.local", 5000}), kErrUdpAddrParse);
+  const uint8_t header_a[] = {'a', 'a'};
+  const uint8_t header_b[] = {'b'};
+  const uint8_t payload[] = {'x', 'y', 'z'};
+  std::vector<UDPMessage> messages = {
+      {&addr_a, header_a, sizeof(header_a), payload, sizeof(payload)},
+      {&addr_b, header_b, sizeof(header_b), payload, sizeof(payload)},
+  };
+  ASSERT_EQ(sender.WriteBatch(messages), kOk);
+
+  NetAddr remote;
+  std::string data;
+  ASSERT_EQ(receiver_a.Read(remote, data), kOk);
+  EXPECT_EQ(data, "aaxyz");
+  ASSERT_EQ(receiver_b.Read(remote, data), kOk);
+  EXPECT_EQ(data, "bxyz");
+
+  // A smaller batch after a larger one, through the same scratch buffers.
+  messages.pop_back();
+  ASSERT_EQ(sender.WriteBatch(messages), kOk);
+  ASSERT_EQ(receiver_a.Read(remote, data), kOk);
+  EXPECT_EQ(data, "aaxyz");
+}
+
+TEST(UDPServerTest, WriteBatchSkipsMessagesItCannotSend) {
+  UDPServer sender, receiver_a, receiver_b;
+  ASSERT_EQ(sender.Bind(), kOk);
+  ASSERT_EQ(receiver_a.Bind(), kOk);
+  ASSERT_EQ(receiver_b.Bind(), kOk);
+  SockAddr addr_a, addr_b, v6;
+  ASSERT_EQ(addr_a.Parse({"127.0.0.1", receiver_a.GetLocalNetAddr().port_}),
+            kOk);
+  ASSERT_EQ(addr_b.Parse({"127.0.0.1", receiver_b.GetLocalNetAddr().port_}),
+            kOk);
+  // An IPv4 socket refuses to send to an IPv6 address.
+  ASSERT_EQ(v6.Parse({"::1", receiver_a.GetLocalNetAddr().port_}), kOk);
+  const uint8_t header[] = {'h'};
+  const uint8_t payload[] = {'p'};
+  std::vector<UDPMessage> messages = {
+      {&v6, header, sizeof(header), payload, sizeof(payload)},
+      {&addr_a, header, sizeof(header), payload, sizeof(payload)},
+      {&v6, header, sizeof(header), payload, sizeof(payload)},
+      {&addr_b, header, sizeof(header), payload, sizeof(payload)},
+  };
+  std::vector<size_t> failed;
+  EXPECT_EQ(sender.WriteBatch(messages, &failed), kErrUdpSend);
+  EXPECT_EQ(failed, (std::vector<size_t>{0, 2}));
+
+  NetAddr remote;
+  std::string data;
+  ASSERT_EQ(receiver_a.Read(remote, data), kOk);
+  EXPECT_EQ(data, "hp");
+  ASSERT_EQ(receiver_b.Read(remote, data), kOk);
+  EXPECT_EQ(data, "hp");
+
+  messages.erase(messages.begin());
+  messages.erase(messages.begin() + 1);
+  EXPECT_EQ(sender.WriteBatch(messages, &failed), kOk);
+  EXPECT_TRUE(failed.empty());
+}
+
+TEST(UDPServerTest, SendsOverIpv6) {
+  UDPServer sender, receiver;
+  ASSERT_EQ(sender.Bind(AF_INET6), kOk);
+  ASSERT_EQ(receiver.Bind(AF_INET6), kOk);
+  ASSERT_EQ(sender.Write({"::1", receiver.GetLocalNetAddr().port_}, "v6"), kOk);
+  NetAddr from;
+  std::string data;
+  ASSERT_EQ(receiver.Read(from, data), kOk);
+  EXPECT_EQ(data, "v6");
+  EXPECT_EQ(from.ip_, "::1");
+  EXPECT_EQ(from.port_, sender.GetLocalNetAddr().port_);
+
+  EXPECT_EQ(SockAddr::Family("::1"), AF_INET6);
+  EXPECT_EQ(SockAddr::Family("127.0.0.1"), AF_INET);
+  EXPECT_EQ(SockAddr::Family("receiver.local"), AF_UNSPEC);
+  EXPECT_EQ(UriHost("10.0.0.2"), "10.0.0.2");
+  EXPECT_EQ(UriHost("::1"), "[::1]");
+  EXPECT_EQ(UriHost("fe80::1%en0"), "[fe80::1%25en0]");
+}
+
+TEST(NetworkTest, ResolveHostKeepsTheZone) {
+  char lo[IF_NAMESIZE] = {0};
+  ASSERT_NE(if_indextoname(1, lo), nullptr);
+  EXPECT_EQ(ResolveHost("fe80::1%" + std::string(lo)),
+            (std::vector<std::string>{"fe80::1%" + std::string(lo)}));
+  EXPECT_EQ(ResolveHost("127.0.0.1"),
+            (std::vector<std::string>{"127.0.0.1"}));
+}
@@ -0,0 +1,131 @@
+#include "raop/packetizer.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include "fake_receiver.h"
+#include "raop/raop.h"
+
+using namespace AirBeamCore;
+using namespace AirBeamCore::raop;
+using AirBeamCore::discovery::RaopCapabilities;
+using AirBeamTesting::FakeReceiver;
+
+namespace {
+// Pipeline frames whose left and right samples differ and cover the
+// extremes.
+std::vector<uint8_t> Frames(size_t count) {
+  std::vector<int16_t> samples(count * 2);
+  for (size_t i = 0; i < count; ++i) {
+    samples[2 * i] = static_cast<int16_t>(i * 311 - 32768);
+    samples[2 * i + 1] = static_cast<int16_t>(32767 - i * 97);
+  }
+  std::vector<uint8_t> bytes(samples.size() * 2);
+  memcpy(bytes.data(), samples.data(), bytes.size());
+  return bytes;
+}
+
+// The payload a receiver expects, one sample at a time.
+std::vector<uint8_t> Reference(const StreamFormat& format,
+                               const std::vector<uint8_t>& input,
+                               size_t frames) {
+  std::vector<uint8_t> out;
+  auto put = [&](int32_t sample) {
+    if (format.sample_size == 24) sample *= 256;
+    for (int shift = format.sample_size - 8; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<uint8_t>(sample >> shift));
+    }
+  };
+  for (size_t i = 0; i < frames; ++i) {
+    int16_t left, right;
+    memcpy(&left, &input[4 * i], 2);
+    memcpy(&right, &input[4 * i + 2], 2);
+    if (format.channels == 1) {
+      put((left + right) / 2);
+    } else {
+      put(left);
+      put(right);
+    }
+  }
+  return out;
+}
+}  // namespace
+
+TEST(PacketizerTest, EveryEntryMatchesTheReference) {
+  const auto& table = Packetizers();
+  ASSERT_EQ(table.size(), 8u);
+  std::set<uint32_t> rates;
+  for (size_t i = 0; i < table.size(); ++i) {
+    const auto& entry = table[i];
+    SCOPED_TRACE(entry.format.Rtpmap());
+    rates.insert(entry.format.sample_rate);
+    EXPECT_EQ(FindPacketizer(entry.format), &entry);
+    EXPECT_EQ(entry.payload_bytes,
+              entry.format.frames_per_packet * entry.format.BytesPerFrame());
+    EXPECT_LE(entry.payload_bytes, sizeof(RtpAudioPacketChunk::data_));
+    if (i > 0) {
+      EXPECT_LE(table[i - 1].format.BytesPerFrame() *
+                    table[i - 1].format.sample_rate,
+                entry.format.BytesPerFrame() * entry.format.sample_rate);
+    }
+
+    // A whole packet out of more input than one, then a short one.
+    auto input = Frames(entry.format.frames_per_packet + 10);
+    RtpAudioPacketChunk output;
+    EXPECT_EQ(entry.packetize(input.data(), input.size(), output),
+              entry.input_bytes);
+    auto expected = Reference(entry.format, input,
+                              entry.format.frames_per_packet);
+    ASSERT_EQ(output.len_, expected.size());
+    EXPECT_EQ(memcmp(output.data_, expected.data(), expected.size()), 0);
+
+    memset(output.data_, 0xff, sizeof(output.data_));
+    EXPECT_EQ(entry.packetize(input.data(), 4 * 5 + 3, output), 4u * 5);
+    expected = Reference(entry.format, input, 5);
+    ASSERT_EQ(output.len_, expected.size());
+    EXPECT_EQ(memcmp(output.data_, expected.data(), expected.size()), 0);
+    for (size_t j = output.len_; j < sizeof(output.data_); ++j) {
+      ASSERT_EQ(output.data_[j], 0) << j;
+    }
+  }
+  EXPECT_EQ(rates, (std::set<uint32_t>{44100, 48000}));
+  StreamFormat alac;
+  alac.codec = discovery::RaopCodec::kAlac;
+  EXPECT_EQ(FindPacketizer(alac), nullptr);
+}
+
+TEST(PacketizerTest, SessionSendsTheNegotiatedLayout) {
+  FakeReceiver::Options options;
+  options.keep_samples = false;
+  options.rtpmap = "L24/44100/1";
+  FakeReceiver receiver(options);
+  ASSERT_EQ(receiver.Start(), helper::kOk);
+
+  Raop raop("127.0.0.1", receiver.GetPort());
+  raop.SetManaged(true);
+  ASSERT_EQ(raop.SetReceiverCapabilities(
+                RaopCapabilities::FromTxt({{"ss", "24"}, {"ch", "1"}})),
+            helper::kOk);
+  ASSERT_EQ(raop.GetPacketInputBytes(), kPCMChunkLength * 4);
+  ASSERT_EQ(raop.StartSession(), helper::kOk);
+  raop.BeginStream(NtpTime::Now());
+
+  auto input = Frames(kPCMChunkLength);
+  RtpAudioPacketChunk encoded;
+  // A full packet and a short one, padded to full.
+  EXPECT_EQ(raop.Packetize(input.data(), input.size(), encoded),
+            input.size());
+  raop.SendChunk(encoded);
+  raop.Packetize(input.data(), 40, encoded);
+  raop.SendChunk(encoded);
+  ASSERT_TRUE(receiver.WaitForPackets(2, std::chrono::seconds(2)));
+
+  EXPECT_EQ(receiver.GetStats().payload_bytes, 2u * kPCMChunkLength * 3);
+  auto packets = receiver.GetPackets();
+  ASSERT_EQ(packets.size(), 2u);
+  EXPECT_EQ(packets[1].timestamp - packets[0].timestamp, kPCMChunkLength);
+  EXPECT_EQ(raop.GetUnderrunStats().padded_packets, 1u);
+}
@@ -0,0 +1,95 @@
+#include "audio/pcm_format.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "audio_files.h"
+
+using AirBeamCore::audio::ConvertToS16Stereo;
+using AirBeamCore::audio::PCMFormat;
+
+namespace {
+std::vector<int16_t> Ramp(size_t samples) {
+  std::vector<int16_t> out(samples);
+  for (size_t i = 0; i < samples; ++i) {
+    out[i] = static_cast<int16_t>(i * 977 - 32768);
+  }
+  return out;
+}
+
+std::vector<int16_t> Convert(const PCMFormat& format,
+                             const std::vector<int16_t>& samples) {
+  std::string bytes = AirBeamTesting::PackPCM(samples, format);
+  size_t frames = samples.size() / format.channels;
+  std::vector<int16_t> out(frames * 2);
+  ConvertToS16Stereo(format, reinterpret_cast<const uint8_t*>(bytes.data()),
+                     frames, out.data());
+  return out;
+}
+
+PCMFormat Format(uint16_t channels, uint16_t bits,
+                 PCMFormat::Encoding encoding, bool big_endian) {
+  PCMFormat format;
+  format.channels = channels;
+  format.bits = bits;
+  format.encoding = encoding;
+  format.big_endian = big_endian;
+  return format;
+}
+}  // namespace
+
+TEST(PCMFormatTest, StereoFormatsRoundTripSixteenBits) {
+  auto samples = Ramp(2 * 300);
+  for (uint16_t bits : {16, 24, 32}) {
+    for (bool big_endian : {false, true}) {
+      auto format =
+          Format(2, bits, PCMFormat::Encoding::kSigned, big_endian);
+      EXPECT_EQ(Convert(format, samples), samples)
+          << bits << " big_endian " << big_endian;
+    }
+  }
+  for (uint16_t bits : {32, 64}) {
+    auto format = Format(2, bits, PCMFormat::Encoding::kFloat, false);
+    EXPECT_EQ(Convert(format, samples), samples) << "float " << bits;
+  }
+}
+
+TEST(PCMFormatTest, EightBitKeepsTheTopByte) {
+  auto samples = Ramp(2 * 200);
+  auto out = Convert(Format(2, 8, PCMFormat::Encoding::kUnsigned, false),
+                     samples);
+  ASSERT_EQ(out.size(), samples.size());
+  for (size_t i = 0; i < samples.size(); ++i) {
+    ASSERT_EQ(out[i], static_cast<int16_t>(samples[i] & ~0xFF)) << i;
+  }
+}
+
+TEST(PCMFormatTest, MonoIsDuplicatedAndExtraChannelsDropped) {
+  auto mono = Ramp(100);
+  auto out = Convert(Format(1, 24, PCMFormat::Encoding::kSigned, true), mono);
+  ASSERT_EQ(out.size(), 200u);
+  for (size_t i = 0; i < mono.size(); ++i) {
+    ASSERT_EQ(out[2 * i], mono[i]);
+    ASSERT_EQ(out[2 * i + 1], mono[i]);
+  }
+
+  auto surround = Ramp(6 * 50);
+  for (uint16_t bits : {16, 24}) {
+    out = Convert(Format(6, bits, PCMFormat::Encoding::kSigned, false),
+                  surround);
+    ASSERT_EQ(out.size(), 100u);
+    for (size_t i = 0; i < 50; ++i) {
+      ASSERT_EQ(out[2 * i], surround[6 * i]) << bits;
+      ASSERT_EQ(out[2 * i + 1], surround[6 * i + 1]) << bits;
+    }
+  }
+}
+
+TEST(PCMFormatTest, FloatsAreClipped) {
+  float loud[] = {1.5f, -2.0f, 0.5f, -0.5f};
+  std::vector<int16_t> out(4);
+  ConvertToS16Stereo(Format(2, 32, PCMFormat::Encoding::kFloat, false),
+                     reinterpret_cast<const uint8_t*>(loud), 2, out.data());
+  EXPECT_EQ(out, (std::vector<int16_t>{32767, -32768, 16384, -16384}));
+}
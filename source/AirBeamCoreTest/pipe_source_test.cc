@@ -0,0 +1,177 @@
+#include "audio/pipe_source.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_files.h"
+
+using namespace AirBeamCore;
+using AirBeamCore::audio::PipeSource;
+
+namespace {
+// Bytes that count up, so reordering or loss shows.
+std::vector<uint8_t> Pattern(size_t len) {
+  std::vector<uint8_t> bytes(len);
+  for (size_t i = 0; i < len; ++i) bytes[i] = static_cast<uint8_t>(i * 7);
+  return bytes;
+}
+
+// Writes bytes in pieces of uneven size, then closes the pipe.
+std::thread WriteInPieces(int fd, const std::vector<uint8_t>& bytes,
+                          std::atomic<size_t>* written = nullptr) {
+  return std::thread([fd, &bytes, written]() {
+    size_t offset = 0;
+    size_t piece = 1;
+    while (offset < bytes.size()) {
+      size_t len = std::min(piece, bytes.size() - offset);
+      ssize_t got = write(fd, bytes.data() + offset, len);
+      if (got <= 0) break;
+      offset += got;
+      if (written != nullptr) written->store(offset);
+      piece = piece * 3 % 10007 + 1;
+    }
+    close(fd);
+  });
+}
+
+std::vector<uint8_t> ReadToEnd(PipeSource& source, size_t chunk) {
+  std::vector<uint8_t> bytes;
+  const uint8_t* data;
+  while (true) {
+    size_t len = source.Next(chunk, data);
+    if (len == 0) {
+      if (source.AtEnd()) break;
+      continue;
+    }
+    bytes.insert(bytes.end(), data, data + len);
+  }
+  return bytes;
+}
+}  // namespace
+
+TEST(PipeSourceTest, PassesThePipeThroughInOrder) {
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  PipeSource::Options options;
+  options.ring_bytes = 64 * 1024;
+  PipeSource source(options);
+  ASSERT_EQ(source.Open(fds[0]), helper::kOk);
+
+  // A trailing partial frame is dropped.
+  auto bytes = Pattern(1'000'003);
+  auto writer = WriteInPieces(fds[1], bytes);
+  auto got = ReadToEnd(source, 352 * 4);
+  writer.join();
+  bytes.resize(bytes.size() / 4 * 4);
+  EXPECT_EQ(got, bytes);
+  EXPECT_TRUE(source.AtEnd());
+  EXPECT_EQ(source.GetStats().bytes, 1'000'003u);
+  close(fds[0]);
+}
+
+TEST(PipeSourceTest, FullRingHoldsBackTheWriter) {
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  PipeSource::Options options;
+  options.ring_bytes = 16 * 1024;
+  PipeSource source(options);
+  ASSERT_EQ(source.Open(fds[0]), helper::kOk);
+
+  auto bytes = Pattern(4 * 1024 * 1024);
+  std::atomic<size_t> written{0};
+  auto writer = WriteInPieces(fds[1], bytes, &written);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  // The ring and the pipe are full, and the writer waits.
+  auto stats = source.GetStats();
+  EXPECT_EQ(stats.buffered, 16 * 1024u);
+  EXPECT_GE(stats.stalls, 1u);
+  EXPECT_LT(written.load(), 2 * 1024 * 1024u);
+
+  EXPECT_EQ(ReadToEnd(source, 4096), bytes);
+  writer.join();
+  close(fds[0]);
+}
+
+TEST(PipeSourceTest, CountsUnderrunsOnceStarted) {
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  PipeSource::Options options;
+  options.read_timeout = std::chrono::milliseconds(5);
+  PipeSource source(options);
+  ASSERT_EQ(source.Open(fds[0]), helper::kOk);
+
+  const uint8_t* data;
+  // Waiting for the producer to start is not an underrun.
+  EXPECT_EQ(source.Next(4096, data), 0u);
+  EXPECT_FALSE(source.AtEnd());
+  EXPECT_EQ(source.GetStats().underruns, 0u);
+
+  auto bytes = Pattern(1000);
+  ASSERT_EQ(write(fds[1], bytes.data(), bytes.size()), 1000);
+  while (source.GetStats().bytes < 1000) std::this_thread::yield();
+  ASSERT_EQ(source.Next(4096, data), 1000u);
+  EXPECT_EQ(memcmp(data, bytes.data(), 1000), 0);
+  EXPECT_EQ(source.Next(4096, data), 0u);
+  EXPECT_FALSE(source.AtEnd());
+  EXPECT_EQ(source.GetStats().underruns, 1u);
+
+  close(fds[1]);
+  EXPECT_EQ(source.Next(4096, data), 0u);
+  EXPECT_TRUE(source.AtEnd());
+  EXPECT_EQ(source.GetStats().underruns, 1u);
+  EXPECT_NE(source.Rewind(), helper::kOk);
+  close(fds[0]);
+}
+
+TEST(PipeSourceTest, ConvertsOtherFormats) {
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  PipeSource::Options options;
+  options.format.bits = 24;
+  // Not a whole number of 6-byte frames.
+  options.ring_bytes = 10'000;
+  PipeSource source(options);
+  ASSERT_EQ(source.Open(fds[0]), helper::kOk);
+
+  std::vector<int16_t> samples(2 * 50'000);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    samples[i] = static_cast<int16_t>(i * 31);
+  }
+  std::string packed = AirBeamTesting::PackPCM(samples, options.format);
+  std::vector<uint8_t> bytes(packed.begin(), packed.end());
+  auto writer = WriteInPieces(fds[1], bytes);
+  auto got = ReadToEnd(source, 352 * 4);
+  writer.join();
+  ASSERT_EQ(got.size(), samples.size() * 2);
+  EXPECT_EQ(memcmp(got.data(), samples.data(), got.size()), 0);
+  close(fds[0]);
+}
+
+TEST(PipeSourceTest, OpenAudioSourceReadsFifosLive) {
+  std::string path =
+      testing::TempDir() + "pipe_source_" + std::to_string(getpid());
+  unlink(path.c_str());
+  ASSERT_EQ(mkfifo(path.c_str(), 0600), 0);
+  auto bytes = Pattern(100'000);
+  std::thread writer([&]() {
+    int fd = open(path.c_str(), O_WRONLY);
+    ASSERT_GE(fd, 0);
+    WriteInPieces(fd, bytes).join();
+  });
+
+  std::unique_ptr<audio::AudioSource> source;
+  ASSERT_EQ(audio::OpenAudioSource(path, source), helper::kOk);
+  auto* pipe_source = dynamic_cast<PipeSource*>(source.get());
+  ASSERT_NE(pipe_source, nullptr);
+  EXPECT_EQ(ReadToEnd(*pipe_source, 352 * 4), bytes);
+  writer.join();
+  unlink(path.c_str());
+}
@@ -0,0 +1,165 @@
+#include "audio/resampler.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace AirBeamCore;
+using namespace AirBeamCore::audio;
+
+namespace {
+constexpr double kAmplitude = 0.89 * 32767;  // -1 dBFS
+
+// A sine, the same on both channels but for the sign.
+std::vector<int16_t> Sine(double frequency, uint32_t rate, size_t frames) {
+  std::vector<int16_t> samples(frames * 2);
+  for (size_t i = 0; i < frames; ++i) {
+    double value = kAmplitude * std::sin(2 * M_PI * frequency * i / rate);
+    samples[2 * i] = static_cast<int16_t>(std::lrint(value));
+    samples[2 * i + 1] = static_cast<int16_t>(std::lrint(-value));
+  }
+  return samples;
+}
+
+std::vector<int16_t> Resample(const Resampler::Options& options,
+                              const std::vector<int16_t>& input,
+                              size_t chunk_frames) {
+  Resampler resampler(options);
+  EXPECT_EQ(resampler.Init(), helper::kOk);
+  std::vector<int16_t> output;
+  const size_t frames = input.size() / 2;
+  for (size_t i = 0; i < frames; i += chunk_frames) {
+    resampler.Process(&input[2 * i], std::min(chunk_frames, frames - i),
+                      output);
+  }
+  resampler.Flush(output);
+  return output;
+}
+
+// THD+N of the left channel against the ideal sine at the output rate, in
+// dB, away from the edges where the filter ran over silence.
+double ThdPlusNoise(const std::vector<int16_t>& output, double frequency,
+                    uint32_t rate) {
+  double signal = 0, residual = 0;
+  const size_t frames = output.size() / 2;
+  for (size_t n = rate / 20; n + rate / 20 < frames; ++n) {
+    double ideal = kAmplitude * std::sin(2 * M_PI * frequency * n / rate);
+    signal += ideal * ideal;
+    residual += (output[2 * n] - ideal) * (output[2 * n] - ideal);
+  }
+  return 10 * std::log10(residual / signal);
+}
+
+// An in-memory source at any rate.
+class MemorySource : public AudioSource {
+ public:
+  MemorySource(std::vector<int16_t> samples, uint32_t rate)
+      : samples_(std::move(samples)) {
+    format_.sample_rate = rate;
+  }
+
+  size_t Next(size_t max_bytes, const uint8_t*& data) override {
+    size_t len = std::min(max_bytes, samples_.size() * 2 - pos_);
+    data = reinterpret_cast<const uint8_t*>(samples_.data()) + pos_;
+    pos_ += len;
+    return len;
+  }
+  helper::ErrCode Rewind() override {
+    pos_ = 0;
+    return helper::kOk;
+  }
+  PCMFormat GetInputFormat() const override { return format_; }
+
+ private:
+  std::vector<int16_t> samples_;
+  size_t pos_ = 0;
+  PCMFormat format_;
+};
+}  // namespace
+
+TEST(ResamplerTest, ConvertsTonesCleanly) {
+  struct Case {
+    uint32_t input_rate;
+    uint32_t output_rate;
+    double frequency;
+  };
+  for (const auto& test : {Case{48000, 44100, 1000}, Case{48000, 44100, 15000},
+                           Case{44100, 48000, 997}, Case{96000, 44100, 5000}}) {
+    SCOPED_TRACE(std::to_string(test.input_rate) + " to " +
+                 std::to_string(test.output_rate) + ", " +
+                 std::to_string(test.frequency) + " Hz");
+    Resampler::Options options;
+    options.input_rate = test.input_rate;
+    options.output_rate = test.output_rate;
+    auto input = Sine(test.frequency, test.input_rate, test.input_rate);
+    // Odd pieces come out the same as one.
+    auto output = Resample(options, input, 333);
+    EXPECT_EQ(output, Resample(options, input, input.size()));
+    EXPECT_NEAR(static_cast<double>(output.size() / 2), test.output_rate, 2);
+    EXPECT_LT(ThdPlusNoise(output, test.frequency, test.output_rate), -88);
+  }
+}
+
+TEST(ResamplerTest, RejectsWhatWouldAlias) {
+  Resampler::Options options;
+  // 23 kHz is in range at 48 kHz and past Nyquist at 44.1.
+  auto input = Sine(23000, 48000, 48000);
+  auto output = Resample(options, input, 1024);
+  double energy = 0;
+  for (size_t n = 4410; n + 4410 < output.size() / 2; ++n) {
+    energy += static_cast<double>(output[2 * n]) * output[2 * n];
+  }
+  double rms = std::sqrt(energy / (output.size() / 2 - 8820));
+  EXPECT_LT(20 * std::log10(rms / (kAmplitude / std::sqrt(2))), -90);
+}
+
+TEST(ResamplerTest, LevelsAgree) {
+  auto input = Sine(3000, 48000, 4800);
+  for (size_t i = 0; i < input.size(); i += 7) input[i] = rand() % 65536;
+  Resampler::Options options;
+  options.level = ResamplerLevel::kScalar;
+  auto scalar = Resample(options, input, 480);
+  for (auto level : {ResamplerLevel::kSse2, ResamplerLevel::kAvx2,
+                     ResamplerLevel::kNeon}) {
+    if (!Resampler::IsSupported(level)) continue;
+    SCOPED_TRACE(Resampler::LevelName(level));
+    options.level = level;
+    auto vector = Resample(options, input, 480);
+    ASSERT_EQ(vector.size(), scalar.size());
+    for (size_t i = 0; i < scalar.size(); ++i) {
+      ASSERT_LE(std::abs(vector[i] - scalar[i]), 1) << i;
+    }
+  }
+}
+
+TEST(ResamplerTest, WrapsSourcesAtAnotherRate) {
+  Resampler::Options bad;
+  bad.taps = 31;
+  EXPECT_NE(Resampler(bad).Init(), helper::kOk);
+  bad.taps = 128;
+  bad.output_rate = 44101;
+  EXPECT_NE(Resampler(bad).Init(), helper::kOk);
+
+  std::unique_ptr<AudioSource> same =
+      std::make_unique<MemorySource>(Sine(1000, 44100, 100), 44100);
+  AudioSource* inner = same.get();
+  ASSERT_EQ(ResampleAudioSource(44100, same), helper::kOk);
+  EXPECT_EQ(same.get(), inner);
+
+  std::unique_ptr<AudioSource> source =
+      std::make_unique<MemorySource>(Sine(1000, 48000, 4800), 48000);
+  ASSERT_EQ(ResampleAudioSource(44100, source), helper::kOk);
+  EXPECT_EQ(source->GetInputFormat().sample_rate, 48000u);
+  for (int pass = 0; pass < 2; ++pass) {
+    size_t frames = 0;
+    const uint8_t* data;
+    while (size_t len = source->Next(1408, data)) frames += len / 4;
+    EXPECT_TRUE(source->AtEnd());
+    EXPECT_NEAR(static_cast<double>(frames), 4410, 2);
+    ASSERT_EQ(source->Rewind(), helper::kOk);
+  }
+}
@@ -32,14 +32,19 @@ TEST(NtpTimeTest, NowAndToString) {
   EXPECT_FALSE(s.empty());
 }
 
-// TODO(cattchen) fix test
-// TEST(NtpTimeTest, FromAndIntoTimestamp) {
-//   uint64_t ts = 44100 * 10;
-//   uint64_t sr = 44100;
-//   NtpTime ntp = NtpTime::FromTimestamp(ts, sr);
-//   uint64_t ts2 = ntp.IntoTimestamp(sr);
-//   EXPECT_NEAR(ts, ts2, 2);
-// }
+TEST(NtpTimeTest, FromAndIntoTimestamp) {
+  uint64_t ts = 44100 * 10;
+  uint64_t sr = 44100;
+  NtpTime ntp = NtpTime::FromTimestamp(ts, sr);
+  uint64_t ts2 = ntp.IntoTimestamp(sr);
+  EXPECT_NEAR(ts, ts2, 2);
+}
+
+TEST(NtpTimeTest, FromTimestampKeepsFraction) {
+  NtpTime ntp = NtpTime::FromTimestamp(44100 * 3 + 22050, 44100);
+  EXPECT_EQ(ntp.seconds, 3);
+  EXPECT_EQ(ntp.fraction, 0x80000000);
+}
 
 TEST(RtpTimePacketTest, SerializeDeserialize) {
   RtpTimePacket pkt;
@@ -101,6 +106,20 @@ TEST(RtpLostPacketTest, ToString) {
 //   EXPECT_EQ(buf[0] & 0xf0, 0x80);
 // }
 
+TEST(RtpSyncPacketTest, BuildWithNtpTime) {
+  NtpTime now{0x12345678, 0x9abcdef0};
+  RtpSyncPacket pkt = RtpSyncPacket::Build(44100 * 5, now, 11025, true);
+  EXPECT_EQ(pkt.header.proto, 0x90);
+  EXPECT_EQ(pkt.curr_time.seconds, now.seconds);
+  EXPECT_EQ(pkt.curr_time.fraction, now.fraction);
+  EXPECT_EQ(pkt.rtp_timestamp, 44100 * 5);
+  EXPECT_EQ(pkt.rtp_timestamp_latency, 44100 * 5 - 11025);
+
+  uint8_t buf[20] = {0};
+  pkt.Serialize(buf);
+  EXPECT_EQ(NtpTime::Deserialize(buf + 8, 8).fraction, now.fraction);
+}
+
 TEST(RtpSyncPacketTest, ToString) {
   RtpSyncPacket pkt = RtpSyncPacket::Build(44100, 44100, 1000, false);
   std::string s = pkt.ToString();
@@ -0,0 +1,162 @@
+#include "discovery/service_cache.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace AirBeamCore;
+using AirBeamCore::discovery::EventType;
+using AirBeamCore::discovery::ServiceCache;
+using AirBeamCore::discovery::ServiceInfo;
+
+namespace {
+class Events {
+ public:
+  ServiceCache::ServiceCallback Callback() {
+    return [this](EventType type, const ServiceInfo& info) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      events_.push_back({type, info});
+    };
+  }
+
+  std::vector<std::pair<EventType, ServiceInfo>> Get() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::pair<EventType, ServiceInfo>> events_;
+};
+
+std::string CachePath(const std::string& name) {
+  std::string path = testing::TempDir() + "service_cache_" +
+                     std::to_string(getpid()) + "/" + name;
+  unlink(path.c_str());
+  return path;
+}
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream in(path);
+  std::stringstream content;
+  content << in.rdbuf();
+  return content.str();
+}
+
+ServiceInfo Receiver(const std::string& name, uint16_t port) {
+  ServiceInfo info;
+  info.name = "001122334455@" + name;
+  info.fullname = info.name + "._raop._tcp.local";
+  info.ip = "192.168.1." + std::to_string(port % 250);
+  info.port = port;
+  info.txt = {{"cn", "0,1"}, {"sr", "44100"}, {"am", "AppleTV5,3"}};
+  return info;
+}
+
+ServiceCache::Options Options(const std::string& path) {
+  ServiceCache::Options options;
+  options.path = path;
+  options.confirm_timeout = std::chrono::milliseconds(100);
+  return options;
+}
+}  // namespace
+
+TEST(ServiceCacheTest, RoundTripsThroughTheFile) {
+  const std::string path = CachePath("round_trip");
+  auto odd = Receiver("Tab\tNew\nline \"quoted\"", 7000);
+  odd.txt["pk"] = "a=b\\c";
+  auto plain = Receiver("Kitchen", 7001);
+  {
+    ServiceCache cache(Options(path));
+    auto callback = cache.Attach(nullptr);
+    ASSERT_EQ(cache.Load(), helper::kOk);
+    callback(EventType::kServiceOnline, odd);
+    callback(EventType::kServiceOnline, plain);
+  }
+  // A line from an older run and one that is not an entry at all.
+  {
+    std::ofstream out(path, std::ios::app);
+    out << "1\t7002\t10.0.0.2\tstale\tstale._raop._tcp.local\n";
+    out << "garbage\n";
+  }
+
+  Events events;
+  ServiceCache cache(Options(path));
+  cache.Attach(events.Callback());
+  ASSERT_EQ(cache.Load(), helper::kOk);
+  auto loaded = events.Get();
+  ASSERT_EQ(loaded.size(), 2u);
+  for (const auto& [type, info] : loaded) {
+    EXPECT_EQ(type, EventType::kServiceOnline);
+    EXPECT_TRUE(info == odd || info == plain) << info.name;
+  }
+  EXPECT_EQ(cache.GetEntries().size(), 2u);
+
+  const std::string foreign = CachePath("foreign");
+  std::ofstream(foreign) << "not a cache\n";
+  ServiceCache other(Options(foreign));
+  EXPECT_NE(other.Load(), helper::kOk);
+}
+
+TEST(ServiceCacheTest, ConfirmsOrDropsCachedServices) {
+  const std::string path = CachePath("confirm");
+  auto staying = Receiver("staying", 7000);
+  auto gone = Receiver("gone", 7001);
+  {
+    ServiceCache cache(Options(path));
+    auto callback = cache.Attach(nullptr);
+    callback(EventType::kServiceOnline, staying);
+    callback(EventType::kServiceOnline, gone);
+  }
+
+  Events events;
+  ServiceCache cache(Options(path));
+  auto callback = cache.Attach(events.Callback());
+  ASSERT_EQ(cache.Load(), helper::kOk);
+  // Offered before the browser found anything.
+  EXPECT_EQ(events.Get().size(), 2u);
+
+  // The browser finds one as it was: nothing new downstream.
+  callback(EventType::kServiceOnline, staying);
+  EXPECT_EQ(events.Get().size(), 2u);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  auto after = events.Get();
+  ASSERT_EQ(after.size(), 3u);
+  EXPECT_EQ(after[2].first, EventType::kServiceOffline);
+  EXPECT_EQ(after[2].second, gone);
+  ASSERT_EQ(cache.GetEntries().size(), 1u);
+  EXPECT_EQ(ReadFile(path).find("gone"), std::string::npos);
+  EXPECT_NE(ReadFile(path).find("staying"), std::string::npos);
+}
+
+TEST(ServiceCacheTest, ForwardsChangesAndGoodbyes) {
+  const std::string path = CachePath("changes");
+  auto moving = Receiver("moving", 7000);
+  {
+    ServiceCache cache(Options(path));
+    cache.Attach(nullptr)(EventType::kServiceOnline, moving);
+  }
+
+  Events events;
+  ServiceCache cache(Options(path));
+  auto callback = cache.Attach(events.Callback());
+  ASSERT_EQ(cache.Load(), helper::kOk);
+  moving.ip = "192.168.1.99";
+  callback(EventType::kServiceOnline, moving);
+  callback(EventType::kServiceOffline, moving);
+
+  auto all = events.Get();
+  ASSERT_EQ(all.size(), 3u);
+  EXPECT_EQ(all[1].first, EventType::kServiceOnline);
+  EXPECT_EQ(all[1].second.ip, "192.168.1.99");
+  EXPECT_EQ(all[2].first, EventType::kServiceOffline);
+  EXPECT_TRUE(cache.GetEntries().empty());
+}
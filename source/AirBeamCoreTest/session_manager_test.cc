@@ -0,0 +1,269 @@
+#include "raop/session_manager.h"
+
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace AirBeamCore::raop;
+
+namespace {
+// Accepts the whole RAOP handshake and counts the audio datagrams sent to
+// its single UDP port. Stops answering after the given number of RTSP
+// requests, if any, and can refuse SETUP as a busy receiver does.
+class FakeRaopReceiver {
+ public:
+  explicit FakeRaopReceiver(int answers = -1, bool reject_setup = false)
+      : answers_left_(answers), reject_setup_(reject_setup) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    udp_fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(listen_fd_, (sockaddr*)&addr, sizeof(addr));
+    listen(listen_fd_, 16);
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd_, (sockaddr*)&addr, &len);
+    port_ = ntohs(addr.sin_port);
+
+    addr.sin_port = 0;
+    bind(udp_fd_, (sockaddr*)&addr, sizeof(addr));
+    len = sizeof(addr);
+    getsockname(udp_fd_, (sockaddr*)&addr, &len);
+    udp_port_ = ntohs(addr.sin_port);
+    thread_ = std::thread([this]() { Loop(); });
+  }
+
+  ~FakeRaopReceiver() {
+    stopped_ = true;
+    thread_.join();
+    for (int fd : conns_) close(fd);
+    close(listen_fd_);
+    close(udp_fd_);
+  }
+
+  uint32_t GetPort() const { return port_; }
+  uint64_t GetDatagrams() const { return datagrams_; }
+  // Closes every RTSP connection, as a receiver that went away.
+  void HangUp() {
+    hang_up_ = true;
+    while (hang_up_) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+ private:
+  void Loop() {
+    std::string response =
+        "RTSP/1.0 200 OK\r\nCSeq: 1\r\nSession: 1\r\n"
+        "Audio-Latency: 11025\r\n"
+        "Transport: RTP/AVP/UDP;unicast;mode=record;server_port=" +
+        std::to_string(udp_port_) +
+        ";control_port=" + std::to_string(udp_port_) +
+        ";timing_port=" + std::to_string(udp_port_) + "\r\n\r\n";
+    while (!stopped_) {
+      if (hang_up_) {
+        for (int fd : conns_) close(fd);
+        conns_.clear();
+        hang_up_ = false;
+      }
+      std::vector<pollfd> fds = {{listen_fd_, POLLIN, 0},
+                                 {udp_fd_, POLLIN, 0}};
+      for (int fd : conns_) fds.push_back({fd, POLLIN, 0});
+      if (poll(fds.data(), fds.size(), 10) <= 0) continue;
+      if (fds[0].revents & POLLIN) {
+        conns_.push_back(accept(listen_fd_, nullptr, nullptr));
+      }
+      if (fds[1].revents & POLLIN) {
+        char buf[2048];
+        while (recv(udp_fd_, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+          datagrams_++;
+        }
+      }
+      for (size_t i = 2; i < fds.size(); ++i) {
+        if (!(fds[i].revents & POLLIN)) continue;
+        char buf[4096];
+        ssize_t n = recv(fds[i].fd, buf, sizeof(buf), 0);
+        if (n <= 0) continue;
+        if (answers_left_ == 0) continue;
+        if (answers_left_ > 0) answers_left_--;
+        const std::string& reply =
+            reject_setup_ && std::string(buf, n).rfind("SETUP ", 0) == 0
+                ? kBusy
+                : response;
+        send(fds[i].fd, reply.data(), reply.size(), 0);
+      }
+    }
+  }
+
+  int listen_fd_ = -1;
+  int udp_fd_ = -1;
+  uint32_t port_ = 0;
+  uint32_t udp_port_ = 0;
+  std::atomic<bool> stopped_ = false;
+  std::atomic<bool> hang_up_ = false;
+  int answers_left_;
+  const bool reject_setup_;
+  const std::string kBusy =
+      "RTSP/1.0 453 Not Enough Bandwidth\r\nCSeq: 1\r\n\r\n";
+  std::atomic<uint64_t> datagrams_ = 0;
+  std::vector<int> conns_;
+  std::thread thread_;
+};
+
+void SilenceSource(RtpAudioPacketChunk& chunk) {
+  memset(chunk.data_, 0, sizeof(chunk.data_));
+  chunk.len_ = sizeof(chunk.data_);
+}
+}  // namespace
+
+TEST(SessionManagerTest, PacesSessionsOnWorkerPool) {
+  FakeRaopReceiver receiver;
+  SessionManager::Options options;
+  options.workers = 1;
+  SessionManager manager(options);
+
+  constexpr int kSessions = 3;
+  std::vector<SessionManager::SessionId> ids;
+  for (int i = 0; i < kSessions; ++i) {
+    SessionManager::SessionId id;
+    auto raop = std::make_shared<Raop>("127.0.0.1", receiver.GetPort());
+    ASSERT_EQ(manager.Add(raop, SilenceSource, id), AirBeamCore::helper::kOk);
+    ids.push_back(id);
+  }
+  EXPECT_EQ(manager.Size(), kSessions);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(400));
+  auto stats = manager.GetStats();
+  EXPECT_EQ(stats.failures, 0);
+  // 400 ms is about 50 packets per session.
+  EXPECT_GT(stats.packets, kSessions * 30);
+  EXPECT_LT(stats.packets, kSessions * 60);
+  EXPECT_GT(stats.pacing_error_p50_us, 0);
+  EXPECT_GT(receiver.GetDatagrams(), kSessions * 30);
+
+  for (auto id : ids) manager.Remove(id);
+  EXPECT_EQ(manager.Size(), 0);
+}
+
+TEST(SessionManagerTest, AddFailsWithoutReceiver) {
+  SessionManager manager;
+  SessionManager::SessionId id;
+  auto raop = std::make_shared<Raop>("127.0.0.1", 1);
+  EXPECT_NE(manager.Add(raop, SilenceSource, id), AirBeamCore::helper::kOk);
+  EXPECT_EQ(manager.Size(), 0);
+}
+
+TEST(SessionManagerTest, ReceiverRejectingSetupFailsOnlyItsAdd) {
+  FakeRaopReceiver receiver, busy(-1, true);
+  SessionManager::Options options;
+  options.workers = 2;
+  SessionManager manager(options);
+  SessionManager::SessionId id;
+  for (int i = 0; i < 2; ++i) {
+    auto raop = std::make_shared<Raop>("127.0.0.1", receiver.GetPort());
+    ASSERT_EQ(manager.Add(raop, SilenceSource, id), AirBeamCore::helper::kOk);
+  }
+  auto refused = std::make_shared<Raop>("127.0.0.1", busy.GetPort());
+  EXPECT_EQ(manager.Add(refused, SilenceSource, id),
+            AirBeamCore::helper::kErrRtspStatus);
+  EXPECT_FALSE(refused->IsConnected());
+  auto raop = std::make_shared<Raop>("127.0.0.1", receiver.GetPort());
+  ASSERT_EQ(manager.Add(raop, SilenceSource, id), AirBeamCore::helper::kOk);
+
+  uint64_t before = receiver.GetDatagrams();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  auto stats = manager.GetStats();
+  EXPECT_EQ(stats.sessions, 3);
+  EXPECT_EQ(stats.failures, 0);
+  // 200 ms is about 25 packets per session.
+  EXPECT_GT(receiver.GetDatagrams() - before, 3 * 15);
+}
+
+TEST(SessionManagerTest, DropsSessionWhoseReceiverHangsUp) {
+  FakeRaopReceiver staying, leaving;
+  SessionManager::Options options;
+  options.workers = 2;
+  SessionManager manager(options);
+  SessionManager::SessionId id;
+  for (auto* receiver : {&staying, &leaving}) {
+    auto raop = std::make_shared<Raop>("127.0.0.1", receiver->GetPort());
+    ASSERT_EQ(manager.Add(raop, SilenceSource, id), AirBeamCore::helper::kOk);
+  }
+  EXPECT_EQ(manager.GetStats().worker_sessions,
+            (std::vector<uint64_t>{1, 1}));
+
+  leaving.HangUp();
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (manager.Size() > 1 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto stats = manager.GetStats();
+  EXPECT_EQ(manager.Size(), 1);
+  EXPECT_EQ(stats.sessions, 1);
+  EXPECT_EQ(stats.failures, 1);
+  EXPECT_EQ(stats.worker_sessions[0] + stats.worker_sessions[1], 1);
+
+  // The freed worker takes the next session.
+  auto raop = std::make_shared<Raop>("127.0.0.1", staying.GetPort());
+  ASSERT_EQ(manager.Add(raop, SilenceSource, id), AirBeamCore::helper::kOk);
+  EXPECT_EQ(manager.GetStats().worker_sessions,
+            (std::vector<uint64_t>{1, 1}));
+}
+
+TEST(SessionManagerTest, KeepAlivesDoNotStallAudio) {
+  // Answers the handshake and nothing after it.
+  FakeRaopReceiver receiver(4);
+  SessionManager::Options options;
+  options.workers = 1;
+  options.keepalive_interval = std::chrono::milliseconds(100);
+  SessionManager manager(options);
+  SessionManager::SessionId id;
+  auto raop = std::make_shared<Raop>("127.0.0.1", receiver.GetPort());
+  ASSERT_EQ(manager.Add(raop, SilenceSource, id), AirBeamCore::helper::kOk);
+
+  // The first keepalive goes out 50 to 100 ms in and is never answered;
+  // the next one, 100 ms later, finds it outstanding and drops the session.
+  std::this_thread::sleep_for(std::chrono::milliseconds(120));
+  auto stats = manager.GetStats();
+  EXPECT_EQ(stats.keepalives, 1);
+  // Audio kept its pace while the reply was outstanding, far from the 5 s
+  // a blocking read would have waited.
+  EXPECT_GT(stats.packets, 10);
+  EXPECT_LT(stats.pacing_error_max_us, 50000);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_EQ(manager.GetStats().failures, 1);
+  EXPECT_EQ(manager.Size(), 0);
+}
+
+TEST(SessionManagerTest, PacesSessionsAtTheirOwnRate) {
+  FakeRaopReceiver receiver;
+  SessionManager::Options options;
+  options.workers = 1;
+  SessionManager manager(options);
+  SessionManager::SessionId id;
+  auto raop = std::make_shared<Raop>("127.0.0.1", receiver.GetPort());
+  ASSERT_EQ(raop->SetReceiverCapabilities(
+                AirBeamCore::discovery::RaopCapabilities::FromTxt(
+                    {{"sr", "48000"}})),
+            AirBeamCore::helper::kOk);
+  ASSERT_EQ(raop->GetStreamFormat().sample_rate, 48000);
+  ASSERT_EQ(manager.Add(raop, SilenceSource, id), AirBeamCore::helper::kOk);
+
+  // A 48 kHz timeline read as 44.1 kHz would put every packet years out.
+  std::this_thread::sleep_for(std::chrono::milliseconds(400));
+  auto stats = manager.GetStats();
+  EXPECT_GT(stats.packets, 30);
+  EXPECT_LT(stats.packets, 80);
+  EXPECT_LT(stats.pacing_error_max_us, 50000);
+  manager.Remove(id);
+}
@@ -0,0 +1,192 @@
+#include "raop/session_pool.h"
+
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace AirBeamCore::raop;
+
+namespace {
+// Answers every request on every connection with a bare 200 OK.
+class FakeRtspServer {
+ public:
+  FakeRtspServer() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(listen_fd_, (sockaddr*)&addr, sizeof(addr));
+    listen(listen_fd_, 16);
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd_, (sockaddr*)&addr, &len);
+    port_ = ntohs(addr.sin_port);
+    thread_ = std::thread([this]() { Loop(); });
+  }
+
+  ~FakeRtspServer() { Stop(); }
+
+  void Stop() {
+    if (stopped_.exchange(true)) return;
+    thread_.join();
+    for (int fd : conns_) close(fd);
+    close(listen_fd_);
+  }
+
+  uint32_t GetPort() const { return port_; }
+
+ private:
+  void Loop() {
+    while (!stopped_) {
+      std::vector<pollfd> fds = {{listen_fd_, POLLIN, 0}};
+      for (int fd : conns_) fds.push_back({fd, POLLIN, 0});
+      if (poll(fds.data(), fds.size(), 10) <= 0) continue;
+      if (fds[0].revents & POLLIN) {
+        conns_.push_back(accept(listen_fd_, nullptr, nullptr));
+      }
+      for (size_t i = 1; i < fds.size(); ++i) {
+        if (!(fds[i].revents & POLLIN)) continue;
+        char buf[4096];
+        if (recv(fds[i].fd, buf, sizeof(buf), 0) <= 0) continue;
+        const char kResp[] = "RTSP/1.0 200 OK\r\nCSeq: 1\r\n\r\n";
+        send(fds[i].fd, kResp, sizeof(kResp) - 1, 0);
+      }
+    }
+  }
+
+  int listen_fd_ = -1;
+  uint32_t port_ = 0;
+  std::atomic<bool> stopped_ = false;
+  std::vector<int> conns_;
+  std::thread thread_;
+};
+}  // namespace
+
+TEST(RaopSessionPoolTest, AcquireHitsWarmSession) {
+  FakeRtspServer server;
+  RaopSessionPool pool;
+
+  EXPECT_TRUE(pool.Warm("127.0.0.1", server.GetPort()));
+  EXPECT_EQ(pool.Size(), 1);
+
+  auto raop = pool.Acquire("127.0.0.1", server.GetPort());
+  ASSERT_NE(raop, nullptr);
+  EXPECT_TRUE(raop->IsConnected());
+  EXPECT_EQ(pool.Size(), 0);
+
+  auto metrics = pool.GetMetrics();
+  EXPECT_EQ(metrics.hits, 1);
+  EXPECT_EQ(metrics.misses, 0);
+  EXPECT_TRUE(pool.IsRecentlyUsed("127.0.0.1", server.GetPort()));
+}
+
+TEST(RaopSessionPoolTest, AcquireMissReturnsColdSession) {
+  RaopSessionPool pool;
+  auto raop = pool.Acquire("127.0.0.1", 1);
+  ASSERT_NE(raop, nullptr);
+  EXPECT_FALSE(raop->IsConnected());
+  EXPECT_EQ(pool.GetMetrics().misses, 1);
+}
+
+TEST(RaopSessionPoolTest, WarmFailsForUnreachableReceiver) {
+  uint32_t port;
+  {
+    FakeRtspServer server;
+    port = server.GetPort();
+  }
+  RaopSessionPool pool;
+  EXPECT_FALSE(pool.Warm("127.0.0.1", port));
+  EXPECT_EQ(pool.Size(), 0);
+  EXPECT_EQ(pool.GetMetrics().warm_failures, 1);
+}
+
+TEST(RaopSessionPoolTest, EvictsOverCap) {
+  FakeRtspServer a, b, c;
+  RaopSessionPool::Options options;
+  options.max_sessions = 2;
+  RaopSessionPool pool(options);
+
+  EXPECT_TRUE(pool.Warm("127.0.0.1", a.GetPort()));
+  EXPECT_TRUE(pool.Warm("127.0.0.1", b.GetPort()));
+  EXPECT_TRUE(pool.Warm("127.0.0.1", c.GetPort()));
+  EXPECT_EQ(pool.Size(), 2);
+  EXPECT_EQ(pool.GetMetrics().evicted_cap, 1);
+
+  // The oldest one was evicted.
+  auto raop = pool.Acquire("127.0.0.1", a.GetPort());
+  EXPECT_FALSE(raop->IsConnected());
+}
+
+TEST(RaopSessionPoolTest, EvictsIdleSessions) {
+  FakeRtspServer server;
+  RaopSessionPool::Options options;
+  options.idle_timeout = std::chrono::milliseconds(20);
+  options.keepalive_interval = std::chrono::hours(1);
+  options.background_maintenance = false;
+  RaopSessionPool pool(options);
+
+  EXPECT_TRUE(pool.Warm("127.0.0.1", server.GetPort()));
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  pool.Maintain();
+  EXPECT_EQ(pool.Size(), 0);
+  EXPECT_EQ(pool.GetMetrics().evicted_idle, 1);
+}
+
+TEST(RaopSessionPoolTest, EvictsDeadSessionsOnValidation) {
+  FakeRtspServer server;
+  RaopSessionPool::Options options;
+  options.keepalive_interval = std::chrono::milliseconds(0);
+  options.background_maintenance = false;
+  RaopSessionPool pool(options);
+
+  EXPECT_TRUE(pool.Warm("127.0.0.1", server.GetPort()));
+  server.Stop();
+  pool.Maintain();
+  EXPECT_EQ(pool.Size(), 0);
+  EXPECT_EQ(pool.GetMetrics().evicted_dead, 1);
+}
+
+TEST(RaopSessionPoolTest, WarmAsyncLeavesTheCallerFree) {
+  FakeRtspServer server;
+  RaopSessionPool::Options options;
+  options.background_maintenance = false;
+  RaopSessionPool manual(options);
+  manual.WarmAsync("127.0.0.1", server.GetPort());
+  EXPECT_EQ(manual.Size(), 0);
+  manual.Maintain();
+  EXPECT_EQ(manual.Size(), 1);
+
+  // The reaper picks it up without waiting out its period.
+  RaopSessionPool pool;
+  pool.WarmAsync("127.0.0.1", server.GetPort());
+  for (int i = 0; i < 100 && pool.Size() == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(pool.Size(), 1);
+}
+
+TEST(RaopSessionPoolTest, RemembersRecentReceiversAcrossRestarts) {
+  RaopSessionPool::Options options;
+  options.background_maintenance = false;
+  options.recent_path = testing::TempDir() + "session_pool_" +
+                        std::to_string(getpid()) + "/recent";
+  std::remove(options.recent_path.c_str());
+  {
+    RaopSessionPool pool(options);
+    pool.Acquire("127.0.0.1", 1);
+  }
+  RaopSessionPool restarted(options);
+  EXPECT_TRUE(restarted.IsRecentlyUsed("127.0.0.1", 1));
+  EXPECT_FALSE(restarted.IsRecentlyUsed("127.0.0.1", 2));
+}
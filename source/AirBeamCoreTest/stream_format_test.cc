@@ -0,0 +1,104 @@
+#include "raop/stream_format.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+
+#include "fake_receiver.h"
+#include "raop/raop.h"
+
+using namespace AirBeamCore;
+using namespace AirBeamCore::raop;
+using AirBeamCore::discovery::RaopCapabilities;
+using AirBeamCore::discovery::RaopCodec;
+using AirBeamCore::discovery::RaopEncryption;
+using AirBeamTesting::FakeReceiver;
+
+TEST(StreamFormatTest, ParsesTxtCapabilities) {
+  auto airport = RaopCapabilities::FromTxt({{"cn", "0,1"},
+                                            {"et", "0,1"},
+                                            {"sr", "44100"},
+                                            {"ss", "16"},
+                                            {"ch", "2"},
+                                            {"tp", "TCP,UDP"},
+                                            {"am", "AirPort10,115"}});
+  EXPECT_TRUE(airport.Supports(RaopCodec::kPcm));
+  EXPECT_TRUE(airport.Supports(RaopCodec::kAlac));
+  EXPECT_FALSE(airport.Supports(RaopCodec::kAac));
+  EXPECT_TRUE(airport.Supports(RaopEncryption::kRsa));
+  EXPECT_EQ(airport.sample_rate, 44100u);
+  EXPECT_TRUE(airport.udp);
+  EXPECT_EQ(airport.model, "AirPort10,115");
+
+  auto tv = RaopCapabilities::FromTxt(
+      {{"cn", "1,2,3"}, {"et", "0,3,5"}, {"sr", "48000"}, {"ch", "1"}});
+  EXPECT_FALSE(tv.Supports(RaopCodec::kPcm));
+  EXPECT_TRUE(tv.Supports(RaopEncryption::kFairPlaySap25));
+  EXPECT_EQ(tv.sample_rate, 48000u);
+  EXPECT_EQ(tv.channels, 1u);
+
+  // Missing and garbled keys keep the defaults.
+  auto bare = RaopCapabilities::FromTxt({{"cn", "x"}, {"sr", "fast"}});
+  EXPECT_EQ(bare, RaopCapabilities());
+  EXPECT_FALSE(RaopCapabilities::FromTxt({{"tp", "TCP"}}).udp);
+}
+
+TEST(StreamFormatTest, NegotiatesOrRefuses) {
+  StreamFormat format;
+  ASSERT_EQ(NegotiateStreamFormat(RaopCapabilities(), format), helper::kOk);
+  EXPECT_EQ(format.Rtpmap(), "L16/44100/2");
+  EXPECT_EQ(format.frames_per_packet, kPCMChunkLength);
+  EXPECT_EQ(format.BytesPerFrame(), 4u);
+  EXPECT_EQ(format.PacketDuration(), std::chrono::microseconds(7981));
+
+  ASSERT_EQ(NegotiateStreamFormat(
+                RaopCapabilities::FromTxt({{"ch", "1"}, {"sr", "48000"}}),
+                format),
+            helper::kOk);
+  EXPECT_EQ(format.Rtpmap(), "L16/48000/1");
+  ASSERT_EQ(NegotiateStreamFormat(RaopCapabilities::FromTxt({{"ss", "24"}}),
+                                  format),
+            helper::kOk);
+  EXPECT_EQ(format.Rtpmap(), "L24/44100/2");
+  // 352 frames of it would not fit one packet.
+  EXPECT_EQ(format.frames_per_packet, kPCMChunkLength / 2);
+  EXPECT_EQ(format.PacketDuration(), std::chrono::microseconds(3990));
+
+  const std::map<std::string, RaopCapabilities> refused = {
+      {"no pcm", RaopCapabilities::FromTxt({{"cn", "1,2"}})},
+      {"encrypted", RaopCapabilities::FromTxt({{"et", "1,3"}})},
+      {"tcp", RaopCapabilities::FromTxt({{"tp", "TCP"}})},
+      {"surround", RaopCapabilities::FromTxt({{"ch", "6"}})},
+      {"96 kHz", RaopCapabilities::FromTxt({{"sr", "96000"}})},
+  };
+  for (const auto& [name, capabilities] : refused) {
+    StreamFormat unchanged;
+    unchanged.frames_per_packet = 1;
+    EXPECT_EQ(NegotiateStreamFormat(capabilities, unchanged),
+              helper::kErrRaopUnsupportedFormat)
+        << name;
+    EXPECT_EQ(unchanged.frames_per_packet, 1u) << name;
+  }
+}
+
+TEST(StreamFormatTest, RefusedSessionSendsNoRtsp) {
+  FakeReceiver receiver;
+  ASSERT_EQ(receiver.Start(), helper::kOk);
+
+  Raop refused("127.0.0.1", receiver.GetPort());
+  refused.SetManaged(true);
+  EXPECT_EQ(refused.SetReceiverCapabilities(
+                RaopCapabilities::FromTxt({{"et", "4"}})),
+            helper::kErrRaopUnsupportedFormat);
+  EXPECT_EQ(refused.StartSession(), helper::kErrRaopUnsupportedFormat);
+  EXPECT_TRUE(receiver.GetMethods().empty());
+
+  Raop accepted("127.0.0.1", receiver.GetPort());
+  accepted.SetManaged(true);
+  ASSERT_EQ(accepted.SetReceiverCapabilities(RaopCapabilities::FromTxt(
+                {{"cn", "0,1"}, {"et", "0,4"}})),
+            helper::kOk);
+  ASSERT_EQ(accepted.StartSession(), helper::kOk);
+  EXPECT_TRUE(receiver.IsRecording());
+}
@@ -0,0 +1,102 @@
+#include "raop/timeline.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace AirBeamCore::raop;
+
+TEST(RtpTimelineTest, ResetAndAdvance) {
+  RtpTimeline timeline(100);
+  timeline.Reset(44100, NtpTime{1, 2});
+
+  auto snapshot = timeline.Load();
+  EXPECT_EQ(snapshot.next_seq, 100);
+  EXPECT_EQ(snapshot.head_ts, 44100);
+  EXPECT_EQ(snapshot.anchor_ts, 44100);
+  EXPECT_EQ(snapshot.anchor_ntp.seconds, 1);
+  EXPECT_EQ(snapshot.anchor_ntp.fraction, 2);
+
+  timeline.Advance(352);
+  snapshot = timeline.Load();
+  EXPECT_EQ(snapshot.next_seq, 101);
+  EXPECT_EQ(snapshot.head_ts, 44100 + 352);
+  EXPECT_EQ(snapshot.anchor_ts, 44100);
+}
+
+TEST(RtpTimelineTest, SeqWrapsAround) {
+  RtpTimeline timeline(0xffff);
+  timeline.Reset(0, NtpTime{0, 0});
+  timeline.Advance(352);
+  EXPECT_EQ(timeline.Load().next_seq, 0);
+}
+
+TEST(RtpTimelineTest, TimestampAtMapsThroughAnchor) {
+  RtpTimeline timeline(0);
+  timeline.Reset(1000, NtpTime{100, 0});
+  auto snapshot = timeline.Load();
+
+  EXPECT_EQ(RtpTimeline::TimestampAt(snapshot, NtpTime{100, 0}, 44100), 1000);
+  EXPECT_EQ(RtpTimeline::TimestampAt(snapshot, NtpTime{102, 0x80000000}, 44100),
+            1000 + 44100 * 2 + 22050);
+  EXPECT_EQ(RtpTimeline::TimestampAt(snapshot, NtpTime{99, 0x80000000}, 44100),
+            1000 - 22050);
+}
+
+// One writer advancing and re-anchoring, several readers checking that every
+// snapshot is internally consistent. Meant to also run under
+// -fsanitize=thread.
+TEST(RtpTimelineTest, ConcurrentReadersSeeConsistentSnapshots) {
+  constexpr uint16_t kInitialSeq = 0xfff0;
+  constexpr uint64_t kFrames = 352;
+  constexpr int kIterations = 200000;
+  constexpr int kReaders = 3;
+
+  RtpTimeline timeline(kInitialSeq);
+  timeline.Reset(0, NtpTime{0, 0});
+  std::atomic<bool> done = false;
+  std::atomic<int> inconsistent = 0;
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < kReaders; ++i) {
+    readers.emplace_back([&]() {
+      uint64_t last_head_ts = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        auto snapshot = timeline.Load();
+        // The writer encodes the anchor in both the NTP and RTP fields and
+        // advances seq and ts in lockstep, so any torn read breaks these.
+        uint64_t packets = (snapshot.head_ts - snapshot.anchor_ts) / kFrames;
+        uint16_t expected_seq =
+            static_cast<uint16_t>(kInitialSeq + snapshot.anchor_ntp.fraction +
+                                  packets);
+        if (snapshot.anchor_ntp.seconds != snapshot.anchor_ts ||
+            (snapshot.head_ts - snapshot.anchor_ts) % kFrames != 0 ||
+            snapshot.next_seq != expected_seq ||
+            snapshot.head_ts < last_head_ts) {
+          inconsistent++;
+        }
+        last_head_ts = snapshot.head_ts;
+      }
+    });
+  }
+
+  uint32_t advanced = 0;
+  for (int i = 0; i < kIterations; ++i) {
+    if (i % 1000 == 999) {
+      uint64_t head_ts = timeline.Load().head_ts;
+      timeline.Reset(head_ts,
+                     NtpTime{static_cast<uint32_t>(head_ts), advanced});
+    } else {
+      timeline.Advance(kFrames);
+      advanced++;
+    }
+  }
+  done = true;
+  for (auto& reader : readers) reader.join();
+
+  EXPECT_EQ(inconsistent.load(), 0);
+  auto snapshot = timeline.Load();
+  EXPECT_EQ(snapshot.next_seq, static_cast<uint16_t>(kInitialSeq + advanced));
+}
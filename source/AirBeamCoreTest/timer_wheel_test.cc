@@ -0,0 +1,78 @@
+#include "raop/timer_wheel.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace AirBeamCore::raop;
+
+TEST(TimerWheelTest, FiresInTickOrder) {
+  TimerWheel wheel(8, 100);
+  wheel.Schedule({102, 1, 0});
+  wheel.Schedule({101, 2, 0});
+  EXPECT_EQ(wheel.Size(), 2);
+
+  std::vector<TimerWheel::Timer> expired;
+  wheel.Advance(100, expired);
+  EXPECT_TRUE(expired.empty());
+  wheel.Advance(101, expired);
+  ASSERT_EQ(expired.size(), 1);
+  EXPECT_EQ(expired[0].id, 2);
+  wheel.Advance(102, expired);
+  ASSERT_EQ(expired.size(), 2);
+  EXPECT_EQ(expired[1].id, 1);
+  EXPECT_EQ(wheel.Size(), 0);
+}
+
+TEST(TimerWheelTest, FarTimerWaitsForItsRound) {
+  TimerWheel wheel(8, 0);
+  // Same slot as tick 3, two revolutions later.
+  wheel.Schedule({19, 1, 7});
+
+  std::vector<TimerWheel::Timer> expired;
+  for (uint64_t tick = 0; tick < 19; ++tick) wheel.Advance(tick, expired);
+  EXPECT_TRUE(expired.empty());
+  wheel.Advance(19, expired);
+  ASSERT_EQ(expired.size(), 1);
+  EXPECT_EQ(expired[0].tag, 7);
+}
+
+TEST(TimerWheelTest, PastDeadlineFiresOnNextAdvance) {
+  TimerWheel wheel(8, 50);
+  std::vector<TimerWheel::Timer> expired;
+  wheel.Advance(60, expired);
+  wheel.Schedule({10, 1, 0});
+  wheel.Advance(61, expired);
+  EXPECT_EQ(expired.size(), 1);
+}
+
+TEST(TimerWheelTest, CatchesUpAfterFallingBehind) {
+  TimerWheel wheel(4, 0);
+  wheel.Schedule({1, 1, 0});
+  wheel.Schedule({6, 2, 0});
+  wheel.Schedule({100, 3, 0});
+
+  std::vector<TimerWheel::Timer> expired;
+  wheel.Advance(50, expired);
+  EXPECT_EQ(expired.size(), 2);
+  EXPECT_EQ(wheel.Size(), 1);
+  wheel.Advance(100, expired);
+  EXPECT_EQ(expired.size(), 3);
+}
+
+TEST(TimerWheelTest, NextDeadlineIsTheFirstToFire) {
+  TimerWheel wheel(8, 100);
+  EXPECT_EQ(wheel.NextDeadline(), UINT64_MAX);
+  // Two revolutions out, in the slot of tick 101.
+  wheel.Schedule({117, 1, 0});
+  EXPECT_EQ(wheel.NextDeadline(), 117);
+  wheel.Schedule({104, 2, 0});
+  EXPECT_EQ(wheel.NextDeadline(), 104);
+  wheel.Schedule({50, 3, 0});
+  EXPECT_EQ(wheel.NextDeadline(), 100);
+
+  std::vector<TimerWheel::Timer> expired;
+  wheel.Advance(104, expired);
+  EXPECT_EQ(expired.size(), 2);
+  EXPECT_EQ(wheel.NextDeadline(), 117);
+}
@@ -0,0 +1,149 @@
+#include "helper/trace.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <regex>
+#include <string>
+#include <thread>
+
+#include "fake_receiver.h"
+#include "raop/raop.h"
+
+using namespace AirBeamCore;
+using AirBeamCore::helper::Tracer;
+
+namespace {
+size_t Count(const std::string& haystack, const std::string& needle) {
+  size_t count = 0;
+  for (size_t pos = haystack.find(needle); pos != std::string::npos;
+       pos = haystack.find(needle, pos + 1)) {
+    count++;
+  }
+  return count;
+}
+
+// Tracing is process wide; every test starts from an empty, enabled trace.
+class TraceTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    Tracer::Clear();
+    Tracer::Enable(true);
+  }
+  void TearDown() override { Tracer::Enable(false); }
+};
+}  // namespace
+
+TEST_F(TraceTest, DisabledRecordsNothing) {
+  Tracer::Enable(false);
+  { ABTraceScope("trace_test_disabled", 1); }
+  EXPECT_EQ(Count(Tracer::DumpChromeJson(), "trace_test_disabled"), 0);
+}
+
+TEST_F(TraceTest, ScopeBecomesCompleteEvent) {
+  {
+    ABTraceScope("trace_test_scope", 42);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  { ABTraceScope("trace_test_noseq"); }
+  std::string json = Tracer::DumpChromeJson();
+
+  std::smatch match;
+  ASSERT_TRUE(std::regex_search(
+      json, match,
+      std::regex("\\{\"ph\":\"X\",\"cat\":\"airbeam\",\"name\":"
+                 "\"trace_test_scope\",\"pid\":\\d+,\"tid\":\\d+,"
+                 "\"ts\":[0-9.]+,\"dur\":([0-9.]+),\"args\":\\{\"seq\":42\\}"
+                 "\\}")));
+  EXPECT_GE(std::stod(match[1]), 2000);
+  EXPECT_TRUE(std::regex_search(
+      json,
+      std::regex("\"name\":\"trace_test_noseq\"[^}]*\"dur\":[0-9.]+\\}")));
+}
+
+TEST_F(TraceTest, ClearDropsEarlierSpans) {
+  { ABTraceScope("trace_test_cleared"); }
+  Tracer::Clear();
+  std::this_thread::sleep_for(std::chrono::microseconds(10));
+  { ABTraceScope("trace_test_kept"); }
+  std::string json = Tracer::DumpChromeJson();
+  EXPECT_EQ(Count(json, "trace_test_cleared"), 0);
+  EXPECT_EQ(Count(json, "trace_test_kept"), 1);
+}
+
+TEST_F(TraceTest, RingKeepsLatestSpansPerThread) {
+  std::thread writer([]() {
+    Tracer::SetThreadName("trace_test_writer");
+    for (size_t i = 0; i < Tracer::kRingEvents + 100; ++i) {
+      Tracer::Record("trace_test_ring", i, Tracer::NowNs(), Tracer::NowNs());
+    }
+  });
+  writer.join();
+  std::string json = Tracer::DumpChromeJson();
+  EXPECT_EQ(Count(json, "\"trace_test_ring\""), Tracer::kRingEvents);
+  EXPECT_EQ(Count(json, "\"seq\":99}"), 0);
+  EXPECT_EQ(Count(json, "\"seq\":100}"), 1);
+  EXPECT_EQ(Count(json, "\"args\":{\"name\":\"trace_test_writer\"}"), 1);
+}
+
+TEST_F(TraceTest, ExitedThreadsDumpOnce) {
+  std::thread writer([]() { ABTraceScope("trace_test_exited"); });
+  writer.join();
+  EXPECT_EQ(Count(Tracer::DumpChromeJson(), "trace_test_exited"), 1);
+  EXPECT_EQ(Count(Tracer::DumpChromeJson(), "trace_test_exited"), 0);
+}
+
+TEST_F(TraceTest, KeepsTheLatestExitedThreads) {
+  Tracer::DumpChromeJson();
+  const size_t threads = Tracer::kExitedRings + 4;
+  for (size_t i = 0; i < threads; ++i) {
+    std::thread([i]() {
+      Tracer::Record("trace_test_exiting", i, Tracer::NowNs(),
+                     Tracer::NowNs());
+    }).join();
+  }
+  std::string json = Tracer::DumpChromeJson();
+  EXPECT_EQ(Count(json, "\"trace_test_exiting\""), Tracer::kExitedRings);
+  EXPECT_EQ(Count(json, "\"seq\":3}"), 0);
+  EXPECT_EQ(Count(json, "\"seq\":4}"), 1);
+}
+
+TEST_F(TraceTest, DumpWhileRecording) {
+  std::atomic<bool> done = false;
+  std::thread writer([&]() {
+    while (!done) {
+      ABTraceScope("trace_test_busy");
+    }
+  });
+  for (int i = 0; i < 20; ++i) {
+    std::string json = Tracer::DumpChromeJson();
+    EXPECT_EQ(json.back(), '}');
+  }
+  done = true;
+  writer.join();
+}
+
+TEST_F(TraceTest, FollowsPacketToTheWire) {
+  AirBeamTesting::FakeReceiver receiver;
+  ASSERT_EQ(receiver.Start(), helper::kOk);
+  auto raop = std::make_shared<raop::Raop>("127.0.0.1", receiver.GetPort());
+  raop->SetManaged(true);
+  ASSERT_EQ(raop->StartSession(), helper::kOk);
+  raop->BeginStream(raop::NtpTime::Now());
+
+  uint32_t seq = raop->GetTimeline().next_seq;
+  raop::RtpAudioPacketChunk chunk;
+  memset(chunk.data_, 0, sizeof(chunk.data_));
+  chunk.len_ = sizeof(chunk.data_);
+  raop->AcceptFrame();
+  raop->SendChunk(chunk);
+
+  std::string json = Tracer::DumpChromeJson();
+  for (const char* name : {"pace", "send_packet", "sendto"}) {
+    EXPECT_TRUE(std::regex_search(
+        json, std::regex(std::string("\"name\":\"") + name +
+                         "\"[^}]*\"seq\":" + std::to_string(seq) + "\\}")))
+        << name;
+  }
+}
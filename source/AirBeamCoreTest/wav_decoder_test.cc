@@ -0,0 +1,175 @@
+#include "audio/wav_decoder.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "audio_files.h"
+
+using namespace AirBeamCore;
+using AirBeamCore::audio::AiffDecoder;
+using AirBeamCore::audio::AudioSource;
+using AirBeamCore::audio::PCMFormat;
+using AirBeamCore::audio::PCMRegionSource;
+using AirBeamCore::audio::WavDecoder;
+
+namespace {
+std::string WriteFile(const std::string& name, const std::string& contents) {
+  std::string path =
+      testing::TempDir() + name + "_" + std::to_string(getpid());
+  std::ofstream out(path, std::ios::binary);
+  out << contents;
+  return path;
+}
+
+std::vector<int16_t> ReadAll(AudioSource& source, size_t chunk) {
+  std::vector<int16_t> samples;
+  const uint8_t* data;
+  while (size_t len = source.Next(chunk, data)) {
+    EXPECT_EQ(len % 4, 0u);
+    size_t old_size = samples.size();
+    samples.resize(old_size + len / 2);
+    memcpy(samples.data() + old_size, data, len);
+  }
+  return samples;
+}
+
+// More than one conversion block, with an odd tail.
+std::vector<int16_t> Tone(size_t frames, uint16_t channels) {
+  std::vector<int16_t> samples(frames * channels);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    samples[i] = static_cast<int16_t>((i * 7919) ^ (i << 9));
+  }
+  return samples;
+}
+
+std::vector<int16_t> ToStereo(const std::vector<int16_t>& samples,
+                              uint16_t channels) {
+  std::vector<int16_t> out;
+  for (size_t i = 0; i < samples.size(); i += channels) {
+    out.push_back(samples[i]);
+    out.push_back(samples[i + (channels > 1 ? 1 : 0)]);
+  }
+  return out;
+}
+
+PCMFormat Format(uint16_t channels, uint16_t bits,
+                 PCMFormat::Encoding encoding, bool big_endian) {
+  PCMFormat format;
+  format.channels = channels;
+  format.bits = bits;
+  format.encoding = encoding;
+  format.big_endian = big_endian;
+  return format;
+}
+
+constexpr size_t kFrames = PCMRegionSource::kBlockFrames * 2 + 123;
+}  // namespace
+
+TEST(WavDecoderTest, DecodesIntegerAndFloatFormats) {
+  struct Case {
+    PCMFormat format;
+    bool extensible;
+  } cases[] = {
+      {Format(2, 16, PCMFormat::Encoding::kSigned, false), false},
+      {Format(2, 24, PCMFormat::Encoding::kSigned, false), false},
+      {Format(2, 32, PCMFormat::Encoding::kSigned, false), true},
+      {Format(1, 16, PCMFormat::Encoding::kSigned, false), false},
+      {Format(2, 32, PCMFormat::Encoding::kFloat, false), false},
+      {Format(2, 64, PCMFormat::Encoding::kFloat, false), true},
+      {Format(2, 24, PCMFormat::Encoding::kSigned, false), true},
+  };
+  for (const auto& test : cases) {
+    auto samples = Tone(kFrames, test.format.channels);
+    std::string path = WriteFile(
+        "wav", AirBeamTesting::MakeWav(
+                   test.format, AirBeamTesting::PackPCM(samples, test.format),
+                   test.extensible));
+    WavDecoder decoder;
+    ASSERT_EQ(decoder.Open(path), helper::kOk);
+    PCMFormat input = decoder.GetInputFormat();
+    EXPECT_EQ(input.channels, test.format.channels);
+    EXPECT_EQ(input.bits, test.format.bits);
+    EXPECT_EQ(input.encoding, test.format.encoding);
+    EXPECT_EQ(input.sample_rate, 44'100u);
+    EXPECT_EQ(ReadAll(decoder, 1000), ToStereo(samples, test.format.channels))
+        << test.format.bits << " bits, " << test.format.channels
+        << " channels";
+  }
+}
+
+TEST(WavDecoderTest, EightBitIsUnsigned) {
+  auto format = Format(2, 8, PCMFormat::Encoding::kUnsigned, false);
+  auto samples = Tone(1000, 2);
+  std::string path = WriteFile(
+      "wav8", AirBeamTesting::MakeWav(
+                  format, AirBeamTesting::PackPCM(samples, format)));
+  WavDecoder decoder;
+  ASSERT_EQ(decoder.Open(path), helper::kOk);
+  EXPECT_EQ(decoder.GetInputFormat().encoding,
+            PCMFormat::Encoding::kUnsigned);
+  auto out = ReadAll(decoder, 4096);
+  ASSERT_EQ(out.size(), samples.size());
+  for (size_t i = 0; i < out.size(); ++i) {
+    ASSERT_EQ(out[i], static_cast<int16_t>(samples[i] & ~0xFF)) << i;
+  }
+}
+
+TEST(WavDecoderTest, RewindStartsOver) {
+  auto format = Format(2, 24, PCMFormat::Encoding::kSigned, false);
+  auto samples = Tone(kFrames, 2);
+  std::string path = WriteFile(
+      "wav_rewind", AirBeamTesting::MakeWav(
+                        format, AirBeamTesting::PackPCM(samples, format)));
+  WavDecoder decoder;
+  ASSERT_EQ(decoder.Open(path), helper::kOk);
+  auto first = ReadAll(decoder, 352 * 4);
+  ASSERT_EQ(decoder.Rewind(), helper::kOk);
+  EXPECT_EQ(ReadAll(decoder, 777 * 4), first);
+  EXPECT_EQ(first, samples);
+}
+
+TEST(WavDecoderTest, RejectsWhatItCannotRead) {
+  WavDecoder decoder;
+  EXPECT_NE(decoder.Open(testing::TempDir() + "no_such.wav"), helper::kOk);
+  std::string no_format("RIFF\0\0\0\0WAVE", 12);
+  EXPECT_NE(decoder.Open(WriteFile("wav_bad", no_format)), helper::kOk);
+  // A truncated data chunk still plays what is there.
+  auto format = Format(2, 16, PCMFormat::Encoding::kSigned, false);
+  auto samples = Tone(500, 2);
+  std::string wav = AirBeamTesting::MakeWav(
+      format, AirBeamTesting::PackPCM(samples, format));
+  wav.resize(wav.size() - 6);
+  ASSERT_EQ(decoder.Open(WriteFile("wav_short", wav)), helper::kOk);
+  auto out = ReadAll(decoder, 4096);
+  EXPECT_EQ(out.size(), samples.size() - 4);
+}
+
+TEST(AiffDecoderTest, DecodesAiffAndAifc) {
+  PCMFormat formats[] = {
+      Format(2, 16, PCMFormat::Encoding::kSigned, true),
+      Format(1, 24, PCMFormat::Encoding::kSigned, true),
+      Format(2, 16, PCMFormat::Encoding::kSigned, false),
+      Format(2, 32, PCMFormat::Encoding::kFloat, true),
+      Format(2, 64, PCMFormat::Encoding::kFloat, true),
+  };
+  for (PCMFormat format : formats) {
+    format.sample_rate = 48'000;
+    auto samples = Tone(kFrames, format.channels);
+    std::string path = WriteFile(
+        "aiff", AirBeamTesting::MakeAiff(
+                    format, AirBeamTesting::PackPCM(samples, format)));
+    AiffDecoder decoder;
+    ASSERT_EQ(decoder.Open(path), helper::kOk);
+    PCMFormat input = decoder.GetInputFormat();
+    EXPECT_EQ(input.sample_rate, 48'000u);
+    EXPECT_EQ(input.big_endian, format.big_endian);
+    EXPECT_EQ(input.encoding, format.encoding);
+    EXPECT_EQ(ReadAll(decoder, 1000), ToStereo(samples, format.channels))
+        << format.bits << " bits, big_endian " << format.big_endian;
+  }
+}
@@ -1,10 +1,11 @@
 #include <sys/fcntl.h>
 
-#include <atomic>
+#include <algorithm>
 #include <chrono>
-#include <fstream>
-#include <ios>
+#include <condition_variable>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -17,16 +18,48 @@
 #include "absl/log/log_sink.h"
 #include "absl/log/log_sink_registry.h"
 #include "absl/strings/str_split.h"
-#include "macos/bonjour_browse.h"
-#include "raop/codec.h"
-#include "raop/fifo.h"
+#include "audio/audio_source.h"
+#include "audio/resampler.h"
+#include "discovery/mdns_browser.h"
+#include "discovery/service_cache.h"
+#include "helper/capture.h"
+#include "helper/metrics_registry.h"
+#include "helper/metrics_server.h"
+#include "helper/trace.h"
+#include "raop/constants.h"
 #include "raop/raop.h"
 
-ABSL_FLAG(std::string, audio_pcm, "", "Path to the audio PCM file.");
+ABSL_FLAG(std::string, audio_pcm, "",
+          "Path to the audio file: WAV, AIFF, FLAC or raw PCM; - or a FIFO "
+          "streams raw PCM live, as does udp://host:port or unix:///path "
+          "with raw PCM or RTP L16 datagrams.");
+ABSL_FLAG(bool, loop, false, "Play the audio file over and over.");
+ABSL_FLAG(uint64_t, start_seconds, 0, "Start this far into the file.");
+ABSL_FLAG(int, duration_seconds, 0,
+          "Stop streaming after this long; 0 runs to the end of the file, "
+          "or forever with --loop.");
 ABSL_FLAG(std::string, log, "", "Log to this file. ");
+ABSL_FLAG(int, metrics_port, 0,
+          "Serve /metrics and /metrics.json on this loopback port; 0 is off.");
+ABSL_FLAG(std::string, metrics_socket, "",
+          "Serve metrics on this Unix-domain socket instead.");
+ABSL_FLAG(std::string, trace_out, "",
+          "Trace the pipeline and write a Chrome trace here when done.");
+ABSL_FLAG(std::string, pcap_out, "",
+          "Record the RTSP and RTP traffic to pcapng files with this prefix.");
+ABSL_FLAG(int, pcap_max_mb, 64, "Start a new pcapng file past this size.");
+ABSL_FLAG(int, browse_ms, 3000,
+          "Look for receivers at most this long; browsing stops sooner once "
+          "the first one resolves and no more show up for a moment.");
+ABSL_FLAG(bool, receiver_cache, true,
+          "List the receivers found last time right away, from a cache "
+          "under $XDG_CACHE_HOME or ~/.cache.");
 
 using namespace AirBeamCore::raop;
-using namespace AirBeamCore::macos;
+using AirBeamCore::discovery::EventType;
+using AirBeamCore::discovery::MdnsBrowser;
+using AirBeamCore::discovery::ServiceCache;
+using AirBeamCore::discovery::ServiceInfo;
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -79,30 +112,71 @@ class FileLogSink : public absl::LogSink {
   int fd_ = -1;
 };
 
-void TryBonjourBrowse(std::vector<BonjourBrowse::ServiceInfo>& found_services) {
-  BonjourBrowse browser;
-  auto callback = [&](BonjourBrowse::EventType event_type,
-                      const BonjourBrowse::ServiceInfo& service_info) {
-    if (event_type == BonjourBrowse::EventType::kServiceOnline) {
-      LOG(INFO) << "[Bonjour] Found: " << service_info.name
+void TryBrowse(std::vector<ServiceInfo>& found_services) {
+  // Receivers on the network answer the first query within a few hundred
+  // milliseconds of each other.
+  constexpr auto kSettle = std::chrono::milliseconds(300);
+  std::mutex mutex;
+  std::condition_variable found;
+  auto last_found = std::chrono::steady_clock::time_point();
+  MdnsBrowser browser;
+  auto callback = [&](EventType event_type, const ServiceInfo& service_info) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (event_type == EventType::kServiceOnline) {
+      LOG(INFO) << "[mDNS] Found: " << service_info.name
                 << ", IP: " << service_info.ip
                 << ", Port: " << service_info.port << std::endl;
+      found_services.erase(
+          std::remove_if(found_services.begin(), found_services.end(),
+                         [&](const ServiceInfo& service) {
+                           return service.fullname == service_info.fullname;
+                         }),
+          found_services.end());
       found_services.push_back(service_info);
-    } else if (event_type == BonjourBrowse::EventType::kServiceOffline) {
-      LOG(INFO) << "[Bonjour] Offline: " << service_info.name << std::endl;
+      last_found = std::chrono::steady_clock::now();
+      found.notify_one();
+    } else if (event_type == EventType::kServiceOffline) {
+      LOG(INFO) << "[mDNS] Offline: " << service_info.name << std::endl;
+      found_services.erase(
+          std::remove_if(found_services.begin(), found_services.end(),
+                         [&](const ServiceInfo& service) {
+                           return service.fullname == service_info.fullname;
+                         }),
+          found_services.end());
     }
   };
-  bool started = browser.startBrowse("_raop._tcp", callback);
-  CHECK(started) << "Failed to start Bonjour browsing.";
-
-  std::this_thread::sleep_for(std::chrono::seconds(3));
-  browser.stop();
+  ServiceCache::Options cache_options;
+  if (absl::GetFlag(FLAGS_receiver_cache)) {
+    cache_options.path = ServiceCache::DefaultPath();
+  }
+  ServiceCache cache(cache_options);
+  auto browse_callback = cache.Attach(callback);
+  if (!cache_options.path.empty()) cache.Load();
+  auto started = browser.Start("_raop._tcp", browse_callback);
+  CHECK(started == AirBeamCore::helper::kOk)
+      << "Failed to start mDNS browsing: " << started;
+
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(absl::GetFlag(FLAGS_browse_ms));
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (std::chrono::steady_clock::now() < deadline) {
+      auto wake = deadline;
+      if (!found_services.empty()) wake = std::min(wake, last_found + kSettle);
+      if (found.wait_until(lock, wake) == std::cv_status::timeout &&
+          !found_services.empty() &&
+          std::chrono::steady_clock::now() >= last_found + kSettle) {
+        break;
+      }
+    }
+  }
+  browser.Stop();
 
   LOG(INFO) << "Found " << found_services.size() << " services.";
 }
 
-void TryChooseService(const std::vector<BonjourBrowse::ServiceInfo>& services,
-                      BonjourBrowse::ServiceInfo& chosen) {
+void TryChooseService(const std::vector<ServiceInfo>& services,
+                      ServiceInfo& chosen) {
   CHECK(services.size() > 0) << "No service found.";
 
   LOG(INFO) << "Available services:" << std::endl;
@@ -138,59 +212,148 @@ void TryChooseService(const std::vector<BonjourBrowse::ServiceInfo>& services,
             << ", Port: " << chosen.port << std::endl;
 }
 
-void TryRaop(const BonjourBrowse::ServiceInfo& service,
+void TryRaop(const ServiceInfo& service,
              const std::string& audio_pcm_path) {
   Raop raop(service.ip, service.port);
-  raop.Start();
-  raop.SetVolume(30);
-
-  LOG(INFO) << "Service Connected";
+  CHECK(raop.SetReceiverCapabilities(service.capabilities) ==
+        AirBeamCore::helper::kOk)
+      << service.name << " plays nothing this sender can send"
+      << (service.capabilities.model.empty()
+              ? ""
+              : " (" + service.capabilities.model + ")");
+  const auto& stream_format = raop.GetStreamFormat();
+  LOG(INFO) << "Format: " << stream_format.Rtpmap() << ", "
+            << stream_format.frames_per_packet << " frames per packet";
+
+  std::unique_ptr<AirBeamCore::audio::AudioSource> source;
+  CHECK(AirBeamCore::audio::OpenAudioSource(audio_pcm_path, source) ==
+        AirBeamCore::helper::kOk)
+      << "Failed to open file: " << audio_pcm_path;
+  auto input_format = source->GetInputFormat();
+  CHECK(AirBeamCore::audio::ResampleAudioSource(stream_format.sample_rate,
+                                                source) ==
+        AirBeamCore::helper::kOk)
+      << "Cannot resample " << input_format.sample_rate << " Hz to "
+      << stream_format.sample_rate << " Hz";
+  if (input_format.sample_rate != stream_format.sample_rate) {
+    LOG(INFO) << "Resampling " << input_format.sample_rate << " Hz to "
+              << stream_format.sample_rate << " Hz";
+  }
+  LOG(INFO) << "Input: " << input_format.channels << " channels, "
+            << input_format.bits << " bits";
+  const bool loop = absl::GetFlag(FLAGS_loop);
+  uint64_t skip_bytes = absl::GetFlag(FLAGS_start_seconds) *
+                        stream_format.sample_rate *
+                        AirBeamCore::audio::kOutputFrameBytes;
+  const uint8_t* data;
+  while (skip_bytes > 0) {
+    size_t len = source->Next(std::min<uint64_t>(skip_bytes, 1 << 20), data);
+    if (len == 0) break;
+    skip_bytes -= len;
+  }
 
-  constexpr size_t kFiFOCapacity = 30 * 1024 * 1024;  // 30MB buffer
+  using AirBeamCore::helper::PacketCapture;
+  std::unique_ptr<PacketCapture> capture;
+  PacketCapture::Options capture_options;
+  capture_options.path = absl::GetFlag(FLAGS_pcap_out);
+  capture_options.max_file_bytes =
+      static_cast<uint64_t>(absl::GetFlag(FLAGS_pcap_max_mb)) << 20;
+  if (!capture_options.path.empty()) {
+    capture = std::make_unique<PacketCapture>(capture_options);
+    CHECK(capture->Start() == AirBeamCore::helper::kOk)
+        << "Failed to start capture: " << capture_options.path;
+  }
 
-  ConcurrentByteFIFO fifo(kFiFOCapacity);
-  std::ifstream ifs(audio_pcm_path, std::ios::binary);
+  CHECK(raop.Start() == AirBeamCore::helper::kOk)
+      << "Failed to start the session with " << service.name;
+  CHECK(raop.SetVolume(30) == AirBeamCore::helper::kOk)
+      << "Failed to set the volume of " << service.name;
 
-  CHECK(ifs.is_open()) << "Failed to open file: " << audio_pcm_path;
+  LOG(INFO) << "Service Connected";
 
-  std::atomic<bool> write_done = false;
-  std::thread producer([&]() {
-    char chunk[1024];
-    while (ifs.read(chunk, sizeof(chunk)) || ifs.gcount() > 0) {
-      fifo.Write(reinterpret_cast<uint8_t*>(chunk), ifs.gcount());
-    }
+  using AirBeamCore::helper::MetricsRegistry;
+  using AirBeamCore::helper::MetricsServer;
+  auto& registry = MetricsRegistry::Default();
+  auto collector = registry.Register(
+      [&](AirBeamCore::helper::MetricsWriter& writer) {
+        raop.WriteMetrics(writer);
+      });
+  std::unique_ptr<MetricsServer> metrics_server;
+  MetricsServer::Options metrics_options;
+  metrics_options.unix_path = absl::GetFlag(FLAGS_metrics_socket);
+  metrics_options.port = absl::GetFlag(FLAGS_metrics_port);
+  if (!metrics_options.unix_path.empty() || metrics_options.port != 0) {
+    metrics_server =
+        std::make_unique<MetricsServer>(registry, metrics_options);
+    CHECK(metrics_server->Start() == AirBeamCore::helper::kOk)
+        << "Failed to start the metrics server";
+  }
 
-    if (ifs.eof()) {
-      LOG(INFO) << "Finished reading file.";
-    } else if (ifs.fail()) {
-      LOG(ERROR) << "Error reading file.";
+  std::string trace_out = absl::GetFlag(FLAGS_trace_out);
+  AirBeamCore::helper::Tracer::Enable(!trace_out.empty());
+  AirBeamCore::helper::Tracer::SetThreadName("sender");
+
+  // The sender encodes straight out of the source's buffer, paced by
+  // AcceptFrame; decoded blocks are stitched into whole packets.
+  RtpAudioPacketChunk encoded;
+  uint8_t staging[sizeof(encoded.data_)];
+  uint64_t loops = 0;
+  uint64_t frames = 0;
+  auto duration = std::chrono::seconds(absl::GetFlag(FLAGS_duration_seconds));
+  auto deadline = std::chrono::steady_clock::now() + duration;
+  while (duration.count() == 0 || std::chrono::steady_clock::now() < deadline) {
+    uint32_t seq = raop.GetTimeline().next_seq;
+    size_t size = AirBeamCore::audio::NextFull(
+        *source, raop.GetPacketInputBytes(), staging, data, loop, &loops);
+    // A live source that ran dry is an underrun, sent as an empty chunk.
+    if (size == 0 && source->AtEnd()) break;
+    frames += size / AirBeamCore::audio::kOutputFrameBytes;
+    {
+      ABTraceScope("encode", seq);
+      raop.Packetize(data, size, encoded);
     }
-
-    ifs.close();
-    write_done.store(true);
-  });
-  producer.detach();
-
-  RtpAudioPacketChunk chunk, encoded;
-  while (!write_done.load() || !fifo.Empty()) {
-    size_t size = fifo.Read(chunk.data_, sizeof(chunk.data_),
-                            std::chrono::milliseconds(100));
-    chunk.len_ = size;
-    PCMCodec::Encode(chunk, encoded);
-    encoded.len_ = chunk.len_;
     raop.AcceptFrame();
-    raop.SendChunk(encoded);
+    auto sent = raop.SendChunk(encoded);
+    if (sent != AirBeamCore::helper::kOk) {
+      LOG(ERROR) << "Session failed, ret=" << sent;
+      break;
+    }
+  }
+  LOG(INFO) << "Finished reading file after " << frames
+            << " frames, loops=" << loops;
+
+  auto underrun_stats = raop.GetUnderrunStats();
+  LOG(INFO) << "Finished sending audio. underruns=" << underrun_stats.underruns
+            << ", silence_packets=" << underrun_stats.silence_packets
+            << ", padded_packets=" << underrun_stats.padded_packets;
+  auto stats = raop.GetStats();
+  LOG(INFO) << "packets_sent=" << stats.packets_sent
+            << ", send_p99_us=" << stats.send_latency.Percentile(0.99) / 1000
+            << ", pacing_p99_us=" << stats.pacing_error.Percentile(0.99) / 1000
+            << ", rtsp_rtt_max_us=" << stats.rtsp_round_trip.max / 1000;
+  metrics_server.reset();
+  registry.Unregister(collector);
+  if (!trace_out.empty()) {
+    CHECK(AirBeamCore::helper::Tracer::WriteChromeTrace(trace_out) ==
+          AirBeamCore::helper::kOk)
+        << "Failed to write trace: " << trace_out;
+    LOG(INFO) << "Trace written to " << trace_out;
+  }
+  if (capture) {
+    capture->Stop();
+    auto capture_stats = capture->GetStats();
+    LOG(INFO) << "Captured " << capture_stats.packets << " packets, dropped "
+              << capture_stats.dropped << ", in " << capture_stats.files
+              << " file(s) starting at " << capture->FilePath(0);
   }
-
-  LOG(INFO) << "Finished sending audio.";
 }
 
 int main(int argc, char* argv[]) {
   absl::SetProgramUsageMessage("AirBeamDoctor");
   absl::ParseCommandLine(argc, argv);
 
-  // audio_pcm file should be raw, 16bit, signed-integer, stereo, 44100 sample
-  // rate, e.g.:
+  // audio_pcm may be a WAV, AIFF or FLAC file at any rate, or raw 16-bit
+  // signed-integer stereo 44100 Hz PCM, e.g.:
   // brew install sox
   // play -t raw -b 16 -e signed-integer -c 2 -r 44100 ./resources/audio.pcm
   std::string audio_pcm_path = absl::GetFlag(FLAGS_audio_pcm);
@@ -207,10 +370,10 @@ int main(int argc, char* argv[]) {
   LOG(INFO) << "Begin Doctor";
 
   int ret = 0;
-  std::vector<BonjourBrowse::ServiceInfo> found_services;
-  BonjourBrowse::ServiceInfo chosen_service;
+  std::vector<ServiceInfo> found_services;
+  ServiceInfo chosen_service;
 
-  TryBonjourBrowse(found_services);
+  TryBrowse(found_services);
   TryChooseService(found_services, chosen_service);
   TryRaop(chosen_service, audio_pcm_path);
 
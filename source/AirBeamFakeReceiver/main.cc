@@ -0,0 +1,59 @@
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "fake_receiver.h"
+#include "fmt/core.h"
+
+ABSL_FLAG(uint32_t, port, 5000, "RTSP port to listen on, 0 for any.");
+ABSL_FLAG(uint64_t, latency, 11025, "Audio-Latency to announce, in frames.");
+ABSL_FLAG(int, seconds, 0, "Exit after this many seconds, 0 to run forever.");
+ABSL_FLAG(std::string, pcm_out, "",
+          "Write the decoded audio here as s16le stereo.");
+
+using namespace AirBeamTesting;
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  FakeReceiver::Options options;
+  options.rtsp_port = absl::GetFlag(FLAGS_port);
+  options.latency = absl::GetFlag(FLAGS_latency);
+  options.keep_samples = !absl::GetFlag(FLAGS_pcm_out).empty();
+  FakeReceiver receiver(options);
+  if (receiver.Start() != AirBeamCore::helper::kOk) {
+    std::cerr << "failed to listen on port " << options.rtsp_port << std::endl;
+    return 1;
+  }
+  std::cout << "listening on 127.0.0.1:" << receiver.GetPort() << std::endl;
+
+  int seconds = absl::GetFlag(FLAGS_seconds);
+  for (int elapsed = 0; seconds == 0 || elapsed < seconds; ++elapsed) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    auto stats = receiver.GetStats();
+    std::cout << fmt::format(
+                     "packets={} lost={} dup={} ooo={} rexmit_req={} "
+                     "syncs={} jitter_us={:.1f} offset_p50_us={} "
+                     "offset_p99_us={} startup_us={} rtt_us={}",
+                     stats.packets, stats.lost, stats.duplicates,
+                     stats.out_of_order, stats.retransmit_requests,
+                     stats.syncs, stats.jitter_us,
+                     stats.schedule_offset_p50_us,
+                     stats.schedule_offset_p99_us, stats.startup_latency_us,
+                     stats.round_trip_us)
+              << std::endl;
+  }
+  receiver.Stop();
+
+  if (!absl::GetFlag(FLAGS_pcm_out).empty()) {
+    auto samples = receiver.GetSamples();
+    std::ofstream out(absl::GetFlag(FLAGS_pcm_out), std::ios::binary);
+    out.write(reinterpret_cast<const char*>(samples.data()),
+              samples.size() * sizeof(int16_t));
+  }
+  return 0;
+}
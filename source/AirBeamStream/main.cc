@@ -0,0 +1,325 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/strings/numbers.h"
+#include "audio/audio_source.h"
+#include "audio/datagram_source.h"
+#include "audio/pipe_source.h"
+#include "audio/resampler.h"
+#include "discovery/mdns_browser.h"
+#include "fmt/core.h"
+#include "helper/network.h"
+#include "raop/constants.h"
+#include "raop/raop.h"
+
+ABSL_FLAG(std::string, receiver, "",
+          "RAOP receiver as host:port, e.g. 192.168.1.20:7000 or "
+          "[fe80::1%eth0]:7000.");
+ABSL_FLAG(std::string, receiver_name, "",
+          "RAOP receiver to find with mDNS instead of --receiver, by its "
+          "name (Kitchen) or its whole instance name (001122334455@Kitchen); "
+          "its TXT record picks the format.");
+ABSL_FLAG(int, browse_ms, 5000,
+          "How long to look for --receiver_name before giving up.");
+ABSL_FLAG(std::string, source, "-",
+          "Audio to stream: a WAV, AIFF, FLAC or raw PCM file, - or a FIFO "
+          "for live raw s16le stereo 44.1 kHz PCM, or udp://host:port or "
+          "unix:///path to listen for that PCM, or RTP L16, as datagrams.");
+ABSL_FLAG(bool, loop, false, "Play a file source over and over.");
+ABSL_FLAG(int, jitter_ms, 40,
+          "Datagram sources: audio to buffer before playing, to ride out "
+          "reordering and late packets.");
+ABSL_FLAG(std::string, conceal, "fade",
+          "Datagram sources: what fills in for a lost packet, repeat (the "
+          "last audio) or fade (it, to silence).");
+ABSL_FLAG(std::string, codec, "pcm",
+          "Audio codec; pcm (uncompressed L16) is the only one so far.");
+ABSL_FLAG(int, latency_ms, 0,
+          "Latency to announce to the receiver; 0 keeps its own.");
+ABSL_FLAG(int, volume, 30, "Receiver volume, 0 to 100.");
+ABSL_FLAG(std::string, underrun, "silence",
+          "What a late live source does to the stream: silence keeps the "
+          "timeline going, resync pauses and restarts it.");
+ABSL_FLAG(int, stats_seconds, 5, "Print stats this often; 0 is off.");
+ABSL_FLAG(int, duration_seconds, 0, "Stop after this long; 0 runs to the end.");
+
+using namespace AirBeamCore;
+
+namespace {
+volatile std::sig_atomic_t g_stop = 0;
+
+void OnSignal(int) { g_stop = 1; }
+
+// Splits host:port, with the host optionally in brackets for IPv6.
+bool ParseReceiver(const std::string& receiver, std::string& host,
+                   uint32_t& port) {
+  size_t colon = receiver.rfind(':');
+  if (colon == std::string::npos || colon == 0) return false;
+  host = receiver.substr(0, colon);
+  if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+    host = host.substr(1, host.size() - 2);
+  }
+  return absl::SimpleAtoi(receiver.substr(colon + 1), &port) && port != 0 &&
+         port <= 65535;
+}
+
+// Browses for the receiver named name, either its whole instance name or
+// the part after '@', until it resolves or timeout passes.
+bool FindReceiver(const std::string& name, std::chrono::milliseconds timeout,
+                  discovery::ServiceInfo& found) {
+  std::mutex mutex;
+  std::condition_variable resolved;
+  bool matched = false;
+  auto callback = [&](discovery::EventType type,
+                      const discovery::ServiceInfo& info) {
+    if (type != discovery::EventType::kServiceOnline) return;
+    size_t at = info.name.find('@');
+    if (info.name != name &&
+        (at == std::string::npos || info.name.substr(at + 1) != name)) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (matched) return;
+    found = info;
+    matched = true;
+    resolved.notify_one();
+  };
+  discovery::MdnsBrowser browser;
+  if (browser.Start("_raop._tcp", callback) != helper::kOk) return false;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    resolved.wait_for(lock, timeout, [&]() { return matched; });
+  }
+  browser.Stop();
+  return matched;
+}
+
+struct StatsPrinter {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point last = start;
+  uint64_t last_bytes = 0;
+
+  void Print(const raop::Raop& raop, const audio::AudioSource& source) {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - last).count();
+    auto stats = raop.GetStats();
+    double kbps = seconds > 0
+                      ? (stats.bytes_sent - last_bytes) * 8 / seconds / 1000
+                      : 0;
+    // Either source runs at the stream's rate, or it would be wrapped in a
+    // resampler and not show up here.
+    uint64_t sample_rate = raop.GetStreamFormat().sample_rate;
+    std::string buffered;
+    if (auto* pipe = dynamic_cast<const audio::PipeSource*>(&source)) {
+      auto pipe_stats = pipe->GetStats();
+      buffered = fmt::format(
+          " buffered_ms={} source_underruns={} stalls={}",
+          pipe_stats.buffered * 1000 /
+              (sample_rate * audio::kOutputFrameBytes),
+          pipe_stats.underruns, pipe_stats.stalls);
+    } else if (auto* datagrams =
+                   dynamic_cast<const audio::DatagramSource*>(&source)) {
+      auto jitter = datagrams->GetStats();
+      buffered = fmt::format(
+          " buffered_ms={} source_underruns={} late={} dup={} concealed={} "
+          "overflow={} rejected={}",
+          jitter.buffered_frames * 1000 / sample_rate,
+          jitter.underruns, jitter.late, jitter.duplicates,
+          jitter.concealed_frames, jitter.overflow_frames, jitter.rejected);
+    }
+    std::cout << fmt::format(
+                     "t={:.0f}s kbps={:.0f} packets={} underruns={} "
+                     "silence={} resyncs={} rexmit_req={} rexmit_pkts={} "
+                     "rexmit_miss={} send_p99_us={} pacing_p99_us={} "
+                     "rtsp_rtt_max_us={} latency_ms={}{}",
+                     std::chrono::duration<double>(now - start).count(), kbps,
+                     stats.packets_sent, stats.underrun.underruns,
+                     stats.underrun.silence_packets, stats.underrun.resyncs,
+                     stats.retransmit.requests, stats.retransmit.packets,
+                     stats.retransmit.misses,
+                     stats.send_latency.Percentile(0.99) / 1000,
+                     stats.pacing_error.Percentile(0.99) / 1000,
+                     stats.rtsp_round_trip.max / 1000,
+                     raop.GetLatency() * 1000 / sample_rate,
+                     buffered)
+              << std::endl;
+    last = now;
+    last_bytes = stats.bytes_sent;
+  }
+};
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::SetProgramUsageMessage(
+      "Streams audio to an AirPlay (RAOP) receiver.\n"
+      "  ffmpeg -i song.mp3 -f s16le -ar 44100 -ac 2 - | "
+      "airbeam-stream --receiver=192.168.1.20:7000");
+  absl::ParseCommandLine(argc, argv);
+
+  std::string receiver = absl::GetFlag(FLAGS_receiver);
+  std::string receiver_name = absl::GetFlag(FLAGS_receiver_name);
+  if (receiver.empty() == receiver_name.empty()) {
+    std::cerr << "give one of --receiver or --receiver_name" << std::endl;
+    return 1;
+  }
+  std::string host;
+  uint32_t port = 0;
+  if (!receiver.empty() && !ParseReceiver(receiver, host, port)) {
+    std::cerr << "--receiver must be host:port" << std::endl;
+    return 1;
+  }
+  if (absl::GetFlag(FLAGS_codec) != "pcm") {
+    std::cerr << "unsupported codec " << absl::GetFlag(FLAGS_codec)
+              << ", only pcm is available" << std::endl;
+    return 1;
+  }
+  std::string underrun = absl::GetFlag(FLAGS_underrun);
+  if (underrun != "silence" && underrun != "resync") {
+    std::cerr << "--underrun must be silence or resync" << std::endl;
+    return 1;
+  }
+  std::vector<std::string> addrs;
+  discovery::ServiceInfo service;
+  if (!receiver_name.empty()) {
+    auto timeout = std::chrono::milliseconds(absl::GetFlag(FLAGS_browse_ms));
+    if (!FindReceiver(receiver_name, timeout, service)) {
+      std::cerr << "no receiver named " << receiver_name << " found"
+                << std::endl;
+      return 1;
+    }
+    addrs.push_back(service.ip);
+    port = service.port;
+    receiver = service.name;
+  } else {
+    // Raop races every address.
+    addrs = helper::ResolveHost(host);
+    if (addrs.empty()) {
+      std::cerr << "cannot resolve " << host << std::endl;
+      return 1;
+    }
+  }
+
+  raop::Raop raop(addrs, port);
+  // An address given by hand comes without a TXT record, so it gets the
+  // default format.
+  if (!receiver_name.empty() &&
+      raop.SetReceiverCapabilities(service.capabilities) != helper::kOk) {
+    std::cerr << receiver << " plays nothing this sender can send"
+              << std::endl;
+    return 1;
+  }
+  const auto& stream_format = raop.GetStreamFormat();
+
+  std::unique_ptr<audio::AudioSource> source;
+  std::string source_path = absl::GetFlag(FLAGS_source);
+  std::string conceal = absl::GetFlag(FLAGS_conceal);
+  if (conceal != "repeat" && conceal != "fade") {
+    std::cerr << "--conceal must be repeat or fade" << std::endl;
+    return 1;
+  }
+  helper::ErrCode opened;
+  if (source_path.rfind("udp://", 0) == 0 ||
+      source_path.rfind("unix://", 0) == 0) {
+    audio::DatagramSource::Options options;
+    options.address = source_path;
+    options.depth = std::chrono::milliseconds(absl::GetFlag(FLAGS_jitter_ms));
+    options.concealment = conceal == "repeat"
+                              ? audio::DatagramSource::Concealment::kRepeat
+                              : audio::DatagramSource::Concealment::kFade;
+    auto datagrams = std::make_unique<audio::DatagramSource>(options);
+    opened = datagrams->Open();
+    source = std::move(datagrams);
+  } else {
+    opened = audio::OpenAudioSource(source_path, source);
+  }
+  if (opened != helper::kOk) {
+    std::cerr << "cannot open " << source_path << std::endl;
+    return 1;
+  }
+  auto format = source->GetInputFormat();
+  if (audio::ResampleAudioSource(stream_format.sample_rate, source) !=
+      helper::kOk) {
+    std::cerr << "cannot resample " << source_path << " from "
+              << format.sample_rate << " Hz to " << stream_format.sample_rate
+              << " Hz" << std::endl;
+    return 1;
+  }
+
+  std::signal(SIGINT, OnSignal);
+  std::signal(SIGTERM, OnSignal);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  raop.SetUnderrunPolicy(underrun == "resync"
+                             ? raop::UnderrunPolicy::kResync
+                             : raop::UnderrunPolicy::kSilenceFill);
+  if (raop.StartSession() != helper::kOk) {
+    std::cerr << "cannot connect to " << receiver << std::endl;
+    return 1;
+  }
+  int latency_ms = absl::GetFlag(FLAGS_latency_ms);
+  if (latency_ms > 0) {
+    raop.SetSyncLatency(uint64_t{stream_format.sample_rate} * latency_ms /
+                        1000);
+  }
+  if (raop.BeginStream(raop::NtpTime::Now()) != helper::kOk ||
+      raop.SetVolume(static_cast<uint8_t>(
+          std::clamp(absl::GetFlag(FLAGS_volume), 0, 100))) != helper::kOk) {
+    std::cerr << "cannot start streaming to " << receiver << std::endl;
+    raop.Stop();
+    return 1;
+  }
+  std::cout << fmt::format("streaming {} to {} ({} Hz, {} ch, {} bit) as {}",
+                           source_path, raop.GetRtspIpAddr(),
+                           format.sample_rate, format.channels, format.bits,
+                           stream_format.Rtpmap())
+            << std::endl;
+
+  const bool loop = absl::GetFlag(FLAGS_loop);
+  auto stats_interval =
+      std::chrono::seconds(absl::GetFlag(FLAGS_stats_seconds));
+  auto duration = std::chrono::seconds(absl::GetFlag(FLAGS_duration_seconds));
+  auto start = std::chrono::steady_clock::now();
+  StatsPrinter printer;
+  auto next_stats = start + stats_interval;
+
+  raop::RtpAudioPacketChunk encoded;
+  uint8_t staging[sizeof(encoded.data_)];
+  const uint8_t* data;
+  while (!g_stop) {
+    auto now = std::chrono::steady_clock::now();
+    if (duration.count() != 0 && now - start >= duration) break;
+    if (stats_interval.count() != 0 && now >= next_stats) {
+      printer.Print(raop, *source);
+      next_stats += stats_interval;
+    }
+    size_t size = audio::NextFull(*source, raop.GetPacketInputBytes(),
+                                  staging, data, loop);
+    // An empty chunk from a live source is an underrun, handled by raop.
+    if (size == 0 && source->AtEnd()) break;
+    raop.Packetize(data, size, encoded);
+    raop.AcceptFrame();
+    helper::ErrCode sent = raop.SendChunk(encoded);
+    if (sent != helper::kOk) {
+      std::cerr << "lost " << receiver << ", error " << sent << std::endl;
+      break;
+    }
+  }
+  // Tears the session down, so the receiver is free for the next sender.
+  raop.Stop();
+  printer.Print(raop, *source);
+  return 0;
+}
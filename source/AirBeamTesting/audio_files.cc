@@ -0,0 +1,464 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "audio_files.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace AirBeamTesting {
+namespace {
+using AirBeamCore::audio::PCMFormat;
+
+void PutInt(std::string& out, uint64_t value, size_t bytes, bool big_endian) {
+  for (size_t i = 0; i < bytes; ++i) {
+    size_t shift = 8 * (big_endian ? bytes - 1 - i : i);
+    out.push_back(static_cast<char>(value >> shift));
+  }
+}
+
+void PutLittle(std::string& out, uint64_t value, size_t bytes) {
+  PutInt(out, value, bytes, false);
+}
+
+void PutBig(std::string& out, uint64_t value, size_t bytes) {
+  PutInt(out, value, bytes, true);
+}
+
+// A sample rate as the 80-bit IEEE extended float AIFF uses.
+void PutExtended(std::string& out, uint32_t rate) {
+  int exponent = 31 - __builtin_clz(rate);
+  PutBig(out, 16383 + exponent, 2);
+  PutBig(out, static_cast<uint64_t>(rate) << (63 - exponent), 8);
+}
+
+void PutChunk(std::string& out, const char* id, const std::string& body,
+              bool big_endian) {
+  out.append(id, 4);
+  PutInt(out, body.size(), 4, big_endian);
+  out += body;
+  if (body.size() & 1) out.push_back(0);
+}
+
+// MSB-first bit packing, as FLAC frames are written.
+class BitWriter {
+ public:
+  void Put(uint64_t value, int bits) {
+    for (int i = bits - 1; i >= 0; --i) PutBit((value >> i) & 1);
+  }
+  void PutSigned(int64_t value, int bits) {
+    Put(static_cast<uint64_t>(value), bits);
+  }
+  void PutUnary(uint32_t zeros) {
+    for (uint32_t i = 0; i < zeros; ++i) PutBit(0);
+    PutBit(1);
+  }
+  void Align() {
+    while (pending_bits_ != 0) PutBit(0);
+  }
+  const std::string& Bytes() const { return bytes_; }
+
+ private:
+  void PutBit(uint32_t bit) {
+    pending_ = static_cast<uint8_t>(pending_ << 1 | bit);
+    if (++pending_bits_ == 8) {
+      bytes_.push_back(static_cast<char>(pending_));
+      pending_ = 0;
+      pending_bits_ = 0;
+    }
+  }
+
+  std::string bytes_;
+  uint8_t pending_ = 0;
+  int pending_bits_ = 0;
+};
+
+uint8_t Crc8(const std::string& bytes) {
+  uint8_t crc = 0;
+  for (char c : bytes) {
+    crc ^= static_cast<uint8_t>(c);
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07)
+                         : static_cast<uint8_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+uint16_t Crc16(const std::string& bytes) {
+  uint16_t crc = 0;
+  for (char c : bytes) {
+    crc ^= static_cast<uint16_t>(static_cast<uint8_t>(c) << 8);
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x8005)
+                           : static_cast<uint16_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// A frame number, UTF-8 style.
+void PutFrameNumber(BitWriter& writer, uint32_t number) {
+  if (number < 0x80) {
+    writer.Put(number, 8);
+    return;
+  }
+  int extra = 1;
+  while (extra < 5 && number >= (1u << (6 + 5 * extra))) extra++;
+  // extra + 1 leading ones, then a zero.
+  writer.Put(((1u << (extra + 1)) - 1) << 1, extra + 2);
+  writer.Put(number >> (6 * extra), 6 - extra);
+  for (int i = extra - 1; i >= 0; --i) {
+    writer.Put(0x80 | ((number >> (6 * i)) & 0x3F), 8);
+  }
+}
+
+// The bits a two's complement value needs.
+int SignedBits(int64_t value) {
+  int bits = 1;
+  while (value < -(int64_t{1} << (bits - 1)) ||
+         value >= (int64_t{1} << (bits - 1))) {
+    bits++;
+  }
+  return bits;
+}
+
+void PutResidual(BitWriter& writer, const std::vector<int64_t>& residual,
+                 int order, const FlacOptions& options) {
+  size_t block_size = residual.size();
+  int partition_order = options.partition_order;
+  while (partition_order > 0 &&
+         ((block_size % (size_t{1} << partition_order)) != 0 ||
+          (block_size >> partition_order) < static_cast<size_t>(order))) {
+    partition_order--;
+  }
+  size_t partitions = size_t{1} << partition_order;
+  size_t partition_size = block_size >> partition_order;
+
+  // Rice parameters from the mean folded residual of each partition.
+  std::vector<int> parameters(partitions);
+  bool wide = false;
+  for (size_t p = 0; p < partitions; ++p) {
+    size_t begin = p == 0 ? order : p * partition_size;
+    size_t end = (p + 1) * partition_size;
+    uint64_t sum = 0;
+    for (size_t i = begin; i < end; ++i) {
+      int64_t v = residual[i];
+      sum += v >= 0 ? 2 * v : -2 * v - 1;
+    }
+    uint64_t mean = end > begin ? sum / (end - begin) : 0;
+    int k = 0;
+    while (k < 30 && (mean >> (k + 1)) != 0) k++;
+    parameters[p] = k;
+    wide |= k > 14;
+  }
+
+  int method = wide && !options.escape ? 1 : 0;
+  int parameter_bits = method == 0 ? 4 : 5;
+  writer.Put(method, 2);
+  writer.Put(partition_order, 4);
+  for (size_t p = 0; p < partitions; ++p) {
+    size_t begin = p == 0 ? order : p * partition_size;
+    size_t end = (p + 1) * partition_size;
+    if (options.escape) {
+      int raw_bits = 0;
+      for (size_t i = begin; i < end; ++i) {
+        if (residual[i] != 0) {
+          raw_bits = std::max(raw_bits, SignedBits(residual[i]));
+        }
+      }
+      writer.Put((1u << parameter_bits) - 1, parameter_bits);
+      writer.Put(raw_bits, 5);
+      for (size_t i = begin; i < end; ++i) {
+        writer.PutSigned(residual[i], raw_bits);
+      }
+      continue;
+    }
+    int k = parameters[p];
+    writer.Put(k, parameter_bits);
+    for (size_t i = begin; i < end; ++i) {
+      int64_t v = residual[i];
+      uint64_t folded = v >= 0 ? 2 * v : -2 * v - 1;
+      writer.PutUnary(static_cast<uint32_t>(folded >> k));
+      writer.Put(folded & ((uint64_t{1} << k) - 1), k);
+    }
+  }
+}
+
+// Fixed predictors as binomial coefficients; LPC subframes use them
+// scaled up by kLpcShift.
+constexpr int kBinomial[5][4] = {
+    {}, {1}, {2, -1}, {3, -3, 1}, {4, -6, 4, -1}};
+constexpr int kLpcShift = 3;
+constexpr int kLpcPrecision = 8;
+
+void PutSubframe(BitWriter& writer, std::vector<int64_t> samples, int bits,
+                 const FlacOptions& options) {
+  int wasted = 0;
+  if (options.wasted_bits) {
+    uint64_t any = 0;
+    for (int64_t v : samples) any |= static_cast<uint64_t>(v);
+    if (any != 0) wasted = __builtin_ctzll(any);
+    wasted = std::min(wasted, bits - 1);
+  }
+  if (wasted != 0) {
+    for (int64_t& v : samples) v >>= wasted;
+    bits -= wasted;
+  }
+  auto put_header = [&](uint32_t type) {
+    writer.Put(0, 1);
+    writer.Put(type, 6);
+    writer.Put(wasted != 0, 1);
+    if (wasted != 0) writer.PutUnary(wasted - 1);
+  };
+
+  if (std::all_of(samples.begin(), samples.end(),
+                  [&](int64_t v) { return v == samples[0]; })) {
+    put_header(0);
+    writer.PutSigned(samples[0], bits);
+    return;
+  }
+  if (options.subframe == FlacOptions::Subframe::kVerbatim) {
+    put_header(1);
+    for (int64_t v : samples) writer.PutSigned(v, bits);
+    return;
+  }
+
+  bool lpc = options.subframe == FlacOptions::Subframe::kLpc;
+  int order = std::clamp(options.order, lpc ? 1 : 0, 4);
+  order = std::min<int>(order, static_cast<int>(samples.size()));
+  put_header(lpc ? 31 + order : 8 + order);
+  for (int i = 0; i < order; ++i) writer.PutSigned(samples[i], bits);
+  if (lpc) {
+    writer.Put(kLpcPrecision - 1, 4);
+    writer.PutSigned(kLpcShift, 5);
+    for (int j = 0; j < order; ++j) {
+      writer.PutSigned(kBinomial[order][j] * (1 << kLpcShift), kLpcPrecision);
+    }
+  }
+  std::vector<int64_t> residual(samples.size());
+  for (size_t i = order; i < samples.size(); ++i) {
+    int64_t prediction = 0;
+    for (int j = 0; j < order; ++j) {
+      prediction += kBinomial[order][j] * samples[i - 1 - j];
+    }
+    residual[i] = samples[i] - prediction;
+  }
+  PutResidual(writer, residual, order, options);
+}
+
+uint32_t BlockSizeCode(uint32_t block_size) {
+  if (block_size == 192) return 1;
+  for (uint32_t code = 2; code <= 5; ++code) {
+    if (block_size == 576u << (code - 2)) return code;
+  }
+  for (uint32_t code = 8; code <= 15; ++code) {
+    if (block_size == 256u << (code - 8)) return code;
+  }
+  return block_size <= 256 ? 6 : 7;
+}
+
+uint32_t SampleRateCode(uint32_t rate) {
+  if (rate == 44'100) return 9;
+  if (rate == 48'000) return 10;
+  return rate < 65'536 ? 13 : 0;
+}
+
+uint32_t SampleSizeCode(int bits) {
+  switch (bits) {
+    case 8:
+      return 1;
+    case 12:
+      return 2;
+    case 16:
+      return 4;
+    case 20:
+      return 5;
+    case 24:
+      return 6;
+    case 32:
+      return 7;
+    default:
+      return 0;
+  }
+}
+}  // namespace
+
+std::string PackPCM(const std::vector<int16_t>& samples,
+                    const PCMFormat& format) {
+  std::string out;
+  size_t bytes = format.bits / 8;
+  out.reserve(samples.size() * bytes);
+  for (int16_t sample : samples) {
+    if (format.encoding == PCMFormat::Encoding::kFloat) {
+      uint64_t raw;
+      if (format.bits == 64) {
+        double value = sample / 32768.0;
+        memcpy(&raw, &value, sizeof(value));
+      } else {
+        float value = sample / 32768.0f;
+        uint32_t raw32;
+        memcpy(&raw32, &value, sizeof(value));
+        raw = raw32;
+      }
+      PutInt(out, raw, bytes, format.big_endian);
+      continue;
+    }
+    int64_t value = format.bits >= 16
+                        ? int64_t{sample} * (int64_t{1} << (format.bits - 16))
+                        : sample >> (16 - format.bits);
+    if (format.encoding == PCMFormat::Encoding::kUnsigned) {
+      value += int64_t{1} << (format.bits - 1);
+    }
+    PutInt(out, static_cast<uint64_t>(value), bytes, format.big_endian);
+  }
+  return out;
+}
+
+std::string MakeWav(const PCMFormat& format, const std::string& data,
+                    bool extensible) {
+  bool is_float = format.encoding == PCMFormat::Encoding::kFloat;
+  uint16_t tag = extensible ? 0xFFFE : is_float ? 3 : 1;
+  std::string fmt;
+  PutLittle(fmt, tag, 2);
+  PutLittle(fmt, format.channels, 2);
+  PutLittle(fmt, format.sample_rate, 4);
+  PutLittle(fmt, format.sample_rate * format.FrameBytes(), 4);
+  PutLittle(fmt, format.FrameBytes(), 2);
+  PutLittle(fmt, format.bits, 2);
+  if (extensible) {
+    PutLittle(fmt, 22, 2);
+    PutLittle(fmt, format.bits, 2);
+    PutLittle(fmt, format.channels == 1 ? 0x4 : 0x3, 4);
+    PutLittle(fmt, is_float ? 3 : 1, 2);
+    static const uint8_t kGuidTail[] = {0x00, 0x00, 0x00, 0x00, 0x10,
+                                        0x00, 0x80, 0x00, 0x00, 0xAA,
+                                        0x00, 0x38, 0x9B, 0x71};
+    fmt.append(reinterpret_cast<const char*>(kGuidTail), sizeof(kGuidTail));
+  } else if (is_float) {
+    PutLittle(fmt, 0, 2);
+  }
+
+  std::string out = "RIFF";
+  PutLittle(out, 0, 4);
+  out += "WAVE";
+  PutChunk(out, "fmt ", fmt, false);
+  // An odd-sized chunk the reader has to skip, padding and all.
+  PutChunk(out, "junk", "abc", false);
+  PutChunk(out, "data", data, false);
+  std::string size;
+  PutLittle(size, out.size() - 8, 4);
+  out.replace(4, 4, size);
+  return out;
+}
+
+std::string MakeAiff(const PCMFormat& format, const std::string& data) {
+  bool is_float = format.encoding == PCMFormat::Encoding::kFloat;
+  bool compressed = is_float || !format.big_endian;
+  std::string comm;
+  PutBig(comm, format.channels, 2);
+  PutBig(comm, data.size() / format.FrameBytes(), 4);
+  PutBig(comm, format.bits, 2);
+  PutExtended(comm, format.sample_rate);
+  if (compressed) {
+    comm += is_float ? (format.bits == 64 ? "fl64" : "fl32") : "sowt";
+    // An empty Pascal string, padded to an even length.
+    comm.append(2, '\0');
+  }
+  std::string ssnd;
+  PutBig(ssnd, 0, 8);
+  ssnd += data;
+
+  std::string out = "FORM";
+  PutBig(out, 0, 4);
+  out += compressed ? "AIFC" : "AIFF";
+  PutChunk(out, "COMM", comm, true);
+  PutChunk(out, "SSND", ssnd, true);
+  std::string size;
+  PutBig(size, out.size() - 8, 4);
+  out.replace(4, 4, size);
+  return out;
+}
+
+std::string EncodeFlac(const std::vector<int32_t>& samples, int channels,
+                       const FlacOptions& options) {
+  uint64_t total = samples.size() / channels;
+  BitWriter header;
+  header.Put(options.padding != 0 ? 0 : 1, 1);
+  header.Put(0, 7);
+  header.Put(34, 24);
+  header.Put(options.block_size, 16);
+  header.Put(options.block_size, 16);
+  header.Put(0, 24);
+  header.Put(0, 24);
+  header.Put(options.sample_rate, 20);
+  header.Put(channels - 1, 3);
+  header.Put(options.bits - 1, 5);
+  header.Put(total, 36);
+  for (int i = 0; i < 4; ++i) header.Put(0, 32);
+  if (options.padding != 0) {
+    header.Put(0x81, 8);
+    header.Put(options.padding, 24);
+    for (uint32_t i = 0; i < options.padding; ++i) header.Put(0, 8);
+  }
+  std::string out = "fLaC" + header.Bytes();
+
+  bool stereo = channels == 2;
+  uint32_t assignment = channels - 1;
+  if (stereo && options.stereo != FlacOptions::Stereo::kIndependent) {
+    assignment = 7 + static_cast<uint32_t>(options.stereo);
+  }
+  uint32_t number = 0;
+  for (uint64_t first = 0; first < total; first += options.block_size) {
+    uint32_t block_size =
+        static_cast<uint32_t>(std::min<uint64_t>(options.block_size,
+                                                 total - first));
+    BitWriter frame;
+    frame.Put(0xFFF8, 16);
+    uint32_t block_code = BlockSizeCode(block_size);
+    uint32_t rate_code = SampleRateCode(options.sample_rate);
+    frame.Put(block_code, 4);
+    frame.Put(rate_code, 4);
+    frame.Put(assignment, 4);
+    frame.Put(SampleSizeCode(options.bits), 3);
+    frame.Put(0, 1);
+    PutFrameNumber(frame, number++);
+    if (block_code == 6) frame.Put(block_size - 1, 8);
+    if (block_code == 7) frame.Put(block_size - 1, 16);
+    if (rate_code == 13) frame.Put(options.sample_rate, 16);
+    frame.Put(Crc8(frame.Bytes()), 8);
+
+    std::vector<int64_t> channel_samples[8];
+    for (int c = 0; c < channels; ++c) {
+      channel_samples[c].resize(block_size);
+      for (uint32_t i = 0; i < block_size; ++i) {
+        channel_samples[c][i] = samples[(first + i) * channels + c];
+      }
+    }
+    int bits[8];
+    std::fill(bits, bits + 8, options.bits);
+    if (assignment >= 8) {
+      std::vector<int64_t>& left = channel_samples[0];
+      std::vector<int64_t>& right = channel_samples[1];
+      for (uint32_t i = 0; i < block_size; ++i) {
+        int64_t side = left[i] - right[i];
+        if (assignment == 8) {
+          right[i] = side;
+        } else if (assignment == 9) {
+          left[i] = side;
+        } else {
+          left[i] = (left[i] + right[i]) >> 1;
+          right[i] = side;
+        }
+      }
+      bits[assignment == 9 ? 0 : 1]++;
+    }
+    for (int c = 0; c < channels; ++c) {
+      PutSubframe(frame, channel_samples[c], bits[c], options);
+    }
+    frame.Align();
+    frame.Put(Crc16(frame.Bytes()), 16);
+    out += frame.Bytes();
+  }
+  return out;
+}
+}  // namespace AirBeamTesting
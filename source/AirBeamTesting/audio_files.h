@@ -0,0 +1,57 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "audio/pcm_format.h"
+
+namespace AirBeamTesting {
+
+// Lays 16-bit samples out in format: narrower samples keep the top bits,
+// wider ones are shifted up, unsigned ones offset and floats scaled to
+// [-1, 1). The input has format.channels interleaved samples per frame.
+std::string PackPCM(const std::vector<int16_t>& samples,
+                    const AirBeamCore::audio::PCMFormat& format);
+
+// A RIFF/WAVE file around data. Floats get WAVE_FORMAT_IEEE_FLOAT unless
+// extensible asks for WAVE_FORMAT_EXTENSIBLE.
+std::string MakeWav(const AirBeamCore::audio::PCMFormat& format,
+                    const std::string& data, bool extensible = false);
+
+// An AIFF file for big-endian integers, an AIFC one (sowt, fl32 or fl64)
+// for anything else.
+std::string MakeAiff(const AirBeamCore::audio::PCMFormat& format,
+                     const std::string& data);
+
+// A small FLAC encoder covering the parts of the format a decoder has to
+// handle. It aims at coverage, not compression: every frame uses the same
+// subframe type and stereo decorrelation, and the stream MD5 is left
+// zero.
+struct FlacOptions {
+  enum class Subframe { kVerbatim, kFixed, kLpc };
+  enum class Stereo { kIndependent, kLeftSide, kSideRight, kMidSide };
+
+  uint32_t sample_rate = 44'100;
+  int bits = 16;
+  uint32_t block_size = 4096;
+  Subframe subframe = Subframe::kFixed;
+  // Predictor order, 0 to 4 for either predictor type.
+  int order = 2;
+  Stereo stereo = Stereo::kIndependent;
+  int partition_order = 2;
+  // Codes residuals with the escape code instead of a Rice parameter.
+  bool escape = false;
+  // Shifts out trailing zero bits shared by a whole subframe.
+  bool wasted_bits = true;
+  // Bytes of PADDING metadata after STREAMINFO.
+  uint32_t padding = 0;
+};
+
+// samples holds channels interleaved values of options.bits each. A
+// subframe whose samples are all equal is always coded as CONSTANT.
+std::string EncodeFlac(const std::vector<int32_t>& samples, int channels,
+                       const FlacOptions& options);
+}  // namespace AirBeamTesting
@@ -0,0 +1,236 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "fake_mdns_responder.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace AirBeamTesting {
+
+using AirBeamCore::helper::ErrCode;
+using namespace AirBeamCore::discovery;
+
+std::string FakeMdnsResponder::Service::FullName() const {
+  return JoinDnsName({instance}) + "." + type;
+}
+
+FakeMdnsResponder::FakeMdnsResponder() : FakeMdnsResponder(Options()) {}
+
+FakeMdnsResponder::FakeMdnsResponder(const Options& options)
+    : options_(options) {}
+
+FakeMdnsResponder::~FakeMdnsResponder() { Stop(); }
+
+ErrCode FakeMdnsResponder::Start() {
+  fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd_ < 0) return AirBeamCore::helper::kErrUdpSocketCreate;
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (bind(fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) !=
+          0 ||
+      getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &len) != 0 ||
+      pipe(wake_) != 0) {
+    Stop();
+    return AirBeamCore::helper::kErrUdpBind;
+  }
+  port_ = ntohs(addr.sin_port);
+  thread_ = std::thread(&FakeMdnsResponder::Loop, this);
+  return AirBeamCore::helper::kOk;
+}
+
+void FakeMdnsResponder::Stop() {
+  if (thread_.joinable()) {
+    char wake = 0;
+    (void)!write(wake_[1], &wake, 1);
+    thread_.join();
+  }
+  for (int& fd : wake_) {
+    if (fd >= 0) close(fd);
+    fd = -1;
+  }
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+}
+
+void FakeMdnsResponder::AddService(const Service& service) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  services_[service.instance] = service;
+}
+
+void FakeMdnsResponder::RemoveService(const std::string& instance,
+                                      uint16_t port) {
+  std::string packet;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = services_.find(instance);
+    if (it == services_.end()) return;
+    DnsMessage goodbye;
+    goodbye.flags = DnsMessage::kResponseFlags;
+    Records(it->second, 0, goodbye.answers, true, true, true, false);
+    packet = EncodeDnsMessage(goodbye);
+    services_.erase(it);
+  }
+  if (port != 0) SendTo(packet, port);
+}
+
+void FakeMdnsResponder::Announce(const Service& service, uint16_t port) {
+  DnsMessage announcement;
+  announcement.flags = DnsMessage::kResponseFlags;
+  Records(service, service.ttl, announcement.answers, true, true, true, true);
+  SendTo(EncodeDnsMessage(announcement), port);
+}
+
+size_t FakeMdnsResponder::GetQuestions(RecordType type) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return questions_[type];
+}
+
+void FakeMdnsResponder::Records(const Service& service, uint32_t ttl,
+                                std::vector<DnsRecord>& out, bool ptr,
+                                bool srv, bool txt, bool a) const {
+  DnsRecord record;
+  record.ttl = ttl;
+  if (ptr) {
+    record.name = service.type;
+    record.type = RecordType::kPtr;
+    record.target = service.FullName();
+    out.push_back(record);
+  }
+  // The rest are unique to this responder.
+  record.cache_flush = true;
+  if (srv) {
+    record.name = service.FullName();
+    record.type = RecordType::kSrv;
+    record.target = service.host;
+    record.port = service.port;
+    out.push_back(record);
+  }
+  if (txt) {
+    record.name = service.FullName();
+    record.type = RecordType::kTxt;
+    record.txt = service.txt;
+    out.push_back(record);
+  }
+  if (a) {
+    record.name = service.host;
+    record.type = RecordType::kA;
+    record.address = service.ip;
+    out.push_back(record);
+  }
+}
+
+void FakeMdnsResponder::HandleQuery(const DnsMessage& query,
+                                    uint16_t from_port) {
+  DnsMessage now_answers, later_answers;
+  now_answers.flags = later_answers.flags = DnsMessage::kResponseFlags;
+  for (const auto& question : query.questions) {
+    questions_[question.type]++;
+    for (const auto& [instance, service] : services_) {
+      switch (question.type) {
+        case RecordType::kPtr: {
+          if (!DnsNameEquals(question.name, service.type)) break;
+          // Known-answer suppression.
+          bool known = std::any_of(
+              query.answers.begin(), query.answers.end(),
+              [&](const DnsRecord& answer) {
+                return DnsNameEquals(answer.target, service.FullName()) &&
+                       answer.ttl * 2 >= service.ttl;
+              });
+          if (known) break;
+          Records(service, service.ttl, now_answers.answers, true, false,
+                  false, false);
+          if (options_.additional_records) {
+            Records(service, service.ttl, now_answers.additionals, false,
+                    true, true, true);
+          }
+          break;
+        }
+        case RecordType::kSrv:
+        case RecordType::kTxt:
+          if (DnsNameEquals(question.name, service.FullName())) {
+            Records(service, service.ttl, later_answers.answers, false,
+                    question.type == RecordType::kSrv,
+                    question.type == RecordType::kTxt, false);
+          }
+          break;
+        case RecordType::kA:
+          if (DnsNameEquals(question.name, service.host)) {
+            Records(service, service.ttl, later_answers.answers, false, false,
+                    false, true);
+          }
+          break;
+        default:
+          break;
+      }
+    }
+  }
+  auto now = std::chrono::steady_clock::now();
+  if (!now_answers.answers.empty()) {
+    pending_.push_back({now, EncodeDnsMessage(now_answers), from_port});
+  }
+  if (!later_answers.answers.empty()) {
+    pending_.push_back({now + options_.answer_delay,
+                        EncodeDnsMessage(later_answers), from_port});
+  }
+}
+
+void FakeMdnsResponder::SendTo(const std::string& packet, uint16_t port) {
+  sockaddr_in to{};
+  to.sin_family = AF_INET;
+  to.sin_port = htons(port);
+  to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sendto(fd_, packet.data(), packet.size(), 0,
+         reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+}
+
+void FakeMdnsResponder::Loop() {
+  std::vector<uint8_t> buffer(9000);
+  while (true) {
+    int timeout_ms = -1;
+    std::vector<Pending> due;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      auto now = std::chrono::steady_clock::now();
+      auto it = std::stable_partition(
+          pending_.begin(), pending_.end(),
+          [&](const Pending& pending) { return pending.due > now; });
+      due.assign(it, pending_.end());
+      pending_.erase(it, pending_.end());
+      for (const auto& pending : pending_) {
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        pending.due - now)
+                        .count() +
+                    1;
+        if (timeout_ms < 0 || wait < timeout_ms) {
+          timeout_ms = static_cast<int>(wait);
+        }
+      }
+    }
+    for (const auto& pending : due) SendTo(pending.packet, pending.port);
+
+    pollfd fds[2] = {{fd_, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+    if (poll(fds, 2, timeout_ms) < 0) continue;
+    if (fds[1].revents != 0) break;
+    if (fds[0].revents == 0) continue;
+    sockaddr_in from{};
+    socklen_t from_len = sizeof(from);
+    ssize_t got = recvfrom(fd_, buffer.data(), buffer.size(), 0,
+                           reinterpret_cast<sockaddr*>(&from), &from_len);
+    DnsMessage query;
+    if (got <= 0 || !DecodeDnsMessage(buffer.data(), got, query) ||
+        query.IsResponse()) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    HandleQuery(query, ntohs(from.sin_port));
+  }
+}
+
+}  // namespace AirBeamTesting
@@ -0,0 +1,89 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "discovery/dns_message.h"
+#include "helper/errcode.h"
+
+namespace AirBeamTesting {
+
+// An mDNS responder on loopback for tests, answering unicast queries from
+// an MdnsBrowser pointed at it. Answers come back to the querying socket;
+// announcements and goodbyes are sent to a given port.
+class FakeMdnsResponder {
+ public:
+  struct Service {
+    // The instance label, e.g. "001122334455@Kitchen".
+    std::string instance;
+    std::string type = "_raop._tcp.local";
+    std::string host = "receiver.local";
+    std::string ip = "127.0.0.1";
+    uint16_t port = 7000;
+    std::vector<std::string> txt;
+    uint32_t ttl = 120;
+
+    std::string FullName() const;
+  };
+
+  struct Options {
+    // Send SRV, TXT and A along with PTR answers, as real responders do;
+    // without, the browser has to ask for them.
+    bool additional_records = true;
+    // How long SRV, TXT and A answers take, each query answered on its own
+    // schedule.
+    std::chrono::milliseconds answer_delay{0};
+  };
+
+  FakeMdnsResponder();
+  explicit FakeMdnsResponder(const Options& options);
+  ~FakeMdnsResponder();
+
+  AirBeamCore::helper::ErrCode Start();
+  void Stop();
+  uint16_t GetPort() const { return port_; }
+
+  void AddService(const Service& service);
+  // Stops answering for the instance, and sends a goodbye to port unless it
+  // is 0.
+  void RemoveService(const std::string& instance, uint16_t port);
+  // Sends all of the service's records to port unasked.
+  void Announce(const Service& service, uint16_t port);
+  // Questions of this type received so far.
+  size_t GetQuestions(AirBeamCore::discovery::RecordType type);
+
+ private:
+  struct Pending {
+    std::chrono::steady_clock::time_point due;
+    std::string packet;
+    uint16_t port;
+  };
+
+  void Loop();
+  void HandleQuery(const AirBeamCore::discovery::DnsMessage& query,
+                   uint16_t from_port);
+  void Records(const Service& service, uint32_t ttl,
+               std::vector<AirBeamCore::discovery::DnsRecord>& out,
+               bool ptr, bool srv, bool txt, bool a) const;
+  void SendTo(const std::string& packet, uint16_t port);
+
+  const Options options_;
+  int fd_ = -1;
+  uint16_t port_ = 0;
+  int wake_[2] = {-1, -1};
+  std::thread thread_;
+
+  std::mutex mtx_;
+  std::map<std::string, Service> services_;
+  std::map<AirBeamCore::discovery::RecordType, size_t> questions_;
+  std::vector<Pending> pending_;
+};
+
+}  // namespace AirBeamTesting
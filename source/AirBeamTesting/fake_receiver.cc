@@ -0,0 +1,487 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "fake_receiver.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "raop/constants.h"
+#include "raop/rtsp.h"
+
+namespace AirBeamTesting {
+
+using namespace AirBeamCore;
+using namespace AirBeamCore::raop;
+
+namespace {
+constexpr uint8_t kTypeTimingRequest = 0x52;
+constexpr uint8_t kTypeTimingReply = 0x53;
+constexpr uint8_t kTypeSync = 0x54;
+constexpr uint8_t kTypeRetransmitRequest = 0x55;
+constexpr uint8_t kTypeRetransmitReply = 0x56;
+constexpr uint8_t kTypeAudio = 0x60;
+
+int64_t NowNs() {
+  return static_cast<int64_t>(NtpTime::Now().IntoNanoseconds());
+}
+
+int64_t Percentile(std::vector<int64_t> values, size_t permille) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  size_t rank = (values.size() * permille + 999) / 1000;
+  return values[std::max<size_t>(rank, 1) - 1];
+}
+}  // namespace
+
+FakeReceiver::FakeReceiver() : FakeReceiver(Options()) {}
+
+FakeReceiver::FakeReceiver(const Options& options) : options_(options) {}
+
+FakeReceiver::~FakeReceiver() { Stop(); }
+
+helper::ErrCode FakeReceiver::Start() {
+  const int family = options_.ipv6 ? AF_INET6 : AF_INET;
+  helper::ErrCode ret = audio_server_.Bind(family);
+  if (ret != helper::kOk) return ret;
+  ret = ctrl_server_.Bind(family);
+  if (ret != helper::kOk) return ret;
+  ret = time_server_.Bind(family);
+  if (ret != helper::kOk) return ret;
+
+  listen_fd_ = socket(family, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) return helper::kErrTcpSocketCreate;
+  int reuse = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  helper::SockAddr addr;
+  addr.Parse({options_.ipv6 ? "::1" : "127.0.0.1", options_.rtsp_port});
+  if (bind(listen_fd_, addr.Get(), addr.len) != 0 ||
+      listen(listen_fd_, 16) != 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return helper::kErrTcpConnect;
+  }
+  getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr.storage),
+              &addr.len);
+  port_ = options_.ipv6
+              ? ntohs(reinterpret_cast<sockaddr_in6*>(&addr.storage)->sin6_port)
+              : ntohs(reinterpret_cast<sockaddr_in*>(&addr.storage)->sin_port);
+
+  rtsp_thread_ = std::thread([this]() { RtspLoop(); });
+  udp_thread_ = std::thread([this]() { UdpLoop(); });
+  return helper::kOk;
+}
+
+void FakeReceiver::Stop() {
+  if (stopped_.exchange(true)) return;
+  if (rtsp_thread_.joinable()) rtsp_thread_.join();
+  if (udp_thread_.joinable()) udp_thread_.join();
+  if (listen_fd_ >= 0) close(listen_fd_);
+  audio_server_.Close();
+  ctrl_server_.Close();
+  time_server_.Close();
+}
+
+FakeReceiver::Stats FakeReceiver::GetStats() {
+  std::lock_guard guard(mtx_);
+  Stats stats = stats_;
+  stats.lost = missing_.size();
+  std::vector<int64_t> offsets;
+  offsets.reserve(packets_.size());
+  for (const auto& packet : packets_) {
+    if (packet.schedule_offset_ns != 0) {
+      offsets.push_back(packet.schedule_offset_ns / 1000);
+    }
+  }
+  stats.schedule_offset_p50_us = Percentile(offsets, 500);
+  stats.schedule_offset_p99_us = Percentile(offsets, 990);
+
+  // A missing packet is audible if it was not filled in before it was due
+  // to play; a run of consecutive audible packets is one gap.
+  int64_t now_ns = NowNs();
+  std::vector<int64_t> recovery;
+  bool in_gap = false;
+  uint16_t last_seq = 0;
+  for (const auto& gap : gaps_) {
+    if (gap.filled_ns != 0) {
+      recovery.push_back((gap.filled_ns - gap.detected_ns) / 1000);
+    }
+    bool audible = gap.filled_ns != 0 ? gap.filled_ns > gap.deadline_ns
+                                      : now_ns > gap.deadline_ns;
+    bool continues = in_gap && gap.seq == static_cast<uint16_t>(last_seq + 1);
+    if (audible && !continues) stats.audible_gaps++;
+    in_gap = audible;
+    last_seq = gap.seq;
+  }
+  stats.recovered = recovery.size();
+  stats.recovery_p50_us = Percentile(recovery, 500);
+  stats.recovery_max_us = Percentile(recovery, 1000);
+  return stats;
+}
+
+std::vector<PacketRecord> FakeReceiver::GetPackets() {
+  std::lock_guard guard(mtx_);
+  return packets_;
+}
+
+std::vector<int16_t> FakeReceiver::GetSamples() {
+  std::lock_guard guard(mtx_);
+  return samples_;
+}
+
+std::vector<std::string> FakeReceiver::GetMethods() {
+  std::lock_guard guard(mtx_);
+  return methods_;
+}
+
+std::vector<std::string> FakeReceiver::GetUris() {
+  std::lock_guard guard(mtx_);
+  return uris_;
+}
+
+std::string FakeReceiver::GetSdp() {
+  std::lock_guard guard(mtx_);
+  return sdp_;
+}
+
+bool FakeReceiver::IsRecording() {
+  std::lock_guard guard(mtx_);
+  return recording_;
+}
+
+bool FakeReceiver::WaitForPackets(size_t count,
+                                  std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (std::chrono::steady_clock::now() < deadline) {
+    {
+      std::lock_guard guard(mtx_);
+      if (packets_.size() >= count) return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  return false;
+}
+
+void FakeReceiver::RtspLoop() {
+  std::vector<Connection> conns;
+  while (!stopped_) {
+    std::vector<pollfd> fds = {{listen_fd_, POLLIN, 0}};
+    for (const auto& conn : conns) fds.push_back({conn.fd, POLLIN, 0});
+    if (poll(fds.data(), fds.size(), 10) <= 0) continue;
+
+    if (fds[0].revents & POLLIN) {
+      sockaddr_storage peer{};
+      socklen_t len = sizeof(peer);
+      int fd = accept(listen_fd_, reinterpret_cast<sockaddr*>(&peer), &len);
+      if (fd >= 0) {
+        char ip[INET6_ADDRSTRLEN] = {0};
+        if (peer.ss_family == AF_INET6) {
+          auto* v6 = reinterpret_cast<sockaddr_in6*>(&peer);
+          inet_ntop(AF_INET6, &v6->sin6_addr, ip, sizeof(ip));
+        } else {
+          auto* v4 = reinterpret_cast<sockaddr_in*>(&peer);
+          inet_ntop(AF_INET, &v4->sin_addr, ip, sizeof(ip));
+        }
+        conns.push_back({fd, "", ip});
+      }
+    }
+
+    std::vector<Connection> alive;
+    for (size_t i = 0; i < conns.size(); ++i) {
+      Connection& conn = conns[i];
+      bool open = true;
+      // A connection accepted above has no poll entry yet.
+      short revents = i + 1 < fds.size() ? fds[i + 1].revents : 0;
+      if (revents & (POLLIN | POLLHUP | POLLERR)) {
+        char buffer[4096];
+        ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+          open = false;
+        } else {
+          conn.buffer.append(buffer, n);
+        }
+      }
+      // Requests are framed by the blank line plus Content-Length.
+      while (open) {
+        size_t end = conn.buffer.find("\r\n\r\n");
+        if (end == std::string::npos) break;
+        size_t body_len = 0;
+        size_t pos = conn.buffer.find("Content-Length:");
+        if (pos != std::string::npos && pos < end) {
+          body_len = std::strtoul(conn.buffer.c_str() + pos + 15, nullptr, 10);
+        }
+        if (conn.buffer.size() < end + 4 + body_len) break;
+        std::string request = conn.buffer.substr(0, end + 4 + body_len);
+        conn.buffer.erase(0, request.size());
+        open = HandleRequest(conn, request);
+      }
+      if (open) {
+        alive.push_back(std::move(conn));
+      } else {
+        close(conn.fd);
+      }
+    }
+    conns.swap(alive);
+  }
+  for (const auto& conn : conns) close(conn.fd);
+}
+
+bool FakeReceiver::HandleRequest(Connection& conn, const std::string& content) {
+  auto request = RtspMessage::Parse(content);
+  std::string method =
+      request.GetStartLine().substr(0, request.GetStartLine().find(' '));
+
+  auto builder = RtspMsgBuilder<RtspRespMessage>()
+                     .SetStatusCode(200)
+                     .SetStatusText("OK")
+                     .AddHeader("CSeq", request.GetHeader("CSeq"));
+  bool keep_open = true;
+  {
+    std::lock_guard guard(mtx_);
+    methods_.push_back(method);
+    const std::string& start_line = request.GetStartLine();
+    size_t uri_begin = start_line.find(' ') + 1;
+    size_t uri_end = start_line.find(' ', uri_begin);
+    uris_.push_back(start_line.substr(uri_begin, uri_end - uri_begin));
+    if (method == "OPTIONS") {
+      builder = builder.AddHeader(
+          "Public",
+          "ANNOUNCE, SETUP, RECORD, PAUSE, FLUSH, TEARDOWN, OPTIONS, "
+          "GET_PARAMETER, SET_PARAMETER");
+    } else if (method == "ANNOUNCE") {
+      sdp_ = request.GetBody();
+      if (request.GetBody().find(options_.rtpmap) == std::string::npos) {
+        builder = builder.SetStatusCode(415).SetStatusText(
+            "Unsupported Media Type");
+      }
+    } else if (method == "SETUP") {
+      auto transport = ParseKVStr(request.GetHeader("Transport"), "=", ";");
+      sender_ctrl_addr_.ip_ = conn.peer_ip;
+      sender_time_addr_.ip_ = conn.peer_ip;
+      absl::SimpleAtoi(transport["control_port"], &sender_ctrl_addr_.port_);
+      absl::SimpleAtoi(transport["timing_port"], &sender_time_addr_.port_);
+      builder = builder.AddHeader("Session", "1").AddHeader(
+          "Transport",
+          absl::StrCat("RTP/AVP/UDP;unicast;mode=record;server_port=",
+                       audio_server_.GetLocalNetAddr().port_,
+                       ";control_port=", ctrl_server_.GetLocalNetAddr().port_,
+                       ";timing_port=", time_server_.GetLocalNetAddr().port_));
+    } else if (method == "RECORD") {
+      recording_ = true;
+      record_ns_ = NowNs();
+      has_expected_seq_ = false;
+      builder = builder.AddHeader("Audio-Latency",
+                                  std::to_string(options_.latency));
+    } else if (method == "SET_PARAMETER") {
+      auto params = ParseKVStr(request.GetBody(), ": ", "\r\n");
+      float volume;
+      if (absl::SimpleAtof(params["volume"], &volume)) stats_.volume = volume;
+    } else if (method == "FLUSH") {
+      has_expected_seq_ = false;
+    } else if (method == "TEARDOWN") {
+      recording_ = false;
+      keep_open = false;
+    } else if (method != "GET_PARAMETER") {
+      builder = builder.SetStatusCode(501).SetStatusText("Not Implemented");
+    }
+  }
+  std::string response = builder.Build().ToString();
+  send(conn.fd, response.data(), response.size(), 0);
+  return keep_open;
+}
+
+void FakeReceiver::UdpLoop() {
+  auto next_timing = std::chrono::steady_clock::now();
+  while (!stopped_) {
+    if (options_.timing_interval.count() > 0 &&
+        std::chrono::steady_clock::now() >= next_timing) {
+      SendTimingRequest();
+      next_timing += options_.timing_interval;
+    }
+
+    pollfd fds[] = {{audio_server_.GetFd(), POLLIN, 0},
+                    {ctrl_server_.GetFd(), POLLIN, 0},
+                    {time_server_.GetFd(), POLLIN, 0}};
+    if (poll(fds, 3, 5) <= 0) continue;
+    helper::UDPServer* servers[] = {&audio_server_, &ctrl_server_,
+                                    &time_server_};
+    for (int i = 0; i < 3; ++i) {
+      if (!(fds[i].revents & POLLIN)) continue;
+      helper::NetAddr remote;
+      std::string data;
+      if (servers[i]->Read(remote, data) != helper::kOk) continue;
+      auto bytes = reinterpret_cast<const uint8_t*>(data.data());
+      if (i == 0) HandleAudio(bytes, data.size(), false);
+      if (i == 1) HandleControl(bytes, data.size());
+      if (i == 2) HandleTiming(bytes, data.size());
+    }
+  }
+}
+
+void FakeReceiver::HandleAudio(const uint8_t* data, size_t size,
+                               bool retransmitted) {
+  if (size < RtpAudioPacket::kHeaderSize) return;
+  auto packet = RtpAudioPacket::Deserialize(data, size);
+  if ((packet.header.type & 0x7f) != kTypeAudio) return;
+  int64_t arrival_ns = NowNs();
+
+  std::lock_guard guard(mtx_);
+  PacketRecord record;
+  record.seq = packet.header.seq;
+  record.timestamp = packet.timestamp;
+  record.marker = packet.header.type & 0x80;
+  record.retransmitted = retransmitted;
+  record.arrival_ns = arrival_ns;
+  record.schedule_offset_ns = 0;
+  if (has_sync_) {
+    int64_t frames = static_cast<int32_t>(packet.timestamp - sync_rtp_);
+    int64_t due_ns = sync_ns_ + frames * 1'000'000'000 / kSampleRate44100;
+    record.schedule_offset_ns = arrival_ns - due_ns;
+  }
+
+  if (stats_.startup_latency_us < 0 && record_ns_ != 0) {
+    stats_.startup_latency_us = (arrival_ns - record_ns_) / 1000;
+  }
+
+  // RFC 3550 section 6.4.1.
+  int64_t transit_ns =
+      arrival_ns - static_cast<int64_t>(packet.timestamp) * 1'000'000'000 /
+                       static_cast<int64_t>(kSampleRate44100);
+  if (has_transit_ && !retransmitted) {
+    double d = std::abs(static_cast<double>(transit_ns - last_transit_ns_));
+    stats_.jitter_us += (d / 1000 - stats_.jitter_us) / 16;
+  }
+  if (!retransmitted) {
+    last_transit_ns_ = transit_ns;
+    has_transit_ = true;
+  }
+
+  uint16_t seq = packet.header.seq;
+  if (retransmitted) {
+    if (!Fill(seq, arrival_ns)) {
+      stats_.duplicates++;
+      return;
+    }
+    stats_.retransmitted++;
+  } else if (!has_expected_seq_ || record.marker) {
+    expected_seq_ = seq + 1;
+    has_expected_seq_ = true;
+  } else {
+    int16_t ahead = static_cast<int16_t>(seq - expected_seq_);
+    if (ahead > 0) {
+      for (uint16_t s = expected_seq_; s != seq; ++s) {
+        uint32_t ts = packet.timestamp -
+                      static_cast<uint16_t>(seq - s) * kPCMChunkLength;
+        missing_[s] = gaps_.size();
+        gaps_.push_back({s, arrival_ns, PlayoutDeadline(ts, arrival_ns), 0});
+      }
+      if (options_.request_retransmits && sender_ctrl_addr_.port_ != 0) {
+        RtpLostPacket request;
+        request.header = {0x80, 0x80 | kTypeRetransmitRequest, 1};
+        request.seq_number = expected_seq_;
+        request.n = static_cast<uint16_t>(ahead);
+        uint8_t buffer[RtpLostPacket::kSize];
+        request.Serialize(buffer);
+        ctrl_server_.Write(sender_ctrl_addr_,
+                           std::string(reinterpret_cast<char*>(buffer),
+                                       sizeof(buffer)));
+        stats_.retransmit_requests++;
+      }
+      expected_seq_ = seq + 1;
+    } else if (ahead < 0) {
+      if (Fill(seq, arrival_ns)) {
+        stats_.out_of_order++;
+      } else {
+        stats_.duplicates++;
+        return;
+      }
+    } else {
+      expected_seq_ = seq + 1;
+    }
+  }
+
+  stats_.packets++;
+  stats_.payload_bytes += packet.data.len_;
+  packets_.push_back(record);
+  if (options_.keep_samples) {
+    // L16 is big-endian.
+    for (size_t i = 0; i + 1 < packet.data.len_; i += 2) {
+      samples_.push_back(static_cast<int16_t>(
+          (packet.data.data_[i] << 8) | packet.data.data_[i + 1]));
+    }
+  }
+}
+
+bool FakeReceiver::Fill(uint16_t seq, int64_t arrival_ns) {
+  auto it = missing_.find(seq);
+  if (it == missing_.end()) return false;
+  gaps_[it->second].filled_ns = arrival_ns;
+  missing_.erase(it);
+  return true;
+}
+
+int64_t FakeReceiver::PlayoutDeadline(uint32_t timestamp,
+                                      int64_t detected_ns) const {
+  uint64_t latency = stats_.sync_latency != 0 ? stats_.sync_latency
+                                              : options_.latency;
+  int64_t latency_ns = latency * 1'000'000'000 / kSampleRate44100;
+  if (!has_sync_) return detected_ns + latency_ns;
+  int64_t frames = static_cast<int32_t>(timestamp - sync_rtp_);
+  return sync_ns_ + frames * 1'000'000'000 / kSampleRate44100 + latency_ns;
+}
+
+void FakeReceiver::HandleControl(const uint8_t* data, size_t size) {
+  if (size < 4) return;
+  uint8_t type = data[1] & 0x7f;
+  if (type == kTypeSync && size >= 20) {
+    auto sync = RtpSyncPacket::Deserialize(data, size);
+    std::lock_guard guard(mtx_);
+    sync_rtp_ = sync.rtp_timestamp;
+    sync_ns_ = static_cast<int64_t>(sync.curr_time.IntoNanoseconds());
+    has_sync_ = true;
+    stats_.syncs++;
+    stats_.sync_latency = sync.rtp_timestamp - sync.rtp_timestamp_latency;
+  } else if (type == kTypeRetransmitReply) {
+    HandleAudio(data + 4, size - 4, true);
+  }
+}
+
+void FakeReceiver::HandleTiming(const uint8_t* data, size_t size) {
+  if (size < 32 || (data[1] & 0x7f) != kTypeTimingReply) return;
+  int64_t t4 = NowNs();
+  auto reply = RtpTimePacket::Deserialize(data, size);
+  int64_t t1 = static_cast<int64_t>(reply.ref_time.IntoNanoseconds());
+  int64_t t2 = static_cast<int64_t>(reply.recv_time.IntoNanoseconds());
+  int64_t t3 = static_cast<int64_t>(reply.send_time.IntoNanoseconds());
+
+  std::lock_guard guard(mtx_);
+  stats_.timing_replies++;
+  stats_.round_trip_us = ((t4 - t1) - (t3 - t2)) / 1000;
+  stats_.clock_offset_us = ((t2 - t1) + (t3 - t4)) / 2 / 1000;
+}
+
+void FakeReceiver::SendTimingRequest() {
+  helper::NetAddr remote;
+  RtpTimePacket request{};
+  {
+    std::lock_guard guard(mtx_);
+    if (sender_time_addr_.port_ == 0) return;
+    remote = sender_time_addr_;
+    request.header = {0x80, 0x80 | kTypeTimingRequest, timing_seq_++};
+  }
+  request.send_time = NtpTime::Now();
+  uint8_t buffer[32] = {0};
+  request.Serialize(buffer);
+  time_server_.Write(remote, std::string(reinterpret_cast<char*>(buffer),
+                                         sizeof(buffer)));
+}
+
+}  // namespace AirBeamTesting
@@ -0,0 +1,173 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "helper/errcode.h"
+#include "helper/network.h"
+#include "raop/rtp.h"
+
+namespace AirBeamTesting {
+
+struct PacketRecord {
+  uint16_t seq;
+  uint32_t timestamp;
+  // First packet of a stream (RTP marker bit).
+  bool marker;
+  // Arrived on the control port as a retransmit response.
+  bool retransmitted;
+  // On the NtpTime::Now clock.
+  int64_t arrival_ns;
+  // Arrival minus the time the latest sync packet maps the timestamp to; 0
+  // before the first sync.
+  int64_t schedule_offset_ns;
+};
+
+// A RAOP receiver on loopback for tests and benchmarks. Answers the RTSP
+// handshake, runs an NTP-style timing client against the sender, asks for
+// retransmits of sequence gaps, decodes the L16 payload and records when
+// every packet arrived relative to the RTP schedule.
+class FakeReceiver {
+ public:
+  struct Options {
+    // 0 picks an ephemeral port.
+    uint32_t rtsp_port = 0;
+    // Listens on ::1 instead of 127.0.0.1, with IPv6 UDP ports.
+    bool ipv6 = false;
+    // Audio-Latency announced in the RECORD response, in frames.
+    uint64_t latency = 11025;
+    // How often to send timing requests; 0 disables the timing client.
+    std::chrono::milliseconds timing_interval = std::chrono::seconds(1);
+    bool request_retransmits = true;
+    // Keep the decoded samples; turn off for long runs.
+    bool keep_samples = true;
+    // The ANNOUNCE encoding accepted; others get a 415. Stats and samples
+    // read the payload as L16/44100/2 whatever it is.
+    std::string rtpmap = "L16/44100/2";
+  };
+
+  struct Stats {
+    uint64_t packets = 0;
+    uint64_t payload_bytes = 0;
+    // Sequence numbers skipped and not (yet) filled in.
+    uint64_t lost = 0;
+    uint64_t duplicates = 0;
+    uint64_t out_of_order = 0;
+    uint64_t retransmit_requests = 0;
+    uint64_t retransmitted = 0;
+    // Missing packets that turned up later, by retransmit or reordering, and
+    // how long after the gap was noticed.
+    uint64_t recovered = 0;
+    int64_t recovery_p50_us = 0;
+    int64_t recovery_max_us = 0;
+    // Runs of packets still missing when they were due to play.
+    uint64_t audible_gaps = 0;
+    uint64_t syncs = 0;
+    // Latency announced by the latest sync packet, in frames.
+    uint32_t sync_latency = 0;
+    uint64_t timing_replies = 0;
+    // RFC 3550 interarrival jitter.
+    double jitter_us = 0;
+    // From the RECORD request to the first audio packet; -1 until then.
+    int64_t startup_latency_us = -1;
+    int64_t schedule_offset_p50_us = 0;
+    int64_t schedule_offset_p99_us = 0;
+    // From the latest timing exchange.
+    int64_t clock_offset_us = 0;
+    int64_t round_trip_us = 0;
+    float volume = 0;
+  };
+
+  FakeReceiver();
+  explicit FakeReceiver(const Options& options);
+  ~FakeReceiver();
+
+  AirBeamCore::helper::ErrCode Start();
+  void Stop();
+  uint32_t GetPort() const { return port_; }
+
+  Stats GetStats();
+  std::vector<PacketRecord> GetPackets();
+  // Host-order interleaved stereo, in arrival order.
+  std::vector<int16_t> GetSamples();
+  // RTSP methods in the order they arrived, and their request URIs.
+  std::vector<std::string> GetMethods();
+  std::vector<std::string> GetUris();
+  // The body of the latest ANNOUNCE.
+  std::string GetSdp();
+  bool IsRecording();
+  bool WaitForPackets(size_t count, std::chrono::milliseconds timeout);
+
+ private:
+  struct Connection {
+    int fd;
+    std::string buffer;
+    std::string peer_ip;
+  };
+
+  void RtspLoop();
+  // Returns false when the connection should be closed.
+  bool HandleRequest(Connection& conn, const std::string& request);
+  void UdpLoop();
+  void HandleAudio(const uint8_t* data, size_t size, bool retransmitted);
+  // Returns false if seq was not missing.
+  bool Fill(uint16_t seq, int64_t arrival_ns);
+  int64_t PlayoutDeadline(uint32_t timestamp, int64_t detected_ns) const;
+  void HandleControl(const uint8_t* data, size_t size);
+  void HandleTiming(const uint8_t* data, size_t size);
+  void SendTimingRequest();
+
+  const Options options_;
+  int listen_fd_ = -1;
+  uint32_t port_ = 0;
+  std::atomic<bool> stopped_ = false;
+  std::thread rtsp_thread_;
+  std::thread udp_thread_;
+
+  AirBeamCore::helper::UDPServer audio_server_;
+  AirBeamCore::helper::UDPServer ctrl_server_;
+  AirBeamCore::helper::UDPServer time_server_;
+
+  std::mutex mtx_;
+  std::vector<std::string> methods_;
+  std::vector<std::string> uris_;
+  std::string sdp_;
+  AirBeamCore::helper::NetAddr sender_ctrl_addr_;
+  AirBeamCore::helper::NetAddr sender_time_addr_;
+  bool recording_ = false;
+  int64_t record_ns_ = 0;
+  uint16_t timing_seq_ = 0;
+
+  // A sequence number that was skipped, and when it turned up if it did.
+  struct Gap {
+    uint16_t seq;
+    int64_t detected_ns;
+    int64_t deadline_ns;
+    int64_t filled_ns;
+  };
+
+  bool has_expected_seq_ = false;
+  uint16_t expected_seq_ = 0;
+  std::vector<Gap> gaps_;
+  // Index into gaps_ of every sequence number still missing.
+  std::map<uint16_t, size_t> missing_;
+  bool has_sync_ = false;
+  uint32_t sync_rtp_ = 0;
+  int64_t sync_ns_ = 0;
+  int64_t last_transit_ns_ = 0;
+  bool has_transit_ = false;
+
+  Stats stats_;
+  std::vector<PacketRecord> packets_;
+  std::vector<int16_t> samples_;
+};
+
+}  // namespace AirBeamTesting
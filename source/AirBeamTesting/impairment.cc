@@ -0,0 +1,85 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "impairment.h"
+
+#include <algorithm>
+
+namespace AirBeamTesting {
+
+ImpairmentStats& ImpairmentStats::operator+=(const ImpairmentStats& other) {
+  datagrams += other.datagrams;
+  dropped += other.dropped;
+  queue_dropped += other.queue_dropped;
+  duplicated += other.duplicated;
+  reordered += other.reordered;
+  return *this;
+}
+
+Impairment::Impairment(const ImpairmentProfile& profile, uint64_t seed)
+    : profile_(profile), rng_(seed) {}
+
+bool Impairment::Chance(double probability) {
+  if (probability <= 0) return false;
+  if (probability >= 1) return true;
+  return std::uniform_real_distribution<double>(0, 1)(rng_) < probability;
+}
+
+bool Impairment::Lost() {
+  if (profile_.ge_good_to_bad > 0) {
+    bad_state_ = bad_state_ ? !Chance(profile_.ge_bad_to_good)
+                            : Chance(profile_.ge_good_to_bad);
+    if (Chance(bad_state_ ? profile_.ge_loss_bad : profile_.ge_loss_good)) {
+      return true;
+    }
+  }
+  return Chance(profile_.loss);
+}
+
+void Impairment::Apply(size_t bytes, int64_t now_ns,
+                       std::vector<int64_t>& release_ns) {
+  stats_.datagrams++;
+  if (Lost()) {
+    stats_.dropped++;
+    return;
+  }
+
+  int64_t sent_ns = now_ns;
+  if (profile_.bandwidth_bps > 0) {
+    int64_t start_ns = std::max(now_ns, link_free_ns_);
+    int64_t queued_bytes = (start_ns - now_ns) *
+                           static_cast<int64_t>(profile_.bandwidth_bps) /
+                           8'000'000'000;
+    if (queued_bytes + static_cast<int64_t>(bytes) >
+        static_cast<int64_t>(profile_.queue_bytes)) {
+      stats_.queue_dropped++;
+      return;
+    }
+    link_free_ns_ = start_ns + static_cast<int64_t>(bytes) * 8'000'000'000 /
+                                   static_cast<int64_t>(profile_.bandwidth_bps);
+    sent_ns = link_free_ns_;
+  }
+
+  int copies = Chance(profile_.duplicate) ? 2 : 1;
+  if (copies == 2) stats_.duplicated++;
+  for (int i = 0; i < copies; ++i) {
+    int64_t at_ns =
+        sent_ns +
+        std::chrono::duration_cast<std::chrono::nanoseconds>(profile_.delay)
+            .count();
+    int64_t jitter_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(profile_.jitter)
+            .count();
+    if (jitter_ns > 0) {
+      at_ns += std::uniform_int_distribution<int64_t>(0, jitter_ns)(rng_);
+    }
+    if (Chance(profile_.reorder)) {
+      stats_.reordered++;
+      at_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   profile_.reorder_delay)
+                   .count();
+    }
+    release_ns.push_back(at_ns);
+  }
+}
+
+}  // namespace AirBeamTesting
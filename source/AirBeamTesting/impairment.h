@@ -0,0 +1,74 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace AirBeamTesting {
+
+// What a bad link does to the datagrams crossing it. All probabilities are
+// per datagram; everything defaults to a perfect link.
+struct ImpairmentProfile {
+  // Independent (Bernoulli) loss.
+  double loss = 0;
+  // Gilbert-Elliott bursty loss, used when ge_good_to_bad > 0: a two-state
+  // chain stepped once per datagram, losing with ge_loss_good or
+  // ge_loss_bad depending on the state.
+  double ge_good_to_bad = 0;
+  double ge_bad_to_good = 0.5;
+  double ge_loss_good = 0;
+  double ge_loss_bad = 1;
+
+  std::chrono::microseconds delay{0};
+  // Uniform extra delay in [0, jitter]; large jitter also reorders.
+  std::chrono::microseconds jitter{0};
+  // Probability that a datagram is held back by reorder_delay.
+  double reorder = 0;
+  std::chrono::microseconds reorder_delay{std::chrono::milliseconds(20)};
+  double duplicate = 0;
+
+  // Serialization rate of the link, 0 for unlimited, and how many bytes may
+  // queue behind it before tail drop.
+  uint64_t bandwidth_bps = 0;
+  size_t queue_bytes = 64 * 1024;
+};
+
+struct ImpairmentStats {
+  uint64_t datagrams = 0;
+  uint64_t dropped = 0;
+  uint64_t queue_dropped = 0;
+  uint64_t duplicated = 0;
+  uint64_t reordered = 0;
+
+  ImpairmentStats& operator+=(const ImpairmentStats& other);
+};
+
+// Applies an ImpairmentProfile to one stream of datagrams. Given the same
+// seed and the same arrivals it makes the same decisions. Not thread-safe.
+class Impairment {
+ public:
+  Impairment(const ImpairmentProfile& profile, uint64_t seed);
+
+  // Appends the times at which copies of a datagram of the given size,
+  // arriving at now_ns, leave the link; appends nothing if it is lost.
+  void Apply(size_t bytes, int64_t now_ns, std::vector<int64_t>& release_ns);
+  const ImpairmentStats& GetStats() const { return stats_; }
+  const ImpairmentProfile& GetProfile() const { return profile_; }
+
+ private:
+  bool Chance(double probability);
+  bool Lost();
+
+  const ImpairmentProfile profile_;
+  std::mt19937_64 rng_;
+  bool bad_state_ = false;
+  // When the link finishes serializing what is already queued.
+  int64_t link_free_ns_ = 0;
+  ImpairmentStats stats_;
+};
+
+}  // namespace AirBeamTesting
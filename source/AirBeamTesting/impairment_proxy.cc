@@ -0,0 +1,284 @@
+// Copyright (c) 2025 ChenKS12138
+
+#include "impairment_proxy.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "raop/rtp.h"
+
+namespace AirBeamTesting {
+
+using namespace AirBeamCore;
+
+namespace {
+int64_t NowNs() {
+  return static_cast<int64_t>(raop::NtpTime::Now().IntoNanoseconds());
+}
+
+// Replaces the value of key in the Transport header of an RTSP message and
+// returns the old one, or 0 if the key is absent.
+uint32_t ReplaceTransportPort(std::string& message, const std::string& key,
+                              uint32_t port) {
+  size_t line = message.find("Transport:");
+  if (line == std::string::npos) return 0;
+  size_t line_end = message.find("\r\n", line);
+  size_t pos = message.find(key + "=", line);
+  if (pos == std::string::npos || pos > line_end) return 0;
+  pos += key.size() + 1;
+  size_t end = message.find_first_not_of("0123456789", pos);
+  uint32_t old_port = std::strtoul(message.c_str() + pos, nullptr, 10);
+  message.replace(pos, end - pos, std::to_string(port));
+  return old_port;
+}
+}  // namespace
+
+ImpairmentProxy::ImpairmentProxy(const std::string& receiver_ip,
+                                 uint32_t receiver_port,
+                                 const Options& options)
+    : receiver_ip_(receiver_ip),
+      receiver_port_(receiver_port),
+      options_(options) {
+  for (int channel = 0; channel < kChannels; ++channel) {
+    // Separate streams per channel, so the audio decisions do not depend on
+    // how sync and timing packets interleave with it.
+    relays_[channel].forward = std::make_unique<Impairment>(
+        options_.forward, options_.seed + channel * 2);
+    relays_[channel].reverse = std::make_unique<Impairment>(
+        options_.reverse, options_.seed + channel * 2 + 1);
+    relays_[channel].sender = {"127.0.0.1", 0};
+    relays_[channel].receiver = {receiver_ip_, 0};
+  }
+}
+
+ImpairmentProxy::~ImpairmentProxy() { Stop(); }
+
+helper::ErrCode ImpairmentProxy::Start() {
+  for (auto& relay : relays_) {
+    helper::ErrCode ret = relay.front.Bind();
+    if (ret != helper::kOk) return ret;
+    ret = relay.back.Bind();
+    if (ret != helper::kOk) return ret;
+  }
+
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) return helper::kErrTcpSocketCreate;
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) !=
+          0 ||
+      listen(listen_fd_, 16) != 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return helper::kErrTcpConnect;
+  }
+  socklen_t len = sizeof(addr);
+  getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+  port_ = ntohs(addr.sin_port);
+
+  tcp_thread_ = std::thread([this]() { TcpLoop(); });
+  udp_thread_ = std::thread([this]() { UdpLoop(); });
+  return helper::kOk;
+}
+
+void ImpairmentProxy::Stop() {
+  if (stopped_.exchange(true)) return;
+  if (tcp_thread_.joinable()) tcp_thread_.join();
+  if (udp_thread_.joinable()) udp_thread_.join();
+  if (listen_fd_ >= 0) close(listen_fd_);
+}
+
+ImpairmentProxy::Stats ImpairmentProxy::GetStats() {
+  std::lock_guard guard(mtx_);
+  Stats stats;
+  for (const auto& relay : relays_) {
+    stats.forward += relay.forward->GetStats();
+    stats.reverse += relay.reverse->GetStats();
+  }
+  return stats;
+}
+
+void ImpairmentProxy::TcpLoop() {
+  std::vector<Stream> streams;
+  while (!stopped_) {
+    std::vector<pollfd> fds = {{listen_fd_, POLLIN, 0}};
+    for (const auto& stream : streams) {
+      fds.push_back({stream.client_fd, POLLIN, 0});
+      fds.push_back({stream.server_fd, POLLIN, 0});
+    }
+    if (poll(fds.data(), fds.size(), 10) <= 0) continue;
+
+    std::vector<Stream> alive;
+    for (size_t i = 0; i < streams.size(); ++i) {
+      Stream& stream = streams[i];
+      bool open = true;
+      for (int side = 0; side < 2 && open; ++side) {
+        if (!(fds[1 + i * 2 + side].revents & (POLLIN | POLLHUP | POLLERR))) {
+          continue;
+        }
+        char buffer[4096];
+        int fd = side == 0 ? stream.client_fd : stream.server_fd;
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+          open = false;
+          break;
+        }
+        (side == 0 ? stream.from_client : stream.from_server).append(buffer,
+                                                                     n);
+        open = Forward(stream, side == 0);
+      }
+      if (open) {
+        alive.push_back(std::move(stream));
+      } else {
+        close(stream.client_fd);
+        close(stream.server_fd);
+      }
+    }
+    streams.swap(alive);
+
+    if (fds[0].revents & POLLIN) {
+      int client_fd = accept(listen_fd_, nullptr, nullptr);
+      if (client_fd < 0) continue;
+      int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+      sockaddr_in addr{};
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(receiver_port_);
+      inet_pton(AF_INET, receiver_ip_.c_str(), &addr.sin_addr);
+      if (connect(server_fd, reinterpret_cast<sockaddr*>(&addr),
+                  sizeof(addr)) != 0) {
+        close(client_fd);
+        close(server_fd);
+        continue;
+      }
+      streams.push_back({client_fd, server_fd, "", "", {}});
+    }
+  }
+  for (const auto& stream : streams) {
+    close(stream.client_fd);
+    close(stream.server_fd);
+  }
+}
+
+bool ImpairmentProxy::Forward(Stream& stream, bool from_client) {
+  std::string& buffer = from_client ? stream.from_client : stream.from_server;
+  int fd = from_client ? stream.server_fd : stream.client_fd;
+  while (true) {
+    size_t end = buffer.find("\r\n\r\n");
+    if (end == std::string::npos) return true;
+    size_t body_len = 0;
+    size_t pos = buffer.find("Content-Length:");
+    if (pos != std::string::npos && pos < end) {
+      body_len = std::strtoul(buffer.c_str() + pos + 15, nullptr, 10);
+    }
+    if (buffer.size() < end + 4 + body_len) return true;
+    std::string message = buffer.substr(0, end + 4 + body_len);
+    buffer.erase(0, message.size());
+
+    if (from_client) {
+      RewriteRequest(message, stream);
+    } else {
+      RewriteResponse(message, stream);
+    }
+    if (send(fd, message.data(), message.size(), 0) !=
+        static_cast<ssize_t>(message.size())) {
+      return false;
+    }
+  }
+}
+
+void ImpairmentProxy::RewriteRequest(std::string& message, Stream& stream) {
+  std::string method = message.substr(0, message.find(' '));
+  stream.methods.push_back(method);
+  if (method != "SETUP") return;
+
+  // The receiver sends its requests to the proxy, which passes them on
+  // from the front socket to the sender's real ports.
+  std::lock_guard guard(mtx_);
+  for (auto [channel, key] : {std::pair{kControl, "control_port"},
+                              std::pair{kTiming, "timing_port"}}) {
+    uint32_t port = ReplaceTransportPort(
+        message, key, relays_[channel].back.GetLocalNetAddr().port_);
+    if (port != 0) relays_[channel].sender.port_ = port;
+  }
+}
+
+void ImpairmentProxy::RewriteResponse(std::string& message, Stream& stream) {
+  if (stream.methods.empty()) return;
+  std::string method = stream.methods.front();
+  stream.methods.pop_front();
+  if (method != "SETUP") return;
+
+  std::lock_guard guard(mtx_);
+  for (auto [channel, key] : {std::pair{kAudio, "server_port"},
+                              std::pair{kControl, "control_port"},
+                              std::pair{kTiming, "timing_port"}}) {
+    uint32_t port = ReplaceTransportPort(
+        message, key, relays_[channel].front.GetLocalNetAddr().port_);
+    if (port != 0) relays_[channel].receiver.port_ = port;
+  }
+}
+
+void ImpairmentProxy::UdpLoop() {
+  std::priority_queue<Pending, std::vector<Pending>, std::greater<Pending>>
+      queue;
+  uint64_t order = 0;
+  std::vector<int64_t> release_ns;
+
+  while (!stopped_) {
+    int timeout_ms = 5;
+    if (!queue.empty()) {
+      int64_t wait_ns = queue.top().release_ns - NowNs();
+      timeout_ms = static_cast<int>(
+          std::clamp<int64_t>((wait_ns + 999'999) / 1'000'000, 0, 5));
+    }
+    pollfd fds[kChannels * 2];
+    for (int channel = 0; channel < kChannels; ++channel) {
+      fds[channel * 2] = {relays_[channel].front.GetFd(), POLLIN, 0};
+      fds[channel * 2 + 1] = {relays_[channel].back.GetFd(), POLLIN, 0};
+    }
+    int ready = poll(fds, kChannels * 2, timeout_ms);
+
+    for (int i = 0; ready > 0 && i < kChannels * 2; ++i) {
+      if (!(fds[i].revents & POLLIN)) continue;
+      Relay& relay = relays_[i / 2];
+      bool forward = i % 2 == 0;
+      helper::NetAddr from;
+      std::string data;
+      auto& in = forward ? relay.front : relay.back;
+      if (in.Read(from, data) != helper::kOk) continue;
+
+      std::lock_guard guard(mtx_);
+      if (forward && relay.sender.port_ == 0) relay.sender = from;
+      const helper::NetAddr& to = forward ? relay.receiver : relay.sender;
+      if (to.port_ == 0) continue;
+      int64_t now_ns = NowNs();
+      release_ns.clear();
+      (forward ? relay.forward : relay.reverse)
+          ->Apply(data.size(), now_ns, release_ns);
+      for (int64_t at_ns : release_ns) {
+        queue.push({at_ns, order++, forward ? &relay.back : &relay.front, to,
+                    data});
+      }
+    }
+
+    int64_t now_ns = NowNs();
+    while (!queue.empty() && queue.top().release_ns <= now_ns) {
+      const Pending& pending = queue.top();
+      pending.socket->Write(pending.to, pending.data);
+      queue.pop();
+    }
+  }
+}
+
+}  // namespace AirBeamTesting
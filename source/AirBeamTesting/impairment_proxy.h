@@ -0,0 +1,105 @@
+// Copyright (c) 2025 ChenKS12138
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "helper/errcode.h"
+#include "helper/network.h"
+#include "impairment.h"
+
+namespace AirBeamTesting {
+
+// Sits between a Raop sender and a receiver on loopback. RTSP is relayed
+// as is, except that SETUP transports are rewritten so the audio, control
+// and timing datagrams in both directions cross the proxy, where they go
+// through an Impairment per channel and direction.
+class ImpairmentProxy {
+ public:
+  struct Options {
+    // Sender to receiver: audio, sync and retransmitted packets, timing
+    // replies.
+    ImpairmentProfile forward;
+    // Receiver to sender: retransmit and timing requests.
+    ImpairmentProfile reverse;
+    uint64_t seed = 1;
+  };
+
+  struct Stats {
+    ImpairmentStats forward;
+    ImpairmentStats reverse;
+  };
+
+  ImpairmentProxy(const std::string& receiver_ip, uint32_t receiver_port,
+                  const Options& options);
+  ~ImpairmentProxy();
+
+  AirBeamCore::helper::ErrCode Start();
+  void Stop();
+  // RTSP port to point the sender at.
+  uint32_t GetPort() const { return port_; }
+  Stats GetStats();
+
+ private:
+  enum Channel { kAudio = 0, kControl = 1, kTiming = 2, kChannels = 3 };
+
+  struct Relay {
+    // Faces the sender and the receiver respectively.
+    AirBeamCore::helper::UDPServer front;
+    AirBeamCore::helper::UDPServer back;
+    AirBeamCore::helper::NetAddr sender;
+    AirBeamCore::helper::NetAddr receiver;
+    std::unique_ptr<Impairment> forward;
+    std::unique_ptr<Impairment> reverse;
+  };
+
+  struct Pending {
+    int64_t release_ns;
+    uint64_t order;
+    AirBeamCore::helper::UDPServer* socket;
+    AirBeamCore::helper::NetAddr to;
+    std::string data;
+    bool operator>(const Pending& other) const {
+      return release_ns != other.release_ns ? release_ns > other.release_ns
+                                            : order > other.order;
+    }
+  };
+
+  struct Stream {
+    int client_fd;
+    int server_fd;
+    std::string from_client;
+    std::string from_server;
+    // Methods of the requests still waiting for a response.
+    std::deque<std::string> methods;
+  };
+
+  void TcpLoop();
+  // Moves every complete RTSP message out of buffer, rewritten, onto fd.
+  // Returns false if the peer went away.
+  bool Forward(Stream& stream, bool from_client);
+  void RewriteRequest(std::string& message, Stream& stream);
+  void RewriteResponse(std::string& message, Stream& stream);
+  void UdpLoop();
+
+  const std::string receiver_ip_;
+  const uint32_t receiver_port_;
+  const Options options_;
+  int listen_fd_ = -1;
+  uint32_t port_ = 0;
+  std::atomic<bool> stopped_ = false;
+  std::thread tcp_thread_;
+  std::thread udp_thread_;
+
+  // Guards the relay addresses and impairment stats.
+  std::mutex mtx_;
+  Relay relays_[kChannels];
+};
+
+}  // namespace AirBeamTesting